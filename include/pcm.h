@@ -1305,6 +1305,10 @@ int snd_pcm_scope_s16_open(snd_pcm_t *pcm, const char *name,
 			   snd_pcm_scope_t **scopep);
 int16_t *snd_pcm_scope_s16_get_channel_buffer(snd_pcm_scope_t *scope,
 					      unsigned int channel);
+int snd_pcm_scope_peak_open(snd_pcm_t *pcm, const char *name,
+			    snd_pcm_scope_t **scopep);
+int snd_pcm_scope_peak_get_levels(snd_pcm_scope_t *scope, unsigned int channel,
+				  float *peak, float *rms, float *true_peak);
 
 /** \} */
 
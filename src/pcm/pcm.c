@@ -668,6 +668,7 @@ playback devices.
 */
 
 #include "pcm_local.h"
+#include "pcm_simd.h"
 #include <stdio.h>
 #include <string.h>
 #if HAVE_MALLOC_H
@@ -2988,6 +2989,11 @@ int snd_pcm_wait_nocheck(snd_pcm_t *pcm, int timeout)
 		timeout = __snd_pcm_wait_drain_timeout(pcm);
 	else if (timeout < -1)
 		SNDMSG("invalid snd_pcm_wait timeout argument %d", timeout);
+	if (pcm->fast_ops->wait) {
+		err = pcm->fast_ops->wait(pcm->fast_op_arg, timeout);
+		if (err != -ENOSYS)
+			return err;
+	}
 	do {
 		__snd_pcm_unlock(pcm->fast_op_arg);
 		err_poll = poll(pfd, npfds, timeout);
@@ -3132,6 +3138,63 @@ int snd_pcm_avail_delay(snd_pcm_t *pcm,
 	return err;
 }
 
+#ifndef DOC_HIDDEN
+/* runs of at least this size are written around the cache */
+#define SND_PCM_AREAS_STREAM_BYTES	(256 * 1024)
+/* strided bytes touched by one frame block of the blocked copy/silence */
+#define SND_PCM_AREAS_BLOCK_BYTES	(16 * 1024)
+/* channel count from which the blocked copy/silence is used */
+#define SND_PCM_AREAS_BLOCK_CHANNELS	8
+
+/* all channels interleaved in one buffer, in the channel order */
+static int snd_pcm_areas_interleaved(const snd_pcm_channel_area_t *areas,
+				     unsigned int channels, int width)
+{
+	unsigned int c;
+
+	if (areas->step != channels * width)
+		return 0;
+	for (c = 1; c < channels; c++) {
+		if (areas[c].addr != areas->addr ||
+		    areas[c].step != areas->step ||
+		    areas[c].first != areas->first + c * width)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Return the frames per block when the channels are better processed in
+ * frame blocks, zero otherwise. Processing all channels block by block
+ * keeps the strided (interleaved) side in the cache instead of walking
+ * the whole buffer once per channel.
+ */
+static snd_pcm_uframes_t snd_pcm_areas_block(const snd_pcm_channel_area_t *dst_areas,
+					     const snd_pcm_channel_area_t *src_areas,
+					     unsigned int channels,
+					     snd_pcm_uframes_t frames, int width)
+{
+	unsigned int step = dst_areas->step;
+	snd_pcm_uframes_t block;
+
+	if (channels < SND_PCM_AREAS_BLOCK_CHANNELS || width < 8 || width % 8)
+		return 0;
+	if (snd_pcm_areas_interleaved(dst_areas, channels, width)) {
+		/* one run already, or a plain interleave */
+		if (!src_areas || snd_pcm_areas_interleaved(src_areas, channels, width))
+			return 0;
+	}
+	if (src_areas && src_areas->step > step)
+		step = src_areas->step;
+	if (step == (unsigned int)width)
+		return 0;
+	block = SND_PCM_AREAS_BLOCK_BYTES * 8 / step;
+	if (block < 16)
+		block = 16;
+	return frames > block ? block : 0;
+}
+#endif
+
 /**
  * \brief Silence an area
  * \param dst_area area specification
@@ -3163,6 +3226,11 @@ int snd_pcm_area_silence(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes
 		unsigned int dwords = samples * width / 64;
 		uint64_t *dstp = (uint64_t *)dst;
 		samples -= dwords * 64 / width;
+		if (dwords * 8 >= SND_PCM_AREAS_STREAM_BYTES) {
+			snd_pcm_simd_ops()->fill_stream(dstp, silence, dwords * 8);
+			dstp += dwords;
+			dwords = 0;
+		}
 		while (dwords-- > 0)
 			*dstp++ = silence;
 		if (samples == 0)
@@ -3246,19 +3314,13 @@ int snd_pcm_area_silence(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes
 	return 0;
 }
 
-/**
- * \brief Silence one or more areas
- * \param dst_areas areas specification (one for each channel)
- * \param dst_offset offset in frames inside area
- * \param channels channels count
- * \param frames frames to silence
- * \param format PCM sample format
- * \return 0 on success otherwise a negative error code
- */
-int snd_pcm_areas_silence(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
-			  unsigned int channels, snd_pcm_uframes_t frames, snd_pcm_format_t format)
+#ifndef DOC_HIDDEN
+static int snd_pcm_areas_silence_run(const snd_pcm_channel_area_t *dst_areas,
+				     snd_pcm_uframes_t dst_offset,
+				     unsigned int channels,
+				     snd_pcm_uframes_t frames,
+				     snd_pcm_format_t format, int width)
 {
-	int width = snd_pcm_format_physical_width(format);
 	while (channels > 0) {
 		void *addr = dst_areas->addr;
 		unsigned int step = dst_areas->step;
@@ -3294,6 +3356,38 @@ int snd_pcm_areas_silence(const snd_pcm_channel_area_t *dst_areas, snd_pcm_ufram
 	}
 	return 0;
 }
+#endif
+
+/**
+ * \brief Silence one or more areas
+ * \param dst_areas areas specification (one for each channel)
+ * \param dst_offset offset in frames inside area
+ * \param channels channels count
+ * \param frames frames to silence
+ * \param format PCM sample format
+ * \return 0 on success otherwise a negative error code
+ */
+int snd_pcm_areas_silence(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+			  unsigned int channels, snd_pcm_uframes_t frames, snd_pcm_format_t format)
+{
+	int width = snd_pcm_format_physical_width(format);
+	snd_pcm_uframes_t block;
+	int err;
+
+	block = snd_pcm_areas_block(dst_areas, NULL, channels, frames, width);
+	if (!block)
+		block = frames;
+	while (frames > 0) {
+		snd_pcm_uframes_t n = frames < block ? frames : block;
+		err = snd_pcm_areas_silence_run(dst_areas, dst_offset, channels,
+						n, format, width);
+		if (err < 0)
+			return err;
+		dst_offset += n;
+		frames -= n;
+	}
+	return 0;
+}
 
 
 /**
@@ -3330,7 +3424,10 @@ int snd_pcm_area_copy(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes_t
 		samples -= bytes * 8 / width;
 		assert(src < dst || src >= dst + bytes);
 		assert(dst < src || dst >= src + bytes);
-		memcpy(dst, src, bytes);
+		if (bytes >= SND_PCM_AREAS_STREAM_BYTES)
+			snd_pcm_simd_ops()->copy_stream(dst, src, bytes);
+		else
+			memcpy(dst, src, bytes);
 		if (samples == 0)
 			return 0;
 	}
@@ -3416,32 +3513,15 @@ int snd_pcm_area_copy(const snd_pcm_channel_area_t *dst_area, snd_pcm_uframes_t
 	return 0;
 }
 
-/**
- * \brief Copy one or more areas
- * \param dst_areas destination areas specification (one for each channel)
- * \param dst_offset offset in frames inside destination area
- * \param src_areas source areas specification (one for each channel)
- * \param src_offset offset in frames inside source area
- * \param channels channels count
- * \param frames frames to copy
- * \param format PCM sample format
- * \return 0 on success otherwise a negative error code
- */
-int snd_pcm_areas_copy(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
-		       const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
-		       unsigned int channels, snd_pcm_uframes_t frames, snd_pcm_format_t format)
+#ifndef DOC_HIDDEN
+static void snd_pcm_areas_copy_run(const snd_pcm_channel_area_t *dst_areas,
+				   snd_pcm_uframes_t dst_offset,
+				   const snd_pcm_channel_area_t *src_areas,
+				   snd_pcm_uframes_t src_offset,
+				   unsigned int channels,
+				   snd_pcm_uframes_t frames,
+				   snd_pcm_format_t format, int width)
 {
-	int width = snd_pcm_format_physical_width(format);
-	assert(dst_areas);
-	assert(src_areas);
-	if (! channels) {
-		SNDMSG("invalid channels %d", channels);
-		return -EINVAL;
-	}
-	if (! frames) {
-		SNDMSG("invalid frames %ld", frames);
-		return -EINVAL;
-	}
 	while (channels > 0) {
 		unsigned int step = src_areas->step;
 		void *src_addr = src_areas->addr;
@@ -3489,6 +3569,47 @@ int snd_pcm_areas_copy(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_
 			channels--;
 		}
 	}
+}
+#endif
+
+/**
+ * \brief Copy one or more areas
+ * \param dst_areas destination areas specification (one for each channel)
+ * \param dst_offset offset in frames inside destination area
+ * \param src_areas source areas specification (one for each channel)
+ * \param src_offset offset in frames inside source area
+ * \param channels channels count
+ * \param frames frames to copy
+ * \param format PCM sample format
+ * \return 0 on success otherwise a negative error code
+ */
+int snd_pcm_areas_copy(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+		       const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+		       unsigned int channels, snd_pcm_uframes_t frames, snd_pcm_format_t format)
+{
+	int width = snd_pcm_format_physical_width(format);
+	snd_pcm_uframes_t block;
+	assert(dst_areas);
+	assert(src_areas);
+	if (! channels) {
+		SNDMSG("invalid channels %d", channels);
+		return -EINVAL;
+	}
+	if (! frames) {
+		SNDMSG("invalid frames %ld", frames);
+		return -EINVAL;
+	}
+	block = snd_pcm_areas_block(dst_areas, src_areas, channels, frames, width);
+	if (!block)
+		block = frames;
+	while (frames > 0) {
+		snd_pcm_uframes_t n = frames < block ? frames : block;
+		snd_pcm_areas_copy_run(dst_areas, dst_offset, src_areas, src_offset,
+				       channels, n, format, width);
+		dst_offset += n;
+		src_offset += n;
+		frames -= n;
+	}
 	return 0;
 }
 
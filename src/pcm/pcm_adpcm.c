@@ -83,6 +83,7 @@ typedef struct {
 	adpcm_f func;
 	snd_pcm_format_t sformat;
 	snd_pcm_adpcm_state_t *states;
+	int s16;		/* linear side is native S16 */
 } snd_pcm_adpcm_t;
 
 #endif
@@ -103,7 +104,7 @@ static const short StepSize[89] = {
 	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
 };
 
-static char adpcm_encoder(int sl, snd_pcm_adpcm_state_t * state)
+static inline char adpcm_encoder(int sl, snd_pcm_adpcm_state_t * state)
 {
 	short diff;		/* Difference between sl and predicted sample */
 	short pred_diff;	/* Predicted difference to next sample */
@@ -164,7 +165,7 @@ static char adpcm_encoder(int sl, snd_pcm_adpcm_state_t * state)
 }
 
 
-static int adpcm_decoder(unsigned char code, snd_pcm_adpcm_state_t * state)
+static inline int adpcm_decoder(unsigned char code, snd_pcm_adpcm_state_t * state)
 {
 	short pred_diff;	/* Predicted difference to next sample */
 	short step;		/* holds previous StepSize value */
@@ -318,6 +319,132 @@ void snd_pcm_adpcm_encode(const snd_pcm_channel_area_t *dst_areas,
 	}
 }
 
+/*
+ * Native S16 versions: the samples are accessed directly instead of
+ * through the get/put labels and the channel state is copied to a local
+ * for the whole run. Interleaved stereo packs both channels in one byte,
+ * so it is coded a byte (frame) at a time in a single pass.
+ */
+static int adpcm_stereo_layout(const snd_pcm_channel_area_t *adpcm_areas,
+			       const snd_pcm_channel_area_t *s16_areas,
+			       unsigned int channels)
+{
+	return channels == 2 &&
+	       adpcm_areas[0].step == 8 && adpcm_areas[1].step == 8 &&
+	       adpcm_areas[1].addr == adpcm_areas[0].addr &&
+	       adpcm_areas[1].first == adpcm_areas[0].first + 4 &&
+	       adpcm_areas[0].first % 8 == 0 &&
+	       s16_areas[0].step == 32 && s16_areas[1].step == 32 &&
+	       s16_areas[1].addr == s16_areas[0].addr &&
+	       s16_areas[1].first == s16_areas[0].first + 16;
+}
+
+static void snd_pcm_adpcm_decode_s16(const snd_pcm_channel_area_t *dst_areas,
+				     snd_pcm_uframes_t dst_offset,
+				     const snd_pcm_channel_area_t *src_areas,
+				     snd_pcm_uframes_t src_offset,
+				     unsigned int channels, snd_pcm_uframes_t frames,
+				     snd_pcm_adpcm_state_t *states)
+{
+	unsigned int channel;
+
+	if (adpcm_stereo_layout(src_areas, dst_areas, channels)) {
+		const unsigned char *src = snd_pcm_channel_area_addr(src_areas, src_offset);
+		int16_t *dst = snd_pcm_channel_area_addr(dst_areas, dst_offset);
+		snd_pcm_adpcm_state_t left = states[0], right = states[1];
+		while (frames-- > 0) {
+			unsigned char v = *src++;
+			dst[0] = adpcm_decoder((v >> 4) & 0x0f, &left);
+			dst[1] = adpcm_decoder(v & 0x0f, &right);
+			dst += 2;
+		}
+		states[0] = left;
+		states[1] = right;
+		return;
+	}
+	for (channel = 0; channel < channels; ++channel, ++states) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		snd_pcm_adpcm_state_t state = *states;
+		int srcbit = src_area->first + src_area->step * src_offset;
+		const char *src = (const char *) src_area->addr + srcbit / 8;
+		int src_step = src_area->step / 8;
+		int srcbit_step = src_area->step % 8;
+		char *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		int dst_step = snd_pcm_channel_area_step(dst_area);
+		snd_pcm_uframes_t frames1 = frames;
+		srcbit %= 8;
+		while (frames1-- > 0) {
+			unsigned char v;
+			if (srcbit)
+				v = *src & 0x0f;
+			else
+				v = (*src >> 4) & 0x0f;
+			*(int16_t *)dst = adpcm_decoder(v, &state);
+			src += src_step;
+			srcbit += srcbit_step;
+			if (srcbit == 8) {
+				src++;
+				srcbit = 0;
+			}
+			dst += dst_step;
+		}
+		*states = state;
+	}
+}
+
+static void snd_pcm_adpcm_encode_s16(const snd_pcm_channel_area_t *dst_areas,
+				     snd_pcm_uframes_t dst_offset,
+				     const snd_pcm_channel_area_t *src_areas,
+				     snd_pcm_uframes_t src_offset,
+				     unsigned int channels, snd_pcm_uframes_t frames,
+				     snd_pcm_adpcm_state_t *states)
+{
+	unsigned int channel;
+
+	if (adpcm_stereo_layout(dst_areas, src_areas, channels)) {
+		unsigned char *dst = snd_pcm_channel_area_addr(dst_areas, dst_offset);
+		const int16_t *src = snd_pcm_channel_area_addr(src_areas, src_offset);
+		snd_pcm_adpcm_state_t left = states[0], right = states[1];
+		while (frames-- > 0) {
+			unsigned char v = adpcm_encoder(src[0], &left) << 4;
+			*dst++ = v | adpcm_encoder(src[1], &right);
+			src += 2;
+		}
+		states[0] = left;
+		states[1] = right;
+		return;
+	}
+	for (channel = 0; channel < channels; ++channel, ++states) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		snd_pcm_adpcm_state_t state = *states;
+		const char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+		int src_step = snd_pcm_channel_area_step(src_area);
+		int dstbit = dst_area->first + dst_area->step * dst_offset;
+		char *dst = (char *) dst_area->addr + dstbit / 8;
+		int dst_step = dst_area->step / 8;
+		int dstbit_step = dst_area->step % 8;
+		snd_pcm_uframes_t frames1 = frames;
+		dstbit %= 8;
+		while (frames1-- > 0) {
+			int v = adpcm_encoder(*(const int16_t *)src, &state);
+			if (dstbit)
+				*dst = (*dst & 0xf0) | v;
+			else
+				*dst = (*dst & 0x0f) | (v << 4);
+			src += src_step;
+			dst += dst_step;
+			dstbit += dstbit_step;
+			if (dstbit == 8) {
+				dst++;
+				dstbit = 0;
+			}
+		}
+		*states = state;
+	}
+}
+
 #endif
 
 static int snd_pcm_adpcm_hw_refine_cprepare(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
@@ -438,6 +565,8 @@ static int snd_pcm_adpcm_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 			adpcm->func = snd_pcm_adpcm_encode;
 		}
 	}
+	adpcm->s16 = (adpcm->sformat == SND_PCM_FORMAT_IMA_ADPCM ?
+		      format : adpcm->sformat) == SND_PCM_FORMAT_S16;
 	assert(!adpcm->states);
 	adpcm->states = malloc(adpcm->plug.gen.slave->channels * sizeof(*adpcm->states));
 	if (adpcm->states == NULL)
@@ -464,6 +593,26 @@ static int snd_pcm_adpcm_init(snd_pcm_t *pcm)
 	return 0;
 }
 
+static void snd_pcm_adpcm_convert(snd_pcm_adpcm_t *adpcm,
+				  const snd_pcm_channel_area_t *dst_areas,
+				  snd_pcm_uframes_t dst_offset,
+				  const snd_pcm_channel_area_t *src_areas,
+				  snd_pcm_uframes_t src_offset,
+				  unsigned int channels, snd_pcm_uframes_t frames)
+{
+	if (!adpcm->s16)
+		adpcm->func(dst_areas, dst_offset, src_areas, src_offset,
+			    channels, frames, adpcm->getput_idx, adpcm->states);
+	else if (adpcm->func == snd_pcm_adpcm_encode)
+		snd_pcm_adpcm_encode_s16(dst_areas, dst_offset,
+					 src_areas, src_offset,
+					 channels, frames, adpcm->states);
+	else
+		snd_pcm_adpcm_decode_s16(dst_areas, dst_offset,
+					 src_areas, src_offset,
+					 channels, frames, adpcm->states);
+}
+
 static snd_pcm_uframes_t
 snd_pcm_adpcm_write_areas(snd_pcm_t *pcm,
 			  const snd_pcm_channel_area_t *areas,
@@ -476,10 +625,8 @@ snd_pcm_adpcm_write_areas(snd_pcm_t *pcm,
 	snd_pcm_adpcm_t *adpcm = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	adpcm->func(slave_areas, slave_offset,
-		    areas, offset, 
-		    pcm->channels, size,
-		    adpcm->getput_idx, adpcm->states);
+	snd_pcm_adpcm_convert(adpcm, slave_areas, slave_offset, areas, offset,
+			      pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -496,10 +643,8 @@ snd_pcm_adpcm_read_areas(snd_pcm_t *pcm,
 	snd_pcm_adpcm_t *adpcm = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	adpcm->func(areas, offset, 
-		    slave_areas, slave_offset,
-		    pcm->channels, size,
-		    adpcm->getput_idx, adpcm->states);
+	snd_pcm_adpcm_convert(adpcm, areas, offset, slave_areas, slave_offset,
+			      pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
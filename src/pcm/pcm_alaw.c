@@ -29,6 +29,10 @@
 #include "pcm_local.h"
 #include "bswap.h"
 #include "pcm_plugin.h"
+#include "pcm_simd.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #include "plugin_ops.h"
 
@@ -52,6 +56,9 @@ typedef struct {
 	unsigned int getput_idx;
 	alaw_f func;
 	snd_pcm_format_t sformat;
+	snd_pcm_simd_conv_func_t simd_func;
+	snd_pcm_simd_conv_t simd_conv;
+	int simd_encode;
 } snd_pcm_alaw_t;
 
 #endif
@@ -141,6 +148,43 @@ static int alaw_to_s16(unsigned char a_val)
 
 #ifndef DOC_HIDDEN
 
+/* the encode table is indexed by the 16-bit sample bits */
+typedef struct {
+	uint16_t dec[256 + SND_PCM_SIMD_LUT_PAD / 2];
+	uint8_t enc[65536 + SND_PCM_SIMD_LUT_PAD];
+} snd_pcm_alaw_lut_t;
+
+static snd_pcm_alaw_lut_t alaw_lut;
+#ifdef HAVE_LIBPTHREAD
+static pthread_once_t alaw_lut_once = PTHREAD_ONCE_INIT;
+#else
+static int alaw_lut_ready;
+#endif
+
+static void snd_pcm_alaw_lut_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 256; i++)
+		alaw_lut.dec[i] = alaw_to_s16(i);
+	for (i = 0; i < 65536; i++)
+		alaw_lut.enc[i] = s16_to_alaw((int16_t)i);
+}
+
+/* the tables are built once, by the first caller */
+static const snd_pcm_alaw_lut_t *snd_pcm_alaw_lut(void)
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_once(&alaw_lut_once, snd_pcm_alaw_lut_init);
+#else
+	if (!alaw_lut_ready) {
+		snd_pcm_alaw_lut_init();
+		alaw_lut_ready = 1;
+	}
+#endif
+	return &alaw_lut;
+}
+
 void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
 			 snd_pcm_uframes_t dst_offset,
 			 const snd_pcm_channel_area_t *src_areas,
@@ -152,6 +196,7 @@ void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
 #include "plugin_ops.h"
 #undef PUT16_LABELS
 	void *put = put16_labels[putidx];
+	const snd_pcm_alaw_lut_t *lut = snd_pcm_alaw_lut();
 	unsigned int channel;
 	for (channel = 0; channel < channels; ++channel) {
 		const unsigned char *src;
@@ -166,7 +211,7 @@ void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
 		dst_step = snd_pcm_channel_area_step(dst_area);
 		frames1 = frames;
 		while (frames1-- > 0) {
-			int16_t sample = alaw_to_s16(*src);
+			int16_t sample = lut->dec[*src];
 			goto *put;
 #define PUT16_END after
 #include "plugin_ops.h"
@@ -189,6 +234,7 @@ void snd_pcm_alaw_encode(const snd_pcm_channel_area_t *dst_areas,
 #include "plugin_ops.h"
 #undef GET16_LABELS
 	void *get = get16_labels[getidx];
+	const snd_pcm_alaw_lut_t *lut = snd_pcm_alaw_lut();
 	unsigned int channel;
 	int16_t sample = 0;
 	for (channel = 0; channel < channels; ++channel) {
@@ -209,7 +255,7 @@ void snd_pcm_alaw_encode(const snd_pcm_channel_area_t *dst_areas,
 #include "plugin_ops.h"
 #undef GET16_END
 		after:
-			*dst = s16_to_alaw(sample);
+			*dst = lut->enc[(uint16_t)sample];
 			src += src_step;
 			dst += dst_step;
 		}
@@ -302,6 +348,44 @@ static int snd_pcm_alaw_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 				       snd_pcm_generic_hw_refine);
 }
 
+static void snd_pcm_alaw_simd_select(snd_pcm_alaw_t *alaw,
+				     snd_pcm_format_t format)
+{
+	const snd_pcm_simd_ops_t *ops = snd_pcm_simd_ops();
+
+	alaw->simd_func = NULL;
+	if (snd_pcm_format_physical_width(format) != 16 ||
+	    snd_pcm_format_cpu_endian(format) != 1)
+		return;
+	alaw->simd_encode = alaw->func == snd_pcm_alaw_encode;
+	alaw->simd_func = alaw->simd_encode ? ops->lut_16_8 : ops->lut_8_16;
+	alaw->simd_conv.flip = snd_pcm_format_signed(format) ? 0 : 0x8000;
+	if (alaw->simd_encode)
+		alaw->simd_conv.table = snd_pcm_alaw_lut()->enc;
+	else
+		alaw->simd_conv.table = snd_pcm_alaw_lut()->dec;
+}
+
+static void snd_pcm_alaw_convert(snd_pcm_alaw_t *alaw,
+				 const snd_pcm_channel_area_t *dst_areas,
+				 snd_pcm_uframes_t dst_offset,
+				 const snd_pcm_channel_area_t *src_areas,
+				 snd_pcm_uframes_t src_offset,
+				 unsigned int channels, snd_pcm_uframes_t frames)
+{
+	if (alaw->simd_func &&
+	    snd_pcm_simd_convert_areas(dst_areas, dst_offset,
+				       src_areas, src_offset,
+				       channels, frames,
+				       alaw->simd_encode ? 8 : 16,
+				       alaw->simd_encode ? 16 : 8,
+				       alaw->simd_func,
+				       &alaw->simd_conv) == 0)
+		return;
+	alaw->func(dst_areas, dst_offset, src_areas, src_offset,
+		   channels, frames, alaw->getput_idx);
+}
+
 static int snd_pcm_alaw_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 {
 	snd_pcm_alaw_t *alaw = pcm->private_data;
@@ -335,6 +419,8 @@ static int snd_pcm_alaw_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 			alaw->func = snd_pcm_alaw_encode;
 		}
 	}
+	snd_pcm_alaw_simd_select(alaw, alaw->sformat == SND_PCM_FORMAT_A_LAW ?
+				 format : alaw->sformat);
 	return 0;
 }
 
@@ -350,10 +436,8 @@ snd_pcm_alaw_write_areas(snd_pcm_t *pcm,
 	snd_pcm_alaw_t *alaw = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	alaw->func(slave_areas, slave_offset,
-		   areas, offset, 
-		   pcm->channels, size,
-		   alaw->getput_idx);
+	snd_pcm_alaw_convert(alaw, slave_areas, slave_offset, areas, offset,
+			     pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -370,10 +454,8 @@ snd_pcm_alaw_read_areas(snd_pcm_t *pcm,
 	snd_pcm_alaw_t *alaw = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	alaw->func(areas, offset, 
-		   slave_areas, slave_offset,
-		   pcm->channels, size,
-		   alaw->getput_idx);
+	snd_pcm_alaw_convert(alaw, areas, offset, slave_areas, slave_offset,
+			     pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
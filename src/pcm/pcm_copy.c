@@ -97,11 +97,15 @@ static int snd_pcm_copy_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 
 static int snd_pcm_copy_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 {
-	return snd_pcm_hw_params_slave(pcm, params,
-				       snd_pcm_copy_hw_refine_cchange,
-				       snd_pcm_copy_hw_refine_sprepare,
-				       snd_pcm_copy_hw_refine_schange,
-				       snd_pcm_generic_hw_params);
+	int err = snd_pcm_hw_params_slave(pcm, params,
+					  snd_pcm_copy_hw_refine_cchange,
+					  snd_pcm_copy_hw_refine_sprepare,
+					  snd_pcm_copy_hw_refine_schange,
+					  snd_pcm_generic_hw_params);
+	if (err < 0)
+		return err;
+	snd_pcm_plugin_set_identity(pcm, params, 1);
+	return 0;
 }
 
 static snd_pcm_uframes_t
@@ -224,6 +228,10 @@ int snd_pcm_copy_open(snd_pcm_t **pcmp, const char *name, snd_pcm_t *slave, int
 This plugin copies samples from master copy PCM to given slave PCM.
 The channel count, format and rate must match for both of them. 
 
+When the buffer size and the mmap access layout match too, the
+application works directly in the slave ring buffer and no copy
+is done for the mmap access.
+
 \code
 pcm.name {
 	type copy		# Copy PCM
@@ -25,6 +25,7 @@
 #include <stddef.h>
 #include <unistd.h>
 #include <signal.h>
+#include <sched.h>
 #include <string.h>
 #include <fcntl.h>
 #include <ctype.h>
@@ -39,8 +40,21 @@
 #include <sys/stat.h>
 #include <sys/un.h>
 #include <sys/mman.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 #include "pcm_direct.h"
 
+#if defined(SYS_futex) && defined(FUTEX_WAIT)
+#define DIRECT_FUTEX		1
+#endif
+
+#if defined(HAVE_LIBPTHREAD) && defined(__linux__) && !defined(__ANDROID__)
+#include <pthread.h>
+#define DIRECT_ROBUST_LOCK	1
+#endif
+
 /*
  *
  */
@@ -57,9 +71,244 @@ union semun {
 #endif
  
 /*
- * FIXME:
- *  add possibility to use futexes here
+ * The dmix mixing lock may be a process shared pthread mutex (a futex)
+ * in the shared area instead of the IPC semaphore, which costs no
+ * system call without contention.  The mutex is robust: when its owner
+ * dies, the kernel marks it (FUTEX_OWNER_DIED) and the next locker
+ * takes it over, which is what SEM_UNDO does for the semaphore.  This
+ * works across PID namespaces, no pid of the owner is ever checked.
+ * The mutex layout depends on the ABI, so only clients with the word
+ * size of the creator can use it.
+ */
+#ifdef DIRECT_ROBUST_LOCK
+
+static pthread_mutex_t *direct_lock_mutex(snd_pcm_direct_t *dmix)
+{
+	return (pthread_mutex_t *)dmix->shmptr->lock.mutex.data;
+}
+
+/* set up the mutex in a new shared area, before others can join */
+int snd_pcm_direct_futex_init(snd_pcm_direct_t *dmix)
+{
+	pthread_mutexattr_t attr;
+	int err;
+
+	if (sizeof(pthread_mutex_t) > sizeof(dmix->shmptr->lock.mutex.data))
+		return -ENOSYS;
+	err = pthread_mutexattr_init(&attr);
+	if (err)
+		return -err;
+	err = pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	if (!err)
+		err = pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+	if (!err)
+		err = pthread_mutex_init(direct_lock_mutex(dmix), &attr);
+	pthread_mutexattr_destroy(&attr);
+	if (err)
+		return -err;
+	dmix->shmptr->lock.bits = sizeof(long) * 8;
+	return 0;
+}
+
+/* the mutex set up by the creator is usable by this client */
+static int direct_futex_usable(snd_pcm_direct_t *dmix)
+{
+	return dmix->shmptr->lock.bits == sizeof(long) * 8;
+}
+
+int snd_pcm_direct_futex_down(snd_pcm_direct_t *dmix)
+{
+	pthread_mutex_t *mutex = direct_lock_mutex(dmix);
+	int err = pthread_mutex_lock(mutex);
+
+	if (err == EOWNERDEAD) {
+		/* the owner died while mixing, as with SEM_UNDO the sum
+		 * buffer keeps what it added so far
+		 */
+		pthread_mutex_consistent(mutex);
+		SNDMSG("recovered the mixing lock of a dead client");
+		return 0;
+	}
+	return -err;
+}
+
+int snd_pcm_direct_futex_up(snd_pcm_direct_t *dmix)
+{
+	return -pthread_mutex_unlock(direct_lock_mutex(dmix));
+}
+
+#else /* !DIRECT_ROBUST_LOCK */
+
+int snd_pcm_direct_futex_init(snd_pcm_direct_t *dmix ATTRIBUTE_UNUSED)
+{
+	return -ENOSYS;
+}
+
+static int direct_futex_usable(snd_pcm_direct_t *dmix ATTRIBUTE_UNUSED)
+{
+	return 0;
+}
+
+int snd_pcm_direct_futex_down(snd_pcm_direct_t *dmix ATTRIBUTE_UNUSED)
+{
+	return -ENOSYS;
+}
+
+int snd_pcm_direct_futex_up(snd_pcm_direct_t *dmix ATTRIBUTE_UNUSED)
+{
+	return -ENOSYS;
+}
+
+#endif /* DIRECT_ROBUST_LOCK */
+
+/*
+ * All clients see the same slave hw_ptr, so the client which needs it
+ * first syncs the slave and publishes the result in the shared area, the
+ * others take it from there while it is younger than hw_cache_time.
+ * The hw_cache is a sequence lock: the writer makes seq odd, stores the
+ * values and makes seq even again, a reader which sees seq changed under
+ * it syncs the slave itself.  The writer never waits, a client which
+ * finds another one writing just keeps its own result.
+ * The slave pointer must never go backwards for a client: a reader
+ * ignores a value behind its own slave_hw_ptr and a writer does not
+ * replace a newer value published while it was syncing.
  */
+static unsigned long long direct_hw_cache_now(void)
+{
+	snd_htimestamp_t ts;
+
+	gettimestamp(&ts, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ptr lies behind ref within the slave boundary */
+static int direct_hw_ptr_behind(snd_pcm_direct_t *direct,
+				snd_pcm_uframes_t ptr, snd_pcm_uframes_t ref)
+{
+	snd_pcm_uframes_t boundary = direct->slave_boundary;
+
+	if (!boundary || ptr == ref)
+		return 0;
+	return (ref + boundary - ptr) % boundary < boundary / 2;
+}
+
+static int direct_hw_cache_read(snd_pcm_direct_t *direct,
+				unsigned long long now,
+				snd_pcm_uframes_t *hw_ptr,
+				snd_htimestamp_t *tstamp)
+{
+	volatile struct snd_pcm_direct_hw_cache *cache = &direct->shmptr->hw_cache;
+	unsigned long long ptr, time;
+	long long sec;
+	unsigned int seq, nsec;
+
+	seq = __atomic_load_n(&cache->seq, __ATOMIC_ACQUIRE);
+	if (seq & 1)
+		return 0;
+	if (cache->ptr_bits != sizeof(snd_pcm_uframes_t) * 8)
+		return 0;
+	ptr = cache->hw_ptr;
+	time = cache->time;
+	sec = cache->tstamp_sec;
+	nsec = cache->tstamp_nsec;
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&cache->seq, __ATOMIC_RELAXED) != seq)
+		return 0;
+	/* also stale when the writer's clock is ahead */
+	if (now - time >= direct->hw_cache_time)
+		return 0;
+	if (direct_hw_ptr_behind(direct, ptr, direct->slave_hw_ptr))
+		return 0;
+	*hw_ptr = ptr;
+	if (tstamp) {
+		tstamp->tv_sec = sec;
+		tstamp->tv_nsec = nsec;
+	}
+	return 1;
+}
+
+static void direct_hw_cache_write(snd_pcm_direct_t *direct,
+				  unsigned long long now,
+				  snd_pcm_uframes_t hw_ptr,
+				  const snd_htimestamp_t *tstamp)
+{
+	volatile struct snd_pcm_direct_hw_cache *cache = &direct->shmptr->hw_cache;
+	unsigned int seq;
+
+	seq = __atomic_load_n(&cache->seq, __ATOMIC_RELAXED);
+	if ((seq & 1) ||
+	    !__atomic_compare_exchange_n(&cache->seq, &seq, seq + 1, 0,
+					 __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		return;
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	if (cache->time && cache->ptr_bits == sizeof(snd_pcm_uframes_t) * 8 &&
+	    (direct_hw_ptr_behind(direct, hw_ptr, cache->hw_ptr) ||
+	     (hw_ptr == cache->hw_ptr && cache->time >= now))) {
+		/* another client published a newer result meanwhile */
+		__atomic_store_n(&cache->seq, seq + 2, __ATOMIC_RELEASE);
+		return;
+	}
+	cache->ptr_bits = sizeof(snd_pcm_uframes_t) * 8;
+	cache->hw_ptr = hw_ptr;
+	cache->time = now;
+	cache->tstamp_sec = tstamp->tv_sec;
+	cache->tstamp_nsec = tstamp->tv_nsec;
+	__atomic_store_n(&cache->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* mark the published hw_ptr stale, e.g. after the slave was restarted */
+static void direct_hw_cache_invalidate(snd_pcm_direct_t *direct)
+{
+	volatile struct snd_pcm_direct_hw_cache *cache = &direct->shmptr->hw_cache;
+	unsigned int seq;
+
+	if (!direct->hw_cache_time)
+		return;
+	for (;;) {
+		seq = __atomic_load_n(&cache->seq, __ATOMIC_RELAXED);
+		if (!(seq & 1) &&
+		    __atomic_compare_exchange_n(&cache->seq, &seq, seq + 1, 0,
+						__ATOMIC_RELAXED, __ATOMIC_RELAXED))
+			break;
+		sched_yield();
+	}
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+	cache->time = 0;
+	__atomic_store_n(&cache->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/*
+ * Return the slave hw_ptr after snd_pcm_hwsync() and, when tstamp is
+ * not NULL, the slave timestamp belonging to it.
+ */
+snd_pcm_uframes_t snd_pcm_direct_hwsync(snd_pcm_direct_t *direct,
+					snd_htimestamp_t *tstamp)
+{
+	snd_pcm_t *spcm = direct->spcm;
+	snd_pcm_uframes_t ptr1 = -2LL /* invalid value */, ptr2;
+	snd_htimestamp_t ts;
+	unsigned long long now = 0;
+
+	if (direct->hw_cache_time) {
+		now = direct_hw_cache_now();
+		if (direct_hw_cache_read(direct, now, &ptr2, tstamp))
+			return ptr2;
+	}
+	snd_pcm_hwsync(spcm);
+	/* loop is required to sync hw.ptr with timestamp */
+	while (1) {
+		ptr2 = *spcm->hw.ptr;
+		if (ptr1 == ptr2)
+			break;
+		ptr1 = ptr2;
+		ts = snd_pcm_hw_fast_tstamp(spcm);
+	}
+	if (direct->hw_cache_time)
+		direct_hw_cache_write(direct, now, ptr1, &ts);
+	if (tstamp)
+		*tstamp = ts;
+	return ptr1;
+}
 
 int snd_pcm_direct_semaphore_create_or_connect(snd_pcm_direct_t *dmix)
 {
@@ -87,12 +336,35 @@ int snd_pcm_direct_semaphore_create_or_connect(snd_pcm_direct_t *dmix)
 	return 0;
 }
 
-static unsigned int snd_pcm_direct_magic(snd_pcm_direct_t *dmix)
+static unsigned int snd_pcm_direct_magic_base(snd_pcm_direct_t *dmix)
 {
 	if (!dmix->direct_memory_access)
-		return 0xa15ad300 + sizeof(snd_pcm_direct_share_t);
-	else
-		return 0xb15ad300 + sizeof(snd_pcm_direct_share_t);
+		return 0xa15ad300 + DIRECT_SHARE_LEGACY_SIZE;
+	return 0xb15ad300 + DIRECT_SHARE_LEGACY_SIZE;
+}
+
+/*
+ * The magic of an instance mixing in a way older versions don't know
+ * has DIRECT_MAGIC_VARIANTS bits set, which keeps those clients away.
+ * The first instance creates the area with the base magic and stores
+ * the full one once its mixing is chosen, before it releases the client
+ * semaphore.
+ */
+unsigned int snd_pcm_direct_magic(snd_pcm_direct_t *dmix)
+{
+	unsigned int magic = snd_pcm_direct_magic_base(dmix);
+
+	/* the futex is used only by clients mixing under a lock */
+	if (dmix->futex_lock)
+		magic |= DIRECT_MAGIC_FUTEX;
+	/* older clients would mix int32 samples into a wider sum buffer */
+	if (dmix->type == SND_PCM_TYPE_DMIX) {
+		if (dmix->u.dmix.mix_bus == SND_PCM_DIRECT_MIX_BUS_INT64)
+			magic |= DIRECT_MAGIC_BUS_INT64;
+		else if (dmix->u.dmix.mix_bus == SND_PCM_DIRECT_MIX_BUS_FLOAT)
+			magic |= DIRECT_MAGIC_BUS_FLOAT;
+	}
+	return magic;
 }
 
 /*
@@ -102,18 +374,30 @@ static unsigned int snd_pcm_direct_magic(snd_pcm_direct_t *dmix)
 int snd_pcm_direct_shm_create_or_connect(snd_pcm_direct_t *dmix)
 {
 	struct shmid_ds buf;
+	size_t size = sizeof(snd_pcm_direct_share_t);
 	int tmpid, err, first_instance = 0;
 	
 retryget:
-	dmix->shmid = shmget(dmix->ipc_key, sizeof(snd_pcm_direct_share_t),
-			     dmix->ipc_perm);
+	dmix->shmid = shmget(dmix->ipc_key, size, dmix->ipc_perm);
 	if (dmix->shmid < 0 && errno == ENOENT) {
-		if ((dmix->shmid = shmget(dmix->ipc_key, sizeof(snd_pcm_direct_share_t),
+		if ((dmix->shmid = shmget(dmix->ipc_key, size,
 					     IPC_CREAT | IPC_EXCL | dmix->ipc_perm)) != -1)
 			first_instance = 1;
 		else if (errno == EEXIST)
 			goto retryget;
 	}
+	if (dmix->shmid < 0 && errno == EINVAL) {
+		/* segment created by an older version without hw_cache */
+		dmix->shmid = shmget(dmix->ipc_key, DIRECT_SHARE_LEGACY_SIZE,
+				     dmix->ipc_perm);
+		if (dmix->shmid >= 0) {
+			size = DIRECT_SHARE_LEGACY_SIZE;
+			dmix->hw_cache_time = 0;
+			dmix->shared_wakeup = 0;
+		} else {
+			errno = EINVAL;
+		}
+	}
 	err = -errno;
 	if (dmix->shmid < 0) {
 		if (errno == EINVAL)
@@ -131,25 +415,41 @@ retryget:
 		snd_pcm_direct_shm_discard(dmix);
 		return err;
 	}
-	mlock(dmix->shmptr, sizeof(snd_pcm_direct_share_t));
+	mlock(dmix->shmptr, size);
 	if (shmctl(dmix->shmid, IPC_STAT, &buf) < 0) {
 		err = -errno;
 		snd_pcm_direct_shm_discard(dmix);
 		return err;
 	}
 	if (first_instance) {	/* we're the first user, clear the segment */
-		memset(dmix->shmptr, 0, sizeof(snd_pcm_direct_share_t));
+		memset(dmix->shmptr, 0, size);
 		if (dmix->ipc_gid >= 0) {
 			buf.shm_perm.gid = dmix->ipc_gid;
 			shmctl(dmix->shmid, IPC_SET, &buf);
 		}
-		dmix->shmptr->magic = snd_pcm_direct_magic(dmix);
+		dmix->shmptr->magic = snd_pcm_direct_magic_base(dmix);
 		return 1;
 	} else {
-		if (dmix->shmptr->magic != snd_pcm_direct_magic(dmix)) {
+		unsigned int magic = dmix->shmptr->magic;
+
+		if ((magic & ~DIRECT_MAGIC_VARIANTS) != snd_pcm_direct_magic_base(dmix)) {
 			snd_pcm_direct_shm_discard(dmix);
 			return -EINVAL;
 		}
+		/* the futex is used only when all clients ask for it, the
+		 * others share the semaphore of an instance without it
+		 */
+		if (magic & DIRECT_MAGIC_FUTEX) {
+			if (!dmix->futex_lock || size < sizeof(*dmix->shmptr) ||
+			    !direct_futex_usable(dmix)) {
+				SNDERR("the running instance mixes under the futex lock, "
+				       "which this client does not use (futex_lock)");
+				snd_pcm_direct_shm_discard(dmix);
+				return -EINVAL;
+			}
+		} else {
+			dmix->futex_lock = 0;
+		}
 	}
 	return 0;
 }
@@ -182,9 +482,12 @@ static int _snd_pcm_direct_shm_discard(snd_pcm_direct_t *dmix)
 	return ret;
 }
 
+static void direct_wake_put_slot(snd_pcm_direct_t *direct);
+
 /* ... and an exported version */
 int snd_pcm_direct_shm_discard(snd_pcm_direct_t *dmix)
 {
+	direct_wake_put_slot(dmix);
 	return _snd_pcm_direct_shm_discard(dmix);
 }
 
@@ -640,6 +943,7 @@ int snd_pcm_direct_slave_recover(snd_pcm_direct_t *direct)
 	}
 
 	ret = snd_pcm_start(direct->spcm);
+	direct_hw_cache_invalidate(direct);
 	if (ret < 0) {
 		SNDERR("recover: unable to start slave");
 		semerr = snd_pcm_direct_semaphore_up(direct,
@@ -803,6 +1107,287 @@ timer_changed:
 	return 0;
 }
 
+/*
+ * shared_wakeup: instead of every waiting client polling its own slave
+ * timer, only one of them (the ticker) does; the others register the
+ * slave hw_ptr at which their avail reaches avail_min and sleep on a
+ * futex in their slot of shmptr->wake.  On each timer tick, the ticker
+ * wakes just the clients whose target was reached.  When the ticker is
+ * done, it hands the role to another waiting client.  Sleepers wake up
+ * after two slave periods anyway to take over the role of a ticker which
+ * died.  This serves only the blocking waits inside alsa-lib, the poll
+ * descriptor of each client is still its own timer.
+ */
+#ifdef DIRECT_FUTEX
+
+static int direct_futex(unsigned int *word, int op, unsigned int val,
+			const struct timespec *timeout)
+{
+	return syscall(SYS_futex, word, op, val, timeout, NULL, 0);
+}
+
+static int direct_wake_get_slot(snd_pcm_direct_t *direct)
+{
+	unsigned int pid = getpid(), old;
+	int i;
+
+	if (direct->wake_slot >= 0)
+		return direct->wake_slot;
+	for (i = 0; i < DIRECT_WAKE_SLOTS; i++) {
+		unsigned int *owner = &direct->shmptr->wake.slot[i].pid;
+
+		old = __atomic_load_n(owner, __ATOMIC_RELAXED);
+		if (old && (kill(old, 0) == 0 || errno != ESRCH))
+			continue;
+		if (__atomic_compare_exchange_n(owner, &old, pid, 0,
+						__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			direct->shmptr->wake.slot[i].waiting = 0;
+			direct->wake_slot = i;
+			return i;
+		}
+	}
+	return -EBUSY;
+}
+
+/* bump the futex of a slot and wake its client */
+static void direct_wake_slot(snd_pcm_direct_t *direct, int i)
+{
+	unsigned int *word = &direct->shmptr->wake.slot[i].word;
+
+	__atomic_add_fetch(word, 1, __ATOMIC_RELEASE);
+	direct_futex(word, FUTEX_WAKE, 1, NULL);
+}
+
+static int direct_wake_reached(snd_pcm_direct_t *direct,
+			       unsigned long long ptr,
+			       unsigned long long target)
+{
+	return pcm_frame_diff(ptr, target, direct->slave_boundary) <
+		(snd_pcm_sframes_t)(direct->slave_boundary / 2);
+}
+
+/* ticker: publish the slave hw_ptr and wake the clients due */
+static void direct_wake_fanout(snd_pcm_direct_t *direct)
+{
+	snd_pcm_uframes_t ptr = snd_pcm_direct_hwsync(direct, NULL);
+	int all = snd_pcm_state(direct->spcm) != SND_PCM_STATE_RUNNING;
+	int i;
+
+	direct->shmptr->wake.ptr_bits = sizeof(snd_pcm_uframes_t) * 8;
+	__atomic_store_n(&direct->shmptr->wake.hw_ptr, ptr, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	for (i = 0; i < DIRECT_WAKE_SLOTS; i++) {
+		volatile struct snd_pcm_direct_wake_slot *slot =
+			&direct->shmptr->wake.slot[i];
+
+		if (i == direct->wake_slot || !slot->waiting)
+			continue;
+		if (all || slot->ptr_bits != sizeof(snd_pcm_uframes_t) * 8 ||
+		    direct_wake_reached(direct, ptr, slot->target))
+			direct_wake_slot(direct, i);
+	}
+}
+
+/* give up the ticker role to another waiting client */
+static void direct_wake_release_ticker(snd_pcm_direct_t *direct)
+{
+	unsigned int me = direct->wake_slot + 1;
+	int i;
+
+	if (!__atomic_compare_exchange_n(&direct->shmptr->wake.ticker, &me, 0,
+					 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+		return;
+	for (i = 0; i < DIRECT_WAKE_SLOTS; i++) {
+		if (i != direct->wake_slot &&
+		    __atomic_load_n(&direct->shmptr->wake.slot[i].waiting,
+				    __ATOMIC_RELAXED)) {
+			direct_wake_slot(direct, i);
+			break;
+		}
+	}
+}
+
+/* become the ticker when there is none or the current one died */
+static int direct_wake_take_ticker(snd_pcm_direct_t *direct)
+{
+	unsigned int *ticker = &direct->shmptr->wake.ticker;
+	unsigned int me = direct->wake_slot + 1, old, pid;
+
+	old = __atomic_load_n(ticker, __ATOMIC_RELAXED);
+	if (old == me)
+		return 1;
+	if (old) {
+		pid = __atomic_load_n(&direct->shmptr->wake.slot[(old - 1) % DIRECT_WAKE_SLOTS].pid,
+				      __ATOMIC_RELAXED);
+		if (pid && (kill(pid, 0) == 0 || errno != ESRCH))
+			return 0;
+	}
+	if (!__atomic_compare_exchange_n(ticker, &old, me, 0,
+					 __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		return 0;
+	/* ticks queued while we were not polling are stale */
+	snd_pcm_direct_clear_timer_queue(direct);
+	return 1;
+}
+
+int snd_pcm_direct_wait(snd_pcm_t *pcm, int timeout)
+{
+	snd_pcm_direct_t *direct = pcm->private_data;
+	volatile struct snd_pcm_direct_wake_slot *slot;
+	unsigned long long start = 0, now, target;
+	snd_pcm_sframes_t avail;
+	snd_pcm_uframes_t need, drain_target = 0;
+	struct timespec ts;
+	unsigned int word;
+	int err, ticker, chunk, left = -1, recheck = 1, draining = 0;
+
+	if (!direct->shared_wakeup || !direct->timer ||
+	    direct_wake_get_slot(direct) < 0)
+		return -ENOSYS;
+	slot = &direct->shmptr->wake.slot[direct->wake_slot];
+	/* sleepers recheck after two slave periods */
+	chunk = direct->slave_period_size * 2000ULL / direct->shmptr->s.rate + 1;
+	if (timeout > 0)
+		start = direct_hw_cache_now();
+	for (;;) {
+		avail = __snd_pcm_avail_update(pcm);
+		if (avail < 0) {
+			err = avail;
+			break;
+		}
+		switch (__snd_pcm_state(pcm)) {
+		case SND_PCM_STATE_RUNNING:
+			need = avail < (snd_pcm_sframes_t)pcm->avail_min ?
+				pcm->avail_min - avail : 0;
+			if (need && direct->sync_area) {
+				/* as poll_revents, and come back each period
+				 * while queued frames don't fit the slave yet
+				 */
+				direct->sync_area(pcm);
+				if (direct->appl_ptr != direct->last_appl_ptr &&
+				    need > direct->slave_period_size)
+					need = direct->slave_period_size;
+			}
+			break;
+		case SND_PCM_STATE_DRAINING:
+			/* return after the next slave period as poll() on
+			 * the timer, so the drain loop syncs the areas again
+			 */
+			if (!draining) {
+				draining = 1;
+				drain_target = (direct->slave_hw_ptr + direct->slave_period_size) %
+					       direct->slave_boundary;
+			}
+			need = pcm_frame_diff(drain_target, direct->slave_hw_ptr,
+					      direct->slave_boundary);
+			if (need > direct->slave_period_size)
+				need = 0;	/* passed already */
+			break;
+		case SND_PCM_STATE_XRUN:
+			err = -EPIPE;
+			goto _end;
+		case SND_PCM_STATE_SUSPENDED:
+			err = -ESTRPIPE;
+			goto _end;
+		case SND_PCM_STATE_DISCONNECTED:
+			err = -ENODEV;
+			goto _end;
+		default:
+			need = 0;
+			break;
+		}
+		if (!need) {
+			err = 1;
+			break;
+		}
+		if (timeout == 0) {
+			err = 0;
+			break;
+		}
+		if (timeout > 0) {
+			now = direct_hw_cache_now();
+			if (now - start >= timeout * 1000000ULL) {
+				err = 0;
+				break;
+			}
+			left = timeout - (now - start) / 1000000ULL;
+		}
+
+		target = (direct->slave_hw_ptr + need) % direct->slave_boundary;
+		word = __atomic_load_n(&slot->word, __ATOMIC_ACQUIRE);
+		slot->target = target;
+		slot->ptr_bits = sizeof(snd_pcm_uframes_t) * 8;
+		__atomic_store_n(&slot->waiting, 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		ticker = direct_wake_take_ticker(direct);
+		if (!ticker && recheck &&
+		    direct->shmptr->wake.ptr_bits == sizeof(snd_pcm_uframes_t) * 8 &&
+		    direct_wake_reached(direct, __atomic_load_n(&direct->shmptr->wake.hw_ptr,
+								__ATOMIC_RELAXED), target)) {
+			/* the ticker passed the target before we registered */
+			recheck = 0;
+			continue;
+		}
+		recheck = 1;
+
+		__snd_pcm_unlock(pcm->fast_op_arg);
+		if (ticker) {
+			err = poll(&direct->timer_fd, 1, left);
+		} else {
+			int tmo = left < 0 || left > chunk ? chunk : left;
+
+			ts.tv_sec = tmo / 1000;
+			ts.tv_nsec = (tmo % 1000) * 1000000L;
+			err = direct_futex((unsigned int *)&slot->word, FUTEX_WAIT,
+					   word, &ts);
+			if (err < 0 && (errno == EAGAIN || errno == ETIMEDOUT))
+				err = 0;
+		}
+		if (err < 0)
+			err = -errno;
+		__snd_pcm_lock(pcm->fast_op_arg);
+		if (err < 0) {
+			if (err == -EINTR && !PCMINABORT(pcm) &&
+			    !(pcm->mode & SND_PCM_EINTR))
+				continue;
+			break;
+		}
+		if (ticker) {
+			snd_pcm_direct_clear_timer_queue(direct);
+			direct_wake_fanout(direct);
+		}
+	}
+ _end:
+	__atomic_store_n(&slot->waiting, 0, __ATOMIC_RELAXED);
+	direct_wake_release_ticker(direct);
+	return err;
+}
+
+static void direct_wake_put_slot(snd_pcm_direct_t *direct)
+{
+	if (direct->wake_slot < 0 || direct->shmptr == (void *) -1)
+		return;
+	direct->shmptr->wake.slot[direct->wake_slot].waiting = 0;
+	direct_wake_release_ticker(direct);
+	__atomic_store_n(&direct->shmptr->wake.slot[direct->wake_slot].pid, 0,
+			 __ATOMIC_RELEASE);
+	direct->wake_slot = -1;
+}
+
+#else /* !DIRECT_FUTEX */
+
+int snd_pcm_direct_wait(snd_pcm_t *pcm ATTRIBUTE_UNUSED,
+			int timeout ATTRIBUTE_UNUSED)
+{
+	return -ENOSYS;
+}
+
+static void direct_wake_put_slot(snd_pcm_direct_t *direct ATTRIBUTE_UNUSED)
+{
+}
+
+#endif /* DIRECT_FUTEX */
+
 int snd_pcm_direct_info(snd_pcm_t *pcm, snd_pcm_info_t * info)
 {
 	snd_pcm_direct_t *dmix = pcm->private_data;
@@ -1053,9 +1638,35 @@ int snd_pcm_direct_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t *params)
 	return 0;
 }
 
+/*
+ * with zero_copy, a client matching the slave (see
+ * snd_pcm_direct_check_in_place()) gets the slave areas of its bound
+ * channels as its mmap areas
+ */
 int snd_pcm_direct_channel_info(snd_pcm_t *pcm, snd_pcm_channel_info_t * info)
 {
-        return snd_pcm_channel_info_shm(pcm, info, -1);
+	snd_pcm_direct_t *direct = pcm->private_data;
+	const snd_pcm_channel_area_t *area;
+	int err;
+
+	err = snd_pcm_channel_info_shm(pcm, info, -1);
+	if (err < 0 || !direct->zero_copy)
+		return err;
+	if (info->channel == 0)
+		snd_pcm_direct_check_in_place(direct, pcm);
+	if (!direct->in_place)
+		return 0;
+	area = &snd_pcm_mmap_areas(direct->spcm)[direct->bindings ?
+						 direct->bindings[info->channel] :
+						 info->channel];
+	/* SHM without an area: snd_pcm_munmap() leaves the memory alone */
+	info->type = SND_PCM_AREA_SHM;
+	info->u.shm.shmid = -1;
+	info->u.shm.area = NULL;
+	info->addr = area->addr;
+	info->first = area->first;
+	info->step = area->step;
+	return 0;
 }
 
 int snd_pcm_direct_mmap(snd_pcm_t *pcm ATTRIBUTE_UNUSED)
@@ -1239,6 +1850,8 @@ int snd_pcm_direct_initialize_slave(snd_pcm_direct_t *dmix, snd_pcm_t *spcm, str
 			SND_PCM_FORMAT_S24_LE,
 			SND_PCM_FORMAT_S24_3LE,
 			SND_PCM_FORMAT_U8,
+			/* mixed on the float bus */
+			SND_PCM_FORMAT_FLOAT,
 		};
 		snd_pcm_format_t format;
 		unsigned int i;
@@ -1713,6 +2326,49 @@ __nointerleaved:
 	return dmix->interleaved = 0;
 }
 
+/*
+ * check whether the client can use the slave buffer as its own buffer:
+ * zero_copy is set, the buffer and sample format are the same, every
+ * channel is bound and, for the mmap accesses promising a layout, the
+ * slave areas have exactly that layout
+ */
+int snd_pcm_direct_check_in_place(snd_pcm_direct_t *direct, snd_pcm_t *pcm)
+{
+	const snd_pcm_channel_area_t *areas;
+	snd_pcm_channel_info_t info;
+	unsigned int chn, schn;
+	int layout;
+
+	direct->in_place = 0;
+	if (!direct->zero_copy ||
+	    pcm->buffer_size != direct->slave_buffer_size ||
+	    pcm->format != direct->spcm->format)
+		return 0;
+	areas = snd_pcm_mmap_areas(direct->spcm);
+	if (!areas)
+		return 0;
+	layout = pcm->access == SND_PCM_ACCESS_MMAP_INTERLEAVED ||
+		 pcm->access == SND_PCM_ACCESS_MMAP_NONINTERLEAVED;
+	for (chn = 0; chn < pcm->channels; chn++) {
+		schn = direct->bindings ? direct->bindings[chn] : chn;
+		if (schn >= direct->spcm->channels)
+			return 0;
+		if (!layout)
+			continue;
+		memset(&info, 0, sizeof(info));
+		info.channel = chn;
+		if (snd_pcm_channel_info_shm(pcm, &info, -1) < 0)
+			return 0;
+		if (areas[schn].first != info.first ||
+		    areas[schn].step != info.step)
+			return 0;
+		if (info.step == pcm->frame_bits && chn > 0 &&
+		    areas[schn].addr != areas[direct->bindings ? direct->bindings[0] : 0].addr)
+			return 0;
+	}
+	return direct->in_place = 1;
+}
+
 /*
  * parse the channel map
  * id == client channel
@@ -1939,7 +2595,13 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 #else
 	rec->direct_memory_access = 0;
 #endif
+	rec->futex_lock = 0;
+	rec->hw_ptr_cache = 0;
+	rec->shared_wakeup = 0;
+	rec->zero_copy = 0;
 	rec->hw_ptr_alignment = SND_PCM_HW_PTR_ALIGNMENT_AUTO;
+	rec->mix_bus = SND_PCM_DIRECT_MIX_BUS_AUTO;
+	rec->hugepages = SND_PCM_DIRECT_HUGEPAGES_THP;
 	rec->tstamp_type = -1;
 
 	/* read defaults */
@@ -2004,6 +2666,46 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 
 			continue;
 		}
+		if (strcmp(id, "mix_bus") == 0) {
+			const char *str;
+			err = snd_config_get_string(n, &str);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			if (strcmp(str, "auto") == 0)
+				rec->mix_bus = SND_PCM_DIRECT_MIX_BUS_AUTO;
+			else if (strcmp(str, "int32") == 0)
+				rec->mix_bus = SND_PCM_DIRECT_MIX_BUS_INT32;
+			else if (strcmp(str, "int64") == 0)
+				rec->mix_bus = SND_PCM_DIRECT_MIX_BUS_INT64;
+			else if (strcmp(str, "float") == 0)
+				rec->mix_bus = SND_PCM_DIRECT_MIX_BUS_FLOAT;
+			else {
+				SNDERR("The field mix_bus is invalid : %s", str);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "hugepages") == 0) {
+			const char *str;
+			err = snd_config_get_string(n, &str);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			if (strcmp(str, "no") == 0 || strcmp(str, "off") == 0)
+				rec->hugepages = SND_PCM_DIRECT_HUGEPAGES_NO;
+			else if (strcmp(str, "thp") == 0)
+				rec->hugepages = SND_PCM_DIRECT_HUGEPAGES_THP;
+			else if (strcmp(str, "hugetlb") == 0)
+				rec->hugepages = SND_PCM_DIRECT_HUGEPAGES_HUGETLB;
+			else {
+				SNDERR("The field hugepages is invalid : %s", str);
+				return -EINVAL;
+			}
+			continue;
+		}
 		if (strcmp(id, "tstamp_type") == 0) {
 			const char *str;
 			err = snd_config_get_string(n, &str);
@@ -2082,6 +2784,18 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 			rec->slowptr = err;
 			continue;
 		}
+		if (strcmp(id, "hw_ptr_cache") == 0) {
+			long val;
+			err = snd_config_get_integer(n, &val);
+			if (err < 0)
+				return err;
+			if (val < 0 || val > 1000000) {
+				SNDERR("Invalid hw_ptr_cache %ld", val);
+				return -EINVAL;
+			}
+			rec->hw_ptr_cache = val;
+			continue;
+		}
 		if (strcmp(id, "max_periods") == 0) {
 			long val;
 			err = snd_config_get_integer(n, &val);
@@ -2104,6 +2818,27 @@ int snd_pcm_direct_parse_open_conf(snd_config_t *root, snd_config_t *conf,
 			rec->direct_memory_access = err;
 			continue;
 		}
+		if (strcmp(id, "futex_lock") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->futex_lock = err;
+			continue;
+		}
+		if (strcmp(id, "zero_copy") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->zero_copy = err;
+			continue;
+		}
+		if (strcmp(id, "shared_wakeup") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return err;
+			rec->shared_wakeup = err;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -2169,6 +2904,13 @@ int _snd_pcm_direct_new(snd_pcm_t **pcmp, snd_pcm_direct_t **_dmix, int type,
 	dmix->shmid = -1;
 	dmix->shmptr = (void *) -1;
 	dmix->type = type;
+	dmix->hw_cache_time = opts->hw_ptr_cache * 1000ULL;
+	dmix->shared_wakeup = opts->shared_wakeup;
+	dmix->zero_copy = type != SND_PCM_TYPE_DMIX && opts->zero_copy;
+	dmix->wake_slot = -1;
+#ifdef DIRECT_ROBUST_LOCK
+	dmix->futex_lock = type == SND_PCM_TYPE_DMIX && opts->futex_lock;
+#endif
 
 	ret = snd_pcm_new(pcmp, type, name, stream, mode);
 	if (ret < 0)
@@ -55,6 +55,31 @@ typedef void (mix_areas_u8_t)(unsigned int size,
 			      volatile signed int *sum, size_t dst_step,
 			      size_t src_step, size_t sum_step);
 
+typedef void (mix_areas_32_64_t)(unsigned int size,
+				 volatile signed int *dst, signed int *src,
+				 volatile long long *sum, size_t dst_step,
+				 size_t src_step, size_t sum_step);
+
+typedef void (mix_areas_float_t)(unsigned int size,
+				 volatile float *dst, float *src,
+				 volatile float *sum, size_t dst_step,
+				 size_t src_step, size_t sum_step);
+
+typedef enum snd_pcm_direct_mix_bus {
+	SND_PCM_DIRECT_MIX_BUS_AUTO = -1,	/* float for FLOAT slaves, int32 otherwise */
+	SND_PCM_DIRECT_MIX_BUS_INT32 = 0,	/* 32-bit integer sums (24-bit resolution for S32) */
+	SND_PCM_DIRECT_MIX_BUS_INT64 = 1,	/* 64-bit integer sums, S32 only */
+	SND_PCM_DIRECT_MIX_BUS_FLOAT = 2	/* float sums, FLOAT only */
+} snd_pcm_direct_mix_bus_t;
+
+typedef enum snd_pcm_direct_hugepages {
+	SND_PCM_DIRECT_HUGEPAGES_NO = 0,	/* regular pages */
+	SND_PCM_DIRECT_HUGEPAGES_THP = 1,	/* advise transparent huge pages */
+	SND_PCM_DIRECT_HUGEPAGES_HUGETLB = 2	/* reserved huge pages, THP as fallback */
+} snd_pcm_direct_hugepages_t;
+
+#define DIRECT_WAKE_SLOTS	32	/* clients sleeping in shared_wakeup mode */
+
 typedef enum snd_pcm_direct_hw_ptr_alignment {
 	SND_PCM_HW_PTR_ALIGNMENT_NO = 0,	/* use the hw_ptr as is and do no rounding */
 	SND_PCM_HW_PTR_ALIGNMENT_ROUNDUP = 1,	/* round the slave_appl_ptr up to slave_period */
@@ -124,9 +149,54 @@ typedef struct {
 		struct {
 			unsigned long long chn_mask;
 		} dshare;
+		struct {
+			unsigned int mix_bus;	/* snd_pcm_direct_mix_bus_t */
+		} dmix;
 	} u;
+	/* members below are missing in segments created by older versions,
+	 * the magic covers only the part above (see DIRECT_SHARE_LEGACY_SIZE)
+	 */
+	struct snd_pcm_direct_hw_cache {
+		unsigned int seq;		/* odd while being written */
+		unsigned int ptr_bits;		/* bits of the writer's hw_ptr */
+		unsigned long long hw_ptr;	/* slave hw_ptr after hwsync */
+		unsigned long long time;	/* CLOCK_MONOTONIC of hwsync in ns */
+		long long tstamp_sec;		/* slave status tstamp */
+		unsigned int tstamp_nsec;
+		unsigned int pad;
+	} hw_cache;
+	struct {
+		unsigned int ticker;		/* slot + 1 of the client polling its timer */
+		unsigned int ptr_bits;		/* bits of the ticker's hw_ptr */
+		unsigned long long hw_ptr;	/* slave hw_ptr seen by the ticker */
+		struct snd_pcm_direct_wake_slot {
+			unsigned int word;	/* futex, bumped to wake the client */
+			unsigned int pid;	/* owner, 0 for a free slot */
+			unsigned int waiting;	/* client sleeps until target */
+			unsigned int ptr_bits;	/* bits of target */
+			unsigned long long target; /* slave hw_ptr to wake at */
+		} slot[DIRECT_WAKE_SLOTS];
+	} wake;
+	struct {
+		unsigned int bits;		/* word size of the creator, 0 = unset */
+		unsigned int pad;
+		union {				/* robust process shared mutex */
+			unsigned long long align;
+			unsigned char data[64];
+		} mutex;
+	} lock;
 } snd_pcm_direct_share_t;
 
+#define DIRECT_SHARE_LEGACY_SIZE	offsetof(snd_pcm_direct_share_t, hw_cache)
+
+/* magic bits of the instances older versions cannot join */
+#define DIRECT_MAGIC_FUTEX		0x00010000U	/* mixed under the futex */
+#define DIRECT_MAGIC_BUS_INT64		0x00020000U	/* int64 sum buffer */
+#define DIRECT_MAGIC_BUS_FLOAT		0x00040000U	/* float sum buffer */
+#define DIRECT_MAGIC_VARIANTS		(DIRECT_MAGIC_FUTEX | \
+					 DIRECT_MAGIC_BUS_INT64 | \
+					 DIRECT_MAGIC_BUS_FLOAT)
+
 typedef struct snd_pcm_direct snd_pcm_direct_t;
 
 struct snd_pcm_direct {
@@ -149,6 +219,7 @@ struct snd_pcm_direct {
 	snd_pcm_uframes_t slave_buffer_size;
 	snd_pcm_uframes_t slave_boundary;
 	int (*sync_ptr)(snd_pcm_t *pcm);
+	void (*sync_area)(snd_pcm_t *pcm);	/* transfer queued frames, optional */
 	snd_pcm_state_t state;
 	snd_htimestamp_t trigger_tstamp;
 	snd_htimestamp_t update_tstamp;
@@ -165,19 +236,28 @@ struct snd_pcm_direct {
 	pid_t server_pid;
 	snd_timer_t *timer; 		/* timer used as poll_fd */
 	int interleaved;	 	/* we have interleaved buffer */
+	int zero_copy;			/* allow in_place when possible */
+	int in_place;			/* our buffer is the slave buffer */
 	int slowptr;			/* use slow but more precise ptr updates */
+	unsigned long long hw_cache_time; /* max. age of a shared hw_ptr in ns */
 	int max_periods;		/* max periods (-1 = fixed periods, 0 = max buffer size) */
 	int var_periodsize;		/* allow variable period size if max_periods is != -1*/
 	unsigned int channels;		/* client's channels */
 	unsigned int *bindings;
 	unsigned int recoveries;	/* mirror of executed recoveries on slave */
 	int direct_memory_access;	/* use arch-optimized buffer RW */
+	int futex_lock;			/* mix under the mutex in the shared area */
+	int shared_wakeup;		/* sleep on the shared futex, one ticker */
+	int wake_slot;			/* our slot in shmptr->wake, -1 = none */
 	snd_pcm_direct_hw_ptr_alignment_t hw_ptr_alignment;
 	int tstamp_type;		/* cached from conf, can be -1(default) on top of real types */
 	union {
 		struct {
 			int shmid_sum;			/* IPC global sum ring buffer memory identification */
-			signed int *sum_buffer;		/* shared sum buffer */
+			void *sum_buffer;		/* shared sum buffer */
+			unsigned int sum_size;		/* bytes per sum sample */
+			snd_pcm_direct_mix_bus_t mix_bus;
+			snd_pcm_direct_hugepages_t hugepages;
 			mix_areas_16_t *mix_areas_16;
 			mix_areas_32_t *mix_areas_32;
 			mix_areas_24_t *mix_areas_24;
@@ -186,6 +266,10 @@ struct snd_pcm_direct {
 			mix_areas_32_t *remix_areas_32;
 			mix_areas_24_t *remix_areas_24;
 			mix_areas_u8_t *remix_areas_u8;
+			mix_areas_32_64_t *mix_areas_32_64;
+			mix_areas_32_64_t *remix_areas_32_64;
+			mix_areas_float_t *mix_areas_float;
+			mix_areas_float_t *remix_areas_float;
 			unsigned int use_sem;
 		} dmix;
 		struct {
@@ -216,6 +300,8 @@ struct snd_pcm_direct {
 	snd1_pcm_direct_initialize_secondary_slave
 #define snd_pcm_direct_initialize_poll_fd \
 	snd1_pcm_direct_initialize_poll_fd
+#define snd_pcm_direct_check_in_place \
+	snd1_pcm_direct_check_in_place
 #define snd_pcm_direct_check_interleave \
 	snd1_pcm_direct_check_interleave
 #define snd_pcm_direct_parse_bindings \
@@ -270,6 +356,18 @@ struct snd_pcm_direct {
 	snd1_pcm_direct_check_xrun
 #define snd_pcm_direct_slave_recover \
 	snd1_pcm_direct_slave_recover
+#define snd_pcm_direct_wait \
+	snd1_pcm_direct_wait
+#define snd_pcm_direct_hwsync \
+	snd1_pcm_direct_hwsync
+#define snd_pcm_direct_magic \
+	snd1_pcm_direct_magic
+#define snd_pcm_direct_futex_init \
+	snd1_pcm_direct_futex_init
+#define snd_pcm_direct_futex_down \
+	snd1_pcm_direct_futex_down
+#define snd_pcm_direct_futex_up \
+	snd1_pcm_direct_futex_up
 
 int snd_pcm_direct_semaphore_create_or_connect(snd_pcm_direct_t *dmix);
 
@@ -305,6 +403,11 @@ static inline int snd_pcm_direct_semaphore_up(snd_pcm_direct_t *dmix, int sem_nu
 	return err;
 }
 
+unsigned int snd_pcm_direct_magic(snd_pcm_direct_t *dmix);
+int snd_pcm_direct_futex_init(snd_pcm_direct_t *dmix);
+int snd_pcm_direct_futex_down(snd_pcm_direct_t *dmix);
+int snd_pcm_direct_futex_up(snd_pcm_direct_t *dmix);
+
 static inline int snd_pcm_direct_semaphore_final(snd_pcm_direct_t *dmix, int sem_num)
 {
 	if (dmix->locked[sem_num] != 1) {
@@ -324,6 +427,7 @@ int snd_pcm_direct_initialize_slave(snd_pcm_direct_t *dmix, snd_pcm_t *spcm, str
 int snd_pcm_direct_initialize_secondary_slave(snd_pcm_direct_t *dmix, snd_pcm_t *spcm, struct slave_params *params);
 int snd_pcm_direct_initialize_poll_fd(snd_pcm_direct_t *dmix);
 int snd_pcm_direct_check_interleave(snd_pcm_direct_t *dmix, snd_pcm_t *pcm);
+int snd_pcm_direct_check_in_place(snd_pcm_direct_t *direct, snd_pcm_t *pcm);
 int snd_pcm_direct_parse_bindings(snd_pcm_direct_t *dmix,
 				  struct slave_params *params,
 				  snd_config_t *cfg);
@@ -355,16 +459,24 @@ int snd_pcm_direct_check_xrun(snd_pcm_direct_t *direct, snd_pcm_t *pcm);
 int snd_timer_async(snd_timer_t *timer, int sig, pid_t pid);
 struct timespec snd_pcm_hw_fast_tstamp(snd_pcm_t *pcm);
 void snd_pcm_direct_reset_slave_ptr(snd_pcm_t *pcm, snd_pcm_direct_t *dmix, snd_pcm_uframes_t hw_ptr);
+snd_pcm_uframes_t snd_pcm_direct_hwsync(snd_pcm_direct_t *direct, snd_htimestamp_t *tstamp);
+int snd_pcm_direct_wait(snd_pcm_t *pcm, int timeout);
 
 struct snd_pcm_direct_open_conf {
 	key_t ipc_key;
 	mode_t ipc_perm;
 	int ipc_gid;
 	int slowptr;
+	unsigned int hw_ptr_cache;
 	int max_periods;
 	int var_periodsize;
 	int direct_memory_access;
+	int futex_lock;
+	int shared_wakeup;
+	int zero_copy;
 	snd_pcm_direct_hw_ptr_alignment_t hw_ptr_alignment;
+	snd_pcm_direct_mix_bus_t mix_bus;
+	snd_pcm_direct_hugepages_t hugepages;
 	int tstamp_type;
 	snd_config_t *slave;
 	snd_config_t *bindings;
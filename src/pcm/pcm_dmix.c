@@ -73,10 +73,19 @@ static int shm_sum_create_or_connect(snd_pcm_direct_t *dmix)
 
 	size = dmix->shmptr->s.channels *
 	       dmix->shmptr->s.buffer_size *
-	       sizeof(signed int);	
+	       dmix->u.dmix.sum_size;
 retryshm:
-	dmix->u.dmix.shmid_sum = shmget(dmix->ipc_key + 1, size,
-					IPC_CREAT | dmix->ipc_perm);
+	dmix->u.dmix.shmid_sum = -1;
+#ifdef SHM_HUGETLB
+	/* the first instance decides, falls back when none are reserved */
+	if (dmix->u.dmix.hugepages == SND_PCM_DIRECT_HUGEPAGES_HUGETLB)
+		dmix->u.dmix.shmid_sum = shmget(dmix->ipc_key + 1, size,
+						IPC_CREAT | IPC_EXCL | SHM_HUGETLB |
+						dmix->ipc_perm);
+#endif
+	if (dmix->u.dmix.shmid_sum < 0)
+		dmix->u.dmix.shmid_sum = shmget(dmix->ipc_key + 1, size,
+						IPC_CREAT | dmix->ipc_perm);
 	err = -errno;
 	if (dmix->u.dmix.shmid_sum < 0) {
 		if (errno == EINVAL)
@@ -103,6 +112,11 @@ retryshm:
 		shm_sum_discard(dmix);
 		return err;
 	}
+#ifdef MADV_HUGEPAGE
+	/* fewer TLB misses when mixing many channels (no-op for hugetlb) */
+	if (dmix->u.dmix.hugepages != SND_PCM_DIRECT_HUGEPAGES_NO)
+		madvise(dmix->u.dmix.sum_buffer, size, MADV_HUGEPAGE);
+#endif
 	mlock(dmix->u.dmix.sum_buffer, size);
 	return 0;
 }
@@ -128,6 +142,54 @@ static int shm_sum_discard(snd_pcm_direct_t *dmix)
 	return ret;
 }
 
+/*
+ *  select the sum format; all clients of a dmix instance must use the same
+ */
+static int dmix_select_mix_bus(snd_pcm_direct_t *dmix,
+			       snd_pcm_direct_mix_bus_t bus,
+			       int first_instance)
+{
+	snd_pcm_format_t format = dmix->shmptr->s.format;
+
+	if (bus == SND_PCM_DIRECT_MIX_BUS_AUTO)
+		bus = format == SND_PCM_FORMAT_FLOAT ?
+			SND_PCM_DIRECT_MIX_BUS_FLOAT : SND_PCM_DIRECT_MIX_BUS_INT32;
+	switch (bus) {
+	case SND_PCM_DIRECT_MIX_BUS_INT32:
+		if (format == SND_PCM_FORMAT_FLOAT) {
+			SNDERR("FLOAT slave format requires the float mix bus");
+			return -EINVAL;
+		}
+		dmix->u.dmix.sum_size = sizeof(signed int);
+		break;
+	case SND_PCM_DIRECT_MIX_BUS_INT64:
+		if (format != SND_PCM_FORMAT_S32_LE &&
+		    format != SND_PCM_FORMAT_S32_BE) {
+			SNDERR("int64 mix bus requires S32 slave format");
+			return -EINVAL;
+		}
+		dmix->u.dmix.sum_size = sizeof(long long);
+		break;
+	case SND_PCM_DIRECT_MIX_BUS_FLOAT:
+		if (format != SND_PCM_FORMAT_FLOAT) {
+			SNDERR("float mix bus requires FLOAT slave format");
+			return -EINVAL;
+		}
+		dmix->u.dmix.sum_size = sizeof(float);
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (first_instance) {
+		dmix->shmptr->u.dmix.mix_bus = bus;
+	} else if (dmix->shmptr->u.dmix.mix_bus != (unsigned int)bus) {
+		SNDERR("mix_bus does not match the running dmix instance");
+		return -EINVAL;
+	}
+	dmix->u.dmix.mix_bus = bus;
+	return 0;
+}
+
 static void dmix_server_free(snd_pcm_direct_t *dmix)
 {
 	/* remove the memory region */
@@ -161,6 +223,7 @@ static void mix_areas(snd_pcm_direct_t *dmix,
 {
 	unsigned int src_step, dst_step;
 	unsigned int chn, dchn, channels, sample_size;
+	unsigned int sum_size = dmix->u.dmix.sum_size;
 	mix_areas_t *do_mix_areas;
 	
 	channels = dmix->channels;
@@ -173,7 +236,14 @@ static void mix_areas(snd_pcm_direct_t *dmix,
 	case SND_PCM_FORMAT_S32_LE:
 	case SND_PCM_FORMAT_S32_BE:
 		sample_size = 4;
-		do_mix_areas = (mix_areas_t *)dmix->u.dmix.mix_areas_32;
+		if (dmix->u.dmix.mix_bus == SND_PCM_DIRECT_MIX_BUS_INT64)
+			do_mix_areas = (mix_areas_t *)dmix->u.dmix.mix_areas_32_64;
+		else
+			do_mix_areas = (mix_areas_t *)dmix->u.dmix.mix_areas_32;
+		break;
+	case SND_PCM_FORMAT_FLOAT:
+		sample_size = 4;
+		do_mix_areas = (mix_areas_t *)dmix->u.dmix.mix_areas_float;
 		break;
 	case SND_PCM_FORMAT_S24_LE:
 		sample_size = 4;
@@ -198,10 +268,11 @@ static void mix_areas(snd_pcm_direct_t *dmix,
 		do_mix_areas(size * channels,
 			     (unsigned char *)dst_areas[0].addr + sample_size * dst_ofs * channels,
 			     (unsigned char *)src_areas[0].addr + sample_size * src_ofs * channels,
-			     dmix->u.dmix.sum_buffer + dst_ofs * channels,
+			     (signed int *)((char *)dmix->u.dmix.sum_buffer +
+					    sum_size * dst_ofs * channels),
 			     sample_size,
 			     sample_size,
-			     sizeof(signed int));
+			     sum_size);
 		return;
 	}
 	for (chn = 0; chn < channels; chn++) {
@@ -213,10 +284,11 @@ static void mix_areas(snd_pcm_direct_t *dmix,
 		do_mix_areas(size,
 			     ((unsigned char *)dst_areas[dchn].addr + dst_areas[dchn].first / 8) + dst_ofs * dst_step,
 			     ((unsigned char *)src_areas[chn].addr + src_areas[chn].first / 8) + src_ofs * src_step,
-			     dmix->u.dmix.sum_buffer + dmix->shmptr->s.channels * dst_ofs + dchn,
+			     (signed int *)((char *)dmix->u.dmix.sum_buffer +
+					    sum_size * (dmix->shmptr->s.channels * dst_ofs + dchn)),
 			     dst_step,
 			     src_step,
-			     dmix->shmptr->s.channels * sizeof(signed int));
+			     dmix->shmptr->s.channels * sum_size);
 	}
 }
 
@@ -229,6 +301,7 @@ static void remix_areas(snd_pcm_direct_t *dmix,
 {
 	unsigned int src_step, dst_step;
 	unsigned int chn, dchn, channels, sample_size;
+	unsigned int sum_size = dmix->u.dmix.sum_size;
 	mix_areas_t *do_remix_areas;
 	
 	channels = dmix->channels;
@@ -241,7 +314,14 @@ static void remix_areas(snd_pcm_direct_t *dmix,
 	case SND_PCM_FORMAT_S32_LE:
 	case SND_PCM_FORMAT_S32_BE:
 		sample_size = 4;
-		do_remix_areas = (mix_areas_t *)dmix->u.dmix.remix_areas_32;
+		if (dmix->u.dmix.mix_bus == SND_PCM_DIRECT_MIX_BUS_INT64)
+			do_remix_areas = (mix_areas_t *)dmix->u.dmix.remix_areas_32_64;
+		else
+			do_remix_areas = (mix_areas_t *)dmix->u.dmix.remix_areas_32;
+		break;
+	case SND_PCM_FORMAT_FLOAT:
+		sample_size = 4;
+		do_remix_areas = (mix_areas_t *)dmix->u.dmix.remix_areas_float;
 		break;
 	case SND_PCM_FORMAT_S24_LE:
 		sample_size = 4;
@@ -266,10 +346,11 @@ static void remix_areas(snd_pcm_direct_t *dmix,
 		do_remix_areas(size * channels,
 			       (unsigned char *)dst_areas[0].addr + sample_size * dst_ofs * channels,
 			       (unsigned char *)src_areas[0].addr + sample_size * src_ofs * channels,
-			       dmix->u.dmix.sum_buffer + dst_ofs * channels,
+			       (signed int *)((char *)dmix->u.dmix.sum_buffer +
+					      sum_size * dst_ofs * channels),
 			       sample_size,
 			       sample_size,
-			       sizeof(signed int));
+			       sum_size);
 		return;
 	}
 	for (chn = 0; chn < channels; chn++) {
@@ -281,10 +362,11 @@ static void remix_areas(snd_pcm_direct_t *dmix,
 		do_remix_areas(size,
 			       ((unsigned char *)dst_areas[dchn].addr + dst_areas[dchn].first / 8) + dst_ofs * dst_step,
 			       ((unsigned char *)src_areas[chn].addr + src_areas[chn].first / 8) + src_ofs * src_step,
-			       dmix->u.dmix.sum_buffer + dmix->shmptr->s.channels * dst_ofs + dchn,
+			       (signed int *)((char *)dmix->u.dmix.sum_buffer +
+					      sum_size * (dmix->shmptr->s.channels * dst_ofs + dchn)),
 			       dst_step,
 			       src_step,
-			       dmix->shmptr->s.channels * sizeof(signed int));
+			       dmix->shmptr->s.channels * sum_size);
 	}
 }
 
@@ -295,13 +377,21 @@ static void remix_areas(snd_pcm_direct_t *dmix,
 #ifndef DOC_HIDDEN
 static void dmix_down_sem(snd_pcm_direct_t *dmix)
 {
-	if (dmix->u.dmix.use_sem)
+	if (!dmix->u.dmix.use_sem)
+		return;
+	if (dmix->futex_lock)
+		snd_pcm_direct_futex_down(dmix);
+	else
 		snd_pcm_direct_semaphore_down(dmix, DIRECT_IPC_SEM_CLIENT);
 }
 
 static void dmix_up_sem(snd_pcm_direct_t *dmix)
 {
-	if (dmix->u.dmix.use_sem)
+	if (!dmix->u.dmix.use_sem)
+		return;
+	if (dmix->futex_lock)
+		snd_pcm_direct_futex_up(dmix);
+	else
 		snd_pcm_direct_semaphore_up(dmix, DIRECT_IPC_SEM_CLIENT);
 }
 #endif
@@ -429,8 +519,9 @@ static int snd_pcm_dmix_sync_ptr(snd_pcm_t *pcm)
 	int err;
 
 	if (dmix->slowptr)
-		snd_pcm_hwsync(dmix->spcm);
-	slave_hw_ptr = *dmix->spcm->hw.ptr;
+		slave_hw_ptr = snd_pcm_direct_hwsync(dmix, NULL);
+	else
+		slave_hw_ptr = *dmix->spcm->hw.ptr;
 	err = snd_pcm_direct_check_xrun(dmix, pcm);
 	if (err < 0)
 		return err;
@@ -940,6 +1031,7 @@ static const snd_pcm_fast_ops_t snd_pcm_dmix_fast_ops = {
 	.poll_descriptors = snd_pcm_direct_poll_descriptors,
 	.poll_descriptors_count = NULL,
 	.poll_revents = snd_pcm_dmix_poll_revents,
+	.wait = snd_pcm_direct_wait,
 };
 
 /**
@@ -988,6 +1080,7 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 	dmix->var_periodsize = opts->var_periodsize;
 	dmix->hw_ptr_alignment = opts->hw_ptr_alignment;
 	dmix->sync_ptr = snd_pcm_dmix_sync_ptr;
+	dmix->sync_area = snd_pcm_dmix_sync_area;
 	dmix->direct_memory_access = opts->direct_memory_access;
 
  retry:
@@ -1073,6 +1166,11 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 		dmix->spcm = spcm;
 	}
 
+	ret = dmix_select_mix_bus(dmix, opts->mix_bus, first_instance);
+	if (ret < 0)
+		goto _err;
+
+	dmix->u.dmix.hugepages = opts->hugepages;
 	ret = shm_sum_create_or_connect(dmix);
 	if (ret < 0) {
 		SNDERR("unable to initialize sum ring buffer");
@@ -1085,7 +1183,19 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 		goto _err;
 	}
 
-	mix_select_callbacks(dmix);
+	/* the arch specific code handles only the int32 bus */
+	if (dmix->u.dmix.mix_bus == SND_PCM_DIRECT_MIX_BUS_INT32)
+		mix_select_callbacks(dmix);
+	else
+		generic_mix_select_callbacks(dmix);
+	/* the lock type matters only when mixing under the lock */
+	if (!dmix->u.dmix.use_sem)
+		dmix->futex_lock = 0;
+	if (first_instance) {
+		if (dmix->futex_lock && snd_pcm_direct_futex_init(dmix) < 0)
+			dmix->futex_lock = 0;
+		dmix->shmptr->magic = snd_pcm_direct_magic(dmix);
+	}
 		
 	pcm->poll_fd = dmix->poll_fd;
 	pcm->poll_events = POLLIN;	/* it's different than other plugins */
@@ -1129,9 +1239,10 @@ int snd_pcm_dmix_open(snd_pcm_t **pcmp, const char *name,
 
 \section pcm_plugins_dmix Plugin: dmix
 
-This plugin provides direct mixing of multiple streams. The resolution
-for 32-bit mixing is only 24-bit. The low significant byte is filled with
-zeros. The extra 8 bits are used for the saturation.
+This plugin provides direct mixing of multiple streams. With the default
+mix bus, the resolution for 32-bit mixing is only 24-bit. The low
+significant byte is filled with zeros. The extra 8 bits are used for the
+saturation.
 
 \code
 pcm.name {
@@ -1148,6 +1259,19 @@ pcm.name {
 	tstamp_type STR		# timestamp type
 				# STR can be one of the below strings :
 				# default, gettimeofday, monotonic, monotonic_raw
+	futex_lock BOOL		# mix under a futex in the shared memory
+				# instead of the IPC semaphore (default no)
+	mix_bus STR		# sum format
+				# STR can be one of the below strings :
+				# auto (default)
+				# int32
+				# int64 (S32 slaves only)
+				# float (FLOAT slaves only)
+	hugepages STR		# pages of the sum buffer
+				# STR can be one of the below strings :
+				# no
+				# thp (default)
+				# hugetlb
 	slave STR
 	# or
 	slave {			# Slave definition
@@ -1169,6 +1293,10 @@ pcm.name {
 		N INT		# maps slave channel to client channel N
 	}
 	slowptr BOOL		# slow but more precise pointer updates
+	hw_ptr_cache INT	# max. age of a slave pointer shared between
+				# clients in usec (0 = disabled, default 0)
+	shared_wakeup BOOL	# blocking waits sleep on a shared futex
+				# instead of each client's timer (default no)
 }
 \endcode
 
@@ -1201,6 +1329,61 @@ the possible configurations:
   case of a dependency to another sound device (e.g. forwarding of
   microphone to speaker). Else "no" will be chosen.
 
+<code>mix_bus</code> specifies the format of the shared sum buffer.
+- int32: 32-bit sums, S32 samples are mixed with 24-bit resolution
+- int64: 64-bit sums for S32 slaves, the full 32-bit resolution is kept
+  and only the result written to the device is clipped
+- float: float sums for FLOAT slaves (native endian), the result written
+  to the device is clipped to [-1.0, 1.0]
+- auto: float for FLOAT slaves, int32 otherwise
+All clients sharing the same <code>ipc_key</code> must use the same
+mix bus. The int64 and float buses always mix under the lock (see
+<code>futex_lock</code> below). Older alsa-lib versions know only the
+int32 bus and cannot join an instance using another one. A FLOAT-only
+device is selected automatically when the slave format is not given.
+
+<code>hugepages</code> selects the pages backing the shared sum buffer,
+which is large for setups with many channels.
+- no: regular pages
+- thp: advise transparent huge pages; this takes effect when
+  /sys/kernel/mm/transparent_hugepage/shmem_enabled is "advise" or
+  "within_size"
+- hugetlb: huge pages reserved through /proc/sys/vm/nr_hugepages; the
+  user must be allowed to use them (vm/hugetlb_shm_group). Without
+  such pages, thp is used instead.
+The client creating the sum buffer decides; the others join it as it
+is. The sum buffer is locked in memory when the limits allow.
+
+When the clients mix under a lock (the generic mixing code used on
+non-x86 architectures, with <code>direct_memory_access</code> off or
+with the wide mix buses), <code>futex_lock true</code> selects a robust
+process shared mutex placed in the shared memory instead of the IPC
+semaphore, which costs no system call when there is no contention. The
+kernel releases the lock of a crashed client, also across PID
+namespaces (containers, sandboxed applications). The futex is used only
+when the client creating the instance asks for it, and then every other
+client must set <code>futex_lock true</code> as well and run with the
+same word size; other clients, including older alsa-lib versions, fail
+to open. A client asking for the futex joins an instance mixing under
+the semaphore with the semaphore. Instances which mix without a lock
+are not affected.
+
+With <code>slowptr</code> and a non-zero <code>hw_ptr_cache</code>, the
+slave pointer synced by one client is published in the shared memory
+and the other clients reuse it instead of syncing the slave themselves
+as long as it is not older than <code>hw_ptr_cache</code> microseconds.
+A published pointer behind a client's own one is never used. The same
+option exists for the dsnoop and dshare plugins.
+
+With <code>shared_wakeup</code>, a client blocked in snd_pcm_writei(),
+snd_pcm_wait() or snd_pcm_drain() does not wake up on each tick of its
+own slave timer. Only one of the waiting clients polls its timer and
+wakes the others when their avail reaches avail_min. Applications
+polling the descriptors themselves are not affected. Up to 32 clients
+per <code>ipc_key</code> can wait this way, the others fall back to
+their own timer. The same option exists for the dsnoop and dshare
+plugins.
+
 Note that the dmix plugin itself supports only a single configuration.
 That is, it supports only the fixed rate (default 48000), format
 (\c S16), channels (2), and period_time (125000).
@@ -117,14 +117,15 @@ static void mix_select_callbacks(snd_pcm_direct_t *dmix)
 
 #else
 
-/* non-concurrent version, supporting both endians */
+/* non-concurrent version, supporting both endians (FLOAT native only) */
 #define generic_dmix_supported_format \
 	((1ULL << SND_PCM_FORMAT_S16_LE) | (1ULL << SND_PCM_FORMAT_S32_LE) |\
 	 (1ULL << SND_PCM_FORMAT_S16_BE) | (1ULL << SND_PCM_FORMAT_S32_BE) |\
 	 (1ULL << SND_PCM_FORMAT_S24_LE) | (1ULL << SND_PCM_FORMAT_S24_3LE) | \
-	 (1ULL << SND_PCM_FORMAT_U8))
+	 (1ULL << SND_PCM_FORMAT_U8) | (1ULL << SND_PCM_FORMAT_FLOAT))
 
 #include "bswap.h"
+#include "pcm_simd.h"
 
 static void generic_mix_areas_16_native(unsigned int size,
 					volatile signed short *dst,
@@ -511,20 +512,231 @@ static void generic_remix_areas_u8(unsigned int size,
 	}
 }
 
+/*
+ * wide mix buses: the sum keeps the full source resolution and only the
+ * destination is clipped, so remix restores the other streams exactly
+ */
+static void generic_mix_areas_32_64_native(unsigned int size,
+					   volatile signed int *dst,
+					   signed int *src,
+					   volatile long long *sum,
+					   size_t dst_step,
+					   size_t src_step,
+					   size_t sum_step)
+{
+	register long long sample;
+
+	for (;;) {
+		sample = *src;
+		if (*dst)
+			sample += *sum;
+		*sum = sample;
+		if (sample > 0x7fffffff)
+			sample = 0x7fffffff;
+		else if (sample < -0x80000000LL)
+			sample = -0x80000000LL;
+		*dst = sample;
+		if (!--size)
+			return;
+		src = (signed int *) ((char *)src + src_step);
+		dst = (signed int *) ((char *)dst + dst_step);
+		sum = (long long *)  ((char *)sum + sum_step);
+	}
+}
+
+static void generic_remix_areas_32_64_native(unsigned int size,
+					     volatile signed int *dst,
+					     signed int *src,
+					     volatile long long *sum,
+					     size_t dst_step,
+					     size_t src_step,
+					     size_t sum_step)
+{
+	register long long sample;
+
+	for (;;) {
+		sample = -(long long)*src;
+		if (*dst)
+			sample += *sum;
+		*sum = sample;
+		if (sample > 0x7fffffff)
+			sample = 0x7fffffff;
+		else if (sample < -0x80000000LL)
+			sample = -0x80000000LL;
+		*dst = sample;
+		if (!--size)
+			return;
+		src = (signed int *) ((char *)src + src_step);
+		dst = (signed int *) ((char *)dst + dst_step);
+		sum = (long long *)  ((char *)sum + sum_step);
+	}
+}
+
+static void generic_mix_areas_32_64_swap(unsigned int size,
+					 volatile signed int *dst,
+					 signed int *src,
+					 volatile long long *sum,
+					 size_t dst_step,
+					 size_t src_step,
+					 size_t sum_step)
+{
+	register long long sample;
+
+	for (;;) {
+		sample = (signed int) bswap_32(*src);
+		if (*dst)
+			sample += *sum;
+		*sum = sample;
+		if (sample > 0x7fffffff)
+			sample = 0x7fffffff;
+		else if (sample < -0x80000000LL)
+			sample = -0x80000000LL;
+		*dst = bswap_32((signed int) sample);
+		if (!--size)
+			return;
+		src = (signed int *) ((char *)src + src_step);
+		dst = (signed int *) ((char *)dst + dst_step);
+		sum = (long long *)  ((char *)sum + sum_step);
+	}
+}
+
+static void generic_remix_areas_32_64_swap(unsigned int size,
+					   volatile signed int *dst,
+					   signed int *src,
+					   volatile long long *sum,
+					   size_t dst_step,
+					   size_t src_step,
+					   size_t sum_step)
+{
+	register long long sample;
+
+	for (;;) {
+		sample = -(long long)(signed int) bswap_32(*src);
+		if (*dst)
+			sample += *sum;
+		*sum = sample;
+		if (sample > 0x7fffffff)
+			sample = 0x7fffffff;
+		else if (sample < -0x80000000LL)
+			sample = -0x80000000LL;
+		*dst = bswap_32((signed int) sample);
+		if (!--size)
+			return;
+		src = (signed int *) ((char *)src + src_step);
+		dst = (signed int *) ((char *)dst + dst_step);
+		sum = (long long *)  ((char *)sum + sum_step);
+	}
+}
+
+/* native endian only, the output is clipped to [-1.0, 1.0] */
+static void generic_mix_areas_float(unsigned int size,
+				    volatile float *dst,
+				    float *src,
+				    volatile float *sum,
+				    size_t dst_step,
+				    size_t src_step,
+				    size_t sum_step)
+{
+	register float sample;
+
+	for (;;) {
+		sample = *src;
+		if (*dst != 0.0f)
+			sample += *sum;
+		*sum = sample;
+		if (sample > 1.0f)
+			sample = 1.0f;
+		else if (sample < -1.0f)
+			sample = -1.0f;
+		*dst = sample;
+		if (!--size)
+			return;
+		src = (float *) ((char *)src + src_step);
+		dst = (float *) ((char *)dst + dst_step);
+		sum = (float *) ((char *)sum + sum_step);
+	}
+}
+
+static void generic_remix_areas_float(unsigned int size,
+				      volatile float *dst,
+				      float *src,
+				      volatile float *sum,
+				      size_t dst_step,
+				      size_t src_step,
+				      size_t sum_step)
+{
+	register float sample;
+
+	for (;;) {
+		sample = -*src;
+		if (*dst != 0.0f)
+			sample += *sum;
+		*sum = sample;
+		if (sample > 1.0f)
+			sample = 1.0f;
+		else if (sample < -1.0f)
+			sample = -1.0f;
+		*dst = sample;
+		if (!--size)
+			return;
+		src = (float *) ((char *)src + src_step);
+		dst = (float *) ((char *)dst + dst_step);
+		sum = (float *) ((char *)sum + sum_step);
+	}
+}
+
+/*
+ * The generic callbacks run with the client semaphore held (use_sem), so
+ * the caller owns the whole sum buffer while mixing and no atomic access
+ * is needed.  Contiguous runs (interleaved slave and client) go to the
+ * vector kernels, which give the same sums and samples as the loops above.
+ */
+#define GENERIC_MIX_BLOCK(name, type, func, fallback)			\
+static void name(unsigned int size,					\
+		 volatile type *dst,					\
+		 type *src,						\
+		 volatile signed int *sum,				\
+		 size_t dst_step,					\
+		 size_t src_step,					\
+		 size_t sum_step)					\
+{									\
+	if (dst_step == sizeof(type) && src_step == sizeof(type) &&	\
+	    sum_step == sizeof(signed int))				\
+		snd_pcm_simd_ops()->func((void *)dst, src,		\
+					 (int32_t *)sum, size);		\
+	else								\
+		fallback(size, dst, src, sum,				\
+			 dst_step, src_step, sum_step);			\
+}
+
+GENERIC_MIX_BLOCK(generic_mix_areas_16_block, signed short, mix_s16,
+		  generic_mix_areas_16_native)
+GENERIC_MIX_BLOCK(generic_remix_areas_16_block, signed short, remix_s16,
+		  generic_remix_areas_16_native)
+GENERIC_MIX_BLOCK(generic_mix_areas_32_block, signed int, mix_s32,
+		  generic_mix_areas_32_native)
+GENERIC_MIX_BLOCK(generic_remix_areas_32_block, signed int, remix_s32,
+		  generic_remix_areas_32_native)
 
 static void generic_mix_select_callbacks(snd_pcm_direct_t *dmix)
 {
 	if (snd_pcm_format_cpu_endian(dmix->shmptr->s.format)) {
-		dmix->u.dmix.mix_areas_16 = generic_mix_areas_16_native;
-		dmix->u.dmix.mix_areas_32 = generic_mix_areas_32_native;
-		dmix->u.dmix.remix_areas_16 = generic_remix_areas_16_native;
-		dmix->u.dmix.remix_areas_32 = generic_remix_areas_32_native;
+		dmix->u.dmix.mix_areas_16 = generic_mix_areas_16_block;
+		dmix->u.dmix.mix_areas_32 = generic_mix_areas_32_block;
+		dmix->u.dmix.remix_areas_16 = generic_remix_areas_16_block;
+		dmix->u.dmix.remix_areas_32 = generic_remix_areas_32_block;
+		dmix->u.dmix.mix_areas_32_64 = generic_mix_areas_32_64_native;
+		dmix->u.dmix.remix_areas_32_64 = generic_remix_areas_32_64_native;
 	} else {
 		dmix->u.dmix.mix_areas_16 = generic_mix_areas_16_swap;
 		dmix->u.dmix.mix_areas_32 = generic_mix_areas_32_swap;
 		dmix->u.dmix.remix_areas_16 = generic_remix_areas_16_swap;
 		dmix->u.dmix.remix_areas_32 = generic_remix_areas_32_swap;
+		dmix->u.dmix.mix_areas_32_64 = generic_mix_areas_32_64_swap;
+		dmix->u.dmix.remix_areas_32_64 = generic_remix_areas_32_64_swap;
 	}
+	dmix->u.dmix.mix_areas_float = generic_mix_areas_float;
+	dmix->u.dmix.remix_areas_float = generic_remix_areas_float;
 	dmix->u.dmix.mix_areas_24 = generic_mix_areas_24;
 	dmix->u.dmix.mix_areas_u8 = generic_mix_areas_u8;
 	dmix->u.dmix.remix_areas_24 = generic_remix_areas_24;
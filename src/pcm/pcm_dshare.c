@@ -112,6 +112,11 @@ static void snd_pcm_dshare_sync_area(snd_pcm_t *pcm)
 	snd_pcm_uframes_t appl_ptr, size;
 	const snd_pcm_channel_area_t *src_areas, *dst_areas;
 	
+	if (dshare->in_place) {
+		/* the client wrote the slave buffer already */
+		dshare->last_appl_ptr = dshare->appl_ptr;
+		return;
+	}
 	/* calculate the size to transfer */
 	size = pcm_frame_diff(dshare->appl_ptr, dshare->last_appl_ptr, pcm->boundary);
 	if (! size)
@@ -162,10 +167,38 @@ static void snd_pcm_dshare_sync_area(snd_pcm_t *pcm)
 static int snd_pcm_dshare_sync_ptr0(snd_pcm_t *pcm, snd_pcm_uframes_t slave_hw_ptr)
 {
 	snd_pcm_direct_t *dshare = pcm->private_data;
-	snd_pcm_uframes_t old_slave_hw_ptr, avail;
+	snd_pcm_uframes_t old_slave_hw_ptr, avail, queued;
 	snd_pcm_sframes_t diff;
 
 	old_slave_hw_ptr = dshare->slave_hw_ptr;
+	if (dshare->in_place) {
+		/* whole slave periods only: hw_ptr is the start of the period
+		 * being played, so hw_ptr + buffer_size ends the writable
+		 * area right before it; the pointers start one period ahead
+		 * of the slave, see snd_pcm_dshare_align_ptr()
+		 */
+		if (dshare->state != SND_PCM_STATE_RUNNING &&
+		    dshare->state != SND_PCM_STATE_DRAINING)
+			return 0;
+		slave_hw_ptr -= slave_hw_ptr % dshare->slave_period_size;
+		diff = pcm_frame_diff(slave_hw_ptr, old_slave_hw_ptr, dshare->slave_boundary);
+		if ((snd_pcm_uframes_t)diff >= dshare->slave_boundary / 2)
+			return 0;
+		/* a running client must have written the period being played
+		 * completely, otherwise it would write the rest of it while
+		 * it is played: move the pointers past that period, which
+		 * reports the underrun
+		 */
+		if (diff && dshare->state == SND_PCM_STATE_RUNNING) {
+			queued = pcm_frame_diff(dshare->appl_ptr,
+						(dshare->hw_ptr + diff) % pcm->boundary,
+						pcm->boundary);
+			if (queued < dshare->slave_period_size ||
+			    queued > pcm->buffer_size)
+				slave_hw_ptr = (slave_hw_ptr + dshare->slave_period_size) %
+					       dshare->slave_boundary;
+		}
+	}
 	dshare->slave_hw_ptr = slave_hw_ptr;
 	diff = pcm_frame_diff(slave_hw_ptr, old_slave_hw_ptr, dshare->slave_boundary);
 	if (diff == 0)		/* fast path */
@@ -204,8 +237,9 @@ static int snd_pcm_dshare_sync_ptr(snd_pcm_t *pcm)
 	int err;
 
 	if (dshare->slowptr)
-		snd_pcm_hwsync(dshare->spcm);
-	slave_hw_ptr = *dshare->spcm->hw.ptr;
+		slave_hw_ptr = snd_pcm_direct_hwsync(dshare, NULL);
+	else
+		slave_hw_ptr = *dshare->spcm->hw.ptr;
 	err = snd_pcm_direct_check_xrun(dshare, pcm);
 	if (err < 0)
 		return err;
@@ -301,9 +335,44 @@ static int snd_pcm_dshare_hwsync(snd_pcm_t *pcm)
 	}
 }
 
+/*
+ * in place, the client buffer is the slave buffer: start the pointers at
+ * the slave period following the current one, the earliest one still
+ * safe to write
+ */
+static void snd_pcm_dshare_align_ptr(snd_pcm_t *pcm)
+{
+	snd_pcm_direct_t *dshare = pcm->private_data;
+	snd_pcm_uframes_t ptr;
+
+	snd_pcm_hwsync(dshare->spcm);
+	ptr = *dshare->spcm->hw.ptr;
+	ptr -= ptr % dshare->slave_period_size;
+	ptr = (ptr + dshare->slave_period_size) % dshare->slave_boundary;
+	dshare->slave_hw_ptr = dshare->slave_appl_ptr = ptr;
+	dshare->hw_ptr = ptr % pcm->buffer_size;
+	dshare->appl_ptr = dshare->last_appl_ptr = dshare->hw_ptr;
+}
+
+static int snd_pcm_dshare_prepare(snd_pcm_t *pcm)
+{
+	snd_pcm_direct_t *dshare = pcm->private_data;
+	int err;
+
+	err = snd_pcm_direct_prepare(pcm);
+	if (err < 0 || !dshare->in_place)
+		return err;
+	snd_pcm_dshare_align_ptr(pcm);
+	return 0;
+}
+
 static int snd_pcm_dshare_reset(snd_pcm_t *pcm)
 {
 	snd_pcm_direct_t *dshare = pcm->private_data;
+	if (dshare->in_place) {
+		snd_pcm_dshare_align_ptr(pcm);
+		return 0;
+	}
 	dshare->hw_ptr %= pcm->period_size;
 	dshare->appl_ptr = dshare->last_appl_ptr = dshare->hw_ptr;
 	snd_pcm_direct_reset_slave_ptr(pcm, dshare, *dshare->spcm->hw.ptr);
@@ -315,7 +384,9 @@ static int snd_pcm_dshare_start_timer(snd_pcm_t *pcm, snd_pcm_direct_t *dshare)
 	int err;
 
 	snd_pcm_hwsync(dshare->spcm);
-	snd_pcm_direct_reset_slave_ptr(pcm, dshare, *dshare->spcm->hw.ptr);
+	/* in place, the written frames are bound to their slave position */
+	if (!dshare->in_place)
+		snd_pcm_direct_reset_slave_ptr(pcm, dshare, *dshare->spcm->hw.ptr);
 	err = snd_timer_start(dshare->timer);
 	if (err < 0)
 		return err;
@@ -332,8 +403,11 @@ static int snd_pcm_dshare_start(snd_pcm_t *pcm)
 	if (dshare->state != SND_PCM_STATE_PREPARED)
 		return -EBADFD;
 	avail = snd_pcm_mmap_playback_hw_avail(pcm);
-	if (avail == 0)
+	if (avail == 0) {
+		if (dshare->in_place)
+			snd_pcm_dshare_align_ptr(pcm);
 		dshare->state = STATE_RUN_PENDING;
+	}
 	else if (avail < 0)
 		return 0;
 	else {
@@ -433,7 +507,17 @@ static int snd_pcm_dshare_pause(snd_pcm_t *pcm ATTRIBUTE_UNUSED, int enable ATTR
 
 static snd_pcm_sframes_t snd_pcm_dshare_rewindable(snd_pcm_t *pcm)
 {
-	return snd_pcm_mmap_playback_hw_rewindable(pcm);
+	snd_pcm_direct_t *dshare = pcm->private_data;
+	snd_pcm_sframes_t avail;
+
+	avail = snd_pcm_mmap_playback_hw_rewindable(pcm);
+	/* in place, the period starting at hw_ptr is being played */
+	if (dshare->in_place) {
+		avail -= dshare->slave_period_size;
+		if (avail < 0)
+			avail = 0;
+	}
+	return avail;
 }
 
 static snd_pcm_sframes_t snd_pcm_dshare_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t frames)
@@ -612,7 +696,7 @@ static const snd_pcm_fast_ops_t snd_pcm_dshare_fast_ops = {
 	.state = snd_pcm_dshare_state,
 	.hwsync = snd_pcm_dshare_hwsync,
 	.delay = snd_pcm_dshare_delay,
-	.prepare = snd_pcm_direct_prepare,
+	.prepare = snd_pcm_dshare_prepare,
 	.reset = snd_pcm_dshare_reset,
 	.start = snd_pcm_dshare_start,
 	.drop = snd_pcm_dshare_drop,
@@ -636,6 +720,7 @@ static const snd_pcm_fast_ops_t snd_pcm_dshare_fast_ops = {
 	.poll_descriptors = snd_pcm_direct_poll_descriptors,
 	.poll_descriptors_count = NULL,
 	.poll_revents = snd_pcm_direct_poll_revents,
+	.wait = snd_pcm_direct_wait,
 };
 
 /**
@@ -873,9 +958,26 @@ pcm.name {
 		N INT		# maps slave channel to client channel N
 	}
 	slowptr BOOL		# slow but more precise pointer updates
+	hw_ptr_cache INT	# max. age of a slave pointer shared between
+				# clients in usec (0 = disabled, default 0)
+	shared_wakeup BOOL	# blocking waits sleep on a shared futex
+				# instead of each client's timer (default no)
+	zero_copy BOOL		# write the slave buffer in place when possible
 }
 \endcode
 
+With <code>zero_copy</code>, a client with the slave's buffer size and
+format writes its bound slave channels in place instead of having
+each period copied. With the MMAP_INTERLEAVED and MMAP_NONINTERLEAVED
+accesses, the bound slave channels must have exactly the layout of
+the access. The pointers of such a client advance in whole slave
+periods and start at the slave period following the one being played
+at prepare (or at start, when nothing was written before), so frames
+written ahead of start begin to play within two periods of prepare.
+Such a client must always have the next slave period written when the
+device enters it; a period not written completely in time is counted
+as an underrun, as the rest of it would be written while it is played.
+
 <code>hw_ptr_alignment</code> specifies slave application and hw
 pointer alignment type. By default hw_ptr_alignment is auto. Below are
 the possible configurations:
@@ -107,6 +107,9 @@ static void snd_pcm_dsnoop_sync_area(snd_pcm_t *pcm, snd_pcm_uframes_t slave_hw_
 	snd_pcm_uframes_t transfer;
 	const snd_pcm_channel_area_t *src_areas, *dst_areas;
 	
+	/* the frames are read from the slave buffer directly */
+	if (dsnoop->in_place)
+		return;
 	/* add sample areas here */
 	dst_areas = snd_pcm_mmap_areas(pcm);
 	src_areas = snd_pcm_mmap_areas(dsnoop->spcm);
@@ -135,10 +138,12 @@ static int snd_pcm_dsnoop_sync_ptr(snd_pcm_t *pcm)
 	snd_pcm_sframes_t diff;
 	int err;
 
-	if (dsnoop->slowptr)
-		snd_pcm_hwsync(dsnoop->spcm);
 	old_slave_hw_ptr = dsnoop->slave_hw_ptr;
-	snoop_timestamp(pcm);
+	if (dsnoop->slowptr)
+		dsnoop->slave_hw_ptr =
+			snd_pcm_direct_hwsync(dsnoop, &dsnoop->update_tstamp);
+	else
+		snoop_timestamp(pcm);
 	slave_hw_ptr = dsnoop->slave_hw_ptr;
 	err = snd_pcm_direct_check_xrun(dsnoop, pcm);
 	if (err < 0)
@@ -247,12 +252,23 @@ static int snd_pcm_dsnoop_hwsync(snd_pcm_t *pcm)
 	}
 }
 
+/* in place, our buffer offsets must be those of the slave */
+static void snd_pcm_dsnoop_align_ptr(snd_pcm_t *pcm)
+{
+	snd_pcm_direct_t *dsnoop = pcm->private_data;
+
+	if (dsnoop->in_place)
+		dsnoop->hw_ptr = dsnoop->appl_ptr =
+			dsnoop->slave_hw_ptr % pcm->buffer_size;
+}
+
 static int snd_pcm_dsnoop_reset(snd_pcm_t *pcm)
 {
 	snd_pcm_direct_t *dsnoop = pcm->private_data;
 	dsnoop->hw_ptr %= pcm->period_size;
 	dsnoop->appl_ptr = dsnoop->hw_ptr;
 	snd_pcm_direct_reset_slave_ptr(pcm, dsnoop, dsnoop->slave_hw_ptr);
+	snd_pcm_dsnoop_align_ptr(pcm);
 	return 0;
 }
 
@@ -266,6 +282,7 @@ static int snd_pcm_dsnoop_start(snd_pcm_t *pcm)
 	snd_pcm_hwsync(dsnoop->spcm);
 	snoop_timestamp(pcm);
 	snd_pcm_direct_reset_slave_ptr(pcm, dsnoop, dsnoop->slave_hw_ptr);
+	snd_pcm_dsnoop_align_ptr(pcm);
 	err = snd_timer_start(dsnoop->timer);
 	if (err < 0)
 		return err;
@@ -508,6 +525,7 @@ static const snd_pcm_fast_ops_t snd_pcm_dsnoop_fast_ops = {
 	.poll_descriptors = snd_pcm_direct_poll_descriptors,
 	.poll_descriptors_count = NULL,
 	.poll_revents = snd_pcm_direct_poll_revents,
+	.wait = snd_pcm_direct_wait,
 };
 
 /**
@@ -727,9 +745,21 @@ pcm.name {
 		N INT		# maps slave channel to client channel N
 	}
 	slowptr BOOL		# slow but more precise pointer updates
+	hw_ptr_cache INT	# max. age of a slave pointer shared between
+				# clients in usec (0 = disabled, default 0)
+	zero_copy BOOL		# read the slave buffer in place when possible
+	shared_wakeup BOOL	# blocking waits sleep on a shared futex
+				# instead of each client's timer (default no)
 }
 \endcode
 
+With <code>zero_copy</code>, a client with the slave's buffer size
+maps the slave buffer itself instead of receiving a copy of each
+period. With the MMAP_INTERLEAVED and MMAP_NONINTERLEAVED accesses,
+the bound slave channels must have exactly the layout of the access.
+Such a client must read in time: frames older than buffer_size minus
+one period may be overwritten by the device already.
+
 <code>hw_ptr_alignment</code> specifies slave application and hw
 pointer alignment type. By default hw_ptr_alignment is auto. Below are
 the possible configurations:
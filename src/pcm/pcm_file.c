@@ -31,6 +31,12 @@
 #include "bswap.h"
 #include <ctype.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#include <semaphore.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -49,6 +55,18 @@ const char *_snd_module_pcm_file = "";
 /* maximum length of a value */
 #define VALUE_MAXLEN	64
 
+/* default length of the async writer ring in ms */
+#define ASYNC_TIME_DEFAULT	2000
+/* the writer thread gathers the ring data to blocks of this size */
+#define ASYNC_BLOCK_BYTES	(64 * 1024)
+/* offset and length alignment of O_DIRECT writes */
+#define ASYNC_DIRECT_ALIGN	4096
+
+/* the input file is mapped in windows of this size */
+#define INFILE_MAP_BYTES	(32 * 1024 * 1024)
+/* and the pages are requested this far ahead of the read position */
+#define INFILE_READAHEAD_BYTES	(2 * 1024 * 1024)
+
 typedef enum _snd_pcm_file_format {
 	SND_PCM_FILE_FORMAT_RAW,
 	SND_PCM_FILE_FORMAT_WAV
@@ -64,6 +82,29 @@ struct wav_fmt {
 	short bits;
 };
 
+#ifdef HAVE_LIBPTHREAD
+/*
+ * Single producer, single consumer ring between the stream and the writer
+ * thread. head is advanced by the stream only, tail by the writer only.
+ */
+typedef struct {
+	char *ring;
+	size_t mask;			/* ring size - 1, the size is a power of two */
+	size_t head;			/* bytes pushed */
+	size_t tail;			/* bytes taken by the writer */
+	size_t hdr;			/* WAV header bytes pushed before the data */
+	char *blk;			/* aligned gather block, writer owned */
+	size_t blk_used;
+	size_t written;			/* bytes written to fd by the writer */
+	int fd;
+	int direct;			/* O_DIRECT is set on fd */
+	int quit;
+	int err;			/* last write error, cleared by the stream */
+	sem_t wake;
+	pthread_t thread;
+} snd_pcm_file_writer_t;
+#endif
+
 typedef struct {
 	snd_pcm_generic_t gen;
 	char *fname;
@@ -90,6 +131,22 @@ typedef struct {
 	struct wav_fmt wav_header;
 	size_t filelen;
 	char ifmmap_overwritten;
+	int imap_mode;			/* 0 undecided, 1 mapped input, -1 read() */
+	char *imap;			/* mapped window of the input file */
+	off_t imap_off;			/* file offset of imap */
+	size_t imap_len;
+	off_t ipos;			/* input read position */
+	off_t isize;			/* input file size */
+	off_t ira;			/* readahead requested up to here */
+	int isealed;			/* the input file cannot shrink */
+	int async;			/* write from a separate thread */
+	int direct;			/* O_DIRECT output in async mode */
+	unsigned int async_time;	/* ring length in ms */
+	snd_pcm_uframes_t async_dropped; /* frames lost to ring overruns */
+	unsigned int async_overruns;
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_file_writer_t *writer;
+#endif
 } snd_pcm_file_t;
 
 #if __BYTE_ORDER == __LITTLE_ENDIAN
@@ -286,6 +343,130 @@ static int snd_pcm_file_open_output_file(snd_pcm_file_t *file)
 	return 0;
 }
 
+/*
+ * A regular input file is read through a mapping, so the samples are
+ * copied once from the page cache to the areas. The mapping is a sliding
+ * window, which keeps the address space and the resident set bounded for
+ * huge files, and the kernel is asked to read ahead of the position.
+ * Access to a mapping beyond the end of a truncated file raises SIGBUS,
+ * so the size is checked before each copy and only the part still in
+ * the file is copied; files sealed against shrinking (memfd) skip the
+ * check.
+ *
+ * The mapped reads do not move the file offset of the input descriptor.
+ */
+static void snd_pcm_file_infile_unmap(snd_pcm_file_t *file)
+{
+	if (file->imap) {
+		munmap(file->imap, file->imap_len);
+		file->imap = NULL;
+	}
+}
+
+static int snd_pcm_file_infile_sealed(int fd)
+{
+#ifdef F_GET_SEALS
+	int seals = fcntl(fd, F_GET_SEALS);
+
+	return seals >= 0 && (seals & F_SEAL_SHRINK);
+#else
+	return 0;
+#endif
+}
+
+static void snd_pcm_file_infile_setup(snd_pcm_file_t *file)
+{
+	struct stat st;
+
+	file->imap_mode = -1;
+	if (fstat(file->ifd, &st) < 0 || !S_ISREG(st.st_mode))
+		return;
+	if (file->rbuf_size_bytes + page_size() > INFILE_MAP_BYTES)
+		return;
+	file->ipos = lseek(file->ifd, 0, SEEK_CUR);
+	if (file->ipos < 0)
+		return;
+	file->isize = st.st_size;
+	file->ira = file->ipos;
+	file->isealed = snd_pcm_file_infile_sealed(file->ifd);
+	file->imap_mode = 1;
+}
+
+/* return the mapped data at ipos, bytes must be within the file */
+static const char *snd_pcm_file_infile_map(snd_pcm_file_t *file, size_t bytes)
+{
+	off_t off, ra_end;
+	size_t len;
+	void *addr;
+
+	if (!file->imap || file->ipos < file->imap_off ||
+	    file->ipos + (off_t)bytes > file->imap_off + (off_t)file->imap_len) {
+		snd_pcm_file_infile_unmap(file);
+		off = file->ipos & ~(off_t)(page_size() - 1);
+		len = INFILE_MAP_BYTES;
+		if ((off_t)len > file->isize - off)
+			len = file->isize - off;
+		addr = mmap(NULL, len, PROT_READ, MAP_SHARED, file->ifd, off);
+		if (addr == MAP_FAILED)
+			return NULL;
+		madvise(addr, len, MADV_SEQUENTIAL);
+		file->imap = addr;
+		file->imap_off = off;
+		file->imap_len = len;
+		if (file->ira < off)
+			file->ira = off;
+	}
+	/* keep the readahead one chunk ahead within the window */
+	if (file->ira < file->ipos + INFILE_READAHEAD_BYTES) {
+		ra_end = file->imap_off + file->imap_len;
+		if (ra_end > file->ira + INFILE_READAHEAD_BYTES)
+			ra_end = file->ira + INFILE_READAHEAD_BYTES;
+		if (ra_end > file->ira) {
+			off = file->ira & ~(off_t)(page_size() - 1);
+			madvise(file->imap + (off - file->imap_off),
+				ra_end - off, MADV_WILLNEED);
+			file->ira = ra_end;
+		}
+	}
+	return file->imap + (file->ipos - file->imap_off);
+}
+
+static int snd_pcm_file_areas_map_infile(snd_pcm_t *pcm,
+					 const snd_pcm_channel_area_t *areas,
+					 snd_pcm_uframes_t offset,
+					 snd_pcm_uframes_t frames)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_channel_area_t areas_if[pcm->channels];
+	const char *data;
+	size_t bytes = snd_pcm_frames_to_bytes(pcm, frames);
+	struct stat st;
+
+	/* the file may grow, and unless sealed it may also shrink */
+	if (!file->isealed || file->ipos + (off_t)bytes > file->isize) {
+		if (fstat(file->ifd, &st) < 0)
+			return -errno;
+		file->isize = st.st_size;
+	}
+	if (file->ipos + (off_t)bytes > file->isize) {
+		if (file->isize <= file->ipos)
+			return 0;
+		frames = snd_pcm_bytes_to_frames(pcm, file->isize - file->ipos);
+		bytes = snd_pcm_frames_to_bytes(pcm, frames);
+		if (!bytes)
+			return 0;
+	}
+	data = snd_pcm_file_infile_map(file, bytes);
+	if (!data) {
+		SYSERR("mmap of input file failed");
+		return -errno;
+	}
+	snd_pcm_areas_from_buf(pcm, areas_if, (void *)data);
+	snd_pcm_areas_copy(areas, offset, areas_if, 0, pcm->channels, frames, pcm->format);
+	file->ipos += bytes;
+	return bytes;
+}
+
 /* fill areas with data from input file, return bytes red */
 static int snd_pcm_file_areas_read_infile(snd_pcm_t *pcm,
 					  const snd_pcm_channel_area_t *areas,
@@ -307,6 +488,11 @@ static int snd_pcm_file_areas_read_infile(snd_pcm_t *pcm,
 		return -ENOMEM;
 	}
 
+	if (!file->imap_mode)
+		snd_pcm_file_infile_setup(file);
+	if (file->imap_mode > 0)
+		return snd_pcm_file_areas_map_infile(pcm, areas, offset, frames);
+
 	bytes = snd_pcm_frames_to_bytes(pcm, frames);
 	if (bytes < 0)
 		return bytes;
@@ -335,35 +521,36 @@ static void setup_wav_header(snd_pcm_t *pcm, struct wav_fmt *fmt)
 	fmt->bits = TO_LE16(fmt->bits);
 }
 
+static const char wav_riff_chunk[] = {
+	'R', 'I', 'F', 'F',
+	0x24, 0, 0, 0,
+	'W', 'A', 'V', 'E',
+	'f', 'm', 't', ' ',
+	0x10, 0, 0, 0,
+};
+
+static const char wav_data_chunk[] = {
+	'd', 'a', 't', 'a',
+	0, 0, 0, 0
+};
+
 static int write_wav_header(snd_pcm_t *pcm)
 {
 	snd_pcm_file_t *file = pcm->private_data;
 	ssize_t res;
 
-	static const char header[] = {
-		'R', 'I', 'F', 'F',
-		0x24, 0, 0, 0,
-		'W', 'A', 'V', 'E',
-		'f', 'm', 't', ' ',
-		0x10, 0, 0, 0,
-	};
-	static const char header2[] = {
-		'd', 'a', 't', 'a',
-		0, 0, 0, 0
-	};
-	
 	setup_wav_header(pcm, &file->wav_header);
 
-	res = safe_write(file->fd, header, sizeof(header));
-	if (res != sizeof(header))
+	res = safe_write(file->fd, wav_riff_chunk, sizeof(wav_riff_chunk));
+	if (res != sizeof(wav_riff_chunk))
 		goto write_error;
 
 	res = safe_write(file->fd, &file->wav_header, sizeof(file->wav_header));
 	if (res != sizeof(file->wav_header))
 		goto write_error;
 
-	res = safe_write(file->fd, header2, sizeof(header2));
-	if (res != sizeof(header2))
+	res = safe_write(file->fd, wav_data_chunk, sizeof(wav_data_chunk));
+	if (res != sizeof(wav_data_chunk))
 		goto write_error;
 
 	return 0;
@@ -414,6 +601,249 @@ static void fixup_wav_header(snd_pcm_t *pcm)
 
 
 
+#ifdef HAVE_LIBPTHREAD
+/*
+ * Async writer
+ *
+ * In the async mode snd_pcm_file_write_bytes() only copies the data to
+ * a preallocated ring and the disk writes are done by a thread, so a
+ * storage stall never blocks the stream. When the ring is full the excess
+ * frames are dropped and counted. The WAV header is pushed to the ring
+ * as well, so with O_DIRECT the data stays block aligned in the file.
+ */
+
+#ifdef O_DIRECT
+static void snd_pcm_file_writer_set_direct(snd_pcm_file_writer_t *w, int direct)
+{
+	int flags = fcntl(w->fd, F_GETFL);
+
+	if (flags < 0)
+		return;
+	flags = direct ? flags | O_DIRECT : flags & ~O_DIRECT;
+	if (fcntl(w->fd, F_SETFL, flags) == 0)
+		w->direct = direct;
+}
+#endif
+
+/* write out the gathered block, with O_DIRECT only whole aligned units */
+static void snd_pcm_file_writer_flush(snd_pcm_file_writer_t *w, int all)
+{
+	size_t len = w->blk_used, done = 0;
+	ssize_t res;
+
+#ifdef O_DIRECT
+	if (w->direct) {
+		if (all)
+			snd_pcm_file_writer_set_direct(w, 0);
+		else
+			len &= ~(size_t)(ASYNC_DIRECT_ALIGN - 1);
+	}
+#endif
+	while (done < len) {
+		res = safe_write(w->fd, w->blk + done, len - done);
+		if (res < 0) {
+#ifdef O_DIRECT
+			if (res == -EINVAL && w->direct) {
+				/* not supported here after all */
+				snd_pcm_file_writer_set_direct(w, 0);
+				if (!w->direct)
+					continue;
+			}
+#endif
+			SYSERR("async write failed, file data may be corrupt");
+			__atomic_store_n(&w->err, (int)res, __ATOMIC_RELEASE);
+			done = len;
+			break;
+		}
+		done += res;
+		w->written += res;
+	}
+	if (done < w->blk_used)
+		memmove(w->blk, w->blk + done, w->blk_used - done);
+	w->blk_used -= done;
+}
+
+static void *snd_pcm_file_writer_thread(void *data)
+{
+	snd_pcm_file_writer_t *w = data;
+	size_t head, n, ofs;
+	int quit;
+
+	for (;;) {
+		/* quit first, the final pushes are visible with it */
+		quit = __atomic_load_n(&w->quit, __ATOMIC_ACQUIRE);
+		head = __atomic_load_n(&w->head, __ATOMIC_ACQUIRE);
+		if (head == w->tail) {
+			if (quit)
+				break;
+			if (w->blk_used)
+				snd_pcm_file_writer_flush(w, 0);
+			while (sem_wait(&w->wake) < 0 && errno == EINTR)
+				;
+			continue;
+		}
+		ofs = w->tail & w->mask;
+		n = head - w->tail;
+		if (n > w->mask + 1 - ofs)
+			n = w->mask + 1 - ofs;
+		if (n > ASYNC_BLOCK_BYTES - w->blk_used)
+			n = ASYNC_BLOCK_BYTES - w->blk_used;
+		memcpy(w->blk + w->blk_used, w->ring + ofs, n);
+		w->blk_used += n;
+		__atomic_store_n(&w->tail, w->tail + n, __ATOMIC_RELEASE);
+		if (w->blk_used == ASYNC_BLOCK_BYTES)
+			snd_pcm_file_writer_flush(w, 0);
+	}
+	snd_pcm_file_writer_flush(w, 1);
+	return NULL;
+}
+
+static void snd_pcm_file_writer_free(snd_pcm_file_writer_t *w)
+{
+	free(w->ring);
+	free(w->blk);
+	free(w);
+}
+
+static int snd_pcm_file_async_start(snd_pcm_file_t *file)
+{
+	snd_pcm_t *slave = file->gen.slave;
+	snd_pcm_file_writer_t *w;
+	snd_pcm_uframes_t frames;
+	size_t size, bytes;
+	int err;
+
+	w = calloc(1, sizeof(*w));
+	if (!w)
+		return -ENOMEM;
+	w->fd = file->fd;
+	frames = (snd_pcm_uframes_t)slave->rate * file->async_time / 1000;
+	bytes = snd_pcm_frames_to_bytes(slave, frames);
+	if (bytes < 2 * file->buffer_bytes)
+		bytes = 2 * file->buffer_bytes;
+	for (size = ASYNC_BLOCK_BYTES; size < bytes; size <<= 1)
+		;
+	w->mask = size - 1;
+	w->ring = malloc(size);
+	if (!w->ring ||
+	    posix_memalign((void **)&w->blk, ASYNC_DIRECT_ALIGN,
+			   ASYNC_BLOCK_BYTES)) {
+		snd_pcm_file_writer_free(w);
+		return -ENOMEM;
+	}
+	/* fault the pages in now, not in the stream */
+	memset(w->ring, 0, size);
+#ifdef O_DIRECT
+	if (file->direct && !file->pipe) {
+		struct stat st;
+		/* the header is written through the ring, the offset is 0 */
+		if (fstat(w->fd, &st) == 0 && S_ISREG(st.st_mode) &&
+		    lseek(w->fd, 0, SEEK_CUR) % ASYNC_DIRECT_ALIGN == 0)
+			snd_pcm_file_writer_set_direct(w, 1);
+		if (!w->direct)
+			SNDERR("%s: O_DIRECT not available, using buffered writes",
+			       file->fname ? file->fname : "file");
+	}
+#endif
+	if (sem_init(&w->wake, 0, 0) < 0) {
+		err = -errno;
+		snd_pcm_file_writer_free(w);
+		return err;
+	}
+	err = -pthread_create(&w->thread, NULL, snd_pcm_file_writer_thread, w);
+	if (err < 0) {
+		SYSERR("pthread_create failed");
+		sem_destroy(&w->wake);
+		snd_pcm_file_writer_free(w);
+		return err;
+	}
+	file->writer = w;
+	return 0;
+}
+
+/* let the writer finish everything pushed so far and account the data */
+static void snd_pcm_file_async_stop(snd_pcm_file_t *file)
+{
+	snd_pcm_file_writer_t *w = file->writer;
+
+	if (!w)
+		return;
+	__atomic_store_n(&w->quit, 1, __ATOMIC_RELEASE);
+	sem_post(&w->wake);
+	pthread_join(w->thread, NULL);
+	sem_destroy(&w->wake);
+	if (w->written > w->hdr)
+		file->filelen += w->written - w->hdr;
+	file->writer = NULL;
+	snd_pcm_file_writer_free(w);
+}
+
+/* copy to the ring at the local head, the caller checked the space */
+static size_t snd_pcm_file_ring_put(snd_pcm_file_writer_t *w, size_t head,
+				    const char *src, size_t bytes)
+{
+	while (bytes > 0) {
+		size_t ofs = head & w->mask;
+		size_t n = bytes;
+		if (n > w->mask + 1 - ofs)
+			n = w->mask + 1 - ofs;
+		memcpy(w->ring + ofs, src, n);
+		src += n;
+		bytes -= n;
+		head += n;
+	}
+	return head;
+}
+
+/* the async variant of snd_pcm_file_write_bytes(), never blocks */
+static int snd_pcm_file_async_write_bytes(snd_pcm_t *pcm, size_t bytes)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+	snd_pcm_file_writer_t *w = file->writer;
+	size_t head = w->head, space, n;
+
+	space = w->mask + 1 - (head - __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE));
+	if (file->format == SND_PCM_FILE_FORMAT_WAV &&
+	    !file->wav_header.fmt) {
+		/* the ring is empty before the first data */
+		setup_wav_header(pcm, &file->wav_header);
+		head = snd_pcm_file_ring_put(w, head, wav_riff_chunk,
+					     sizeof(wav_riff_chunk));
+		head = snd_pcm_file_ring_put(w, head,
+					     (const char *)&file->wav_header,
+					     sizeof(file->wav_header));
+		head = snd_pcm_file_ring_put(w, head, wav_data_chunk,
+					     sizeof(wav_data_chunk));
+		w->hdr = head - w->head;
+		space -= w->hdr;
+	}
+
+	n = bytes;
+	if (n > space) {
+		n = snd_pcm_frames_to_bytes(pcm, snd_pcm_bytes_to_frames(pcm, space));
+		file->async_dropped += snd_pcm_bytes_to_frames(pcm, bytes - n);
+		file->async_overruns++;
+	}
+	file->wbuf_used_bytes -= bytes;
+	while (bytes > 0) {
+		size_t cont = file->wbuf_size_bytes - file->file_ptr_bytes;
+		size_t len = bytes < cont ? bytes : cont;
+		if (n > 0)
+			head = snd_pcm_file_ring_put(w, head,
+						     file->wbuf + file->file_ptr_bytes,
+						     len < n ? len : n);
+		n -= len < n ? len : n;
+		bytes -= len;
+		file->file_ptr_bytes += len;
+		if (file->file_ptr_bytes == file->wbuf_size_bytes)
+			file->file_ptr_bytes = 0;
+	}
+	__atomic_store_n(&w->head, head, __ATOMIC_RELEASE);
+	sem_post(&w->wake);
+	return __atomic_exchange_n(&w->err, 0, __ATOMIC_ACQ_REL);
+}
+#endif /* HAVE_LIBPTHREAD */
+
 /* return error code in case write failed */
 static int snd_pcm_file_write_bytes(snd_pcm_t *pcm, size_t bytes)
 {
@@ -421,6 +851,10 @@ static int snd_pcm_file_write_bytes(snd_pcm_t *pcm, size_t bytes)
 	snd_pcm_sframes_t err = 0;
 	assert(bytes <= file->wbuf_used_bytes);
 
+#ifdef HAVE_LIBPTHREAD
+	if (file->writer)
+		return snd_pcm_file_async_write_bytes(pcm, bytes);
+#endif
 	if (file->format == SND_PCM_FILE_FORMAT_WAV &&
 	    !file->wav_header.fmt) {
 		err = write_wav_header(pcm);
@@ -492,6 +926,13 @@ static int snd_pcm_file_add_frames(snd_pcm_t *pcm,
 static int snd_pcm_file_close(snd_pcm_t *pcm)
 {
 	snd_pcm_file_t *file = pcm->private_data;
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_file_async_stop(file);
+#endif
+	if (file->async_dropped)
+		SNDERR("%s: %lu frames dropped in %u async ring overruns",
+		       file->fname ? file->fname : "file",
+		       file->async_dropped, file->async_overruns);
 	if (file->fname) {
 		if (file->wav_header.fmt)
 			fixup_wav_header(pcm);
@@ -502,6 +943,7 @@ static int snd_pcm_file_close(snd_pcm_t *pcm)
 			close(file->fd);
 		}
 	}
+	snd_pcm_file_infile_unmap(file);
 	if (file->ifname) {
 		free((void *)file->ifname);
 		close(file->ifd);
@@ -737,6 +1179,9 @@ static int snd_pcm_file_mmap_begin(snd_pcm_t *pcm, const snd_pcm_channel_area_t
 static int snd_pcm_file_hw_free(snd_pcm_t *pcm)
 {
 	snd_pcm_file_t *file = pcm->private_data;
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_file_async_stop(file);
+#endif
 	free(file->wbuf);
 	free(file->wbuf_areas);
 	free(file->final_fname);
@@ -795,6 +1240,15 @@ static int snd_pcm_file_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 			return err;
 		}
 	}
+#ifdef HAVE_LIBPTHREAD
+	if (file->async && file->fd >= 0) {
+		err = snd_pcm_file_async_start(file);
+		if (err < 0) {
+			snd_pcm_file_hw_free(pcm);
+			return err;
+		}
+	}
+#endif
 
 	/* pointer may have changed - e.g if plug is used. */
 	snd_pcm_unlink_hw_ptr(pcm, file->gen.slave);
@@ -816,6 +1270,11 @@ static void snd_pcm_file_dump(snd_pcm_t *pcm, snd_output_t *out)
 	if (file->final_fname)
 		snd_output_printf(out, "Final file PCM (file=%s)\n",
 				file->final_fname);
+	if (file->async)
+		snd_output_printf(out, "Async writer: %ums ring%s, %lu frames dropped in %u overruns\n",
+				  file->async_time,
+				  file->direct ? ", O_DIRECT" : "",
+				  file->async_dropped, file->async_overruns);
 
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
@@ -871,6 +1330,7 @@ static const snd_pcm_fast_ops_t snd_pcm_file_fast_ops = {
 	.poll_descriptors_count = snd_pcm_generic_poll_descriptors_count,
 	.poll_descriptors = snd_pcm_generic_poll_descriptors,
 	.poll_revents = snd_pcm_generic_poll_revents,
+	.wait = snd_pcm_generic_wait,
 	.htimestamp = snd_pcm_generic_htimestamp,
 	.mmap_begin = snd_pcm_file_mmap_begin,
 };
@@ -970,6 +1430,17 @@ int snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 }
 
+/* enable the async writer, takes effect at the next hw_params */
+static void snd_pcm_file_set_async(snd_pcm_t *pcm, unsigned int async_time,
+				   int direct)
+{
+	snd_pcm_file_t *file = pcm->private_data;
+
+	file->async = 1;
+	file->async_time = async_time;
+	file->direct = direct;
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_file Plugin: File
@@ -1006,9 +1477,28 @@ pcm.name {
 	infile INT		# Input file descriptor number
 	[format STR]		# File format ("raw" or "wav")
 	[perm INT]		# Output file permission (octal, def. 0600)
+	[async BOOL]		# Write the file from a separate thread
+	[async_time INT]	# Async ring length in ms (def. 2000)
+	[direct BOOL]		# Open the output file with O_DIRECT,
+				# implies async
 }
 \endcode
 
+With async set, the stream only copies the data to a preallocated ring and
+a writer thread does the file I/O, so a slow disk cannot cause an xrun.
+When the ring is full the newest frames are dropped; the count is shown
+in the PCM dump and reported when the PCM is closed. The WAV header is
+fixed up after the writer has finished. With direct, the writer bypasses
+the page cache where the filesystem supports it, and falls back to
+buffered writes otherwise.
+
+A regular input file is mapped and the samples are copied straight from
+the page cache, with the kernel reading ahead of the position, so large
+captures can be replayed without a read() per period. The file size is
+checked before each copy, so a file truncated while it is played just
+ends there; as the truncation may still race with the copy, do not
+shrink an input file in use (a memfd sealed with F_SEAL_SHRINK is safe).
+
 \subsection pcm_plugins_file_funcref Function reference
 
 <UL>
@@ -1043,6 +1533,8 @@ int _snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 	const char *format = NULL;
 	long fd = -1, ifd = -1, trunc = 1;
 	long perm = 0600;
+	long async_time = ASYNC_TIME_DEFAULT;
+	int async = 0, direct = 0;
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
 		const char *id;
@@ -1103,6 +1595,32 @@ int _snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 			trunc = err;
 			continue;
 		}
+		if (strcmp(id, "async") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return -EINVAL;
+			async = err;
+			continue;
+		}
+		if (strcmp(id, "async_time") == 0) {
+			err = snd_config_get_integer(n, &async_time);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return err;
+			}
+			if (async_time <= 0 || async_time > 60000) {
+				SNDERR("Invalid async_time value %ld", async_time);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "direct") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0)
+				return -EINVAL;
+			direct = err;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1121,6 +1639,12 @@ int _snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 		SNDERR("slave is not defined");
 		return -EINVAL;
 	}
+#ifndef HAVE_LIBPTHREAD
+	if (async || direct) {
+		SNDERR("async file writes need thread support");
+		return -EINVAL;
+	}
+#endif
 	err = snd_pcm_slave_conf(root, slave, &sconf, 0);
 	if (err < 0)
 		return err;
@@ -1135,9 +1659,13 @@ int _snd_pcm_file_open(snd_pcm_t **pcmp, const char *name,
 		return err;
 	err = snd_pcm_file_open(pcmp, name, fname, fd, ifname, ifd,
 				trunc, format, perm, spcm, 1, stream);
-	if (err < 0)
+	if (err < 0) {
 		snd_pcm_close(spcm);
-	return err;
+		return err;
+	}
+	if (async || direct)
+		snd_pcm_file_set_async(*pcmp, async_time, direct);
+	return 0;
 }
 #ifndef DOC_HIDDEN
 SND_DLSYM_BUILD_VERSION(_snd_pcm_file_open, SND_PCM_DLSYM_VERSION);
@@ -346,4 +346,18 @@ int snd_pcm_generic_may_wait_for_avail_min(snd_pcm_t *pcm, snd_pcm_uframes_t ava
 	return snd_pcm_may_wait_for_avail_min(generic->slave, snd_pcm_mmap_avail(generic->slave));
 }
 
+/* the slave waits under its own lock, as poll() on its descriptors */
+int snd_pcm_generic_wait(snd_pcm_t *pcm, int timeout)
+{
+	snd_pcm_generic_t *generic = pcm->private_data;
+	int err;
+
+	if (!generic->slave->fast_ops->wait)
+		return -ENOSYS;
+	__snd_pcm_unlock(pcm);
+	err = snd_pcm_wait(generic->slave, timeout);
+	__snd_pcm_lock(pcm);
+	return err;
+}
+
 #endif /* DOC_HIDDEN */
@@ -29,6 +29,7 @@
 #include "pcm_local.h"
 #include "pcm_plugin.h"
 #include "plugin_ops.h"
+#include "pcm_simd.h"
 #include "bswap.h"
 
 #ifndef PIC
@@ -63,6 +64,9 @@ struct snd_pcm_iec958 {
 	unsigned char preamble[3];	/* B/M/W or Z/X/Y */
 	snd_pcm_fast_ops_t fops;
 	int hdmi_mode;
+	uint32_t *pattern;		/* see snd_pcm_iec958_pattern() */
+	unsigned int pattern_frames;
+	unsigned int counter_step;
 };
 
 enum { PREAMBLE_Z, PREAMBLE_X, PREAMBLE_Y };
@@ -76,17 +80,11 @@ enum { PREAMBLE_Z, PREAMBLE_X, PREAMBLE_Y };
  */
 static unsigned int iec958_parity(unsigned int data)
 {
-	unsigned int parity;
-	int bit;
-
-	data >>= 4;     /* start from bit 4 */
-	parity = 0;
-	for (bit = 4; bit <= 30; bit++) {
-		if (data & 1)
-			parity++;
-		data >>= 1;
-	}
-	return (parity & 1);
+	data &= 0x7ffffff0;	/* bit 4 upto 30 */
+	data ^= data >> 16;
+	data ^= data >> 8;
+	data ^= data >> 4;
+	return (0x6996 >> (data & 0xf)) & 1;	/* parity of a nibble */
 }
 
 /*
@@ -233,6 +231,121 @@ static void snd_pcm_iec958_encode(snd_pcm_iec958_t *iec,
 			iec->counter = (counter + frames * counter_step) % 192;
 	}
 }
+
+/*
+ * Build the non-data bits of the subframes of one channel status block,
+ * interleaved by channels, for the iec958_enc kernel: entry
+ * f * channels + c holds the preamble and channel status bit of channel c
+ * in frame f, bit 31 carries the parity of the preamble bits so that
+ * they cancel out in the parity of the whole subframe.
+ * In the HDMI single stream mode the status counter advances by four
+ * per frame, so the pattern repeats after 48 frames.
+ */
+static int snd_pcm_iec958_pattern(snd_pcm_iec958_t *iec, unsigned int channels)
+{
+	int single_stream = iec->hdmi_mode &&
+			    (iec->status[0] & IEC958_AES0_NONAUDIO) &&
+			    (channels == 8);
+	unsigned int f, c, k;
+
+	free(iec->pattern);
+	iec->pattern = NULL;
+	for (k = 0; k < 3; k++) {
+		if (iec->preamble[k] & ~0xf)
+			return 0;	/* overlaps the data, use the generic path */
+	}
+	iec->counter_step = single_stream ? ((channels + 1) >> 1) : 1;
+	iec->pattern_frames = 192 / iec->counter_step;
+	iec->pattern = malloc(iec->pattern_frames * channels * sizeof(uint32_t));
+	if (!iec->pattern)
+		return -ENOMEM;
+	for (f = 0; f < iec->pattern_frames; f++) {
+		for (c = 0; c < channels; c++) {
+			unsigned int counter = f * iec->counter_step;
+			uint32_t data, parity;
+			if (single_stream)
+				counter = (counter + (c >> 1)) % 192;
+			if (c)
+				data = iec->preamble[PREAMBLE_Y];
+			else if (!counter)
+				data = iec->preamble[PREAMBLE_Z];
+			else
+				data = iec->preamble[PREAMBLE_X];
+			parity = data ^ (data >> 2);
+			parity ^= parity >> 1;
+			data |= (parity & 1) << 31;
+			if (iec->status[counter >> 3] & (1 << (counter & 7)))
+				data |= 0x40000000;
+			iec->pattern[f * channels + c] = data;
+		}
+	}
+	return 0;
+}
+
+/* all channels interleaved in one run of 32-bit samples */
+static int snd_pcm_iec958_interleaved(const snd_pcm_channel_area_t *areas,
+				      unsigned int channels)
+{
+	unsigned int c;
+
+	if (areas->step != channels * 32 || areas->first % 32)
+		return 0;
+	for (c = 1; c < channels; c++) {
+		if (areas[c].addr != areas->addr ||
+		    areas[c].step != areas->step ||
+		    areas[c].first != areas->first + c * 32)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+ * Whole period conversion with the SIMD kernels for interleaved native S32
+ * samples, returns zero when the layout or state is not supported.
+ */
+static int snd_pcm_iec958_convert_fast(snd_pcm_iec958_t *iec,
+				       const snd_pcm_channel_area_t *dst_areas,
+				       snd_pcm_uframes_t dst_offset,
+				       const snd_pcm_channel_area_t *src_areas,
+				       snd_pcm_uframes_t src_offset,
+				       unsigned int channels, snd_pcm_uframes_t frames)
+{
+	const snd_pcm_simd_ops_t *ops = snd_pcm_simd_ops();
+	snd_pcm_format_t linear = iec->sformat;
+	size_t samples = frames * channels;
+	unsigned int pos;
+
+	if (linear == SND_PCM_FORMAT_IEC958_SUBFRAME_LE ||
+	    linear == SND_PCM_FORMAT_IEC958_SUBFRAME_BE)
+		linear = iec->format;
+	if (linear != SND_PCM_FORMAT_S32 ||
+	    !snd_pcm_iec958_interleaved(dst_areas, channels) ||
+	    !snd_pcm_iec958_interleaved(src_areas, channels))
+		return 0;
+	if (iec->func == snd_pcm_iec958_decode) {
+		ops->iec958_dec(snd_pcm_channel_area_addr(dst_areas, dst_offset),
+				snd_pcm_channel_area_addr(src_areas, src_offset),
+				samples, iec->byteswap);
+		return 1;
+	}
+	if (!iec->pattern || iec->counter % iec->counter_step)
+		return 0;
+	pos = iec->counter / iec->counter_step * channels;
+	while (samples > 0) {
+		size_t n = iec->pattern_frames * channels - pos;
+		if (n > samples)
+			n = samples;
+		ops->iec958_enc(snd_pcm_channel_area_addr(dst_areas, dst_offset),
+				snd_pcm_channel_area_addr(src_areas, src_offset),
+				iec->pattern + pos, n, iec->byteswap);
+		dst_offset += n / channels;
+		src_offset += n / channels;
+		samples -= n;
+		pos = 0;
+	}
+	iec->counter = (iec->counter + frames * iec->counter_step) % 192;
+	return 1;
+}
 #endif /* DOC_HIDDEN */
 
 static int snd_pcm_iec958_hw_refine_cprepare(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
@@ -438,9 +551,24 @@ static int snd_pcm_iec958_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params
 			iec->status[4] |= ws;
 		}
 	}
+	if (iec->func == snd_pcm_iec958_encode) {
+		unsigned int channels;
+		err = INTERNAL(snd_pcm_hw_params_get_channels)(params, &channels);
+		if (err < 0)
+			return err;
+		return snd_pcm_iec958_pattern(iec, channels);
+	}
 	return 0;
 }
 
+static int snd_pcm_iec958_hw_free(snd_pcm_t *pcm)
+{
+	snd_pcm_iec958_t *iec = pcm->private_data;
+	free(iec->pattern);
+	iec->pattern = NULL;
+	return snd_pcm_generic_hw_free(pcm);
+}
+
 static snd_pcm_uframes_t
 snd_pcm_iec958_write_areas(snd_pcm_t *pcm,
 			   const snd_pcm_channel_area_t *areas,
@@ -453,9 +581,11 @@ snd_pcm_iec958_write_areas(snd_pcm_t *pcm,
 	snd_pcm_iec958_t *iec = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	iec->func(iec, slave_areas, slave_offset,
-		  areas, offset, 
-		  pcm->channels, size);
+	if (!snd_pcm_iec958_convert_fast(iec, slave_areas, slave_offset,
+					 areas, offset, pcm->channels, size))
+		iec->func(iec, slave_areas, slave_offset,
+			  areas, offset, 
+			  pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -472,9 +602,12 @@ snd_pcm_iec958_read_areas(snd_pcm_t *pcm,
 	snd_pcm_iec958_t *iec = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	iec->func(iec, areas, offset, 
-		  slave_areas, slave_offset,
-		  pcm->channels, size);
+	if (!snd_pcm_iec958_convert_fast(iec, areas, offset,
+					 slave_areas, slave_offset,
+					 pcm->channels, size))
+		iec->func(iec, areas, offset, 
+			  slave_areas, slave_offset,
+			  pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -533,7 +666,7 @@ static const snd_pcm_ops_t snd_pcm_iec958_ops = {
 	.info = snd_pcm_generic_info,
 	.hw_refine = snd_pcm_iec958_hw_refine,
 	.hw_params = snd_pcm_iec958_hw_params,
-	.hw_free = snd_pcm_generic_hw_free,
+	.hw_free = snd_pcm_iec958_hw_free,
 	.sw_params = snd_pcm_generic_sw_params,
 	.channel_info = snd_pcm_generic_channel_info,
 	.dump = snd_pcm_iec958_dump,
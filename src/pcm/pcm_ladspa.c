@@ -34,6 +34,7 @@
   
 #include "pcm_local.h"
 #include "pcm_plugin.h"
+#include "pcm_simd.h"
 #include <dirent.h>
 #include <locale.h>
 #include <math.h>
@@ -63,6 +64,8 @@ typedef struct {
 	unsigned int channels;			/* forced input channels, 0 = auto */
 	unsigned int allocated;			/* count of allocated samples */
 	LADSPA_Data *zero[2];			/* zero input or dummy output */
+	LADSPA_Data **scratch;			/* buffers shared by the chain */
+	unsigned int scratch_count;
 } snd_pcm_ladspa_t;
  
 typedef struct {
@@ -73,7 +76,6 @@ typedef struct {
 typedef struct {
         snd_pcm_ladspa_array_t channels;
         snd_pcm_ladspa_array_t ports;
-	LADSPA_Data **m_data;
         LADSPA_Data **data;
 } snd_pcm_ladspa_eps_t;
 
@@ -192,16 +194,26 @@ static void snd_pcm_ladspa_free_plugins(struct list_head *plugins)
 	}
 }
 
-static void snd_pcm_ladspa_free(snd_pcm_ladspa_t *ladspa)
+static void snd_pcm_ladspa_free_buffers(snd_pcm_ladspa_t *ladspa)
 {
         unsigned int idx;
 
-	snd_pcm_ladspa_free_plugins(&ladspa->pplugins);
-	snd_pcm_ladspa_free_plugins(&ladspa->cplugins);
 	for (idx = 0; idx < 2; idx++) {
 		free(ladspa->zero[idx]);
                 ladspa->zero[idx] = NULL;
         }
+	for (idx = 0; idx < ladspa->scratch_count; idx++)
+		free(ladspa->scratch[idx]);
+	free(ladspa->scratch);
+	ladspa->scratch = NULL;
+	ladspa->scratch_count = 0;
+}
+
+static void snd_pcm_ladspa_free(snd_pcm_ladspa_t *ladspa)
+{
+	snd_pcm_ladspa_free_plugins(&ladspa->pplugins);
+	snd_pcm_ladspa_free_plugins(&ladspa->cplugins);
+	snd_pcm_ladspa_free_buffers(ladspa);
         ladspa->allocated = 0;
 }
 
@@ -319,7 +331,6 @@ static void snd_pcm_ladspa_free_eps(snd_pcm_ladspa_eps_t *eps)
 static void snd_pcm_ladspa_free_instances(snd_pcm_t *pcm, snd_pcm_ladspa_t *ladspa, int cleanup)
 {
 	struct list_head *list, *pos, *pos1, *next1;
-	unsigned int idx;
 	
 	list = pcm->stream == SND_PCM_STREAM_PLAYBACK ? &ladspa->pplugins : &ladspa->cplugins;
 	list_for_each(pos, list) {
@@ -331,16 +342,6 @@ static void snd_pcm_ladspa_free_instances(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
 			if (cleanup) {
 				if (plugin->desc->cleanup)
 					plugin->desc->cleanup(instance->handle);
-				if (instance->input.m_data) {
-				        for (idx = 0; idx < instance->input.channels.size; idx++)
-						free(instance->input.m_data[idx]);
-					free(instance->input.m_data);
-                                }
-				if (instance->output.m_data) {
-				        for (idx = 0; idx < instance->output.channels.size; idx++)
-						free(instance->output.m_data[idx]);
-					free(instance->output.m_data);
-                                }
                                 free(instance->input.data);
                                 free(instance->output.data);
 				list_del(&(instance->list));
@@ -356,6 +357,8 @@ static void snd_pcm_ladspa_free_instances(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
 			assert(list_empty(&plugin->instances));
 		}
 	}
+	if (cleanup)
+		snd_pcm_ladspa_free_buffers(ladspa);
 }
 
 static int snd_pcm_ladspa_add_to_carray(snd_pcm_ladspa_array_t *array,
@@ -676,13 +679,95 @@ static int snd_pcm_ladspa_allocate_instances(snd_pcm_t *pcm, snd_pcm_ladspa_t *l
 	return 0;
 }
 
+/* whole cache lines, aligned for any vector width of the plugins */
+#define LADSPA_BUFFER_ALIGN	64
+
+static LADSPA_Data *snd_pcm_ladspa_allocate_buffer(snd_pcm_ladspa_t *ladspa)
+{
+	void *buf;
+
+	if (posix_memalign(&buf, LADSPA_BUFFER_ALIGN,
+			   ladspa->allocated * sizeof(LADSPA_Data)))
+		return NULL;
+	return buf;
+}
+
 static LADSPA_Data *snd_pcm_ladspa_allocate_zero(snd_pcm_ladspa_t *ladspa, unsigned int idx)
 {
-        if (ladspa->zero[idx] == NULL)
-                ladspa->zero[idx] = calloc(ladspa->allocated, sizeof(LADSPA_Data));
+        if (ladspa->zero[idx] == NULL) {
+                ladspa->zero[idx] = snd_pcm_ladspa_allocate_buffer(ladspa);
+                if (ladspa->zero[idx])
+                        memset(ladspa->zero[idx], 0, ladspa->allocated * sizeof(LADSPA_Data));
+        }
         return ladspa->zero[idx];
 }
 
+static int snd_pcm_ladspa_uses(void **array, unsigned int size, void *data)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < size; idx++)
+		if (array[idx] == data)
+			return 1;
+	return 0;
+}
+
+/*
+ * Return a scratch buffer which does not hold the current data of any
+ * channel and is not read by the instance, allocate a new one when all
+ * buffers are busy. The buffers are shared by the whole chain, so their
+ * count follows the channels alive at once rather than the chain length.
+ */
+static LADSPA_Data *snd_pcm_ladspa_allocate_scratch(snd_pcm_ladspa_t *ladspa,
+						    snd_pcm_ladspa_instance_t *instance,
+						    void **pchannels,
+						    unsigned int channels)
+{
+	LADSPA_Data *data, **scratch;
+	unsigned int idx;
+
+	for (idx = 0; idx < ladspa->scratch_count; idx++) {
+		data = ladspa->scratch[idx];
+		if (!snd_pcm_ladspa_uses(pchannels, channels, data) &&
+		    !snd_pcm_ladspa_uses((void **)instance->input.data,
+					 instance->input.channels.size, data))
+			return data;
+	}
+	scratch = realloc(ladspa->scratch, (ladspa->scratch_count + 1) * sizeof(*scratch));
+	if (scratch == NULL)
+		return NULL;
+	ladspa->scratch = scratch;
+	data = snd_pcm_ladspa_allocate_buffer(ladspa);
+	if (data == NULL)
+		return NULL;
+	scratch[ladspa->scratch_count++] = data;
+	return data;
+}
+
+/*
+ * Return the buffer of the input port reading the same channel as the
+ * output port, when the plugin may overwrite it (in-place processing).
+ */
+static LADSPA_Data *snd_pcm_ladspa_inplace(snd_pcm_ladspa_t *ladspa,
+					   snd_pcm_ladspa_instance_t *instance,
+					   void **pchannels, unsigned int chn)
+{
+	unsigned int idx;
+	LADSPA_Data *data;
+
+	if (LADSPA_IS_INPLACE_BROKEN(instance->desc->Properties))
+		return NULL;
+	for (idx = 0; idx < instance->input.channels.size; idx++) {
+		if (instance->input.channels.array[idx] != chn)
+			continue;
+		data = instance->input.data[idx];
+		/* ALSA areas and the shared zero input are read-only */
+		if (data != NULL && data != ladspa->zero[0] && data == pchannels[chn])
+			return data;
+	}
+	return NULL;
+}
+
 static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *ladspa)
 {
 	struct list_head *list, *pos, *pos1;
@@ -694,7 +779,7 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
 	
         ladspa->allocated = 2048;
         if (pcm->buffer_size > ladspa->allocated)
-                ladspa->allocated = pcm->buffer_size;
+                ladspa->allocated = (pcm->buffer_size + 15) & ~15;
         if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
                 ichannels = pcm->channels;
                 ochannels = ladspa->plug.gen.slave->channels;
@@ -732,19 +817,14 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
                                 for (idx = channels; idx < nchannels; idx++)
                                         npchannels[idx] = NULL;
                                 pchannels = npchannels;
+                                channels = nchannels;
                         }
                         assert(instance->input.data == NULL);
-                        assert(instance->input.m_data == NULL);
                         assert(instance->output.data == NULL);
-                        assert(instance->output.m_data == NULL);
                         instance->input.data = calloc(instance->input.channels.size, sizeof(void *));
-                        instance->input.m_data = calloc(instance->input.channels.size, sizeof(void *));
                         instance->output.data = calloc(instance->output.channels.size, sizeof(void *));
-                        instance->output.m_data = calloc(instance->output.channels.size, sizeof(void *));
                         if (instance->input.data == NULL ||
-                            instance->input.m_data == NULL ||
-                            instance->output.data == NULL ||
-                            instance->output.m_data == NULL) {
+                            instance->output.data == NULL) {
                                 free(pchannels);
                                 return -ENOMEM;
                         }
@@ -765,30 +845,29 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
                         }
                         for (idx = 0; idx < instance->output.channels.size; idx++) {
 			        chn = instance->output.channels.array[idx];
-                                /* FIXME/OPTIMIZE: check if we can remove double alloc */
-                                /* if LADSPA plugin has no broken inplace */
-                                instance->output.data[idx] = malloc(sizeof(LADSPA_Data) * ladspa->allocated);
+			        instance->output.data[idx] = snd_pcm_ladspa_inplace(ladspa, instance, pchannels, chn);
+			        if (instance->output.data[idx] == NULL)
+			                instance->output.data[idx] = snd_pcm_ladspa_allocate_scratch(ladspa, instance, pchannels, channels);
                                 if (instance->output.data[idx] == NULL) {
                                         free(pchannels);
                                         return -ENOMEM;
                                 }
-                                pchannels[chn] = instance->output.m_data[idx] = instance->output.data[idx];
+                                pchannels[chn] = instance->output.data[idx];
                         }
 		}
 	}
-	/* OPTIMIZE: we have already allocated areas for ALSA output channels */
-	/* next loop deallocates the last output LADSPA areas and connects */
-	/* them to ALSA areas (NULL) or dummy area ladpsa->free[1] ; */
-	/* this algorithm might be optimized to not allocate the last LADSPA outputs */
-	list_for_each(pos, list) {
+	/* the last LADSPA outputs of the ALSA output channels are connected */
+	/* to ALSA areas (NULL), the others to dummy area ladspa->zero[1]; */
+	/* the walk goes backwards, so only the last writer of a buffer is */
+	/* redirected when it was passed through several plugins in-place */
+	for (pos = list->prev; pos != list; pos = pos->prev) {
 		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
-		list_for_each(pos1, &plugin->instances) {
+		for (pos1 = plugin->instances.prev; pos1 != &plugin->instances; pos1 = pos1->prev) {
 			instance = list_entry(pos1, snd_pcm_ladspa_instance_t, list);
                         for (idx = 0; idx < instance->output.channels.size; idx++) {
         			chn = instance->output.channels.array[idx];
                                 if (instance->output.data[idx] == pchannels[chn]) {
-					free(instance->output.m_data[idx]);
-					instance->output.m_data[idx] = NULL;
+                                        pchannels[chn] = NULL;
                                         if (chn < ochannels) {
                                                 instance->output.data[idx] = NULL;
                                         } else {
@@ -805,14 +884,15 @@ static int snd_pcm_ladspa_allocate_memory(snd_pcm_t *pcm, snd_pcm_ladspa_t *lads
 #if 0
         printf("zero[0] = %p\n", ladspa->zero[0]);
         printf("zero[1] = %p\n", ladspa->zero[1]);
+        printf("scratch = %u\n", ladspa->scratch_count);
 	list_for_each(pos, list) {
 		snd_pcm_ladspa_plugin_t *plugin = list_entry(pos, snd_pcm_ladspa_plugin_t, list);
 		list_for_each(pos1, &plugin->instances) {
 			instance = list_entry(pos1, snd_pcm_ladspa_instance_t, list);
                         for (idx = 0; idx < instance->input.channels.size; idx++)
-                                printf("%i:alloc-input%i:  data = %p, m_data = %p\n", instance->depth, idx, instance->input.data[idx], instance->input.m_data[idx]);
+                                printf("%i:alloc-input%i:  data = %p\n", instance->depth, idx, instance->input.data[idx]);
                         for (idx = 0; idx < instance->output.channels.size; idx++)
-                                printf("%i:alloc-output%i:  data = %p, m_data = %p\n", instance->depth, idx, instance->output.data[idx], instance->output.m_data[idx]);
+                                printf("%i:alloc-output%i:  data = %p\n", instance->depth, idx, instance->output.data[idx]);
 		}
 	}
 #endif
@@ -861,6 +941,7 @@ snd_pcm_ladspa_write_areas(snd_pcm_t *pcm,
 	struct list_head *pos, *pos1;
 	LADSPA_Data *data;
 	unsigned int idx, chn, size1, size2;
+	unsigned int fpstate;
 	
 	if (size > *slave_sizep)
 		size = *slave_sizep;
@@ -870,6 +951,8 @@ snd_pcm_ladspa_write_areas(snd_pcm_t *pcm,
 			   areas, offset,
 			   pcm->channels, size, pcm->format);
 #else
+	/* denormals in feedback paths (reverb tails) are very slow */
+	fpstate = snd_pcm_simd_denormals_enter();
         while (size > 0) {
                 size1 = size;
                 if (size1 > ladspa->allocated)
@@ -903,6 +986,7 @@ snd_pcm_ladspa_write_areas(snd_pcm_t *pcm,
         	slave_offset += size1;
         	size -= size1;
 	}
+	snd_pcm_simd_denormals_leave(fpstate);
 #endif
 	*slave_sizep = size2;
 	return size2;
@@ -921,7 +1005,8 @@ snd_pcm_ladspa_read_areas(snd_pcm_t *pcm,
 	snd_pcm_ladspa_instance_t *instance;
 	struct list_head *pos, *pos1;
 	LADSPA_Data *data;
-	unsigned int idx, chn, size1, size2;;
+	unsigned int idx, chn, size1, size2;
+	unsigned int fpstate;
 
 	if (size > *slave_sizep)
 		size = *slave_sizep;
@@ -931,6 +1016,7 @@ snd_pcm_ladspa_read_areas(snd_pcm_t *pcm,
 			   slave_areas, slave_offset,
 			   pcm->channels, size, pcm->format);
 #else
+	fpstate = snd_pcm_simd_denormals_enter();
         while (size > 0) {
                 size1 = size;
                 if (size1 > ladspa->allocated)
@@ -964,6 +1050,7 @@ snd_pcm_ladspa_read_areas(snd_pcm_t *pcm,
         	slave_offset += size1;
         	size -= size1;
 	}
+	snd_pcm_simd_denormals_leave(fpstate);
 #endif
 	*slave_sizep = size2;
 	return size2;
@@ -1672,6 +1759,11 @@ connected to a dummy sample area.
 
 Instances of LADSPA plugins are created dynamically.
 
+The intermediate sample buffers (64-byte aligned) are shared by the whole
+chain. Unless the plugin sets LADSPA_PROPERTY_INPLACE_BROKEN, an output port
+overwrites the buffer of the input port bound to the same channel. The plugins
+run with denormal floats flushed to zero (FTZ/DAZ on x86, FZ on aarch64).
+
 \code
 pcm.name {
         type ladspa             # ALSA<->LADSPA PCM
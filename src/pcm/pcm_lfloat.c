@@ -30,6 +30,7 @@
 #include "pcm_plugin.h"
 #include "plugin_ops.h"
 #include "bswap.h"
+#include "pcm_simd.h"
 
 #ifndef DOC_HIDDEN
 
@@ -55,6 +56,11 @@ typedef struct {
 		     const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
 		     unsigned int channels, snd_pcm_uframes_t frames,
 		     unsigned int get32idx, unsigned int put32floatidx);
+	unsigned int f2i_mode;
+	snd_pcm_format_t float_format;
+	snd_pcm_simd_conv_func_t simd_func;
+	snd_pcm_simd_conv_t simd_conv;
+	unsigned int simd_src_width, simd_dst_width;
 } snd_pcm_lfloat_t;
 
 int snd_pcm_lfloat_get_s32_index(snd_pcm_format_t format)
@@ -182,6 +188,143 @@ void snd_pcm_lfloat_convert_float_integer(const snd_pcm_channel_area_t *dst_area
 	}
 }
 
+#ifndef HAVE_SOFT_FLOAT
+/* float -> integer with rounding or dither, used when the SIMD kernels
+ * cannot handle the format or the areas layout
+ */
+static void snd_pcm_lfloat_convert_float_integer_round(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+						       const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+						       unsigned int channels, snd_pcm_uframes_t frames,
+						       unsigned int put32idx, snd_pcm_format_t src_format,
+						       snd_pcm_simd_conv_t *conv)
+{
+#define PUT32_LABELS
+#include "plugin_ops.h"
+#undef PUT32_LABELS
+	void *put32 = put32_labels[put32idx];
+	int width = snd_pcm_format_physical_width(src_format);
+#ifdef SND_LITTLE_ENDIAN
+	int swap = snd_pcm_format_big_endian(src_format);
+#else
+	int swap = snd_pcm_format_little_endian(src_format);
+#endif
+	unsigned int channel;
+	for (channel = 0; channel < channels; ++channel) {
+		const char *src;
+		char *dst;
+		int src_step, dst_step;
+		snd_pcm_uframes_t frames1;
+		int32_t sample = 0;
+		snd_tmp_float_t tmp_float;
+		snd_tmp_double_t tmp_double;
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		src = snd_pcm_channel_area_addr(src_area, src_offset);
+		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		src_step = snd_pcm_channel_area_step(src_area);
+		dst_step = snd_pcm_channel_area_step(dst_area);
+		frames1 = frames;
+		while (frames1-- > 0) {
+			if (width == 32) {
+				tmp_float.i = *(const int32_t *)src;
+				if (swap)
+					tmp_float.i = bswap_32(tmp_float.i);
+				sample = snd_pcm_simd_float_to_int(tmp_float.f, conv);
+			} else {
+				tmp_double.l = *(const int64_t *)src;
+				if (swap)
+					tmp_double.l = bswap_64(tmp_double.l);
+				sample = snd_pcm_simd_double_to_int(tmp_double.d, conv);
+			}
+			sample = (uint32_t)sample << (32 - conv->bits);
+			goto *put32;
+#define PUT32_END sample_put
+#include "plugin_ops.h"
+#undef PUT32_END
+		sample_put:
+			src += src_step;
+			dst += dst_step;
+		}
+	}
+}
+#endif
+
+/*
+ * Pick a whole-buffer kernel, the kernels handle only host endian signed
+ * 16, 24 (in 32-bit container) and 32 bit integers.
+ */
+static void snd_pcm_lfloat_simd_select(snd_pcm_lfloat_t *lfloat,
+				       snd_pcm_format_t src_format,
+				       snd_pcm_format_t dst_format)
+{
+	const snd_pcm_simd_ops_t *ops = snd_pcm_simd_ops();
+	int to_float = snd_pcm_format_linear(src_format);
+	snd_pcm_format_t iformat = to_float ? src_format : dst_format;
+	snd_pcm_format_t fformat = to_float ? dst_format : src_format;
+	int width = snd_pcm_format_width(iformat);
+	int fwidth = snd_pcm_format_physical_width(fformat);
+
+	lfloat->simd_func = NULL;
+	lfloat->float_format = fformat;
+	lfloat->simd_conv.bits = width;
+	lfloat->simd_conv.mode = lfloat->f2i_mode;
+	lfloat->simd_src_width = snd_pcm_format_physical_width(src_format);
+	lfloat->simd_dst_width = snd_pcm_format_physical_width(dst_format);
+	if (snd_pcm_format_cpu_endian(iformat) != 1 ||
+	    snd_pcm_format_cpu_endian(fformat) != 1 ||
+	    snd_pcm_format_signed(iformat) != 1)
+		return;
+	if (width != 16 &&
+	    (width != 24 || snd_pcm_format_physical_width(iformat) != 32) &&
+	    width != 32)
+		return;
+	if (to_float) {
+		if (fwidth == 32)
+			lfloat->simd_func = width == 16 ? ops->conv_s16_float : ops->conv_s32_float;
+		else
+			lfloat->simd_func = width == 16 ? ops->conv_s16_double : ops->conv_s32_double;
+	} else {
+		if (fwidth == 32)
+			lfloat->simd_func = width == 16 ? ops->conv_float_s16 : ops->conv_float_s32;
+		else
+			lfloat->simd_func = width == 16 ? ops->conv_double_s16 : ops->conv_double_s32;
+	}
+}
+
+static void snd_pcm_lfloat_do_convert(snd_pcm_lfloat_t *lfloat,
+				      const snd_pcm_channel_area_t *dst_areas,
+				      snd_pcm_uframes_t dst_offset,
+				      const snd_pcm_channel_area_t *src_areas,
+				      snd_pcm_uframes_t src_offset,
+				      unsigned int channels, snd_pcm_uframes_t frames)
+{
+	if (lfloat->simd_func &&
+	    snd_pcm_simd_convert_areas(dst_areas, dst_offset,
+				       src_areas, src_offset,
+				       channels, frames,
+				       lfloat->simd_dst_width,
+				       lfloat->simd_src_width,
+				       lfloat->simd_func,
+				       &lfloat->simd_conv) == 0)
+		return;
+#ifndef HAVE_SOFT_FLOAT
+	if (lfloat->simd_conv.mode != SND_PCM_SIMD_F2I_TRUNC &&
+	    lfloat->func == snd_pcm_lfloat_convert_float_integer) {
+		snd_pcm_lfloat_convert_float_integer_round(dst_areas, dst_offset,
+							   src_areas, src_offset,
+							   channels, frames,
+							   lfloat->int32_idx,
+							   lfloat->float_format,
+							   &lfloat->simd_conv);
+		return;
+	}
+#endif
+	lfloat->func(dst_areas, dst_offset,
+		     src_areas, src_offset,
+		     channels, frames,
+		     lfloat->int32_idx, lfloat->float32_idx);
+}
+
 #endif /* DOC_HIDDEN */
 
 static int snd_pcm_lfloat_hw_refine_cprepare(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
@@ -293,6 +436,7 @@ static int snd_pcm_lfloat_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 		lfloat->float32_idx = snd_pcm_lfloat_get_s32_index(src_format);
 		lfloat->func = snd_pcm_lfloat_convert_float_integer;
 	}
+	snd_pcm_lfloat_simd_select(lfloat, src_format, dst_format);
 	return 0;
 }
 
@@ -308,10 +452,9 @@ snd_pcm_lfloat_write_areas(snd_pcm_t *pcm,
 	snd_pcm_lfloat_t *lfloat = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	lfloat->func(slave_areas, slave_offset,
-		     areas, offset, 
-		     pcm->channels, size,
-		     lfloat->int32_idx, lfloat->float32_idx);
+	snd_pcm_lfloat_do_convert(lfloat, slave_areas, slave_offset,
+				  areas, offset,
+				  pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -328,10 +471,9 @@ snd_pcm_lfloat_read_areas(snd_pcm_t *pcm,
 	snd_pcm_lfloat_t *lfloat = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	lfloat->func(areas, offset, 
-		     slave_areas, slave_offset,
-		     pcm->channels, size,
-		     lfloat->int32_idx, lfloat->float32_idx);
+	snd_pcm_lfloat_do_convert(lfloat, areas, offset,
+				  slave_areas, slave_offset,
+				  pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -339,8 +481,15 @@ snd_pcm_lfloat_read_areas(snd_pcm_t *pcm,
 static void snd_pcm_lfloat_dump(snd_pcm_t *pcm, snd_output_t *out)
 {
 	snd_pcm_lfloat_t *lfloat = pcm->private_data;
+	static const char *const modes[] = {
+		[SND_PCM_SIMD_F2I_TRUNC] = "truncate",
+		[SND_PCM_SIMD_F2I_ROUND] = "nearest",
+		[SND_PCM_SIMD_F2I_DITHER] = "nearest, tpdf dither",
+	};
 	snd_output_printf(out, "Linear Integer <-> Linear Float conversion PCM (%s)\n", 
 		snd_pcm_format_name(lfloat->sformat));
+	snd_output_printf(out, "Float to integer rounding: %s\n",
+			  modes[lfloat->f2i_mode]);
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -367,19 +516,9 @@ static const snd_pcm_ops_t snd_pcm_lfloat_ops = {
 	.set_chmap = snd_pcm_generic_set_chmap,
 };
 
-/**
- * \brief Creates a new linear conversion PCM
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param sformat Slave (destination) format
- * \param slave Slave PCM handle
- * \param close_slave When set, the slave PCM handle is closed with copy PCM
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
- */
-int snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sformat, snd_pcm_t *slave, int close_slave)
+static int lfloat_open(snd_pcm_t **pcmp, const char *name,
+		       snd_pcm_format_t sformat, unsigned int f2i_mode,
+		       snd_pcm_t *slave, int close_slave)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_lfloat_t *lfloat;
@@ -394,6 +533,8 @@ int snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sfo
 	}
 	snd_pcm_plugin_init(&lfloat->plug);
 	lfloat->sformat = sformat;
+	lfloat->f2i_mode = f2i_mode;
+	lfloat->simd_conv.seed = 0x2545f491;
 	lfloat->plug.read = snd_pcm_lfloat_read_areas;
 	lfloat->plug.write = snd_pcm_lfloat_write_areas;
 	lfloat->plug.undo_read = snd_pcm_plugin_undo_read_generic;
@@ -419,6 +560,24 @@ int snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sfo
 	return 0;
 }
 
+/**
+ * \brief Creates a new linear conversion PCM
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param sformat Slave (destination) format
+ * \param slave Slave PCM handle
+ * \param close_slave When set, the slave PCM handle is closed with copy PCM
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name, snd_pcm_format_t sformat, snd_pcm_t *slave, int close_slave)
+{
+	return lfloat_open(pcmp, name, sformat, SND_PCM_SIMD_F2I_TRUNC,
+			   slave, close_slave);
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_lfloat Plugin: linear<->float
@@ -438,9 +597,18 @@ pcm.name {
                 pcm { }         # Slave PCM definition
                 format STR      # Slave format
         }
+        [rounding STR]          # Float to integer rounding:
+                                #   truncate (default), nearest
+        [dither STR]            # Float to integer dither: none (default), tpdf
 }
 \endcode
 
+By default float samples are truncated towards zero as in the rest of
+the conversion plugins. With \c nearest the samples are rounded to the
+nearest integer and saturated, \c tpdf adds triangular dither noise of
+one LSB before rounding (it implies \c nearest). Both options affect
+only the float to integer direction.
+
 \subsection pcm_plugins_lfloat_funcref Function reference
 
 <UL>
@@ -472,6 +640,8 @@ int _snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_t *spcm;
 	snd_config_t *slave = NULL, *sconf;
 	snd_pcm_format_t sformat;
+	unsigned int f2i_mode = SND_PCM_SIMD_F2I_TRUNC;
+	int dither = 0;
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
 		const char *id;
@@ -483,6 +653,40 @@ int _snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name,
 			slave = n;
 			continue;
 		}
+		if (strcmp(id, "rounding") == 0) {
+			const char *str;
+			err = snd_config_get_string(n, &str);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			if (strcmp(str, "truncate") == 0)
+				f2i_mode = SND_PCM_SIMD_F2I_TRUNC;
+			else if (strcmp(str, "nearest") == 0)
+				f2i_mode = SND_PCM_SIMD_F2I_ROUND;
+			else {
+				SNDERR("Invalid rounding %s", str);
+				return -EINVAL;
+			}
+			continue;
+		}
+		if (strcmp(id, "dither") == 0) {
+			const char *str;
+			err = snd_config_get_string(n, &str);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			if (strcmp(str, "none") == 0)
+				dither = 0;
+			else if (strcmp(str, "tpdf") == 0)
+				dither = 1;
+			else {
+				SNDERR("Invalid dither %s", str);
+				return -EINVAL;
+			}
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -504,7 +708,9 @@ int _snd_pcm_lfloat_open(snd_pcm_t **pcmp, const char *name,
 	snd_config_delete(sconf);
 	if (err < 0)
 		return err;
-	err = snd_pcm_lfloat_open(pcmp, name, sformat, spcm, 1);
+	if (dither)
+		f2i_mode = SND_PCM_SIMD_F2I_DITHER;
+	err = lfloat_open(pcmp, name, sformat, f2i_mode, spcm, 1);
 	if (err < 0)
 		snd_pcm_close(spcm);
 	return err;
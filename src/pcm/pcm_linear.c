@@ -29,6 +29,7 @@
 #include "pcm_local.h"
 #include "pcm_plugin.h"
 #include "plugin_ops.h"
+#include "pcm_simd.h"
 #include "bswap.h"
 
 #ifndef PIC
@@ -44,6 +45,10 @@ typedef struct {
 	unsigned int conv_idx;
 	unsigned int get_idx, put_idx;
 	snd_pcm_format_t sformat;
+	/* whole-buffer kernel for the common format pairs */
+	snd_pcm_simd_conv_func_t simd_func;
+	snd_pcm_simd_conv_t simd_conv;
+	unsigned int simd_src_width, simd_dst_width;
 } snd_pcm_linear_t;
 #endif
 
@@ -213,6 +218,71 @@ void snd_pcm_linear_getput(const snd_pcm_channel_area_t *dst_areas, snd_pcm_ufra
 	}
 }
 
+/*
+ * Pick a whole-buffer kernel for src_format -> dst_format, the kernels
+ * only handle host endian formats and match the conv/getput tables
+ * bit by bit.
+ */
+static void snd_pcm_linear_simd_select(snd_pcm_linear_t *linear,
+				       snd_pcm_format_t src_format,
+				       snd_pcm_format_t dst_format)
+{
+	const snd_pcm_simd_ops_t *ops = snd_pcm_simd_ops();
+	int src_width = snd_pcm_format_width(src_format);
+	int src_pwidth = snd_pcm_format_physical_width(src_format);
+	int dst_width = snd_pcm_format_width(dst_format);
+	int dst_pwidth = snd_pcm_format_physical_width(dst_format);
+	int flip = (snd_pcm_format_signed(src_format) !=
+		    snd_pcm_format_signed(dst_format));
+
+	linear->simd_func = NULL;
+	if (snd_pcm_format_cpu_endian(src_format) != 1 ||
+	    snd_pcm_format_cpu_endian(dst_format) != 1)
+		return;
+	if (src_width == 16 && dst_width == 32) {
+		linear->simd_func = ops->conv_16_32;
+		linear->simd_conv.flip = flip ? 0x8000 : 0;
+	} else if (src_width == 32 && dst_width == 16) {
+		linear->simd_func = ops->conv_32_16;
+		linear->simd_conv.flip = flip ? 0x8000 : 0;
+	} else if (src_width == 24 && src_pwidth == 24 && dst_width == 32) {
+		linear->simd_func = ops->conv_24_3_32;
+		linear->simd_conv.flip = flip ? 0x80000000 : 0;
+	} else if (src_width == 32 && dst_width == 24 && dst_pwidth == 24) {
+		linear->simd_func = ops->conv_32_24_3;
+		linear->simd_conv.flip = flip ? 0x80000000 : 0;
+	}
+	linear->simd_src_width = src_pwidth;
+	linear->simd_dst_width = dst_pwidth;
+}
+
+static void snd_pcm_linear_do_convert(snd_pcm_linear_t *linear,
+				      const snd_pcm_channel_area_t *dst_areas,
+				      snd_pcm_uframes_t dst_offset,
+				      const snd_pcm_channel_area_t *src_areas,
+				      snd_pcm_uframes_t src_offset,
+				      unsigned int channels, snd_pcm_uframes_t frames)
+{
+	if (linear->simd_func &&
+	    snd_pcm_simd_convert_areas(dst_areas, dst_offset,
+				       src_areas, src_offset,
+				       channels, frames,
+				       linear->simd_dst_width,
+				       linear->simd_src_width,
+				       linear->simd_func,
+				       &linear->simd_conv) == 0)
+		return;
+	if (linear->use_getput)
+		snd_pcm_linear_getput(dst_areas, dst_offset,
+				      src_areas, src_offset,
+				      channels, frames,
+				      linear->get_idx, linear->put_idx);
+	else
+		snd_pcm_linear_convert(dst_areas, dst_offset,
+				       src_areas, src_offset,
+				       channels, frames, linear->conv_idx);
+}
+
 #endif /* DOC_HIDDEN */
 
 static int snd_pcm_linear_hw_refine_cprepare(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd_pcm_hw_params_t *params)
@@ -327,6 +397,11 @@ static int snd_pcm_linear_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 			linear->conv_idx = snd_pcm_linear_convert_index(linear->sformat,
 									format);
 	}
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		snd_pcm_linear_simd_select(linear, format, linear->sformat);
+	else
+		snd_pcm_linear_simd_select(linear, linear->sformat, format);
+	snd_pcm_plugin_set_identity(pcm, params, format == linear->sformat);
 	return 0;
 }
 
@@ -342,15 +417,8 @@ snd_pcm_linear_write_areas(snd_pcm_t *pcm,
 	snd_pcm_linear_t *linear = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	if (linear->use_getput)
-		snd_pcm_linear_getput(slave_areas, slave_offset,
-				      areas, offset, 
-				      pcm->channels, size,
-				      linear->get_idx, linear->put_idx);
-	else
-		snd_pcm_linear_convert(slave_areas, slave_offset,
-				       areas, offset, 
-				       pcm->channels, size, linear->conv_idx);
+	snd_pcm_linear_do_convert(linear, slave_areas, slave_offset,
+				  areas, offset, pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -367,15 +435,8 @@ snd_pcm_linear_read_areas(snd_pcm_t *pcm,
 	snd_pcm_linear_t *linear = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	if (linear->use_getput)
-		snd_pcm_linear_getput(areas, offset, 
-				      slave_areas, slave_offset,
-				      pcm->channels, size,
-				      linear->get_idx, linear->put_idx);
-	else
-		snd_pcm_linear_convert(areas, offset, 
-				       slave_areas, slave_offset,
-				       pcm->channels, size, linear->conv_idx);
+	snd_pcm_linear_do_convert(linear, areas, offset,
+				  slave_areas, slave_offset, pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
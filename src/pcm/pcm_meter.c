@@ -29,7 +29,9 @@
 
 #include "pcm_local.h"
 #include "pcm_plugin.h"
+#include "pcm_simd.h"
 #include "bswap.h"
+#include <math.h>
 #include <time.h>
 #include <pthread.h>
 #include <dlfcn.h>
@@ -56,9 +58,15 @@ struct _snd_pcm_scope {
 	struct list_head list;
 };
 
+/*
+ * The stream copies the frames to buf and then publishes the end position
+ * in wptr, the meter thread only reads buf up to wptr. The stream never
+ * waits for the meter; frames older than buf_size are simply overwritten.
+ */
 typedef struct _snd_pcm_meter {
 	snd_pcm_generic_t gen;
 	snd_pcm_uframes_t rptr;
+	snd_pcm_uframes_t wptr;
 	snd_pcm_uframes_t buf_size;
 	snd_pcm_channel_area_t *buf_areas;
 	snd_pcm_uframes_t now;
@@ -68,7 +76,6 @@ typedef struct _snd_pcm_meter {
 	int running;
 	int reset;
 	pthread_t thread;
-	pthread_mutex_t update_mutex;
 	pthread_mutex_t running_mutex;
 	pthread_cond_t running_cond;
 	struct timespec delay;
@@ -101,50 +108,25 @@ static void snd_pcm_meter_add_frames(snd_pcm_t *pcm,
 		if (ptr == pcm->boundary)
 			ptr = 0;
 	}
+	__atomic_store_n(&meter->wptr, ptr, __ATOMIC_RELEASE);
 }
 
-static void snd_pcm_meter_update_main(snd_pcm_t *pcm)
+static void snd_pcm_meter_set_rptr(snd_pcm_meter_t *meter,
+				   snd_pcm_uframes_t ptr)
 {
-	snd_pcm_meter_t *meter = pcm->private_data;
-	snd_pcm_sframes_t frames;
-	snd_pcm_uframes_t rptr, old_rptr;
-	const snd_pcm_channel_area_t *areas;
-	int locked;
-	locked = (pthread_mutex_trylock(&meter->update_mutex) >= 0);
-	areas = snd_pcm_mmap_areas(pcm);
-	rptr = *pcm->hw.ptr;
-	old_rptr = meter->rptr;
-	meter->rptr = rptr;
-	frames = rptr - old_rptr;
-	if (frames < 0)
-		frames += pcm->boundary;
-	if (frames > 0) {
-		assert((snd_pcm_uframes_t) frames <= pcm->buffer_size);
-		snd_pcm_meter_add_frames(pcm, areas, old_rptr,
-					 (snd_pcm_uframes_t) frames);
-	}
-	if (locked)
-		pthread_mutex_unlock(&meter->update_mutex);
+	meter->rptr = ptr;
+	__atomic_store_n(&meter->wptr, ptr, __ATOMIC_RELEASE);
 }
 
-static int snd_pcm_meter_update_scope(snd_pcm_t *pcm)
+static void snd_pcm_meter_update_main(snd_pcm_t *pcm)
 {
 	snd_pcm_meter_t *meter = pcm->private_data;
 	snd_pcm_sframes_t frames;
 	snd_pcm_uframes_t rptr, old_rptr;
 	const snd_pcm_channel_area_t *areas;
-	int reset = 0;
-	/* Wait main thread */
-	pthread_mutex_lock(&meter->update_mutex);
 	areas = snd_pcm_mmap_areas(pcm);
- _again:
 	rptr = *pcm->hw.ptr;
 	old_rptr = meter->rptr;
-	if (atomic_read(&meter->reset)) {
-		reset = 1;
-		atomic_dec(&meter->reset);
-		goto _again;
-	}
 	meter->rptr = rptr;
 	frames = rptr - old_rptr;
 	if (frames < 0)
@@ -154,8 +136,6 @@ static int snd_pcm_meter_update_scope(snd_pcm_t *pcm)
 		snd_pcm_meter_add_frames(pcm, areas, old_rptr,
 					 (snd_pcm_uframes_t) frames);
 	}
-	pthread_mutex_unlock(&meter->update_mutex);
-	return reset;
 }
 
 static int snd_pcm_scope_remove(snd_pcm_scope_t *scope)
@@ -191,6 +171,7 @@ static void *snd_pcm_meter_thread(void *data)
 	snd_pcm_t *spcm = meter->gen.slave;
 	struct list_head *pos;
 	snd_pcm_scope_t *scope;
+	snd_pcm_sframes_t ahead;
 	int reset;
 	list_for_each(pos, &meter->scopes) {
 		scope = list_entry(pos, snd_pcm_scope_t, list);
@@ -228,15 +209,20 @@ static void *snd_pcm_meter_thread(void *data)
 			if ((snd_pcm_uframes_t) now >= pcm->boundary)
 				now -= pcm->boundary;
 		}
+		/* never look past the frames published by the stream */
+		ahead = now - __atomic_load_n(&meter->wptr, __ATOMIC_ACQUIRE);
+		if (ahead < 0)
+			ahead += pcm->boundary;
+		if (ahead > 0 && (snd_pcm_uframes_t) ahead < pcm->boundary / 2) {
+			now -= ahead;
+			if (now < 0)
+				now += pcm->boundary;
+		}
 		meter->now = now;
-		if (pcm->stream == SND_PCM_STREAM_CAPTURE)
-			reset = snd_pcm_meter_update_scope(pcm);
-		else {
-			reset = 0;
-			while (atomic_read(&meter->reset)) {
-				reset = 1;
-				atomic_dec(&meter->reset);
-			}
+		reset = 0;
+		while (atomic_read(&meter->reset)) {
+			reset = 1;
+			atomic_dec(&meter->reset);
 		}
 		if (reset) {
 			list_for_each(pos, &meter->scopes) {
@@ -274,7 +260,6 @@ static int snd_pcm_meter_close(snd_pcm_t *pcm)
 	snd_pcm_meter_t *meter = pcm->private_data;
 	struct list_head *pos, *npos;
 	int err = 0;
-	pthread_mutex_destroy(&meter->update_mutex);
 	pthread_mutex_destroy(&meter->running_mutex);
 	pthread_cond_destroy(&meter->running_cond);
 	if (meter->gen.close_slave)
@@ -298,9 +283,9 @@ static int snd_pcm_meter_prepare(snd_pcm_t *pcm)
 	err = snd_pcm_prepare(meter->gen.slave);
 	if (err >= 0) {
 		if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
-			meter->rptr = *pcm->appl.ptr;
+			snd_pcm_meter_set_rptr(meter, *pcm->appl.ptr);
 		else
-			meter->rptr = *pcm->hw.ptr;
+			snd_pcm_meter_set_rptr(meter, *pcm->hw.ptr);
 	}
 	return err;
 }
@@ -311,7 +296,7 @@ static int snd_pcm_meter_reset(snd_pcm_t *pcm)
 	int err = snd_pcm_reset(meter->gen.slave);
 	if (err >= 0) {
 		if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
-			meter->rptr = *pcm->appl.ptr;
+			snd_pcm_meter_set_rptr(meter, *pcm->appl.ptr);
 	}
 	return err;
 }
@@ -333,7 +318,7 @@ static snd_pcm_sframes_t snd_pcm_meter_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t
 	snd_pcm_meter_t *meter = pcm->private_data;
 	snd_pcm_sframes_t err = snd_pcm_rewind(meter->gen.slave, frames);
 	if (err > 0 && pcm->stream == SND_PCM_STREAM_PLAYBACK)
-		meter->rptr = *pcm->appl.ptr;
+		snd_pcm_meter_set_rptr(meter, *pcm->appl.ptr);
 	return err;
 }
 
@@ -342,7 +327,7 @@ static snd_pcm_sframes_t snd_pcm_meter_forward(snd_pcm_t *pcm, snd_pcm_uframes_t
 	snd_pcm_meter_t *meter = pcm->private_data;
 	snd_pcm_sframes_t err = INTERNAL(snd_pcm_forward)(meter->gen.slave, frames);
 	if (err > 0 && pcm->stream == SND_PCM_STREAM_PLAYBACK)
-		meter->rptr = *pcm->appl.ptr;
+		snd_pcm_meter_set_rptr(meter, *pcm->appl.ptr);
 	return err;
 }
 
@@ -551,6 +536,7 @@ static const snd_pcm_fast_ops_t snd_pcm_meter_fast_ops = {
 	.poll_descriptors_count = snd_pcm_generic_poll_descriptors_count,
 	.poll_descriptors = snd_pcm_generic_poll_descriptors,
 	.poll_revents = snd_pcm_generic_poll_revents,
+	.wait = snd_pcm_generic_wait,
 	.may_wait_for_avail_min = snd_pcm_generic_may_wait_for_avail_min,
 };
 
@@ -599,7 +585,6 @@ int snd_pcm_meter_open(snd_pcm_t **pcmp, const char *name, unsigned int frequenc
 	snd_pcm_link_appl_ptr(pcm, slave);
 	*pcmp = pcm;
 
-	pthread_mutex_init(&meter->update_mutex, NULL);
 	pthread_mutex_init(&meter->running_mutex, NULL);
 	pthread_cond_init(&meter->running_cond, NULL);
 	return 0;
@@ -733,6 +718,19 @@ pcm.name {
 }
 \endcode
 
+The frames are passed to the meter thread through a ring that the stream
+fills without ever taking a lock, so a slow scope cannot stall the stream.
+
+The built-in scope type peak measures the sample peak, the RMS level and
+the 4x oversampled true peak of every channel with the SIMD kernels, see
+snd_pcm_scope_peak_get_levels():
+
+\code
+pcm_scope.name {
+	type peak		# Peak, RMS and true peak levels
+}
+\endcode
+
 \subsection pcm_plugins_meter_funcref Function reference
 
 <UL>
@@ -1224,6 +1222,336 @@ int16_t *snd_pcm_scope_s16_get_channel_buffer(snd_pcm_scope_t *scope,
 	return s16->buf_areas[channel].addr;
 }
 
+#ifndef DOC_HIDDEN
+/* true peak: 4x oversampling, three interpolated phases of PEAK_TAPS taps */
+#define PEAK_TAPS	12
+#define PEAK_PHASES	3
+/* frames converted per channel at once */
+#define PEAK_BLOCK	1024
+
+typedef struct _snd_pcm_scope_peak_level {
+	float peak;
+	float rms;
+	float true_peak;
+} snd_pcm_scope_peak_level_t;
+
+typedef struct _snd_pcm_scope_peak {
+	snd_pcm_t *pcm;
+	const snd_pcm_simd_ops_t *ops;
+	snd_pcm_simd_conv_func_t conv;	/* to float, NULL for FLOAT */
+	snd_pcm_simd_conv_t conv_args;
+	unsigned int index;		/* linear conversion to S32 or -1 */
+	snd_pcm_uframes_t old;
+	int32_t *tmp;			/* PEAK_BLOCK samples of S32 */
+	float *work;			/* history followed by PEAK_BLOCK */
+	float *history;			/* PEAK_TAPS - 1 samples per channel */
+	snd_pcm_scope_peak_level_t *levels;
+	float taps[PEAK_PHASES][PEAK_TAPS];
+} snd_pcm_scope_peak_t;
+
+/* windowed sinc interpolating at 1/4, 2/4 and 3/4 between the middle taps */
+static void peak_init_taps(snd_pcm_scope_peak_t *peak)
+{
+	unsigned int p, k;
+
+	for (p = 0; p < PEAK_PHASES; p++) {
+		float sum = 0;
+		for (k = 0; k < PEAK_TAPS; k++) {
+			double t = (int)k - (PEAK_TAPS / 2 - 1) - (p + 1) / 4.0;
+			double x = M_PI * t;
+			double w = 0.42 + 0.5 * cos(x / (PEAK_TAPS / 2)) +
+				0.08 * cos(2 * x / (PEAK_TAPS / 2));
+			peak->taps[p][k] = w * sin(x) / x;
+			sum += peak->taps[p][k];
+		}
+		for (k = 0; k < PEAK_TAPS; k++)
+			peak->taps[p][k] /= sum;
+	}
+}
+
+static int peak_enable(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_peak_t *peak = scope->private_data;
+	snd_pcm_meter_t *meter = peak->pcm->private_data;
+	snd_pcm_t *spcm = meter->gen.slave;
+	const snd_pcm_simd_ops_t *ops = snd_pcm_simd_ops();
+	int width = snd_pcm_format_width(spcm->format);
+
+	if (!ops->meter_level)
+		return -ENXIO;
+	peak->ops = ops;
+	peak->index = -1;
+	peak->conv = ops->conv_s32_float;
+	peak->conv_args.bits = 32;
+	switch (spcm->format) {
+	case SND_PCM_FORMAT_FLOAT:
+		peak->conv = NULL;
+		break;
+	case SND_PCM_FORMAT_S16:
+		peak->conv = ops->conv_s16_float;
+		break;
+	case SND_PCM_FORMAT_S24:
+	case SND_PCM_FORMAT_S32:
+		peak->conv_args.bits = width;
+		break;
+	default:
+		if (!snd_pcm_format_linear(spcm->format) ||
+		    snd_pcm_format_physical_width(spcm->format) == 24)
+			return -EINVAL;
+		peak->index = snd_pcm_linear_convert_index(spcm->format,
+							   SND_PCM_FORMAT_S32);
+		peak->tmp = malloc(PEAK_BLOCK * sizeof(*peak->tmp));
+		if (!peak->tmp)
+			return -ENOMEM;
+		break;
+	}
+	peak->work = malloc((PEAK_TAPS - 1 + PEAK_BLOCK) * sizeof(float));
+	peak->history = calloc(spcm->channels * (PEAK_TAPS - 1), sizeof(float));
+	peak->levels = calloc(spcm->channels, sizeof(*peak->levels));
+	if (!peak->work || !peak->history || !peak->levels) {
+		free(peak->tmp);
+		free(peak->work);
+		free(peak->history);
+		free(peak->levels);
+		peak->tmp = NULL;
+		peak->work = NULL;
+		peak->history = NULL;
+		peak->levels = NULL;
+		return -ENOMEM;
+	}
+	peak_init_taps(peak);
+	return 0;
+}
+
+static void peak_disable(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_peak_t *peak = scope->private_data;
+	free(peak->tmp);
+	free(peak->work);
+	free(peak->history);
+	free(peak->levels);
+	peak->tmp = NULL;
+	peak->work = NULL;
+	peak->history = NULL;
+	peak->levels = NULL;
+}
+
+static void peak_close(snd_pcm_scope_t *scope)
+{
+	free(scope->private_data);
+}
+
+static void peak_start(snd_pcm_scope_t *scope ATTRIBUTE_UNUSED)
+{
+}
+
+static void peak_stop(snd_pcm_scope_t *scope ATTRIBUTE_UNUSED)
+{
+}
+
+/* measure frames of one channel from the meter buffer at offset */
+static void peak_channel(snd_pcm_scope_peak_t *peak, unsigned int c,
+			 snd_pcm_uframes_t offset, snd_pcm_uframes_t frames,
+			 float *res)
+{
+	snd_pcm_meter_t *meter = peak->pcm->private_data;
+	const snd_pcm_channel_area_t *area = &meter->buf_areas[c];
+	float *history = peak->history + c * (PEAK_TAPS - 1);
+	float *x = peak->work + PEAK_TAPS - 1;
+	const char *src;
+	unsigned int p;
+	float tp;
+
+	while (frames > 0) {
+		snd_pcm_uframes_t n = frames < PEAK_BLOCK ? frames : PEAK_BLOCK;
+		src = (const char *)area->addr + offset * (area->step / 8);
+		if (peak->index != -1U) {
+			snd_pcm_channel_area_t tmp_area = {
+				.addr = peak->tmp, .first = 0, .step = 32
+			};
+			snd_pcm_linear_convert(&tmp_area, 0, area, offset, 1,
+					       n, peak->index);
+			src = (const char *)peak->tmp;
+		}
+		if (peak->conv)
+			peak->conv(x, src, n, &peak->conv_args);
+		else
+			memcpy(x, src, n * sizeof(float));
+		memcpy(peak->work, history, (PEAK_TAPS - 1) * sizeof(float));
+		peak->ops->meter_level(x, n, res);
+		for (p = 0; p < PEAK_PHASES; p++) {
+			tp = peak->ops->fir_peak(peak->work, peak->taps[p],
+						 PEAK_TAPS, n);
+			if (tp > res[2])
+				res[2] = tp;
+		}
+		memcpy(history, x + n - (PEAK_TAPS - 1),
+		       (PEAK_TAPS - 1) * sizeof(float));
+		offset += n;
+		frames -= n;
+	}
+}
+
+static void peak_update(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_peak_t *peak = scope->private_data;
+	snd_pcm_meter_t *meter = peak->pcm->private_data;
+	snd_pcm_t *spcm = meter->gen.slave;
+	snd_pcm_sframes_t size;
+	snd_pcm_uframes_t offset, cont;
+	unsigned int c;
+
+	size = meter->now - peak->old;
+	if (size < 0)
+		size += spcm->boundary;
+	if (size > (snd_pcm_sframes_t)peak->pcm->buffer_size) {
+		/* the older frames are overwritten already, measure the
+		 * newest ones and restart the oversampling filter
+		 */
+		size = peak->pcm->buffer_size;
+		memset(peak->history, 0,
+		       spcm->channels * (PEAK_TAPS - 1) * sizeof(float));
+	}
+	if (size <= 0)
+		return;
+	offset = (meter->now + spcm->boundary - size) % spcm->boundary %
+		 meter->buf_size;
+	cont = meter->buf_size - offset;
+	for (c = 0; c < spcm->channels; c++) {
+		/* peak, sum of squares, true peak */
+		float res[3] = { 0, 0, 0 };
+		snd_pcm_scope_peak_level_t *l = &peak->levels[c];
+		if ((snd_pcm_uframes_t)size > cont) {
+			peak_channel(peak, c, offset, cont, res);
+			peak_channel(peak, c, 0, size - cont, res);
+		} else
+			peak_channel(peak, c, offset, size, res);
+		l->peak = res[0];
+		l->rms = sqrtf(res[1] / size);
+		l->true_peak = res[2] > res[0] ? res[2] : res[0];
+	}
+	peak->old = meter->now;
+}
+
+static void peak_reset(snd_pcm_scope_t *scope)
+{
+	snd_pcm_scope_peak_t *peak = scope->private_data;
+	snd_pcm_meter_t *meter = peak->pcm->private_data;
+	unsigned int channels = meter->gen.slave->channels;
+
+	memset(peak->history, 0, channels * (PEAK_TAPS - 1) * sizeof(float));
+	memset(peak->levels, 0, channels * sizeof(*peak->levels));
+	peak->old = meter->now;
+}
+
+static const snd_pcm_scope_ops_t peak_ops = {
+	.enable = peak_enable,
+	.disable = peak_disable,
+	.close = peak_close,
+	.start = peak_start,
+	.stop = peak_stop,
+	.update = peak_update,
+	.reset = peak_reset,
+};
+
+#endif
+
+/**
+ * \brief Add a peak level scope to a #SND_PCM_TYPE_METER PCM
+ * \param pcm The pcm handle
+ * \param name Scope name
+ * \param scopep Pointer to newly created and added scope
+ * \return 0 on success otherwise a negative error code
+ *
+ * The peak scope measures the sample peak, the RMS level and the true
+ * peak (4x oversampled) of each channel over the frames of every meter
+ * update, see #snd_pcm_scope_peak_get_levels. It handles the linear
+ * formats up to 32 bits and #SND_PCM_FORMAT_FLOAT in CPU endian.
+ */
+int snd_pcm_scope_peak_open(snd_pcm_t *pcm, const char *name,
+			    snd_pcm_scope_t **scopep)
+{
+	snd_pcm_meter_t *meter;
+	snd_pcm_scope_t *scope;
+	snd_pcm_scope_peak_t *peak;
+	assert(pcm->type == SND_PCM_TYPE_METER);
+	meter = pcm->private_data;
+	scope = calloc(1, sizeof(*scope));
+	if (!scope)
+		return -ENOMEM;
+	peak = calloc(1, sizeof(*peak));
+	if (!peak) {
+		free(scope);
+		return -ENOMEM;
+	}
+	if (name)
+		scope->name = strdup(name);
+	peak->pcm = pcm;
+	scope->ops = &peak_ops;
+	scope->private_data = peak;
+	list_add_tail(&scope->list, &meter->scopes);
+	*scopep = scope;
+	return 0;
+}
+
+/**
+ * \brief Get the levels of a channel from a peak scope
+ * \param scope peak scope handle
+ * \param channel Channel
+ * \param peak Returns the sample peak (1.0 is full scale)
+ * \param rms Returns the RMS level (1.0 is full scale)
+ * \param true_peak Returns the true peak (1.0 is full scale)
+ * \return 0 on success otherwise a negative error code
+ *
+ * The levels are measured over the frames of the last meter update.
+ * Any of the pointers may be NULL.
+ */
+int snd_pcm_scope_peak_get_levels(snd_pcm_scope_t *scope, unsigned int channel,
+				  float *peak, float *rms, float *true_peak)
+{
+	snd_pcm_scope_peak_t *p;
+	snd_pcm_meter_t *meter;
+	const snd_pcm_scope_peak_level_t *l;
+	assert(scope->ops == &peak_ops);
+	p = scope->private_data;
+	meter = p->pcm->private_data;
+	if (!p->levels)
+		return -EBADFD;
+	if (channel >= meter->gen.slave->channels)
+		return -EINVAL;
+	l = &p->levels[channel];
+	if (peak)
+		*peak = l->peak;
+	if (rms)
+		*rms = l->rms;
+	if (true_peak)
+		*true_peak = l->true_peak;
+	return 0;
+}
+
+#ifndef DOC_HIDDEN
+int _snd_pcm_scope_peak_open(snd_pcm_t *pcm, const char *name,
+			     snd_config_t *root ATTRIBUTE_UNUSED,
+			     snd_config_t *conf)
+{
+	snd_config_iterator_t i, next;
+	snd_pcm_scope_t *scope;
+	snd_config_for_each(i, next, conf) {
+		snd_config_t *n = snd_config_iterator_entry(i);
+		const char *id;
+		if (snd_config_get_id(n, &id) < 0)
+			continue;
+		if (strcmp(id, "comment") == 0)
+			continue;
+		if (strcmp(id, "type") == 0)
+			continue;
+		SNDERR("Unknown field %s", id);
+		return -EINVAL;
+	}
+	return snd_pcm_scope_peak_open(pcm, name, &scope);
+}
+#endif
+
 /**
  * \brief allocate an invalid #snd_pcm_scope_t using standard malloc
  * \param ptr returned pointer
@@ -29,7 +29,11 @@
 #include "pcm_local.h"
 #include "pcm_plugin.h"
 #include "plugin_ops.h"
+#include "pcm_simd.h"
 #include "bswap.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #ifndef PIC
 /* entry for static linking */
@@ -51,6 +55,9 @@ typedef struct {
 	unsigned int getput_idx;
 	mulaw_f func;
 	snd_pcm_format_t sformat;
+	snd_pcm_simd_conv_func_t simd_func;
+	snd_pcm_simd_conv_t simd_conv;
+	int simd_encode;
 } snd_pcm_mulaw_t;
 
 #endif
@@ -157,6 +164,43 @@ static int ulaw_to_s16(unsigned char u_val)
 
 #ifndef DOC_HIDDEN
 
+/* the encode table is indexed by the 16-bit sample bits */
+typedef struct {
+	uint16_t dec[256 + SND_PCM_SIMD_LUT_PAD / 2];
+	uint8_t enc[65536 + SND_PCM_SIMD_LUT_PAD];
+} snd_pcm_mulaw_lut_t;
+
+static snd_pcm_mulaw_lut_t mulaw_lut;
+#ifdef HAVE_LIBPTHREAD
+static pthread_once_t mulaw_lut_once = PTHREAD_ONCE_INIT;
+#else
+static int mulaw_lut_ready;
+#endif
+
+static void snd_pcm_mulaw_lut_init(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 256; i++)
+		mulaw_lut.dec[i] = ulaw_to_s16(i);
+	for (i = 0; i < 65536; i++)
+		mulaw_lut.enc[i] = s16_to_ulaw((int16_t)i);
+}
+
+/* the tables are built once, by the first caller */
+static const snd_pcm_mulaw_lut_t *snd_pcm_mulaw_lut(void)
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_once(&mulaw_lut_once, snd_pcm_mulaw_lut_init);
+#else
+	if (!mulaw_lut_ready) {
+		snd_pcm_mulaw_lut_init();
+		mulaw_lut_ready = 1;
+	}
+#endif
+	return &mulaw_lut;
+}
+
 void snd_pcm_mulaw_decode(const snd_pcm_channel_area_t *dst_areas,
 			  snd_pcm_uframes_t dst_offset,
 			  const snd_pcm_channel_area_t *src_areas,
@@ -168,6 +212,7 @@ void snd_pcm_mulaw_decode(const snd_pcm_channel_area_t *dst_areas,
 #include "plugin_ops.h"
 #undef PUT16_LABELS
 	void *put = put16_labels[putidx];
+	const snd_pcm_mulaw_lut_t *lut = snd_pcm_mulaw_lut();
 	unsigned int channel;
 	for (channel = 0; channel < channels; ++channel) {
 		const unsigned char *src;
@@ -182,7 +227,7 @@ void snd_pcm_mulaw_decode(const snd_pcm_channel_area_t *dst_areas,
 		dst_step = snd_pcm_channel_area_step(dst_area);
 		frames1 = frames;
 		while (frames1-- > 0) {
-			int16_t sample = ulaw_to_s16(*src);
+			int16_t sample = lut->dec[*src];
 			goto *put;
 #define PUT16_END after
 #include "plugin_ops.h"
@@ -205,6 +250,7 @@ void snd_pcm_mulaw_encode(const snd_pcm_channel_area_t *dst_areas,
 #include "plugin_ops.h"
 #undef GET16_LABELS
 	void *get = get16_labels[getidx];
+	const snd_pcm_mulaw_lut_t *lut = snd_pcm_mulaw_lut();
 	unsigned int channel;
 	int16_t sample = 0;
 	for (channel = 0; channel < channels; ++channel) {
@@ -225,7 +271,7 @@ void snd_pcm_mulaw_encode(const snd_pcm_channel_area_t *dst_areas,
 #include "plugin_ops.h"
 #undef GET16_END
 		after:
-			*dst = s16_to_ulaw(sample);
+			*dst = lut->enc[(uint16_t)sample];
 			src += src_step;
 			dst += dst_step;
 		}
@@ -316,6 +362,44 @@ static int snd_pcm_mulaw_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 				       snd_pcm_generic_hw_refine);
 }
 
+static void snd_pcm_mulaw_simd_select(snd_pcm_mulaw_t *mulaw,
+				      snd_pcm_format_t format)
+{
+	const snd_pcm_simd_ops_t *ops = snd_pcm_simd_ops();
+
+	mulaw->simd_func = NULL;
+	if (snd_pcm_format_physical_width(format) != 16 ||
+	    snd_pcm_format_cpu_endian(format) != 1)
+		return;
+	mulaw->simd_encode = mulaw->func == snd_pcm_mulaw_encode;
+	mulaw->simd_func = mulaw->simd_encode ? ops->lut_16_8 : ops->lut_8_16;
+	mulaw->simd_conv.flip = snd_pcm_format_signed(format) ? 0 : 0x8000;
+	if (mulaw->simd_encode)
+		mulaw->simd_conv.table = snd_pcm_mulaw_lut()->enc;
+	else
+		mulaw->simd_conv.table = snd_pcm_mulaw_lut()->dec;
+}
+
+static void snd_pcm_mulaw_convert(snd_pcm_mulaw_t *mulaw,
+				  const snd_pcm_channel_area_t *dst_areas,
+				  snd_pcm_uframes_t dst_offset,
+				  const snd_pcm_channel_area_t *src_areas,
+				  snd_pcm_uframes_t src_offset,
+				  unsigned int channels, snd_pcm_uframes_t frames)
+{
+	if (mulaw->simd_func &&
+	    snd_pcm_simd_convert_areas(dst_areas, dst_offset,
+				       src_areas, src_offset,
+				       channels, frames,
+				       mulaw->simd_encode ? 8 : 16,
+				       mulaw->simd_encode ? 16 : 8,
+				       mulaw->simd_func,
+				       &mulaw->simd_conv) == 0)
+		return;
+	mulaw->func(dst_areas, dst_offset, src_areas, src_offset,
+		    channels, frames, mulaw->getput_idx);
+}
+
 static int snd_pcm_mulaw_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 {
 	snd_pcm_mulaw_t *mulaw = pcm->private_data;
@@ -349,6 +433,8 @@ static int snd_pcm_mulaw_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 			mulaw->func = snd_pcm_mulaw_encode;
 		}
 	}
+	snd_pcm_mulaw_simd_select(mulaw, mulaw->sformat == SND_PCM_FORMAT_MU_LAW ?
+				  format : mulaw->sformat);
 	return 0;
 }
 
@@ -364,10 +450,8 @@ snd_pcm_mulaw_write_areas(snd_pcm_t *pcm,
 	snd_pcm_mulaw_t *mulaw = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	mulaw->func(slave_areas, slave_offset,
-		    areas, offset, 
-		    pcm->channels, size,
-		    mulaw->getput_idx);
+	snd_pcm_mulaw_convert(mulaw, slave_areas, slave_offset, areas, offset,
+			      pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -384,10 +468,8 @@ snd_pcm_mulaw_read_areas(snd_pcm_t *pcm,
 	snd_pcm_mulaw_t *mulaw = pcm->private_data;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
-	mulaw->func(areas, offset, 
-		    slave_areas, slave_offset,
-		    pcm->channels, size,
-		    mulaw->getput_idx);
+	snd_pcm_mulaw_convert(mulaw, areas, offset, slave_areas, slave_offset,
+			      pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
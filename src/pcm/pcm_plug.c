@@ -28,6 +28,7 @@
   
 #include "pcm_local.h"
 #include "pcm_plugin.h"
+#include "pcm_simd.h"
 
 #ifndef PIC
 /* entry for static linking */
@@ -343,6 +344,260 @@ static snd_pcm_format_t snd_pcm_plug_slave_format(snd_pcm_format_t format, const
 	return SND_PCM_FORMAT_UNKNOWN;
 }
 
+#ifndef DOC_HIDDEN
+/*
+ * Conversion cost model
+ *
+ * Among the slave formats keeping the most of the client resolution,
+ * the one with the cheapest conversion stages is chosen. The costs are
+ * rough estimates in tenths of a cycle per sample for the conversion
+ * loops of this tree. A stage with its own buffer also pays for one
+ * more pass over the samples.
+ */
+#define PLUG_COST_PASS		1	/* per byte read or written by a stage */
+#define PLUG_COST_SIMD		5	/* whole-buffer SIMD kernel */
+#define PLUG_COST_CONV		25	/* conversion labels */
+#define PLUG_COST_GETPUT	40	/* 3 byte and 20-bit samples */
+#define PLUG_COST_FLOAT		60	/* float <-> integer without SIMD */
+#define PLUG_COST_LAW		30	/* mu-law, A-law */
+#define PLUG_COST_ADPCM		120
+#define PLUG_COST_ROUTE		10	/* per slave sample */
+#define PLUG_COST_RATE		100	/* depends much on the converter */
+
+typedef struct {
+	snd_pcm_type_t type;
+	snd_pcm_format_t format, sformat;
+	unsigned int channels, schannels;
+} snd_pcm_plug_stage_t;
+#endif
+
+/* significant bits of a format, 0 for the formats plug cannot convert */
+static int snd_pcm_plug_format_bits(snd_pcm_format_t format)
+{
+	if (snd_pcm_format_linear(format) == 1)
+		return snd_pcm_format_width(format);
+	switch (format) {
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+	case SND_PCM_FORMAT_FLOAT_LE:
+	case SND_PCM_FORMAT_FLOAT_BE:
+		return 24;
+	case SND_PCM_FORMAT_FLOAT64_LE:
+	case SND_PCM_FORMAT_FLOAT64_BE:
+		return 53;
+#endif
+#ifdef BUILD_PCM_PLUGIN_MULAW
+	case SND_PCM_FORMAT_MU_LAW:
+		return 14;
+#endif
+#ifdef BUILD_PCM_PLUGIN_ALAW
+	case SND_PCM_FORMAT_A_LAW:
+		return 13;
+#endif
+#ifdef BUILD_PCM_PLUGIN_ADPCM
+	case SND_PCM_FORMAT_IMA_ADPCM:
+		return 16;
+#endif
+	default:
+		return 0;
+	}
+}
+
+/* host endian integer formats handled by the SIMD kernels */
+static int snd_pcm_plug_simd_format(snd_pcm_format_t format)
+{
+	return snd_pcm_format_linear(format) == 1 &&
+	       snd_pcm_format_cpu_endian(format) == 1;
+}
+
+/* cost of converting one sample between two formats */
+static unsigned int snd_pcm_plug_conv_cost(snd_pcm_format_t a, snd_pcm_format_t b)
+{
+	const snd_pcm_simd_ops_t *ops = snd_pcm_simd_ops();
+	snd_pcm_format_t t;
+	int wa, wb;
+
+	if (a == b)
+		return 0;
+	if (snd_pcm_format_linear(a) == 1) {
+		t = a;
+		a = b;
+		b = t;
+	}
+	/* b is linear now, unless none is */
+	wa = snd_pcm_format_width(a);
+	wb = snd_pcm_format_width(b);
+	if (snd_pcm_format_linear(a) == 1) {
+		if (snd_pcm_plug_simd_format(a) && snd_pcm_plug_simd_format(b)) {
+			if (((wa == 16 && wb == 32) || (wa == 32 && wb == 16)) &&
+			    ops->conv_16_32)
+				return PLUG_COST_SIMD;
+			if (((wa == 24 && snd_pcm_format_physical_width(a) == 24 && wb == 32) ||
+			     (wb == 24 && snd_pcm_format_physical_width(b) == 24 && wa == 32)) &&
+			    ops->conv_24_3_32)
+				return PLUG_COST_SIMD;
+		}
+		if (snd_pcm_format_physical_width(a) == 24 ||
+		    snd_pcm_format_physical_width(b) == 24 ||
+		    wa == 20 || wb == 20)
+			return PLUG_COST_GETPUT;
+		return PLUG_COST_CONV;
+	}
+	if (snd_pcm_format_float(a) == 1) {
+		if (snd_pcm_format_linear(b) == 1 &&
+		    snd_pcm_format_cpu_endian(a) == 1 &&
+		    snd_pcm_plug_simd_format(b) &&
+		    snd_pcm_format_signed(b) == 1 &&
+		    (wb == 16 || wb == 32 ||
+		     (wb == 24 && snd_pcm_format_physical_width(b) == 32)) &&
+		    ops->conv_s32_float)
+			return PLUG_COST_SIMD * 2;
+		return PLUG_COST_FLOAT;
+	}
+	if (a == SND_PCM_FORMAT_IMA_ADPCM || b == SND_PCM_FORMAT_IMA_ADPCM)
+		return PLUG_COST_ADPCM;
+	return PLUG_COST_LAW;
+}
+
+/* bytes per frame of one side of a stage, for the cost of a pass */
+static unsigned int snd_pcm_plug_frame_bytes(snd_pcm_format_t format,
+					     unsigned int channels)
+{
+	int width = snd_pcm_format_physical_width(format);
+
+	return (width > 0 ? width : 8) * channels / 8;
+}
+
+/* estimated cost of a stage per frame */
+static unsigned int snd_pcm_plug_stage_cost(const snd_pcm_plug_stage_t *s)
+{
+	unsigned int cost;
+
+	cost = (snd_pcm_plug_frame_bytes(s->format, s->channels) +
+		snd_pcm_plug_frame_bytes(s->sformat, s->schannels)) *
+		PLUG_COST_PASS;
+	switch (s->type) {
+	case SND_PCM_TYPE_ROUTE:
+		cost += (PLUG_COST_ROUTE +
+			 snd_pcm_plug_conv_cost(s->format, s->sformat)) * s->schannels;
+		break;
+	case SND_PCM_TYPE_RATE:
+		cost += (PLUG_COST_RATE +
+			 snd_pcm_plug_conv_cost(s->format, s->sformat)) * s->schannels;
+		break;
+	case SND_PCM_TYPE_LINEAR:
+	case SND_PCM_TYPE_LINEAR_FLOAT:
+	case SND_PCM_TYPE_MULAW:
+	case SND_PCM_TYPE_ALAW:
+	case SND_PCM_TYPE_ADPCM:
+		cost += snd_pcm_plug_conv_cost(s->format, s->sformat) * s->channels;
+		break;
+	default:
+		break;
+	}
+	return cost;
+}
+
+/*
+ * estimated cost of the format dependent part of the chain built by
+ * snd_pcm_plug_insert_plugins() for the given formats, a linear
+ * conversion is done by route or rate when there is one
+ */
+static unsigned int snd_pcm_plug_format_cost(snd_pcm_format_t format,
+					     snd_pcm_format_t sformat,
+					     unsigned int channels,
+					     unsigned int schannels,
+					     int rchange, int cchange)
+{
+	snd_pcm_plug_stage_t s;
+
+	s.format = format;
+	s.sformat = sformat;
+	s.channels = s.schannels = channels;
+	if (snd_pcm_format_linear(format) == 1 &&
+	    snd_pcm_format_linear(sformat) == 1) {
+		if (rchange || cchange)
+			return snd_pcm_plug_conv_cost(format, sformat) * channels;
+		s.type = SND_PCM_TYPE_LINEAR;
+	} else if (snd_pcm_format_linear(sformat) == 1 &&
+		   snd_pcm_format_float(format) == 1) {
+		/* see snd_pcm_plug_change_channels() */
+		if (cchange && !rchange &&
+		    (format == SND_PCM_FORMAT_FLOAT ||
+		     format == SND_PCM_FORMAT_FLOAT64))
+			return snd_pcm_plug_conv_cost(format, SND_PCM_FORMAT_S32) * channels;
+		s.type = SND_PCM_TYPE_LINEAR_FLOAT;
+	} else {
+		/* converted next to the slave */
+		if (snd_pcm_format_linear(format) == 1)
+			s.channels = s.schannels = schannels;
+		s.type = snd_pcm_format_float(sformat) == 1 ?
+			SND_PCM_TYPE_LINEAR_FLOAT : SND_PCM_TYPE_LINEAR;
+	}
+	return snd_pcm_plug_stage_cost(&s);
+}
+
+/* whether snd_pcm_plug_insert_plugins() can convert between the formats */
+static int snd_pcm_plug_format_reachable(snd_pcm_format_t format,
+					 snd_pcm_format_t sformat)
+{
+	if (!snd_pcm_plug_format_bits(format) ||
+	    !snd_pcm_plug_format_bits(sformat))
+		return 0;
+	if (snd_pcm_format_linear(format) == 1 ||
+	    snd_pcm_format_linear(sformat) == 1)
+		return 1;
+	/* a float or non linear pair needs an S16 step between them */
+	return 0;
+}
+
+/*
+ * Pick the slave format for a client format: keep the most significant
+ * bits first, then take the cheapest conversion, the choice of
+ * snd_pcm_plug_slave_format() wins the ties.
+ */
+static snd_pcm_format_t snd_pcm_plug_plan_format(snd_pcm_hw_params_t *params,
+						 snd_pcm_hw_params_t *sparams,
+						 snd_pcm_format_t format,
+						 const snd_pcm_format_mask_t *format_mask)
+{
+	snd_pcm_format_t best, f;
+	unsigned int channels, schannels, cost, best_cost;
+	int rchange, cchange, bits, best_bits, cbits;
+
+	best = snd_pcm_plug_slave_format(format, format_mask);
+	if (best == SND_PCM_FORMAT_UNKNOWN || best == format ||
+	    !snd_pcm_plug_format_reachable(format, best))
+		return best;
+	channels = snd_interval_min(snd_pcm_hw_param_get_interval(params, SND_PCM_HW_PARAM_CHANNELS));
+	schannels = snd_interval_min(snd_pcm_hw_param_get_interval(sparams, SND_PCM_HW_PARAM_CHANNELS));
+	rchange = !snd_pcm_hw_param_always_eq(params, SND_PCM_HW_PARAM_RATE, sparams);
+	cchange = !snd_pcm_hw_param_always_eq(params, SND_PCM_HW_PARAM_CHANNELS, sparams);
+	cbits = snd_pcm_plug_format_bits(format);
+	best_bits = snd_pcm_plug_format_bits(best);
+	if (best_bits > cbits)
+		best_bits = cbits;
+	best_cost = snd_pcm_plug_format_cost(format, best, channels, schannels,
+					     rchange, cchange);
+	for (f = 0; f <= SND_PCM_FORMAT_LAST; f++) {
+		if (f == best || !snd_pcm_format_mask_test(format_mask, f) ||
+		    !snd_pcm_plug_format_reachable(format, f))
+			continue;
+		bits = snd_pcm_plug_format_bits(f);
+		if (bits > cbits)
+			bits = cbits;
+		if (bits < best_bits)
+			continue;
+		cost = snd_pcm_plug_format_cost(format, f, channels, schannels,
+						rchange, cchange);
+		if (bits == best_bits && cost >= best_cost)
+			continue;
+		best = f;
+		best_bits = bits;
+		best_cost = cost;
+	}
+	return best;
+}
+
 static void snd_pcm_plug_clear(snd_pcm_t *pcm)
 {
 	snd_pcm_plug_t *plug = pcm->private_data;
@@ -486,6 +741,15 @@ static int snd_pcm_plug_change_channels(snd_pcm_t *pcm, snd_pcm_t **new, snd_pcm
 	slv->access = clt->access;
 	if (snd_pcm_format_linear(clt->format))
 		slv->format = clt->format;
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+	/* route converts host endian float samples in the same pass, but
+	 * a rate converter following it needs linear ones
+	 */
+	else if ((clt->format == SND_PCM_FORMAT_FLOAT ||
+		  clt->format == SND_PCM_FORMAT_FLOAT64) &&
+		 clt->rate == slv->rate)
+		slv->format = clt->format;
+#endif
 	return 1;
 }
 #endif
@@ -824,7 +1088,8 @@ static int snd_pcm_plug_hw_refine_schange(snd_pcm_t *pcm, snd_pcm_hw_params_t *p
 			if (snd_pcm_format_mask_test(sformat_mask, format))
 				f = format;
 			else {
-				f = snd_pcm_plug_slave_format(format, sformat_mask);
+				f = snd_pcm_plug_plan_format(params, sparams,
+							     format, sformat_mask);
 				if (f == SND_PCM_FORMAT_UNKNOWN)
 					continue;
 			}
@@ -1077,11 +1342,40 @@ static int snd_pcm_plug_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t * params)
 	return err;
 }
 
+/* the inserted plugins with their estimated cost, see snd_pcm_plug_stage_cost() */
+static void snd_pcm_plug_dump_chain(snd_pcm_t *pcm, snd_output_t *out)
+{
+	snd_pcm_plug_t *plug = pcm->private_data;
+	snd_pcm_plug_stage_t s;
+	snd_pcm_t *p, *slave;
+	unsigned int cost, total = 0;
+
+	snd_output_printf(out, "Conversion cost estimate (cycles/frame):\n");
+	for (p = plug->gen.slave; p != plug->req_slave; p = slave) {
+		slave = ((snd_pcm_generic_t *)p->private_data)->slave;
+		s.type = p->type;
+		s.format = p->format;
+		s.sformat = slave->format;
+		s.channels = p->channels;
+		s.schannels = slave->channels;
+		cost = snd_pcm_plug_stage_cost(&s);
+		total += cost;
+		snd_output_printf(out, "  %s: %s %uch -> %s %uch: %u.%u\n",
+				  snd_pcm_type_name(p->type),
+				  snd_pcm_format_name(s.format), s.channels,
+				  snd_pcm_format_name(s.sformat), s.schannels,
+				  cost / 10, cost % 10);
+	}
+	snd_output_printf(out, "  total: %u.%u\n", total / 10, total % 10);
+}
+
 static void snd_pcm_plug_dump(snd_pcm_t *pcm, snd_output_t *out)
 {
 	snd_pcm_plug_t *plug = pcm->private_data;
 	snd_output_printf(out, "Plug PCM: ");
 	snd_pcm_dump(plug->gen.slave, out);
+	if (pcm->setup && plug->gen.slave != plug->req_slave)
+		snd_pcm_plug_dump_chain(pcm, out);
 }
 
 static const snd_pcm_ops_t snd_pcm_plug_ops = {
@@ -1210,6 +1504,13 @@ pcm.name {
 }
 \endcode
 
+When the slave format is not given, it is chosen among the formats of
+the slave keeping the most significant bits of the client format, by
+the estimated cost of the conversions it needs. snd_pcm_dump() of a
+set up plug PCM ends with the inserted plugins and their estimated cost
+in cycles per frame. These are rough figures of the model used for the
+choice, not measurements.
+
 \subsection pcm_plugins_plug_funcref Function reference
 
 <UL>
@@ -135,6 +135,50 @@ void snd_pcm_plugin_init(snd_pcm_plugin_t *plugin)
 	plugin->undo_write = snd_pcm_plugin_undo_write;
 }
 
+/*
+ * Called from hw_params of a plugin, identity is set when the plugin
+ * passes the samples unchanged with the current parameters. When the
+ * slave buffer also has the layout the client access needs, the plugin
+ * shadows the slave buffer (see snd_pcm_generic_channel_info()) and
+ * the mmap commits only forward the slave pointers.
+ * Only playback is shadowed: a capture slave would have to be committed
+ * when the hw_ptr syncs, before the client read the frames, and the
+ * device could then overwrite them without an xrun.
+ */
+void snd_pcm_plugin_set_identity(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, int identity)
+{
+	snd_pcm_plugin_t *plugin = pcm->private_data;
+	snd_pcm_t *slave = plugin->gen.slave;
+	snd_pcm_access_t access;
+	snd_pcm_format_t format;
+	snd_pcm_uframes_t buffer_size;
+	unsigned int channels;
+
+	plugin->identity = 0;
+	pcm->mmap_shadow = 0;
+	if (!identity || pcm->stream != SND_PCM_STREAM_PLAYBACK ||
+	    !slave->mmap_channels ||
+	    INTERNAL(snd_pcm_hw_params_get_access)(params, &access) < 0 ||
+	    INTERNAL(snd_pcm_hw_params_get_format)(params, &format) < 0 ||
+	    INTERNAL(snd_pcm_hw_params_get_channels)(params, &channels) < 0 ||
+	    INTERNAL(snd_pcm_hw_params_get_buffer_size)(params, &buffer_size) < 0)
+		return;
+	if (format != slave->format || channels != slave->channels ||
+	    buffer_size != slave->buffer_size)
+		return;
+	switch (access) {
+	case SND_PCM_ACCESS_MMAP_INTERLEAVED:
+	case SND_PCM_ACCESS_MMAP_NONINTERLEAVED:
+		if (access != slave->access)
+			return;
+		break;
+	default:
+		break;
+	}
+	plugin->identity = 1;
+	pcm->mmap_shadow = 1;
+}
+
 static int snd_pcm_plugin_delay(snd_pcm_t *pcm, snd_pcm_sframes_t *delayp)
 {
 	snd_pcm_plugin_t *plugin = pcm->private_data;
@@ -420,8 +464,14 @@ snd_pcm_plugin_mmap_commit(snd_pcm_t *pcm,
 		}
 		if (frames > cont)
 			frames = cont;
-		frames = plugin->write(pcm, areas, appl_offset, frames,
-				       slave_areas, slave_offset, &slave_frames);
+		if (plugin->identity) {
+			/* the frames are in the slave buffer already */
+			if (frames > slave_frames)
+				frames = slave_frames;
+			slave_frames = frames;
+		} else
+			frames = plugin->write(pcm, areas, appl_offset, frames,
+					       slave_areas, slave_offset, &slave_frames);
 		result = snd_pcm_mmap_commit(slave, slave_offset, slave_frames);
 		if (result > 0 && (snd_pcm_uframes_t)result != slave_frames) {
 			snd_pcm_sframes_t res;
@@ -685,6 +735,7 @@ const snd_pcm_fast_ops_t snd_pcm_plugin_fast_ops = {
 	.poll_descriptors_count = snd_pcm_generic_poll_descriptors_count,
 	.poll_descriptors = snd_pcm_generic_poll_descriptors,
 	.poll_revents = snd_pcm_generic_poll_revents,
+	.wait = snd_pcm_generic_wait,
 	.may_wait_for_avail_min = snd_pcm_plugin_may_wait_for_avail_min,
 };
 
@@ -45,6 +45,7 @@ typedef struct {
 	snd_pcm_slave_xfer_areas_undo_func_t undo_write;
 	int (*init)(snd_pcm_t *pcm);
 	snd_pcm_uframes_t appl_ptr, hw_ptr;
+	int identity;	/* passes the slave buffer, see snd_pcm_plugin_set_identity() */
 } snd_pcm_plugin_t;	
 
 /* make local functions really local */
@@ -64,10 +65,13 @@ typedef struct {
 	snd1_pcm_plugin_rewind
 #define snd_pcm_plugin_forward \
 	snd1_pcm_plugin_forward
+#define snd_pcm_plugin_set_identity \
+	snd1_pcm_plugin_set_identity
 
 void snd_pcm_plugin_init(snd_pcm_plugin_t *plugin);
 snd_pcm_sframes_t snd_pcm_plugin_rewind(snd_pcm_t *pcm, snd_pcm_uframes_t frames);
 snd_pcm_sframes_t snd_pcm_plugin_forward(snd_pcm_t *pcm, snd_pcm_uframes_t frames);
+void snd_pcm_plugin_set_identity(snd_pcm_t *pcm, snd_pcm_hw_params_t *params, int identity);
 int snd_pcm_plugin_may_wait_for_avail_min_conv(snd_pcm_t *pcm, snd_pcm_uframes_t avail,
 					       snd_pcm_uframes_t (*conv)(snd_pcm_t *, snd_pcm_uframes_t));
 int snd_pcm_plugin_may_wait_for_avail_min(snd_pcm_t *pcm, snd_pcm_uframes_t avail);
@@ -113,6 +117,16 @@ void snd_pcm_linear_getput(const snd_pcm_channel_area_t *dst_areas, snd_pcm_ufra
 			   const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
 			   unsigned int channels, snd_pcm_uframes_t frames,
 			   unsigned int get_idx, unsigned int put_idx);
+int snd_pcm_lfloat_get_s32_index(snd_pcm_format_t format);
+int snd_pcm_lfloat_put_s32_index(snd_pcm_format_t format);
+void snd_pcm_lfloat_convert_integer_float(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+					  const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+					  unsigned int channels, snd_pcm_uframes_t frames,
+					  unsigned int get32idx, unsigned int put32floatidx);
+void snd_pcm_lfloat_convert_float_integer(const snd_pcm_channel_area_t *dst_areas, snd_pcm_uframes_t dst_offset,
+					  const snd_pcm_channel_area_t *src_areas, snd_pcm_uframes_t src_offset,
+					  unsigned int channels, snd_pcm_uframes_t frames,
+					  unsigned int put32idx, unsigned int get32floatidx);
 void snd_pcm_alaw_decode(const snd_pcm_channel_area_t *dst_areas,
 			 snd_pcm_uframes_t dst_offset,
 			 const snd_pcm_channel_area_t *src_areas,
@@ -33,6 +33,9 @@
 #include "plugin_ops.h"
 #include "bswap.h"
 #include <inttypes.h>
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
 
 #if 0
 #define DEBUG_REFINE
@@ -47,6 +50,25 @@ const char *_snd_module_pcm_rate = "";
 
 typedef struct _snd_pcm_rate snd_pcm_rate_t;
 
+/* upper limit of the threads option */
+#define RATE_MAX_THREADS	64
+/* channel groups smaller than this are not worth an own thread */
+#define RATE_THREAD_MIN_CHANNELS	8
+
+#ifdef HAVE_LIBPTHREAD
+/* a group of channels resampled by its own converter instance */
+typedef struct {
+	snd_pcm_rate_t *rate;
+	void *obj;
+	snd_pcm_rate_info_t info;	/* info.channels is the group size */
+	unsigned int first;		/* first channel of the group */
+	unsigned int seq;		/* last job taken */
+	int inited;
+	int running;
+	pthread_t thread;
+} snd_pcm_rate_worker_t;
+#endif
+
 struct _snd_pcm_rate {
 	snd_pcm_generic_t gen;
 	snd_pcm_uframes_t appl_ptr, hw_ptr, last_slave_hw_ptr;
@@ -74,6 +96,23 @@ struct _snd_pcm_rate {
 	uint64_t in_formats;
 	uint64_t out_formats;
 	unsigned int format_flags;
+	int open_conf;			/* open_func takes the converter config */
+	unsigned int threads;		/* converter instances (threads option) */
+	void **objs;			/* instances besides obj, threads - 1 */
+#ifdef HAVE_LIBPTHREAD
+	snd_pcm_rate_worker_t *workers;	/* channel groups, NULL if unused */
+	unsigned int nworkers;
+	pthread_mutex_t pool_mutex;
+	pthread_cond_t pool_start;
+	pthread_cond_t pool_done;
+	unsigned int pool_seq;		/* current job */
+	unsigned int pool_pending;	/* groups not finished yet */
+	int pool_quit;
+	const snd_pcm_channel_area_t *job_dst_areas;
+	const snd_pcm_channel_area_t *job_src_areas;
+	snd_pcm_uframes_t job_dst_offset, job_src_offset;
+	unsigned int job_dst_frames, job_src_frames;
+#endif
 };
 
 #define SND_PCM_RATE_PLUGIN_VERSION_OLD	0x010001	/* old rate plugin */
@@ -348,6 +387,207 @@ static int choose_preferred_format(snd_pcm_rate_t *rate)
 	return 0;
 }
 
+#ifdef HAVE_LIBPTHREAD
+static void rate_group_convert(snd_pcm_rate_worker_t *w)
+{
+	snd_pcm_rate_t *rate = w->rate;
+
+	rate->ops.convert(w->obj,
+			  rate->job_dst_areas + w->first, rate->job_dst_offset,
+			  rate->job_dst_frames,
+			  rate->job_src_areas + w->first, rate->job_src_offset,
+			  rate->job_src_frames);
+}
+
+static void *rate_pool_thread(void *data)
+{
+	snd_pcm_rate_worker_t *w = data;
+	snd_pcm_rate_t *rate = w->rate;
+
+	pthread_mutex_lock(&rate->pool_mutex);
+	for (;;) {
+		while (w->seq == rate->pool_seq && !rate->pool_quit)
+			pthread_cond_wait(&rate->pool_start, &rate->pool_mutex);
+		if (rate->pool_quit)
+			break;
+		w->seq = rate->pool_seq;
+		pthread_mutex_unlock(&rate->pool_mutex);
+		rate_group_convert(w);
+		pthread_mutex_lock(&rate->pool_mutex);
+		if (--rate->pool_pending == 0)
+			pthread_cond_signal(&rate->pool_done);
+	}
+	pthread_mutex_unlock(&rate->pool_mutex);
+	return NULL;
+}
+
+/* convert one period, the first group runs on the calling thread */
+static void rate_pool_convert(snd_pcm_rate_t *rate,
+			      const snd_pcm_channel_area_t *dst_areas,
+			      snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
+			      const snd_pcm_channel_area_t *src_areas,
+			      snd_pcm_uframes_t src_offset, unsigned int src_frames)
+{
+	pthread_mutex_lock(&rate->pool_mutex);
+	rate->job_dst_areas = dst_areas;
+	rate->job_dst_offset = dst_offset;
+	rate->job_dst_frames = dst_frames;
+	rate->job_src_areas = src_areas;
+	rate->job_src_offset = src_offset;
+	rate->job_src_frames = src_frames;
+	rate->pool_pending = rate->nworkers - 1;
+	rate->pool_seq++;
+	pthread_cond_broadcast(&rate->pool_start);
+	pthread_mutex_unlock(&rate->pool_mutex);
+
+	rate_group_convert(&rate->workers[0]);
+
+	pthread_mutex_lock(&rate->pool_mutex);
+	while (rate->pool_pending)
+		pthread_cond_wait(&rate->pool_done, &rate->pool_mutex);
+	pthread_mutex_unlock(&rate->pool_mutex);
+}
+
+static void rate_pool_stop(snd_pcm_rate_t *rate)
+{
+	unsigned int g;
+
+	pthread_mutex_lock(&rate->pool_mutex);
+	rate->pool_quit = 1;
+	pthread_cond_broadcast(&rate->pool_start);
+	pthread_mutex_unlock(&rate->pool_mutex);
+	for (g = 0; g < rate->nworkers; g++) {
+		snd_pcm_rate_worker_t *w = &rate->workers[g];
+		if (w->running)
+			pthread_join(w->thread, NULL);
+		if (w->inited && rate->ops.free)
+			rate->ops.free(w->obj);
+	}
+	free(rate->workers);
+	rate->workers = NULL;
+	rate->nworkers = 0;
+}
+
+/*
+ * the workers share the deadline of the calling thread, so they get its
+ * scheduling policy and priority; the default attributes are used when
+ * these cannot be applied (e.g. without the privilege for a RT policy)
+ */
+static int rate_pool_create(snd_pcm_rate_worker_t *w)
+{
+	pthread_attr_t attr;
+	struct sched_param param;
+	int policy, err;
+
+	if (pthread_getschedparam(pthread_self(), &policy, &param) == 0 &&
+	    pthread_attr_init(&attr) == 0) {
+		err = pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		if (!err)
+			err = pthread_attr_setschedpolicy(&attr, policy);
+		if (!err)
+			err = pthread_attr_setschedparam(&attr, &param);
+		if (!err)
+			err = pthread_create(&w->thread, &attr, rate_pool_thread, w);
+		pthread_attr_destroy(&attr);
+		if (!err)
+			return 0;
+	}
+	return -pthread_create(&w->thread, NULL, rate_pool_thread, w);
+}
+
+/* split the channels evenly to groups, each with an own converter */
+static int rate_pool_start(snd_pcm_rate_t *rate, unsigned int groups)
+{
+	unsigned int channels = rate->info.channels;
+	unsigned int g, first = 0;
+	int err;
+
+	rate->workers = calloc(groups, sizeof(*rate->workers));
+	if (!rate->workers)
+		return -ENOMEM;
+	rate->nworkers = groups;
+	rate->pool_quit = 0;
+	rate->pool_pending = 0;
+	for (g = 0; g < groups; g++) {
+		snd_pcm_rate_worker_t *w = &rate->workers[g];
+		w->rate = rate;
+		w->obj = g ? rate->objs[g - 1] : rate->obj;
+		w->info = rate->info;
+		w->info.channels = (channels - first) / (groups - g);
+		w->first = first;
+		first += w->info.channels;
+		err = rate->ops.init(w->obj, &w->info);
+		if (err < 0)
+			goto error;
+		w->inited = 1;
+		if (!g)
+			continue;
+		w->seq = rate->pool_seq;
+		err = rate_pool_create(w);
+		if (err < 0) {
+			SYSERR("pthread_create failed");
+			goto error;
+		}
+		w->running = 1;
+	}
+	return 0;
+
+ error:
+	rate_pool_stop(rate);
+	return err;
+}
+#endif
+
+/* on failure, the converters are released already */
+static int rate_init_converters(snd_pcm_rate_t *rate)
+{
+	int err;
+#ifdef HAVE_LIBPTHREAD
+	unsigned int groups = rate->threads;
+
+	/* the interleaved converters cannot work on a subset of channels */
+	if (groups > rate->info.channels / RATE_THREAD_MIN_CHANNELS)
+		groups = rate->info.channels / RATE_THREAD_MIN_CHANNELS;
+	if (groups > 1 && rate->ops.convert &&
+	    !(rate->format_flags & SND_PCM_RATE_FLAG_INTERLEAVED))
+		return rate_pool_start(rate, groups);
+#endif
+	err = rate->ops.init(rate->obj, &rate->info);
+	if (err < 0 && rate->ops.free)
+		rate->ops.free(rate->obj);
+	return err;
+}
+
+static void rate_free_converters(snd_pcm_rate_t *rate)
+{
+#ifdef HAVE_LIBPTHREAD
+	if (rate->workers) {
+		rate_pool_stop(rate);
+		return;
+	}
+#endif
+	if (rate->ops.free)
+		rate->ops.free(rate->obj);
+}
+
+static void rate_adjust_pitch(snd_pcm_rate_t *rate)
+{
+#ifdef HAVE_LIBPTHREAD
+	unsigned int g;
+
+	if (rate->workers) {
+		for (g = 0; g < rate->nworkers; g++) {
+			snd_pcm_rate_worker_t *w = &rate->workers[g];
+			w->info.in = rate->info.in;
+			w->info.out = rate->info.out;
+			rate->ops.adjust_pitch(w->obj, &w->info);
+		}
+		return;
+	}
+#endif
+	rate->ops.adjust_pitch(rate->obj, &rate->info);
+}
+
 static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
@@ -417,9 +657,9 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 		goto error_pareas;
 	}
 
-	err = rate->ops.init(rate->obj, &rate->info);
+	err = rate_init_converters(rate);
 	if (err < 0)
-		goto error_init;
+		goto error_pareas;
 
 	rate_free_tmp_buf(&rate->src_buf);
 	rate_free_tmp_buf(&rate->dst_buf);
@@ -466,9 +706,7 @@ static int snd_pcm_rate_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
  error:
 	rate_free_tmp_buf(&rate->src_buf);
 	rate_free_tmp_buf(&rate->dst_buf);
- error_init:
-	if (rate->ops.free)
-		rate->ops.free(rate->obj);
+	rate_free_converters(rate);
  error_pareas:
 	rate_free_tmp_buf(&rate->pareas);
 	rate_free_tmp_buf(&rate->sareas);
@@ -481,8 +719,7 @@ static int snd_pcm_rate_hw_free(snd_pcm_t *pcm)
 
 	rate_free_tmp_buf(&rate->pareas);
 	rate_free_tmp_buf(&rate->sareas);
-	if (rate->ops.free)
-		rate->ops.free(rate->obj);
+	rate_free_converters(rate);
 	rate_free_tmp_buf(&rate->src_buf);
 	rate_free_tmp_buf(&rate->dst_buf);
 	return snd_pcm_hw_free(rate->gen.slave);
@@ -530,7 +767,7 @@ static int snd_pcm_rate_sw_params(snd_pcm_t *pcm, snd_pcm_sw_params_t * params)
 	sparams->boundary = sboundary;
 
 	if (rate->ops.adjust_pitch)
-		rate->ops.adjust_pitch(rate->obj, &rate->info);
+		rate_adjust_pitch(rate);
 
 	recalc(pcm, &sparams->avail_min);
 	rate->orig_avail_min = sparams->avail_min;
@@ -558,8 +795,14 @@ static int snd_pcm_rate_init(snd_pcm_t *pcm)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
 
-	if (rate->ops.reset)
+	if (rate->ops.reset) {
+#ifdef HAVE_LIBPTHREAD
+		unsigned int g;
+		for (g = 1; g < rate->nworkers; g++)
+			rate->ops.reset(rate->workers[g].obj);
+#endif
 		rate->ops.reset(rate->obj);
+	}
 	rate->last_commit_ptr = 0;
 	rate->start_pending = 0;
 	return 0;
@@ -592,6 +835,12 @@ static void do_convert(const snd_pcm_channel_area_t *dst_areas,
 		src_offset = 0;
 	}
 
+#ifdef HAVE_LIBPTHREAD
+	if (rate->workers)
+		rate_pool_convert(rate, out_areas, out_offset, dst_frames,
+				  src_areas, src_offset, src_frames);
+	else
+#endif
 	if (rate->ops.convert)
 		rate->ops.convert(rate->obj, out_areas, out_offset, dst_frames,
 				   src_areas, src_offset, src_frames);
@@ -1262,6 +1511,16 @@ static void snd_pcm_rate_dump(snd_pcm_t *pcm, snd_output_t *out)
 	if (rate->ops.dump)
 		rate->ops.dump(rate->obj, out);
 	snd_output_printf(out, "Protocol version: %x\n", rate->plugin_version);
+	if (rate->threads > 1) {
+#ifdef HAVE_LIBPTHREAD
+		snd_output_printf(out, "Threads: %u (%u channel groups)\n",
+				  rate->threads,
+				  rate->nworkers ? rate->nworkers : 1);
+#else
+		snd_output_printf(out, "Threads: %u (not supported)\n",
+				  rate->threads);
+#endif
+	}
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -1270,10 +1529,72 @@ static void snd_pcm_rate_dump(snd_pcm_t *pcm, snd_output_t *out)
 	snd_pcm_dump(rate->gen.slave, out);
 }
 
+#ifndef PIC
+extern int SND_PCM_RATE_PLUGIN_ENTRY(linear) (unsigned int version, void **objp, snd_pcm_rate_ops_t *ops);
+#endif
+
+/* open the additional converter instances for the threads option */
+static int rate_open_instances(snd_pcm_rate_t *rate, unsigned int threads,
+			       const snd_config_t *converter_conf)
+{
+	snd_pcm_rate_ops_t ops;
+	unsigned int i;
+	int err = 0;
+
+	rate->objs = calloc(threads - 1, sizeof(*rate->objs));
+	if (!rate->objs)
+		return -ENOMEM;
+	rate->threads = threads;
+	for (i = 0; i < threads - 1; i++) {
+#ifdef PIC
+		if (rate->open_conf)
+			err = ((snd_pcm_rate_open_conf_func_t)rate->open_func)
+				(rate->plugin_version, &rate->objs[i], &ops,
+				 converter_conf);
+		else
+			err = ((snd_pcm_rate_open_func_t)rate->open_func)
+				(rate->plugin_version, &rate->objs[i], &ops);
+#else
+		err = SND_PCM_RATE_PLUGIN_ENTRY(linear)(rate->plugin_version,
+							&rate->objs[i], &ops);
+#endif
+		if (err < 0) {
+			rate->objs[i] = NULL;
+			break;
+		}
+	}
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_init(&rate->pool_mutex, NULL);
+	pthread_cond_init(&rate->pool_start, NULL);
+	pthread_cond_init(&rate->pool_done, NULL);
+#endif
+	return err;
+}
+
+static void rate_close_instances(snd_pcm_rate_t *rate)
+{
+	unsigned int i;
+
+	if (!rate->objs)
+		return;
+	for (i = 0; i < rate->threads - 1; i++) {
+		if (rate->objs[i] && rate->ops.close)
+			rate->ops.close(rate->objs[i]);
+	}
+	free(rate->objs);
+	rate->objs = NULL;
+#ifdef HAVE_LIBPTHREAD
+	pthread_mutex_destroy(&rate->pool_mutex);
+	pthread_cond_destroy(&rate->pool_start);
+	pthread_cond_destroy(&rate->pool_done);
+#endif
+}
+
 static int snd_pcm_rate_close(snd_pcm_t *pcm)
 {
 	snd_pcm_rate_t *rate = pcm->private_data;
 
+	rate_close_instances(rate);
 	if (rate->ops.close)
 		rate->ops.close(rate->obj);
 	if (rate->open_func)
@@ -1395,7 +1716,10 @@ static void rate_initial_setup(snd_pcm_rate_t *rate)
 #ifdef PIC
 static int is_builtin_plugin(const char *type)
 {
-	return strcmp(type, "linear") == 0;
+	return strcmp(type, "linear") == 0 ||
+	       strcmp(type, "sinc_fast") == 0 ||
+	       strcmp(type, "sinc") == 0 ||
+	       strcmp(type, "sinc_best") == 0;
 }
 
 static const char *const default_rate_plugins[] = {
@@ -1423,6 +1747,7 @@ static int rate_open_func(snd_pcm_rate_t *rate, const char *type, const snd_conf
 				     &rate->obj, &rate->ops, converter_conf);
 		if (!err) {
 			rate->open_func = open_conf_func;
+			rate->open_conf = 1;
 			return 0;
 		} else {
 			snd_dlobj_cache_put(open_conf_func);
@@ -1478,32 +1803,18 @@ static int is_string_array(const snd_config_t *conf)
 	return 1;
 }
 
-/**
- * \brief Creates a new rate PCM
- * \param pcmp Returns created PCM handle
- * \param name Name of PCM
- * \param sformat Slave format
- * \param srate Slave rate
- * \param converter SRC type string node
- * \param slave Slave PCM handle
- * \param close_slave When set, the slave PCM handle is closed with copy PCM
- * \retval zero on success otherwise a negative error code
- * \warning Using of this function might be dangerous in the sense
- *          of compatibility reasons. The prototype might be freely
- *          changed in future.
- */
-int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
-		      snd_pcm_format_t sformat, unsigned int srate,
-		      const snd_config_t *converter,
-		      snd_pcm_t *slave, int close_slave)
+static int rate_open(snd_pcm_t **pcmp, const char *name,
+		     snd_pcm_format_t sformat, unsigned int srate,
+		     const snd_config_t *converter, unsigned int threads,
+		     snd_pcm_t *slave, int close_slave)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_rate_t *rate;
 	const char *type = NULL;
 	int err;
+	const snd_config_t *converter_conf = NULL;
 #ifndef PIC
 	snd_pcm_rate_open_func_t open_func;
-	extern int SND_PCM_RATE_PLUGIN_ENTRY(linear) (unsigned int version, void **objp, snd_pcm_rate_ops_t *ops);
 #endif
 
 	assert(pcmp && slave);
@@ -1570,7 +1881,8 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 			free(rate);
 			return -EINVAL;
 		}
-		err = rate_open_func(rate, type, converter, 1);
+		converter_conf = converter;
+		err = rate_open_func(rate, type, converter_conf, 1);
 	} else {
 		SNDERR("Invalid type for rate converter");
 		snd_pcm_free(pcm);
@@ -1604,6 +1916,23 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 
 	rate_initial_setup(rate);
 
+	if (threads > 1) {
+		err = rate_open_instances(rate, threads, converter_conf);
+		if (err < 0) {
+			SNDERR("Cannot open %u instances of rate converter %s",
+			       threads, type);
+			rate_close_instances(rate);
+			if (rate->ops.close)
+				rate->ops.close(rate->obj);
+#ifdef PIC
+			snd_dlobj_cache_put(rate->open_func);
+#endif
+			snd_pcm_free(pcm);
+			free(rate);
+			return err;
+		}
+	}
+
 	pcm->ops = &snd_pcm_rate_ops;
 	pcm->fast_ops = &snd_pcm_rate_fast_ops;
 	pcm->private_data = rate;
@@ -1618,6 +1947,29 @@ int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 	return 0;
 }
 
+/**
+ * \brief Creates a new rate PCM
+ * \param pcmp Returns created PCM handle
+ * \param name Name of PCM
+ * \param sformat Slave format
+ * \param srate Slave rate
+ * \param converter SRC type string node
+ * \param slave Slave PCM handle
+ * \param close_slave When set, the slave PCM handle is closed with copy PCM
+ * \retval zero on success otherwise a negative error code
+ * \warning Using of this function might be dangerous in the sense
+ *          of compatibility reasons. The prototype might be freely
+ *          changed in future.
+ */
+int snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
+		      snd_pcm_format_t sformat, unsigned int srate,
+		      const snd_config_t *converter,
+		      snd_pcm_t *slave, int close_slave)
+{
+	return rate_open(pcmp, name, sformat, srate, converter, 1,
+			 slave, close_slave);
+}
+
 /*! \page pcm_plugins
 
 \section pcm_plugins_rate Plugin: Rate
@@ -1646,9 +1998,29 @@ pcm.name {
 		name STR	# Convertor type
 		xxx yyy		# optional convertor-specific configuration
 	}
+	threads INT		# optional, default 1
+				# Number of converter threads
 }
 \endcode
 
+With threads set above one, the channels are split into groups, each with
+its own converter instance, and the groups of a period are resampled in
+parallel by a pool of worker threads. Fewer groups are used when there
+would be less than eight channels per group, so the calling thread does all
+the work for small channel counts. The converters working only on
+interleaved samples are always run on the calling thread.
+
+The worker threads are created when the hardware parameters are set, with
+the scheduling policy and priority of the thread calling
+snd_pcm_hw_params(), so a realtime audio thread gets realtime workers.
+When that policy cannot be applied to a new thread, the workers fall back
+to the default scheduling.
+
+Besides the external converter plugins, the built-in converters "linear"
+(linear interpolation) and "sinc_fast", "sinc", "sinc_best" (windowed-sinc
+polyphase filters of increasing quality, for S16 and S32 samples) are
+always available.
+
 \subsection pcm_plugins_rate_funcref Function reference
 
 <UL>
@@ -1681,6 +2053,7 @@ int _snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 	snd_config_t *slave = NULL, *sconf;
 	snd_pcm_format_t sformat = SND_PCM_FORMAT_UNKNOWN;
 	int srate = -1;
+	long threads = 1;
 	const snd_config_t *converter = NULL;
 
 	snd_config_for_each(i, next, conf) {
@@ -1698,6 +2071,18 @@ int _snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 			converter = n;
 			continue;
 		}
+		if (strcmp(id, "threads") == 0) {
+			err = snd_config_get_integer(n, &threads);
+			if (err < 0) {
+				SNDERR("Invalid type for %s", id);
+				return -EINVAL;
+			}
+			if (threads < 1 || threads > RATE_MAX_THREADS) {
+				SNDERR("Invalid threads value %ld", threads);
+				return -EINVAL;
+			}
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1721,8 +2106,8 @@ int _snd_pcm_rate_open(snd_pcm_t **pcmp, const char *name,
 	snd_config_delete(sconf);
 	if (err < 0)
 		return err;
-	err = snd_pcm_rate_open(pcmp, name, sformat, (unsigned int) srate,
-				converter, spcm, 1);
+	err = rate_open(pcmp, name, sformat, (unsigned int) srate,
+			converter, threads, spcm, 1);
 	if (err < 0)
 		snd_pcm_close(spcm);
 	return err;
@@ -0,0 +1,470 @@
+/*
+ *  Windowed-sinc polyphase rate converter plugin
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "pcm_local.h"
+#include "pcm_plugin.h"
+#include "pcm_rate.h"
+#include "pcm_simd.h"
+#include <math.h>
+#include <inttypes.h>
+
+/*
+ * Each output sample is computed from the taps input samples around its
+ * position with a Kaiser windowed sinc. The filter is tabulated for
+ * phases + 1 fractional positions, the coefficients of the two nearest
+ * phases are interpolated linearly, so any ratio of the period sizes can
+ * be followed exactly without a per-ratio table.
+ *
+ * The tables depend only on the quality and on the cutoff (i.e. on the
+ * rate ratio when downsampling), they are shared by all streams.
+ */
+
+#define SINC_QUALITY_FAST	0
+#define SINC_QUALITY_MEDIUM	1
+#define SINC_QUALITY_BEST	2
+
+struct sinc_quality {
+	const char *name;
+	unsigned int taps;	/* filter length at unity ratio */
+	unsigned int phases;
+	double rolloff;		/* cutoff relative to the lower Nyquist */
+	double beta;		/* Kaiser window parameter */
+};
+
+static const struct sinc_quality sinc_qualities[] = {
+	[SINC_QUALITY_FAST] = { "fast", 16, 32, 0.85, 6.0 },
+	[SINC_QUALITY_MEDIUM] = { "medium", 32, 128, 0.91, 8.0 },
+	[SINC_QUALITY_BEST] = { "best", 64, 256, 0.95, 10.0 },
+};
+
+/* upper limit of the filter length for extreme downsampling ratios */
+#define SINC_MAX_TAPS	1024
+
+struct sinc_bank {
+	struct list_head list;
+	unsigned int refcnt;
+	unsigned int quality;
+	unsigned int in_rate, out_rate;	/* reduced, 1:1 for upsampling */
+	unsigned int taps;		/* multiple of 8 */
+	unsigned int phases;
+	float *coefs;			/* (phases + 1) * taps */
+};
+
+struct rate_sinc {
+	unsigned int quality;
+	unsigned int channels;
+	int s16;			/* S16 on both sides, else S32 */
+	unsigned int in_period, out_period;
+	struct sinc_bank *bank;
+	snd_pcm_simd_dot2_func_t dot2;
+	float *hist;			/* channels * (taps - 1) */
+	float *buf;			/* taps - 1 + in_period */
+	unsigned int buf_frames;
+};
+
+static LIST_HEAD(sinc_bank_list);
+
+#ifdef HAVE_LIBPTHREAD
+static pthread_mutex_t sinc_bank_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static inline void sinc_bank_lock(void)
+{
+	pthread_mutex_lock(&sinc_bank_mutex);
+}
+
+static inline void sinc_bank_unlock(void)
+{
+	pthread_mutex_unlock(&sinc_bank_mutex);
+}
+#else
+static inline void sinc_bank_lock(void) {}
+static inline void sinc_bank_unlock(void) {}
+#endif
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b) {
+		unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+/* zeroth order modified Bessel function of the first kind */
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	unsigned int k;
+
+	for (k = 1; k < 64; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+	return sum;
+}
+
+static void sinc_bank_fill(struct sinc_bank *bank, double cutoff, double beta)
+{
+	unsigned int taps = bank->taps, p, k;
+	double half = taps / 2.0;
+	double i0_beta = bessel_i0(beta);
+
+	for (p = 0; p <= bank->phases; p++) {
+		float *h = bank->coefs + p * taps;
+		double frac = (double)p / bank->phases;
+		double sum = 0;
+		for (k = 0; k < taps; k++) {
+			/* distance of tap k from the output position */
+			double t = frac + half - 1 - k;
+			double w = t / half, v;
+			if (w <= -1.0 || w >= 1.0) {
+				h[k] = 0;
+				continue;
+			}
+			v = cutoff;
+			if (t != 0)
+				v = sin(M_PI * cutoff * t) / (M_PI * t);
+			v *= bessel_i0(beta * sqrt(1.0 - w * w)) / i0_beta;
+			h[k] = v;
+			sum += v;
+		}
+		/* unity DC gain for every phase */
+		for (k = 0; k < taps; k++)
+			h[k] /= sum;
+	}
+}
+
+static struct sinc_bank *sinc_bank_get(unsigned int quality,
+				       unsigned int in_rate,
+				       unsigned int out_rate)
+{
+	const struct sinc_quality *q = &sinc_qualities[quality];
+	struct sinc_bank *bank;
+	struct list_head *pos;
+	unsigned int div, taps;
+	double cutoff = q->rolloff;
+
+	if (in_rate <= out_rate) {
+		in_rate = out_rate = 1;
+		taps = q->taps;
+	} else {
+		div = gcd(in_rate, out_rate);
+		in_rate /= div;
+		out_rate /= div;
+		cutoff = cutoff * out_rate / in_rate;
+		taps = (uint64_t)q->taps * in_rate / out_rate;
+		if (taps > SINC_MAX_TAPS)
+			taps = SINC_MAX_TAPS;
+	}
+	taps = (taps + 7) & ~7U;
+
+	sinc_bank_lock();
+	list_for_each(pos, &sinc_bank_list) {
+		bank = list_entry(pos, struct sinc_bank, list);
+		if (bank->quality == quality &&
+		    bank->in_rate == in_rate && bank->out_rate == out_rate) {
+			bank->refcnt++;
+			sinc_bank_unlock();
+			return bank;
+		}
+	}
+	bank = calloc(1, sizeof(*bank));
+	if (bank) {
+		bank->quality = quality;
+		bank->in_rate = in_rate;
+		bank->out_rate = out_rate;
+		bank->taps = taps;
+		bank->phases = q->phases;
+		bank->coefs = malloc(sizeof(float) * (q->phases + 1) * taps);
+		if (!bank->coefs) {
+			free(bank);
+			bank = NULL;
+		} else {
+			sinc_bank_fill(bank, cutoff, q->beta);
+			bank->refcnt = 1;
+			list_add_tail(&bank->list, &sinc_bank_list);
+		}
+	}
+	sinc_bank_unlock();
+	return bank;
+}
+
+static void sinc_bank_put(struct sinc_bank *bank)
+{
+	sinc_bank_lock();
+	if (--bank->refcnt == 0) {
+		list_del(&bank->list);
+		free(bank->coefs);
+		free(bank);
+	}
+	sinc_bank_unlock();
+}
+
+static snd_pcm_uframes_t input_frames(void *obj, snd_pcm_uframes_t frames)
+{
+	struct rate_sinc *rate = obj;
+	if (frames == 0)
+		return 0;
+	return muldiv_near(frames, rate->in_period, rate->out_period);
+}
+
+static snd_pcm_uframes_t output_frames(void *obj, snd_pcm_uframes_t frames)
+{
+	struct rate_sinc *rate = obj;
+	if (frames == 0)
+		return 0;
+	return muldiv_near(frames, rate->out_period, rate->in_period);
+}
+
+static inline int16_t sinc_to_s16(float v)
+{
+	if (v >= 32767.0f)
+		return 32767;
+	if (v <= -32768.0f)
+		return -32768;
+	return lrintf(v);
+}
+
+static inline int32_t sinc_to_s32(float v)
+{
+	if (v >= 2147483648.0f)
+		return 0x7fffffff;
+	if (v <= -2147483648.0f)
+		return (int32_t)0x80000000;
+	return lrintf(v);
+}
+
+/*
+ * Output frame i lies at i * src_frames / dst_frames input frames from the
+ * start of the period, the filter delay is taps / 2 input frames. The
+ * window of an output sample ends at its integer input position, buf
+ * holds the last taps - 1 input samples of the previous period in front
+ * of the new ones.
+ */
+static void sinc_convert(void *obj,
+			 const snd_pcm_channel_area_t *dst_areas,
+			 snd_pcm_uframes_t dst_offset, unsigned int dst_frames,
+			 const snd_pcm_channel_area_t *src_areas,
+			 snd_pcm_uframes_t src_offset, unsigned int src_frames)
+{
+	struct rate_sinc *rate = obj;
+	unsigned int taps = rate->bank->taps;
+	unsigned int phases = rate->bank->phases;
+	const float *coefs = rate->bank->coefs;
+	unsigned int step = src_frames / dst_frames;
+	unsigned int step_rem = src_frames % dst_frames;
+	unsigned int channel, i;
+
+	if (CHECK_SANITY(src_frames > rate->buf_frames)) {
+		SNDERR("src_frames overflow");
+		return;
+	}
+	for (channel = 0; channel < rate->channels; ++channel) {
+		const snd_pcm_channel_area_t *src_area = &src_areas[channel];
+		const snd_pcm_channel_area_t *dst_area = &dst_areas[channel];
+		const char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+		char *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+		int src_step = snd_pcm_channel_area_step(src_area);
+		int dst_step = snd_pcm_channel_area_step(dst_area);
+		float *hist = rate->hist + channel * (taps - 1);
+		float *x = rate->buf + taps - 1;
+		unsigned int pos = 0, rem = 0;
+
+		memcpy(rate->buf, hist, (taps - 1) * sizeof(float));
+		if (rate->s16) {
+			for (i = 0; i < src_frames; i++, src += src_step)
+				x[i] = *(const int16_t *)src;
+		} else {
+			for (i = 0; i < src_frames; i++, src += src_step)
+				x[i] = *(const int32_t *)src;
+		}
+
+		for (i = 0; i < dst_frames; i++, dst += dst_step) {
+			uint64_t phase = (uint64_t)rem * phases;
+			unsigned int p = phase / dst_frames;
+			float frac = (float)(phase % dst_frames) / dst_frames;
+			float res[2], v;
+
+			rate->dot2(rate->buf + pos, coefs + p * taps,
+				   coefs + (p + 1) * taps, taps, res);
+			v = res[0] + frac * (res[1] - res[0]);
+			if (rate->s16)
+				*(int16_t *)dst = sinc_to_s16(v);
+			else
+				*(int32_t *)dst = sinc_to_s32(v);
+
+			pos += step;
+			rem += step_rem;
+			if (rem >= dst_frames) {
+				rem -= dst_frames;
+				pos++;
+			}
+		}
+
+		memcpy(hist, rate->buf + src_frames, (taps - 1) * sizeof(float));
+	}
+}
+
+static void sinc_free(void *obj)
+{
+	struct rate_sinc *rate = obj;
+
+	if (rate->bank) {
+		sinc_bank_put(rate->bank);
+		rate->bank = NULL;
+	}
+	free(rate->hist);
+	rate->hist = NULL;
+	free(rate->buf);
+	rate->buf = NULL;
+}
+
+static int sinc_init(void *obj, snd_pcm_rate_info_t *info)
+{
+	struct rate_sinc *rate = obj;
+	unsigned int taps;
+
+	sinc_free(rate);
+	rate->dot2 = snd_pcm_simd_ops()->rate_dot2;
+	if (!rate->dot2)
+		return -ENXIO;
+	rate->bank = sinc_bank_get(rate->quality, info->in.rate, info->out.rate);
+	if (!rate->bank)
+		return -ENOMEM;
+	taps = rate->bank->taps;
+	rate->channels = info->channels;
+	rate->s16 = info->in.format == SND_PCM_FORMAT_S16;
+	rate->in_period = info->in.rate;
+	rate->out_period = info->out.rate;
+	rate->buf_frames = info->in.period_size;
+	rate->hist = calloc(rate->channels * (taps - 1), sizeof(float));
+	rate->buf = malloc((taps - 1 + rate->buf_frames) * sizeof(float));
+	if (!rate->hist || !rate->buf) {
+		sinc_free(rate);
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+static int sinc_adjust_pitch(void *obj, snd_pcm_rate_info_t *info)
+{
+	struct rate_sinc *rate = obj;
+
+	/* every period is converted on its own, so the ratio of the
+	 * period sizes is followed exactly
+	 */
+	rate->in_period = info->in.period_size;
+	rate->out_period = info->out.period_size;
+	return 0;
+}
+
+static void sinc_reset(void *obj)
+{
+	struct rate_sinc *rate = obj;
+
+	if (rate->hist)
+		memset(rate->hist, 0,
+		       rate->channels * (rate->bank->taps - 1) * sizeof(float));
+}
+
+static void sinc_close(void *obj)
+{
+	sinc_free(obj);
+	free(obj);
+}
+
+static int get_supported_rates(ATTRIBUTE_UNUSED void *rate,
+			       unsigned int *rate_min, unsigned int *rate_max)
+{
+	*rate_min = SND_PCM_PLUGIN_RATE_MIN;
+	*rate_max = SND_PCM_PLUGIN_RATE_MAX;
+	return 0;
+}
+
+static int get_supported_formats(ATTRIBUTE_UNUSED void *rate,
+				 uint64_t *in_formats, uint64_t *out_formats,
+				 unsigned int *flags)
+{
+	*in_formats = *out_formats =
+		(1ULL << SND_PCM_FORMAT_S16) | (1ULL << SND_PCM_FORMAT_S32);
+	*flags = SND_PCM_RATE_FLAG_SYNC_FORMATS;
+	return 0;
+}
+
+static void sinc_dump(void *obj, snd_output_t *out)
+{
+	struct rate_sinc *rate = obj;
+
+	snd_output_printf(out, "Converter: windowed-sinc (%s",
+			  sinc_qualities[rate->quality].name);
+	if (rate->bank)
+		snd_output_printf(out, ", %u taps, %u phases",
+				  rate->bank->taps, rate->bank->phases);
+	snd_output_printf(out, ")\n");
+}
+
+static const snd_pcm_rate_ops_t sinc_ops = {
+	.close = sinc_close,
+	.init = sinc_init,
+	.free = sinc_free,
+	.reset = sinc_reset,
+	.adjust_pitch = sinc_adjust_pitch,
+	.convert = sinc_convert,
+	.input_frames = input_frames,
+	.output_frames = output_frames,
+	.version = SND_PCM_RATE_PLUGIN_VERSION,
+	.get_supported_rates = get_supported_rates,
+	.dump = sinc_dump,
+	.get_supported_formats = get_supported_formats,
+};
+
+static int sinc_open(void **objp, snd_pcm_rate_ops_t *ops,
+		     unsigned int quality)
+{
+	struct rate_sinc *rate;
+
+	rate = calloc(1, sizeof(*rate));
+	if (! rate)
+		return -ENOMEM;
+	rate->quality = quality;
+
+	*objp = rate;
+	*ops = sinc_ops;
+	return 0;
+}
+
+int SND_PCM_RATE_PLUGIN_ENTRY(sinc_fast) (ATTRIBUTE_UNUSED unsigned int version,
+					  void **objp, snd_pcm_rate_ops_t *ops)
+{
+	return sinc_open(objp, ops, SINC_QUALITY_FAST);
+}
+
+int SND_PCM_RATE_PLUGIN_ENTRY(sinc) (ATTRIBUTE_UNUSED unsigned int version,
+				     void **objp, snd_pcm_rate_ops_t *ops)
+{
+	return sinc_open(objp, ops, SINC_QUALITY_MEDIUM);
+}
+
+int SND_PCM_RATE_PLUGIN_ENTRY(sinc_best) (ATTRIBUTE_UNUSED unsigned int version,
+					  void **objp, snd_pcm_rate_ops_t *ops)
+{
+	return sinc_open(objp, ops, SINC_QUALITY_BEST);
+}
@@ -30,6 +30,7 @@
 #include "pcm_plugin.h"
 #include "plugin_ops.h"
 #include "bswap.h"
+#include "pcm_simd.h"
 #include <math.h>
 
 #ifndef PIC
@@ -58,6 +59,49 @@ typedef struct {
 
 typedef struct snd_pcm_route_ttable_dst snd_pcm_route_ttable_dst_t;
 
+/* frames processed at once by the block plan */
+#define ROUTE_PLAN_BLOCK	256
+
+typedef struct {
+	unsigned int block;	/* index of the converted source block */
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	float gain;
+#else
+	int gain;
+#endif
+} snd_pcm_route_plan_term_t;
+
+typedef struct {
+	unsigned int channel;
+	unsigned int nterms;
+	snd_pcm_route_plan_term_t *terms;
+} snd_pcm_route_plan_dst_t;
+
+/*
+ * Destinations mixing several sources are compiled at hw_params time into
+ * a plan: every used source channel is converted to int32 once per block
+ * of frames and each destination is a short list of multiply-accumulate
+ * terms over these blocks.
+ */
+typedef struct {
+	unsigned int nsrcs;
+	unsigned int *srcs;		/* source channel of each block */
+	unsigned int ndsts;
+	snd_pcm_route_plan_dst_t *dsts;
+	snd_pcm_route_plan_term_t *terms;
+	int32_t *samples;		/* nsrcs blocks of source samples */
+	int32_t *out;
+	unsigned int get_width;		/* 16 or 32 for direct host endian */
+	unsigned int put_width;		/* access, 0 to use get32/put32 */
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	float *sum;
+	snd_pcm_simd_mac_func_t mac;
+	snd_pcm_simd_norm_func_t norm;
+#else
+	int64_t *sum;
+#endif
+} snd_pcm_route_plan_t;
+
 typedef struct {
 	enum {UINT64, FLOAT} sum_idx;
 	unsigned int get_idx;
@@ -69,6 +113,7 @@ typedef struct {
 	unsigned int nsrcs;
 	unsigned int ndsts;
 	snd_pcm_route_ttable_dst_t *dsts;
+	snd_pcm_route_plan_t *plan;
 } snd_pcm_route_params_t;
 
 
@@ -86,6 +131,7 @@ struct snd_pcm_route_ttable_dst {
 	unsigned int nsrcs;
 	snd_pcm_route_ttable_src_t* srcs;
 	route_f func;
+	int planned;	/* handled by params->plan */
 };
 
 typedef union {
@@ -104,6 +150,15 @@ typedef struct {
 	snd_pcm_route_params_t params;
 	snd_pcm_chmap_t *chmap;
 	snd_pcm_chmap_query_t **chmap_override;
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+	/* float client samples, converted from/to S32 block by block */
+	snd_pcm_format_t float_format;	/* SND_PCM_FORMAT_UNKNOWN if linear */
+	int32_t *float_buf;
+	snd_pcm_channel_area_t *float_areas;
+	unsigned int int32_idx, float32_idx;
+	snd_pcm_simd_conv_func_t float_func;
+	snd_pcm_simd_conv_t float_conv;
+#endif
 } snd_pcm_route_t;
 
 #endif /* DOC_HIDDEN */
@@ -395,6 +450,141 @@ static void snd_pcm_route_convert1_many(const snd_pcm_channel_area_t *dst_area,
 	}
 }
 
+static void snd_pcm_route_plan_get(int32_t *buf,
+				   const snd_pcm_channel_area_t *src_area,
+				   snd_pcm_uframes_t src_offset,
+				   unsigned int frames,
+				   const snd_pcm_route_params_t *params)
+{
+#define GET32_LABELS
+#include "plugin_ops.h"
+#undef GET32_LABELS
+	void *get32 = get32_labels[params->get_idx];
+	const char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+	int src_step = snd_pcm_channel_area_step(src_area);
+	int32_t sample = 0;
+
+	switch (params->plan->get_width) {
+	case 16:
+		for (; frames > 0; frames--, src += src_step)
+			*buf++ = (uint32_t)*(const uint16_t *)src << 16;
+		return;
+	case 32:
+		for (; frames > 0; frames--, src += src_step)
+			*buf++ = *(const int32_t *)src;
+		return;
+	}
+	while (frames-- > 0) {
+		goto *get32;
+#define GET32_END after_get
+#include "plugin_ops.h"
+#undef GET32_END
+	after_get:
+		*buf++ = sample;
+		src += src_step;
+	}
+}
+
+static void snd_pcm_route_plan_put(const snd_pcm_channel_area_t *dst_area,
+				   snd_pcm_uframes_t dst_offset,
+				   const int32_t *buf,
+				   unsigned int frames,
+				   const snd_pcm_route_params_t *params)
+{
+#define PUT32_LABELS
+#include "plugin_ops.h"
+#undef PUT32_LABELS
+	void *put32 = put32_labels[params->put_idx];
+	char *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+	int dst_step = snd_pcm_channel_area_step(dst_area);
+	int32_t sample;
+
+	switch (params->plan->put_width) {
+	case 16:
+		for (; frames > 0; frames--, dst += dst_step)
+			*(int16_t *)dst = *buf++ >> 16;
+		return;
+	case 32:
+		for (; frames > 0; frames--, dst += dst_step)
+			*(int32_t *)dst = *buf++;
+		return;
+	}
+	while (frames-- > 0) {
+		sample = *buf++;
+		goto *put32;
+#define PUT32_END after_put32
+#include "plugin_ops.h"
+#undef PUT32_END
+	after_put32:
+		dst += dst_step;
+	}
+}
+
+static void snd_pcm_route_plan_mix(snd_pcm_route_plan_t *plan,
+				   const snd_pcm_route_plan_dst_t *dp,
+				   unsigned int frames)
+{
+	const snd_pcm_route_plan_term_t *t = dp->terms;
+	unsigned int k;
+
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	memset(plan->sum, 0, frames * sizeof(*plan->sum));
+	for (k = 0; k < dp->nterms; k++, t++)
+		plan->mac(plan->sum,
+			  plan->samples + t->block * ROUTE_PLAN_BLOCK,
+			  frames, t->gain);
+	plan->norm(plan->out, plan->sum, frames);
+#else
+	unsigned int i;
+
+	memset(plan->sum, 0, frames * sizeof(*plan->sum));
+	for (k = 0; k < dp->nterms; k++, t++) {
+		const int32_t *src = plan->samples + t->block * ROUTE_PLAN_BLOCK;
+		for (i = 0; i < frames; i++)
+			plan->sum[i] += (int64_t)src[i] * t->gain;
+	}
+	/* non attenuated terms have the full gain, so the division is exact */
+	for (i = 0; i < frames; i++) {
+		int64_t sum = plan->sum[i];
+		div(sum);
+		if (sum > (int64_t)0x7fffffff)
+			plan->out[i] = 0x7fffffff;
+		else if (sum < -(int64_t)0x80000000)
+			plan->out[i] = 0x80000000;
+		else
+			plan->out[i] = sum;
+	}
+#endif
+}
+
+static void snd_pcm_route_plan_run(const snd_pcm_channel_area_t *dst_areas,
+				   snd_pcm_uframes_t dst_offset,
+				   const snd_pcm_channel_area_t *src_areas,
+				   snd_pcm_uframes_t src_offset,
+				   snd_pcm_uframes_t frames,
+				   const snd_pcm_route_params_t *params)
+{
+	snd_pcm_route_plan_t *plan = params->plan;
+	unsigned int i;
+
+	while (frames > 0) {
+		unsigned int n = frames > ROUTE_PLAN_BLOCK ? ROUTE_PLAN_BLOCK : frames;
+		for (i = 0; i < plan->nsrcs; i++)
+			snd_pcm_route_plan_get(plan->samples + i * ROUTE_PLAN_BLOCK,
+					       &src_areas[plan->srcs[i]],
+					       src_offset, n, params);
+		for (i = 0; i < plan->ndsts; i++) {
+			const snd_pcm_route_plan_dst_t *dp = &plan->dsts[i];
+			snd_pcm_route_plan_mix(plan, dp, n);
+			snd_pcm_route_plan_put(&dst_areas[dp->channel], dst_offset,
+					       plan->out, n, params);
+		}
+		src_offset += n;
+		dst_offset += n;
+		frames -= n;
+	}
+}
+
 #endif /* DOC_HIDDEN */
 
 static void snd_pcm_route_convert(const snd_pcm_channel_area_t *dst_areas,
@@ -412,13 +602,17 @@ static void snd_pcm_route_convert(const snd_pcm_channel_area_t *dst_areas,
 
 	dstp = params->dsts;
 	dst_area = dst_areas;
+	if (params->plan)
+		snd_pcm_route_plan_run(dst_areas, dst_offset,
+				       src_areas, src_offset,
+				       frames, params);
 	for (dst_channel = 0; dst_channel < dst_channels; ++dst_channel) {
 		if (dst_channel >= params->ndsts)
 			snd_pcm_route_convert1_zero(dst_area, dst_offset,
 						    src_areas, src_offset,
 						    src_channels,
 						    frames, dstp, params);
-		else
+		else if (!dstp->planned)
 			dstp->func(dst_area, dst_offset,
 				   src_areas, src_offset,
 				   src_channels,
@@ -428,12 +622,260 @@ static void snd_pcm_route_convert(const snd_pcm_channel_area_t *dst_areas,
 	}
 }
 
+static void snd_pcm_route_plan_free(snd_pcm_route_params_t *params)
+{
+	snd_pcm_route_plan_t *plan = params->plan;
+	unsigned int dst_channel;
+
+	for (dst_channel = 0; dst_channel < params->ndsts; ++dst_channel)
+		params->dsts[dst_channel].planned = 0;
+	if (!plan)
+		return;
+	free(plan->srcs);
+	free(plan->dsts);
+	free(plan->terms);
+	free(plan->samples);
+	free(plan->out);
+	free(plan->sum);
+	free(plan);
+	params->plan = NULL;
+}
+
+/* direct access width for host endian signed 16 and 32 bit samples */
+static unsigned int snd_pcm_route_plan_width(snd_pcm_format_t format)
+{
+	int width = snd_pcm_format_physical_width(format);
+
+	if (snd_pcm_format_cpu_endian(format) != 1 ||
+	    snd_pcm_format_signed(format) != 1 ||
+	    snd_pcm_format_width(format) != width)
+		return 0;
+	return width == 16 || width == 32 ? width : 0;
+}
+
+/*
+ * Compile the destinations mixing more than one source (or attenuating
+ * a single one) into a block plan, the selection of the sources mirrors
+ * snd_pcm_route_convert1_many().
+ */
+static int snd_pcm_route_plan_build(snd_pcm_route_params_t *params,
+				    unsigned int src_channels,
+				    unsigned int dst_channels,
+				    snd_pcm_format_t src_format,
+				    snd_pcm_format_t dst_format)
+{
+	snd_pcm_route_plan_t *plan;
+	snd_pcm_route_plan_term_t *term;
+	unsigned int dst_channel, srcidx, ndsts = 0, nterms = 0;
+	int block[src_channels];
+
+	snd_pcm_route_plan_free(params);
+	if (dst_channels > params->ndsts)
+		dst_channels = params->ndsts;
+	for (dst_channel = 0; dst_channel < dst_channels; ++dst_channel) {
+		snd_pcm_route_ttable_dst_t *d = &params->dsts[dst_channel];
+		const snd_pcm_route_ttable_src_t *first = NULL;
+		unsigned int n = 0;
+		if (d->func != snd_pcm_route_convert1_many)
+			continue;
+		for (srcidx = 0; srcidx < d->nsrcs && srcidx < src_channels; ++srcidx) {
+			if ((unsigned int)d->srcs[srcidx].channel >= src_channels)
+				continue;
+			if (!first)
+				first = &d->srcs[srcidx];
+			n++;
+		}
+		if (n == 0 ||
+		    (n == 1 && first->as_int == SND_PCM_PLUGIN_ROUTE_RESOLUTION))
+			continue;
+		d->planned = 1;
+		ndsts++;
+		nterms += n;
+	}
+	if (ndsts == 0)
+		return 0;
+
+	plan = calloc(1, sizeof(*plan));
+	if (!plan)
+		goto _nomem;
+	params->plan = plan;
+	plan->srcs = calloc(src_channels, sizeof(*plan->srcs));
+	plan->dsts = calloc(ndsts, sizeof(*plan->dsts));
+	plan->terms = calloc(nterms, sizeof(*plan->terms));
+	plan->out = calloc(ROUTE_PLAN_BLOCK, sizeof(*plan->out));
+	plan->sum = calloc(ROUTE_PLAN_BLOCK, sizeof(*plan->sum));
+	if (!plan->srcs || !plan->dsts || !plan->terms ||
+	    !plan->out || !plan->sum)
+		goto _nomem;
+	for (srcidx = 0; srcidx < src_channels; ++srcidx)
+		block[srcidx] = -1;
+	term = plan->terms;
+	for (dst_channel = 0; dst_channel < dst_channels; ++dst_channel) {
+		snd_pcm_route_ttable_dst_t *d = &params->dsts[dst_channel];
+		snd_pcm_route_plan_dst_t *dp;
+		if (!d->planned)
+			continue;
+		dp = &plan->dsts[plan->ndsts++];
+		dp->channel = dst_channel;
+		dp->terms = term;
+		for (srcidx = 0; srcidx < d->nsrcs && srcidx < src_channels; ++srcidx) {
+			unsigned int channel = d->srcs[srcidx].channel;
+			if (channel >= src_channels)
+				continue;
+			if (block[channel] < 0) {
+				block[channel] = plan->nsrcs;
+				plan->srcs[plan->nsrcs++] = channel;
+			}
+			term->block = block[channel];
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+			term->gain = d->srcs[srcidx].as_float;
+#else
+			term->gain = d->srcs[srcidx].as_int;
+#endif
+			term++;
+			dp->nterms++;
+		}
+	}
+	plan->samples = calloc(plan->nsrcs * ROUTE_PLAN_BLOCK, sizeof(*plan->samples));
+	if (!plan->samples)
+		goto _nomem;
+#if SND_PCM_PLUGIN_ROUTE_FLOAT
+	plan->mac = snd_pcm_simd_ops()->route_mac;
+	plan->norm = snd_pcm_simd_ops()->route_norm;
+#endif
+	if (!params->use_getput) {
+		plan->get_width = snd_pcm_route_plan_width(src_format);
+		plan->put_width = snd_pcm_route_plan_width(dst_format);
+	}
+	return 0;
+
+ _nomem:
+	snd_pcm_route_plan_free(params);
+	return -ENOMEM;
+}
+
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+static void snd_pcm_route_float_free(snd_pcm_route_t *route)
+{
+	route->float_format = SND_PCM_FORMAT_UNKNOWN;
+	free(route->float_buf);
+	route->float_buf = NULL;
+	free(route->float_areas);
+	route->float_areas = NULL;
+}
+
+/*
+ * Float client samples are converted to S32 (playback) or from S32
+ * (capture) through a scratch block of ROUTE_PLAN_BLOCK frames, so
+ * the conversion and the routing run in one pass over the client
+ * buffer instead of through the ring buffer of a separate lfloat PCM.
+ * The scratch block has the client layout for the SIMD kernels, the
+ * route parameters are then set up for S32 client samples.
+ */
+static int snd_pcm_route_float_setup(snd_pcm_t *pcm,
+				     snd_pcm_hw_params_t *params,
+				     snd_pcm_format_t *format)
+{
+	snd_pcm_route_t *route = pcm->private_data;
+	const snd_pcm_simd_ops_t *ops = snd_pcm_simd_ops();
+	snd_pcm_access_t access;
+	unsigned int channels, chn;
+	int err, interleaved;
+
+	snd_pcm_route_float_free(route);
+	if (!snd_pcm_format_float(*format))
+		return 0;
+	err = INTERNAL(snd_pcm_hw_params_get_channels)(params, &channels);
+	if (err < 0)
+		return err;
+	err = INTERNAL(snd_pcm_hw_params_get_access)(params, &access);
+	if (err < 0)
+		return err;
+	route->float_buf = malloc(channels * ROUTE_PLAN_BLOCK * sizeof(int32_t));
+	route->float_areas = calloc(channels, sizeof(*route->float_areas));
+	if (!route->float_buf || !route->float_areas) {
+		snd_pcm_route_float_free(route);
+		return -ENOMEM;
+	}
+	interleaved = access == SND_PCM_ACCESS_MMAP_INTERLEAVED ||
+		      access == SND_PCM_ACCESS_RW_INTERLEAVED;
+	for (chn = 0; chn < channels; chn++) {
+		snd_pcm_channel_area_t *a = &route->float_areas[chn];
+		if (interleaved) {
+			a->addr = route->float_buf;
+			a->first = chn * 32;
+			a->step = channels * 32;
+		} else {
+			a->addr = route->float_buf + chn * ROUTE_PLAN_BLOCK;
+			a->first = 0;
+			a->step = 32;
+		}
+	}
+	route->float_format = *format;
+	route->float_conv.bits = 32;
+	route->float_conv.mode = SND_PCM_SIMD_F2I_TRUNC;
+	route->float_conv.seed = 0x2545f491;
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK) {
+		route->int32_idx = snd_pcm_linear_put_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32);
+		route->float32_idx = snd_pcm_lfloat_get_s32_index(*format);
+		route->float_func = *format == SND_PCM_FORMAT_FLOAT ?
+			ops->conv_float_s32 : ops->conv_double_s32;
+	} else {
+		route->int32_idx = snd_pcm_linear_get_index(SND_PCM_FORMAT_S32, SND_PCM_FORMAT_S32);
+		route->float32_idx = snd_pcm_lfloat_put_s32_index(*format);
+		route->float_func = *format == SND_PCM_FORMAT_FLOAT ?
+			ops->conv_s32_float : ops->conv_s32_double;
+	}
+	*format = SND_PCM_FORMAT_S32;
+	return 0;
+}
+
+static void snd_pcm_route_float_get(snd_pcm_route_t *route,
+				    const snd_pcm_channel_area_t *areas,
+				    snd_pcm_uframes_t offset,
+				    unsigned int channels,
+				    snd_pcm_uframes_t frames)
+{
+	if (route->float_func &&
+	    snd_pcm_simd_convert_areas(route->float_areas, 0, areas, offset,
+				       channels, frames, 32,
+				       snd_pcm_format_physical_width(route->float_format),
+				       route->float_func, &route->float_conv) == 0)
+		return;
+	snd_pcm_lfloat_convert_float_integer(route->float_areas, 0, areas, offset,
+					     channels, frames,
+					     route->int32_idx, route->float32_idx);
+}
+
+static void snd_pcm_route_float_put(snd_pcm_route_t *route,
+				    const snd_pcm_channel_area_t *areas,
+				    snd_pcm_uframes_t offset,
+				    unsigned int channels,
+				    snd_pcm_uframes_t frames)
+{
+	if (route->float_func &&
+	    snd_pcm_simd_convert_areas(areas, offset, route->float_areas, 0,
+				       channels, frames,
+				       snd_pcm_format_physical_width(route->float_format),
+				       32, route->float_func, &route->float_conv) == 0)
+		return;
+	snd_pcm_lfloat_convert_integer_float(areas, offset, route->float_areas, 0,
+					     channels, frames,
+					     route->int32_idx, route->float32_idx);
+}
+#endif
+
 static int snd_pcm_route_close(snd_pcm_t *pcm)
 {
 	snd_pcm_route_t *route = pcm->private_data;
 	snd_pcm_route_params_t *params = &route->params;
 	unsigned int dst_channel;
 
+	snd_pcm_route_plan_free(params);
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+	snd_pcm_route_float_free(route);
+#endif
+
 	if (params->dsts) {
 		for (dst_channel = 0; dst_channel < params->ndsts; ++dst_channel) {
 			free(params->dsts[dst_channel].srcs);
@@ -445,11 +887,21 @@ static int snd_pcm_route_close(snd_pcm_t *pcm)
 	return snd_pcm_generic_close(pcm);
 }
 
-static int snd_pcm_route_hw_refine_cprepare(snd_pcm_t *pcm ATTRIBUTE_UNUSED, snd_pcm_hw_params_t *params)
+static int snd_pcm_route_hw_refine_cprepare(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 {
+	snd_pcm_route_t *route = pcm->private_data;
 	int err;
 	snd_pcm_access_mask_t access_mask = { SND_PCM_ACCBIT_SHM };
 	snd_pcm_format_mask_t format_mask = { SND_PCM_FMTBIT_LINEAR };
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+	/* host endian float client samples when the slave format is fixed */
+	if (route->sformat != SND_PCM_FORMAT_UNKNOWN) {
+		snd_pcm_format_mask_set(&format_mask, SND_PCM_FORMAT_FLOAT);
+		snd_pcm_format_mask_set(&format_mask, SND_PCM_FORMAT_FLOAT64);
+	}
+#else
+	(void)route;
+#endif
 	err = _snd_pcm_hw_param_set_mask(params, SND_PCM_HW_PARAM_ACCESS,
 					 &access_mask);
 	if (err < 0)
@@ -544,11 +996,30 @@ static int snd_pcm_route_hw_refine(snd_pcm_t *pcm, snd_pcm_hw_params_t *params)
 				       snd_pcm_generic_hw_refine);
 }
 
+/* each channel is copied to the same channel with the full gain */
+static int snd_pcm_route_is_identity(const snd_pcm_route_params_t *params,
+				     unsigned int channels,
+				     unsigned int schannels)
+{
+	unsigned int dst_channel;
+
+	if (channels != schannels || params->ndsts < channels)
+		return 0;
+	for (dst_channel = 0; dst_channel < channels; ++dst_channel) {
+		const snd_pcm_route_ttable_dst_t *d = &params->dsts[dst_channel];
+		if (d->nsrcs != 1 || d->att ||
+		    (unsigned int)d->srcs[0].channel != dst_channel)
+			return 0;
+	}
+	return 1;
+}
+
 static int snd_pcm_route_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 {
 	snd_pcm_route_t *route = pcm->private_data;
 	snd_pcm_t *slave = route->plug.gen.slave;
 	snd_pcm_format_t src_format, dst_format;
+	unsigned int channels;
 	int err = snd_pcm_hw_params_slave(pcm, params,
 					  snd_pcm_route_hw_refine_cchange,
 					  snd_pcm_route_hw_refine_sprepare,
@@ -566,6 +1037,13 @@ static int snd_pcm_route_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 	}
 	if (err < 0)
 		return err;
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+	err = snd_pcm_route_float_setup(pcm, params,
+					pcm->stream == SND_PCM_STREAM_PLAYBACK ?
+					&src_format : &dst_format);
+	if (err < 0)
+		return err;
+#endif
 	/* 3 bytes or 20-bit formats? */
 	route->params.use_getput =
 		(snd_pcm_format_physical_width(src_format) + 7) / 8 == 3 ||
@@ -582,7 +1060,31 @@ static int snd_pcm_route_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * params)
 #else
 	route->params.sum_idx = UINT64;
 #endif
-	return 0;
+	err = INTERNAL(snd_pcm_hw_params_get_channels)(params, &channels);
+	if (err < 0)
+		return err;
+	snd_pcm_plugin_set_identity(pcm, params,
+				    src_format == dst_format &&
+				    snd_pcm_route_is_identity(&route->params, channels,
+							      slave->channels));
+	if (pcm->stream == SND_PCM_STREAM_PLAYBACK)
+		return snd_pcm_route_plan_build(&route->params,
+						channels, slave->channels,
+						src_format, dst_format);
+	return snd_pcm_route_plan_build(&route->params,
+					slave->channels, channels,
+					src_format, dst_format);
+}
+
+static int snd_pcm_route_hw_free(snd_pcm_t *pcm)
+{
+	snd_pcm_route_t *route = pcm->private_data;
+
+	snd_pcm_route_plan_free(&route->params);
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+	snd_pcm_route_float_free(route);
+#endif
+	return snd_pcm_generic_hw_free(pcm);
 }
 
 static snd_pcm_uframes_t
@@ -598,6 +1100,25 @@ snd_pcm_route_write_areas(snd_pcm_t *pcm,
 	snd_pcm_t *slave = route->plug.gen.slave;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+	if (route->float_format != SND_PCM_FORMAT_UNKNOWN) {
+		snd_pcm_uframes_t done, frames;
+		for (done = 0; done < size; done += frames) {
+			frames = size - done;
+			if (frames > ROUTE_PLAN_BLOCK)
+				frames = ROUTE_PLAN_BLOCK;
+			snd_pcm_route_float_get(route, areas, offset + done,
+						pcm->channels, frames);
+			snd_pcm_route_convert(slave_areas, slave_offset + done,
+					      route->float_areas, 0,
+					      pcm->channels,
+					      slave->channels,
+					      frames, &route->params);
+		}
+		*slave_sizep = size;
+		return size;
+	}
+#endif
 	snd_pcm_route_convert(slave_areas, slave_offset,
 			      areas, offset, 
 			      pcm->channels,
@@ -620,6 +1141,25 @@ snd_pcm_route_read_areas(snd_pcm_t *pcm,
 	snd_pcm_t *slave = route->plug.gen.slave;
 	if (size > *slave_sizep)
 		size = *slave_sizep;
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+	if (route->float_format != SND_PCM_FORMAT_UNKNOWN) {
+		snd_pcm_uframes_t done, frames;
+		for (done = 0; done < size; done += frames) {
+			frames = size - done;
+			if (frames > ROUTE_PLAN_BLOCK)
+				frames = ROUTE_PLAN_BLOCK;
+			snd_pcm_route_convert(route->float_areas, 0,
+					      slave_areas, slave_offset + done,
+					      slave->channels,
+					      pcm->channels,
+					      frames, &route->params);
+			snd_pcm_route_float_put(route, areas, offset + done,
+						pcm->channels, frames);
+		}
+		*slave_sizep = size;
+		return size;
+	}
+#endif
 	snd_pcm_route_convert(areas, offset, 
 			      slave_areas, slave_offset,
 			      slave->channels,
@@ -715,6 +1255,16 @@ static void snd_pcm_route_dump(snd_pcm_t *pcm, snd_output_t *out)
 		}
 		snd_output_putc(out, '\n');
 	}
+	if (route->params.plan)
+		snd_output_printf(out, "  Block plan: %u sources, %u destinations\n",
+				  route->params.plan->nsrcs,
+				  route->params.plan->ndsts);
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+	if (route->float_format != SND_PCM_FORMAT_UNKNOWN)
+		snd_output_printf(out, "  Client %s samples converted in blocks of %u frames\n",
+				  snd_pcm_format_name(route->float_format),
+				  ROUTE_PLAN_BLOCK);
+#endif
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -914,7 +1464,7 @@ static const snd_pcm_ops_t snd_pcm_route_ops = {
 	.info = snd_pcm_generic_info,
 	.hw_refine = snd_pcm_route_hw_refine,
 	.hw_params = snd_pcm_route_hw_params,
-	.hw_free = snd_pcm_generic_hw_free,
+	.hw_free = snd_pcm_route_hw_free,
 	.sw_params = snd_pcm_generic_sw_params,
 	.channel_info = snd_pcm_generic_channel_info,
 	.dump = snd_pcm_route_dump,
@@ -1034,6 +1584,9 @@ int snd_pcm_route_open(snd_pcm_t **pcmp, const char *name,
 	}
 	snd_pcm_plugin_init(&route->plug);
 	route->sformat = sformat;
+#ifdef BUILD_PCM_PLUGIN_LFLOAT
+	route->float_format = SND_PCM_FORMAT_UNKNOWN;
+#endif
 	route->schannels = schannels;
 	route->plug.read = snd_pcm_route_read_areas;
 	route->plug.write = snd_pcm_route_write_areas;
@@ -0,0 +1,2500 @@
+/*
+ *  PCM - SIMD sample kernels
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#include <math.h>
+#include "pcm_local.h"
+#include "pcm_simd.h"
+#include "bswap.h"
+#ifdef HAVE_LIBPTHREAD
+#include <pthread.h>
+#endif
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#define SIMD_TARGET(x) __attribute__((target(x)))
+#endif
+#if defined(__ARM_NEON) && defined(SNDRV_LITTLE_ENDIAN)
+#include <arm_neon.h>
+#define HAVE_NEON_SIMD 1
+#endif
+
+#ifndef DOC_HIDDEN
+
+#define SIMD_CONV_ARGS \
+	void *dst, const void *src, size_t samples, snd_pcm_simd_conv_t *conv
+
+/*
+ * generic C versions, also used for the tails of the vector loops
+ */
+
+static void conv_16_32_c(SIMD_CONV_ARGS)
+{
+	uint32_t *d = dst;
+	const uint16_t *s = src;
+	while (samples-- > 0)
+		*d++ = (uint32_t)(uint16_t)(*s++ ^ conv->flip) << 16;
+}
+
+static void conv_32_16_c(SIMD_CONV_ARGS)
+{
+	uint16_t *d = dst;
+	const uint32_t *s = src;
+	while (samples-- > 0)
+		*d++ = (*s++ >> 16) ^ conv->flip;
+}
+
+static void conv_24_3_32_c(SIMD_CONV_ARGS)
+{
+	uint32_t *d = dst;
+	const uint8_t *s = src;
+	while (samples-- > 0) {
+#ifdef SNDRV_LITTLE_ENDIAN
+		*d++ = (((uint32_t)s[0] << 8 | (uint32_t)s[1] << 16 |
+			 (uint32_t)s[2] << 24)) ^ conv->flip;
+#else
+		*d++ = (((uint32_t)s[2] << 8 | (uint32_t)s[1] << 16 |
+			 (uint32_t)s[0] << 24)) ^ conv->flip;
+#endif
+		s += 3;
+	}
+}
+
+static void conv_32_24_3_c(SIMD_CONV_ARGS)
+{
+	uint8_t *d = dst;
+	const uint32_t *s = src;
+	while (samples-- > 0) {
+		uint32_t val = (*s++ ^ conv->flip) >> 8;
+#ifdef SNDRV_LITTLE_ENDIAN
+		d[0] = val;
+		d[1] = val >> 8;
+		d[2] = val >> 16;
+#else
+		d[0] = val >> 16;
+		d[1] = val >> 8;
+		d[2] = val;
+#endif
+		d += 3;
+	}
+}
+
+/*
+ * softvol gain, vol is a 16.16 fixed point factor below 0x80000000; the
+ * product is rounded towards minus infinity and saturated to bits, as the
+ * MULTI_DIV_* helpers in pcm_softvol.c do
+ */
+
+/* move the row by n samples, ramping the factors that were used */
+static inline void gain_advance(snd_pcm_simd_gain_t *g, unsigned int n)
+{
+	uint32_t *vol = g->vol + g->pos;
+	unsigned int k;
+
+	if (g->step) {
+		const uint32_t *step = g->step + g->pos;
+		for (k = 0; k < n; k++)
+			vol[k] += step[k];
+	}
+	g->pos += n;
+	if (g->pos >= g->len)
+		g->pos = 0;
+}
+
+/* the factor of the next sample */
+static inline uint32_t gain_next(snd_pcm_simd_gain_t *g)
+{
+	uint32_t vol = g->vol[g->pos];
+
+	gain_advance(g, 1);
+	return vol;
+}
+
+/* samples to run through the C version until the row position is a
+ * multiple of the vector width n
+ */
+static inline size_t gain_head(const snd_pcm_simd_gain_t *g, size_t samples,
+			       unsigned int n)
+{
+	size_t head = (n - g->pos % n) % n;
+
+	return head < samples ? head : samples;
+}
+
+static void gain_s16_c(void *dst, const void *src, size_t samples,
+		       snd_pcm_simd_gain_t *g,
+		       ATTRIBUTE_UNUSED unsigned int bits)
+{
+	int16_t *d = dst;
+	const int16_t *s = src;
+
+	while (samples-- > 0) {
+		int64_t v = ((int64_t)*s++ * gain_next(g)) >> 16;
+		*d++ = v > 0x7fff ? 0x7fff : v < -0x8000 ? -0x8000 : v;
+	}
+}
+
+/* the input is sign extended from bits, too */
+static void gain_s32_c(void *dst, const void *src, size_t samples,
+		       snd_pcm_simd_gain_t *g, unsigned int bits)
+{
+	int32_t *d = dst;
+	const uint32_t *s = src;
+	unsigned int shift = 32 - bits;
+	int64_t max = (1LL << (bits - 1)) - 1;
+	int64_t min = -(1LL << (bits - 1));
+
+	while (samples-- > 0) {
+		int64_t v = (int32_t)(*s++ << shift) >> shift;
+		v = (v * gain_next(g)) >> 16;
+		*d++ = v > max ? max : v < min ? min : v;
+	}
+}
+
+/*
+ * dmix, same results as generic_mix_areas_*_native in pcm_dmix_generic.c:
+ * a zero destination sample starts a new sum, otherwise the source is
+ * added to the shared sum and the saturated sum is stored; remix
+ * subtracts the source instead
+ */
+
+static inline void mix_s16_run_c(int16_t *d, const int16_t *s, int32_t *sum,
+				 size_t samples, int remix)
+{
+	while (samples-- > 0) {
+		int32_t v = remix ? -*s : *s;
+		s++;
+		if (*d) {
+			v = (int32_t)((uint32_t)*sum + (uint32_t)v);
+			*d++ = v > 0x7fff ? 0x7fff : v < -0x8000 ? -0x8000 : v;
+		} else {
+			*d++ = (int16_t)v;
+		}
+		*sum++ = v;
+	}
+}
+
+static inline void mix_s32_run_c(int32_t *d, const int32_t *s, int32_t *sum,
+				 size_t samples, int remix)
+{
+	while (samples-- > 0) {
+		int32_t v = *s >> 8;
+		if (remix)
+			v = -v;
+		if (*d) {
+			v = (int32_t)((uint32_t)*sum + (uint32_t)v);
+			*d = v > 0x7fffff ? 0x7fffffff :
+			     v < -0x800000 ? (int32_t)0x80000000 : v * 256;
+		} else {
+			*d = remix ? (int32_t)(0U - (uint32_t)*s) : *s;
+		}
+		*sum++ = v;
+		s++;
+		d++;
+	}
+}
+
+static void mix_s16_c(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s16_run_c(dst, src, sum, samples, 0);
+}
+
+static void remix_s16_c(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s16_run_c(dst, src, sum, samples, 1);
+}
+
+static void mix_s32_c(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s32_run_c(dst, src, sum, samples, 0);
+}
+
+static void remix_s32_c(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s32_run_c(dst, src, sum, samples, 1);
+}
+
+static void lut_8_16_c(SIMD_CONV_ARGS)
+{
+	uint16_t *d = dst;
+	const uint8_t *s = src;
+	const uint16_t *t = conv->table;
+	while (samples-- > 0)
+		*d++ = t[*s++] ^ conv->flip;
+}
+
+static void lut_16_8_c(SIMD_CONV_ARGS)
+{
+	uint8_t *d = dst;
+	const uint16_t *s = src;
+	const uint8_t *t = conv->table;
+	while (samples-- > 0)
+		*d++ = t[(uint16_t)(*s++ ^ conv->flip)];
+}
+
+/* bit 31 = parity of all the bits */
+static inline uint32_t iec958_fold(uint32_t x)
+{
+	x ^= x << 16;
+	x ^= x << 8;
+	x ^= x << 4;
+	x ^= x << 2;
+	return x ^ (x << 1);
+}
+
+static void iec958_enc_c(uint32_t *dst, const int32_t *src,
+			 const uint32_t *pattern, size_t samples,
+			 unsigned int byteswap)
+{
+	while (samples-- > 0) {
+		uint32_t t = (((uint32_t)*src++ >> 4) & 0x0ffffff0) | *pattern++;
+		t = (t & 0x7fffffff) | (iec958_fold(t) & 0x80000000);
+		*dst++ = byteswap ? bswap_32(t) : t;
+	}
+}
+
+static void iec958_dec_c(int32_t *dst, const uint32_t *src, size_t samples,
+			 unsigned int byteswap)
+{
+	while (samples-- > 0) {
+		uint32_t t = byteswap ? bswap_32(*src) : *src;
+		src++;
+		*dst++ = (int32_t)((t & ~0xfU) << 4);
+	}
+}
+
+static void copy_stream_c(void *dst, const void *src, size_t bytes)
+{
+	memcpy(dst, src, bytes);
+}
+
+static void fill_stream_c(void *dst, uint64_t pattern, size_t bytes)
+{
+	uint64_t *d = dst;
+	for (bytes /= 8; bytes > 0; bytes--)
+		*d++ = pattern;
+}
+
+#ifndef HAVE_SOFT_FLOAT
+
+#define SIMD_S32_SCALE	(1.0 / 2147483648.0)	/* 1 / 0x80000000 */
+
+/* TPDF noise in LSB units, two draws per sample in sample order */
+static inline float simd_tpdf(uint32_t *seed)
+{
+	uint32_t a, b;
+	*seed = *seed * 1664525 + 1013904223;
+	a = *seed >> 8;
+	*seed = *seed * 1664525 + 1013904223;
+	b = *seed >> 8;
+	return ((float)a - (float)b) * (1.0f / 16777216.0f);
+}
+
+static inline int32_t simd_max_int(unsigned int bits)
+{
+	return (int32_t)((1U << (bits - 1)) - 1);
+}
+
+static inline int32_t simd_min_int(unsigned int bits)
+{
+	return (int32_t)(0U - (1U << (bits - 1)));
+}
+
+/**
+ * \brief Convert one float sample to integer
+ * \param val sample value, full scale is 1.0
+ * \param conv conversion parameters
+ * \return sample with conv->bits significant bits, sign extended
+ *
+ * SND_PCM_SIMD_F2I_TRUNC gives the same result as the get32float and
+ * put32 tables, the other modes round to nearest and saturate.
+ */
+int32_t snd_pcm_simd_float_to_int(float val, snd_pcm_simd_conv_t *conv)
+{
+	float scale, v;
+
+	if (conv->mode == SND_PCM_SIMD_F2I_TRUNC) {
+		int32_t sample;
+		if (val >= 1.0)
+			sample = 0x7fffffff;
+		else if (val <= -1.0)
+			sample = (int32_t)0x80000000;
+		else
+			sample = (int32_t)(val * (float)0x80000000UL);
+		return sample >> (32 - conv->bits);
+	}
+	scale = (float)(1U << (conv->bits - 1));
+	v = val * scale;
+	if (conv->mode == SND_PCM_SIMD_F2I_DITHER)
+		v += simd_tpdf(&conv->seed);
+	/* for 32 bits the threshold rounds up to 2^31 */
+	if (v >= scale - 1.0f)
+		return simd_max_int(conv->bits);
+	if (!(v > -scale))
+		return simd_min_int(conv->bits);
+	return (int32_t)lrintf(v);
+}
+
+/**
+ * \brief Convert one float64 sample to integer
+ * \param val sample value, full scale is 1.0
+ * \param conv conversion parameters
+ * \return sample with conv->bits significant bits, sign extended
+ */
+int32_t snd_pcm_simd_double_to_int(double val, snd_pcm_simd_conv_t *conv)
+{
+	double scale, v;
+
+	if (conv->mode == SND_PCM_SIMD_F2I_TRUNC) {
+		int32_t sample;
+		if (val >= 1.0)
+			sample = 0x7fffffff;
+		else if (val <= -1.0)
+			sample = (int32_t)0x80000000;
+		else
+			sample = (int32_t)(val * (double)0x80000000UL);
+		return sample >> (32 - conv->bits);
+	}
+	scale = (double)(1U << (conv->bits - 1));
+	v = val * scale;
+	if (conv->mode == SND_PCM_SIMD_F2I_DITHER)
+		v += simd_tpdf(&conv->seed);
+	if (v >= scale - 1.0)
+		return simd_max_int(conv->bits);
+	if (!(v > -scale))
+		return simd_min_int(conv->bits);
+	return (int32_t)lrint(v);
+}
+
+static void conv_s16_float_c(SIMD_CONV_ARGS)
+{
+	float *d = dst;
+	const uint16_t *s = src;
+	while (samples-- > 0)
+		*d++ = (float)(int32_t)((uint32_t)*s++ << 16) * (float)SIMD_S32_SCALE;
+}
+
+static void conv_s32_float_c(SIMD_CONV_ARGS)
+{
+	float *d = dst;
+	const uint32_t *s = src;
+	unsigned int shift = 32 - conv->bits;
+	while (samples-- > 0)
+		*d++ = (float)(int32_t)(*s++ << shift) * (float)SIMD_S32_SCALE;
+}
+
+static void conv_s16_double_c(SIMD_CONV_ARGS)
+{
+	double *d = dst;
+	const uint16_t *s = src;
+	while (samples-- > 0)
+		*d++ = (double)(int32_t)((uint32_t)*s++ << 16) * SIMD_S32_SCALE;
+}
+
+static void conv_s32_double_c(SIMD_CONV_ARGS)
+{
+	double *d = dst;
+	const uint32_t *s = src;
+	unsigned int shift = 32 - conv->bits;
+	while (samples-- > 0)
+		*d++ = (double)(int32_t)(*s++ << shift) * SIMD_S32_SCALE;
+}
+
+/* conv->bits is 16 for the 16-bit containers */
+static void conv_float_s16_c(SIMD_CONV_ARGS)
+{
+	int16_t *d = dst;
+	const float *s = src;
+	while (samples-- > 0)
+		*d++ = snd_pcm_simd_float_to_int(*s++, conv);
+}
+
+static void conv_float_s32_c(SIMD_CONV_ARGS)
+{
+	int32_t *d = dst;
+	const float *s = src;
+	while (samples-- > 0)
+		*d++ = snd_pcm_simd_float_to_int(*s++, conv);
+}
+
+static void conv_double_s16_c(SIMD_CONV_ARGS)
+{
+	int16_t *d = dst;
+	const double *s = src;
+	while (samples-- > 0)
+		*d++ = snd_pcm_simd_double_to_int(*s++, conv);
+}
+
+static void conv_double_s32_c(SIMD_CONV_ARGS)
+{
+	int32_t *d = dst;
+	const double *s = src;
+	while (samples-- > 0)
+		*d++ = snd_pcm_simd_double_to_int(*s++, conv);
+}
+
+/*
+ * route plugin accumulation, the same arithmetic as the float sum in
+ * snd_pcm_route_convert1_many()
+ */
+
+static void route_mac_c(float *acc, const int32_t *src, size_t samples,
+			float gain)
+{
+	while (samples-- > 0)
+		*acc++ += *src++ * gain;
+}
+
+static void route_norm_c(int32_t *dst, const float *acc, size_t samples)
+{
+	while (samples-- > 0) {
+		float v = rint(*acc++);
+		if (v > (int64_t)0x7fffffff)
+			*dst++ = 0x7fffffff;
+		else if (v < -(int64_t)0x80000000)
+			*dst++ = 0x80000000;
+		else
+			*dst++ = v;
+	}
+}
+
+/* two FIR phases over the same input window */
+static void rate_dot2_c(const float *x, const float *h0, const float *h1,
+			size_t taps, float *res)
+{
+	float a = 0, b = 0;
+	while (taps-- > 0) {
+		a += *x * *h0++;
+		b += *x++ * *h1++;
+	}
+	res[0] = a;
+	res[1] = b;
+}
+
+/* meter levels, the peak comparisons skip NaNs */
+static void meter_level_c(const float *src, size_t samples, float *res)
+{
+	float peak = res[0], sum = 0;
+
+	while (samples-- > 0) {
+		float v = *src++;
+		if (fabsf(v) > peak)
+			peak = fabsf(v);
+		sum += v * v;
+	}
+	res[0] = peak;
+	res[1] += sum;
+}
+
+static float fir_peak_c(const float *x, const float *h, size_t taps,
+			size_t samples)
+{
+	float peak = 0;
+
+	for (; samples > 0; samples--, x++) {
+		float y = 0;
+		size_t k;
+		for (k = 0; k < taps; k++)
+			y += x[k] * h[k];
+		if (fabsf(y) > peak)
+			peak = fabsf(y);
+	}
+	return peak;
+}
+
+static void gain_float_c(void *dst, const void *src, size_t samples,
+			 snd_pcm_simd_gain_t *g,
+			 ATTRIBUTE_UNUSED unsigned int bits)
+{
+	float *d = dst;
+	const float *s = src;
+
+	while (samples-- > 0)
+		*d++ = *s++ * ((int32_t)gain_next(g) * (1.0f / 65536));
+}
+
+#endif /* HAVE_SOFT_FLOAT */
+
+#ifdef HAVE_X86_SIMD
+
+/*
+ * SSE2 versions
+ */
+
+SIMD_TARGET("sse2")
+static void conv_16_32_sse2(SIMD_CONV_ARGS)
+{
+	uint32_t *d = dst;
+	const uint16_t *s = src;
+	const __m128i f = _mm_set1_epi16((short)conv->flip);
+	const __m128i z = _mm_setzero_si128();
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8) {
+		__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)s), f);
+		_mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi16(z, v));
+		_mm_storeu_si128((__m128i *)(d + 4), _mm_unpackhi_epi16(z, v));
+	}
+	conv_16_32_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("sse2")
+static void conv_32_16_sse2(SIMD_CONV_ARGS)
+{
+	uint16_t *d = dst;
+	const uint32_t *s = src;
+	const __m128i f = _mm_set1_epi16((short)conv->flip);
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8) {
+		/* the arithmetic shift keeps packs from saturating */
+		__m128i a = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)s), 16);
+		__m128i b = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(s + 4)), 16);
+		_mm_storeu_si128((__m128i *)d, _mm_xor_si128(_mm_packs_epi32(a, b), f));
+	}
+	conv_32_16_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("sse2")
+static void gain_s16_sse2(void *dst, const void *src, size_t samples,
+			  snd_pcm_simd_gain_t *g, unsigned int bits)
+{
+	int16_t *d = dst;
+	const int16_t *s = src;
+	size_t head;
+
+	head = gain_head(g, samples, 8);
+	gain_s16_c(d, s, head, g, bits);
+	s += head;
+	d += head;
+	for (samples -= head; samples >= 8; samples -= 8, s += 8, d += 8) {
+		const uint32_t *vol = g->vol + g->pos;
+		__m128i a = _mm_loadu_si128((const __m128i *)s);
+		__m128i v0 = _mm_loadu_si128((const __m128i *)vol);
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(vol + 4));
+		/* integer and fraction parts of the factor as 16-bit lanes */
+		__m128i gi = _mm_packs_epi32(_mm_srli_epi32(v0, 16),
+					     _mm_srli_epi32(v1, 16));
+		__m128i f = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(v0, 16), 16),
+					    _mm_srai_epi32(_mm_slli_epi32(v1, 16), 16));
+		/* (a * f) >> 16 with f unsigned */
+		__m128i fr = _mm_sub_epi16(_mm_mulhi_epu16(a, f),
+					   _mm_and_si128(_mm_srai_epi16(a, 15), f));
+		__m128i lo = _mm_mullo_epi16(a, gi);
+		__m128i hi = _mm_mulhi_epi16(a, gi);
+		__m128i p0 = _mm_add_epi32(_mm_unpacklo_epi16(lo, hi),
+					   _mm_srai_epi32(_mm_unpacklo_epi16(fr, fr), 16));
+		__m128i p1 = _mm_add_epi32(_mm_unpackhi_epi16(lo, hi),
+					   _mm_srai_epi32(_mm_unpackhi_epi16(fr, fr), 16));
+		_mm_storeu_si128((__m128i *)d, _mm_packs_epi32(p0, p1));
+		gain_advance(g, 8);
+	}
+	gain_s16_c(d, s, samples, g, bits);
+}
+
+/*
+ * the sum of a lane is restarted where the destination is zero by
+ * clearing it before the add
+ */
+SIMD_TARGET("sse2")
+static inline void mix_s16_run_sse2(int16_t *d, const int16_t *s, int32_t *sum,
+				    size_t samples, int remix)
+{
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8, sum += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)s);
+		__m128i z = _mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)d), zero);
+		__m128i a0 = _mm_srai_epi32(_mm_unpacklo_epi16(a, a), 16);
+		__m128i a1 = _mm_srai_epi32(_mm_unpackhi_epi16(a, a), 16);
+		__m128i s0 = _mm_andnot_si128(_mm_unpacklo_epi16(z, z),
+					      _mm_loadu_si128((const __m128i *)sum));
+		__m128i s1 = _mm_andnot_si128(_mm_unpackhi_epi16(z, z),
+					      _mm_loadu_si128((const __m128i *)(sum + 4)));
+		__m128i r;
+		if (remix) {
+			s0 = _mm_sub_epi32(s0, a0);
+			s1 = _mm_sub_epi32(s1, a1);
+		} else {
+			s0 = _mm_add_epi32(s0, a0);
+			s1 = _mm_add_epi32(s1, a1);
+		}
+		_mm_storeu_si128((__m128i *)sum, s0);
+		_mm_storeu_si128((__m128i *)(sum + 4), s1);
+		r = _mm_packs_epi32(s0, s1);
+		/* a new -0x8000 sample wraps on remix */
+		if (remix)
+			r = _mm_or_si128(_mm_and_si128(z, _mm_sub_epi16(zero, a)),
+					 _mm_andnot_si128(z, r));
+		_mm_storeu_si128((__m128i *)d, r);
+	}
+	mix_s16_run_c(d, s, sum, samples, remix);
+}
+
+SIMD_TARGET("sse2")
+static inline void mix_s32_run_sse2(int32_t *d, const int32_t *s, int32_t *sum,
+				    size_t samples, int remix)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i max = _mm_set1_epi32(0x7fffff);
+	const __m128i min = _mm_set1_epi32(-0x800000);
+	const __m128i smax = _mm_set1_epi32(0x7fffffff);
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4, sum += 4) {
+		__m128i a = _mm_loadu_si128((const __m128i *)s);
+		__m128i z = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i *)d), zero);
+		__m128i v = _mm_andnot_si128(z, _mm_loadu_si128((const __m128i *)sum));
+		__m128i hi, lo, r;
+		if (remix) {
+			v = _mm_sub_epi32(v, _mm_srai_epi32(a, 8));
+			a = _mm_sub_epi32(zero, a);
+		} else {
+			v = _mm_add_epi32(v, _mm_srai_epi32(a, 8));
+		}
+		_mm_storeu_si128((__m128i *)sum, v);
+		hi = _mm_cmpgt_epi32(v, max);
+		lo = _mm_cmpgt_epi32(min, v);
+		r = _mm_andnot_si128(_mm_or_si128(hi, lo), _mm_slli_epi32(v, 8));
+		r = _mm_or_si128(r, _mm_and_si128(hi, smax));
+		r = _mm_or_si128(r, _mm_andnot_si128(smax, lo));
+		_mm_storeu_si128((__m128i *)d, _mm_or_si128(_mm_and_si128(z, a),
+							    _mm_andnot_si128(z, r)));
+	}
+	mix_s32_run_c(d, s, sum, samples, remix);
+}
+
+SIMD_TARGET("sse2")
+static void mix_s16_sse2(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s16_run_sse2(dst, src, sum, samples, 0);
+}
+
+SIMD_TARGET("sse2")
+static void remix_s16_sse2(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s16_run_sse2(dst, src, sum, samples, 1);
+}
+
+SIMD_TARGET("sse2")
+static void mix_s32_sse2(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s32_run_sse2(dst, src, sum, samples, 0);
+}
+
+SIMD_TARGET("sse2")
+static void remix_s32_sse2(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s32_run_sse2(dst, src, sum, samples, 1);
+}
+
+SIMD_TARGET("sse2")
+static void copy_stream_sse2(void *dst, const void *src, size_t bytes)
+{
+	char *d = dst;
+	const char *s = src;
+	size_t head = -(uintptr_t)d & 15;
+
+	if (head > bytes)
+		head = bytes;
+	memcpy(d, s, head);
+	d += head;
+	s += head;
+	bytes -= head;
+	for (; bytes >= 64; bytes -= 64, s += 64, d += 64) {
+		__m128i a = _mm_loadu_si128((const __m128i *)s);
+		__m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+		__m128i e = _mm_loadu_si128((const __m128i *)(s + 48));
+		_mm_stream_si128((__m128i *)d, a);
+		_mm_stream_si128((__m128i *)(d + 16), b);
+		_mm_stream_si128((__m128i *)(d + 32), c);
+		_mm_stream_si128((__m128i *)(d + 48), e);
+	}
+	_mm_sfence();
+	memcpy(d, s, bytes);
+}
+
+SIMD_TARGET("sse2")
+static void fill_stream_sse2(void *dst, uint64_t pattern, size_t bytes)
+{
+	uint64_t *d = dst;
+	const __m128i v = _mm_set1_epi64x((long long)pattern);
+
+	if (((uintptr_t)d & 15) && bytes >= 8) {
+		*d++ = pattern;
+		bytes -= 8;
+	}
+	for (; bytes >= 64; bytes -= 64, d += 8) {
+		_mm_stream_si128((__m128i *)d, v);
+		_mm_stream_si128((__m128i *)(d + 2), v);
+		_mm_stream_si128((__m128i *)(d + 4), v);
+		_mm_stream_si128((__m128i *)(d + 6), v);
+	}
+	_mm_sfence();
+	fill_stream_c(d, pattern, bytes);
+}
+
+SIMD_TARGET("sse2")
+static inline __m128i iec958_bswap_sse2(__m128i v)
+{
+	__m128i m = _mm_set1_epi32(0x00ff00ff);
+	v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+	return _mm_or_si128(_mm_slli_epi32(_mm_and_si128(v, m), 8),
+			    _mm_and_si128(_mm_srli_epi32(v, 8), m));
+}
+
+SIMD_TARGET("sse2")
+static void iec958_enc_sse2(uint32_t *dst, const int32_t *src,
+			    const uint32_t *pattern, size_t samples,
+			    unsigned int byteswap)
+{
+	const __m128i dm = _mm_set1_epi32(0x0ffffff0);
+	const __m128i pm = _mm_set1_epi32(0x80000000);
+
+	for (; samples >= 4; samples -= 4, src += 4, pattern += 4, dst += 4) {
+		__m128i t = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((const __m128i *)src), 4), dm);
+		__m128i f;
+		t = _mm_or_si128(t, _mm_loadu_si128((const __m128i *)pattern));
+		f = _mm_xor_si128(t, _mm_slli_epi32(t, 16));
+		f = _mm_xor_si128(f, _mm_slli_epi32(f, 8));
+		f = _mm_xor_si128(f, _mm_slli_epi32(f, 4));
+		f = _mm_xor_si128(f, _mm_slli_epi32(f, 2));
+		f = _mm_xor_si128(f, _mm_slli_epi32(f, 1));
+		t = _mm_or_si128(_mm_andnot_si128(pm, t), _mm_and_si128(f, pm));
+		if (byteswap)
+			t = iec958_bswap_sse2(t);
+		_mm_storeu_si128((__m128i *)dst, t);
+	}
+	iec958_enc_c(dst, src, pattern, samples, byteswap);
+}
+
+SIMD_TARGET("sse2")
+static void iec958_dec_sse2(int32_t *dst, const uint32_t *src, size_t samples,
+			    unsigned int byteswap)
+{
+	for (; samples >= 4; samples -= 4, src += 4, dst += 4) {
+		__m128i t = _mm_loadu_si128((const __m128i *)src);
+		if (byteswap)
+			t = iec958_bswap_sse2(t);
+		_mm_storeu_si128((__m128i *)dst, _mm_slli_epi32(_mm_srli_epi32(t, 4), 8));
+	}
+	iec958_dec_c(dst, src, samples, byteswap);
+}
+
+/*
+ * AVX2 versions
+ */
+
+SIMD_TARGET("avx2")
+static void conv_16_32_avx2(SIMD_CONV_ARGS)
+{
+	uint32_t *d = dst;
+	const uint16_t *s = src;
+	const __m256i f = _mm256_set1_epi16((short)conv->flip);
+
+	for (; samples >= 16; samples -= 16, s += 16, d += 16) {
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)s), f);
+		__m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+		__m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+		_mm256_storeu_si256((__m256i *)d, _mm256_slli_epi32(lo, 16));
+		_mm256_storeu_si256((__m256i *)(d + 8), _mm256_slli_epi32(hi, 16));
+	}
+	conv_16_32_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void conv_32_16_avx2(SIMD_CONV_ARGS)
+{
+	uint16_t *d = dst;
+	const uint32_t *s = src;
+	const __m256i f = _mm256_set1_epi16((short)conv->flip);
+
+	for (; samples >= 16; samples -= 16, s += 16, d += 16) {
+		__m256i a = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)s), 16);
+		__m256i b = _mm256_srai_epi32(_mm256_loadu_si256((const __m256i *)(s + 8)), 16);
+		/* packs works per 128-bit lane, restore the sample order */
+		__m256i v = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b),
+						     _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i *)d, _mm256_xor_si256(v, f));
+	}
+	conv_32_16_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void conv_24_3_32_avx2(SIMD_CONV_ARGS)
+{
+	uint32_t *d = dst;
+	const uint8_t *s = src;
+	const __m256i f = _mm256_set1_epi32(conv->flip);
+	const __m256i shuf = _mm256_setr_epi8(
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+		-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+
+	/* the second load reads 4 bytes past the 8 samples */
+	for (; samples >= 10; samples -= 8, s += 24, d += 8) {
+		__m256i v = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)s)),
+			_mm_loadu_si128((const __m128i *)(s + 12)), 1);
+		v = _mm256_shuffle_epi8(v, shuf);
+		_mm256_storeu_si256((__m256i *)d, _mm256_xor_si256(v, f));
+	}
+	conv_24_3_32_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void conv_32_24_3_avx2(SIMD_CONV_ARGS)
+{
+	uint8_t *d = dst;
+	const uint32_t *s = src;
+	const __m256i f = _mm256_set1_epi32(conv->flip);
+	const __m256i shuf = _mm256_setr_epi8(
+		1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1,
+		1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1);
+
+	/* the second store writes 4 bytes past the 8 samples, they are
+	 * overwritten by the next iteration
+	 */
+	for (; samples >= 10; samples -= 8, s += 8, d += 24) {
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)s), f);
+		v = _mm256_shuffle_epi8(v, shuf);
+		_mm_storeu_si128((__m128i *)d, _mm256_castsi256_si128(v));
+		_mm_storeu_si128((__m128i *)(d + 12), _mm256_extracti128_si256(v, 1));
+	}
+	conv_32_24_3_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void gain_s16_avx2(void *dst, const void *src, size_t samples,
+			  snd_pcm_simd_gain_t *g, unsigned int bits)
+{
+	int16_t *d = dst;
+	const int16_t *s = src;
+	size_t head;
+
+	head = gain_head(g, samples, 16);
+	gain_s16_c(d, s, head, g, bits);
+	s += head;
+	d += head;
+	for (samples -= head; samples >= 16; samples -= 16, s += 16, d += 16) {
+		const uint32_t *vol = g->vol + g->pos;
+		__m256i a = _mm256_loadu_si256((const __m256i *)s);
+		__m256i v0 = _mm256_loadu_si256((const __m256i *)vol);
+		__m256i v1 = _mm256_loadu_si256((const __m256i *)(vol + 8));
+		__m256i gi = _mm256_packs_epi32(_mm256_srli_epi32(v0, 16),
+						_mm256_srli_epi32(v1, 16));
+		__m256i f = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(v0, 16), 16),
+					       _mm256_srai_epi32(_mm256_slli_epi32(v1, 16), 16));
+		__m256i fr, lo, hi, p0, p1;
+		/* packs works per 128-bit lane, restore the sample order */
+		gi = _mm256_permute4x64_epi64(gi, 0xd8);
+		f = _mm256_permute4x64_epi64(f, 0xd8);
+		fr = _mm256_sub_epi16(_mm256_mulhi_epu16(a, f),
+				      _mm256_and_si256(_mm256_srai_epi16(a, 15), f));
+		lo = _mm256_mullo_epi16(a, gi);
+		hi = _mm256_mulhi_epi16(a, gi);
+		p0 = _mm256_add_epi32(_mm256_unpacklo_epi16(lo, hi),
+				      _mm256_srai_epi32(_mm256_unpacklo_epi16(fr, fr), 16));
+		p1 = _mm256_add_epi32(_mm256_unpackhi_epi16(lo, hi),
+				      _mm256_srai_epi32(_mm256_unpackhi_epi16(fr, fr), 16));
+		_mm256_storeu_si256((__m256i *)d, _mm256_packs_epi32(p0, p1));
+		gain_advance(g, 16);
+	}
+	gain_s16_c(d, s, samples, g, bits);
+}
+
+/* (a * v) >> 16 of the even 32-bit lanes, saturated to 32 bits */
+SIMD_TARGET("avx2")
+static inline __m256i gain_s64_avx2(__m256i a, __m256i v)
+{
+	const __m256i sign = _mm256_set1_epi64x(1LL << 47);
+	const __m256i max = _mm256_set1_epi64x(0x7fffffff);
+	const __m256i min = _mm256_set1_epi64x(-0x80000000LL);
+	__m256i p = _mm256_srli_epi64(_mm256_mul_epi32(a, v), 16);
+
+	/* no 64-bit arithmetic shift, sign extend from bit 47 */
+	p = _mm256_sub_epi64(_mm256_xor_si256(p, sign), sign);
+	p = _mm256_blendv_epi8(p, max, _mm256_cmpgt_epi64(p, max));
+	return _mm256_blendv_epi8(p, min, _mm256_cmpgt_epi64(min, p));
+}
+
+SIMD_TARGET("avx2")
+static void gain_s32_avx2(void *dst, const void *src, size_t samples,
+			  snd_pcm_simd_gain_t *g, unsigned int bits)
+{
+	int32_t *d = dst;
+	const int32_t *s = src;
+	const __m128i shift = _mm_cvtsi32_si128(32 - bits);
+	const __m256i max = _mm256_set1_epi32((1U << (bits - 1)) - 1);
+	const __m256i min = _mm256_set1_epi32(0U - (1U << (bits - 1)));
+	size_t head;
+
+	head = gain_head(g, samples, 8);
+	gain_s32_c(d, s, head, g, bits);
+	s += head;
+	d += head;
+	for (samples -= head; samples >= 8; samples -= 8, s += 8, d += 8) {
+		const uint32_t *vol = g->vol + g->pos;
+		__m256i a = _mm256_loadu_si256((const __m256i *)s);
+		__m256i v = _mm256_loadu_si256((const __m256i *)vol);
+		__m256i r;
+		a = _mm256_sra_epi32(_mm256_sll_epi32(a, shift), shift);
+		r = _mm256_blend_epi32(gain_s64_avx2(a, v),
+				       _mm256_slli_epi64(gain_s64_avx2(_mm256_srli_epi64(a, 32),
+								       _mm256_srli_epi64(v, 32)), 32),
+				       0xaa);
+		r = _mm256_min_epi32(_mm256_max_epi32(r, min), max);
+		_mm256_storeu_si256((__m256i *)d, r);
+		gain_advance(g, 8);
+	}
+	gain_s32_c(d, s, samples, g, bits);
+}
+
+/* one iteration covers a cache line of the sum buffer */
+SIMD_TARGET("avx2")
+static inline void mix_s16_run_avx2(int16_t *d, const int16_t *s, int32_t *sum,
+				    size_t samples, int remix)
+{
+	const __m256i zero = _mm256_setzero_si256();
+
+	for (; samples >= 16; samples -= 16, s += 16, d += 16, sum += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)s);
+		__m256i z = _mm256_cmpeq_epi16(_mm256_loadu_si256((const __m256i *)d), zero);
+		__m256i a0 = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(a));
+		__m256i a1 = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(a, 1));
+		__m256i s0 = _mm256_andnot_si256(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(z)),
+						 _mm256_loadu_si256((const __m256i *)sum));
+		__m256i s1 = _mm256_andnot_si256(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(z, 1)),
+						 _mm256_loadu_si256((const __m256i *)(sum + 8)));
+		__m256i r;
+		if (remix) {
+			s0 = _mm256_sub_epi32(s0, a0);
+			s1 = _mm256_sub_epi32(s1, a1);
+		} else {
+			s0 = _mm256_add_epi32(s0, a0);
+			s1 = _mm256_add_epi32(s1, a1);
+		}
+		_mm256_storeu_si256((__m256i *)sum, s0);
+		_mm256_storeu_si256((__m256i *)(sum + 8), s1);
+		r = _mm256_permute4x64_epi64(_mm256_packs_epi32(s0, s1), 0xd8);
+		if (remix)
+			r = _mm256_blendv_epi8(r, _mm256_sub_epi16(zero, a), z);
+		_mm256_storeu_si256((__m256i *)d, r);
+	}
+	mix_s16_run_c(d, s, sum, samples, remix);
+}
+
+SIMD_TARGET("avx2")
+static inline void mix_s32_run_avx2(int32_t *d, const int32_t *s, int32_t *sum,
+				    size_t samples, int remix)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i max = _mm256_set1_epi32(0x7fffff);
+	const __m256i min = _mm256_set1_epi32(-0x800000);
+	const __m256i low = _mm256_set1_epi32(0xff);
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8, sum += 8) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)s);
+		__m256i z = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i *)d), zero);
+		__m256i v = _mm256_andnot_si256(z, _mm256_loadu_si256((const __m256i *)sum));
+		__m256i r;
+		if (remix) {
+			v = _mm256_sub_epi32(v, _mm256_srai_epi32(a, 8));
+			a = _mm256_sub_epi32(zero, a);
+		} else {
+			v = _mm256_add_epi32(v, _mm256_srai_epi32(a, 8));
+		}
+		_mm256_storeu_si256((__m256i *)sum, v);
+		/* 0x7fffff00 | 0xff for the positive overflow */
+		r = _mm256_slli_epi32(_mm256_min_epi32(_mm256_max_epi32(v, min), max), 8);
+		r = _mm256_or_si256(r, _mm256_and_si256(_mm256_cmpgt_epi32(v, max), low));
+		_mm256_storeu_si256((__m256i *)d, _mm256_blendv_epi8(r, a, z));
+	}
+	mix_s32_run_c(d, s, sum, samples, remix);
+}
+
+SIMD_TARGET("avx2")
+static void mix_s16_avx2(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s16_run_avx2(dst, src, sum, samples, 0);
+}
+
+SIMD_TARGET("avx2")
+static void remix_s16_avx2(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s16_run_avx2(dst, src, sum, samples, 1);
+}
+
+SIMD_TARGET("avx2")
+static void mix_s32_avx2(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s32_run_avx2(dst, src, sum, samples, 0);
+}
+
+SIMD_TARGET("avx2")
+static void remix_s32_avx2(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s32_run_avx2(dst, src, sum, samples, 1);
+}
+
+SIMD_TARGET("avx2")
+static void lut_8_16_avx2(SIMD_CONV_ARGS)
+{
+	uint16_t *d = dst;
+	const uint8_t *s = src;
+	const int *t = conv->table;
+	const __m256i f = _mm256_set1_epi16((short)conv->flip);
+	const __m256i m = _mm256_set1_epi32(0xffff);
+
+	for (; samples >= 16; samples -= 16, s += 16, d += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)s);
+		__m256i i0 = _mm256_cvtepu8_epi32(v);
+		__m256i i1 = _mm256_cvtepu8_epi32(_mm_srli_si128(v, 8));
+		__m256i g0 = _mm256_and_si256(_mm256_i32gather_epi32(t, i0, 2), m);
+		__m256i g1 = _mm256_and_si256(_mm256_i32gather_epi32(t, i1, 2), m);
+		__m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi32(g0, g1), 0xd8);
+		_mm256_storeu_si256((__m256i *)d, _mm256_xor_si256(r, f));
+	}
+	lut_8_16_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void lut_16_8_avx2(SIMD_CONV_ARGS)
+{
+	uint8_t *d = dst;
+	const uint16_t *s = src;
+	const int *t = conv->table;
+	const __m256i f = _mm256_set1_epi16((short)conv->flip);
+	const __m256i m = _mm256_set1_epi32(0xff);
+
+	for (; samples >= 16; samples -= 16, s += 16, d += 16) {
+		__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)s), f);
+		__m256i i0 = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+		__m256i i1 = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+		__m256i g0 = _mm256_and_si256(_mm256_i32gather_epi32(t, i0, 1), m);
+		__m256i g1 = _mm256_and_si256(_mm256_i32gather_epi32(t, i1, 1), m);
+		__m256i w = _mm256_permute4x64_epi64(_mm256_packus_epi32(g0, g1), 0xd8);
+		__m256i b = _mm256_permute4x64_epi64(_mm256_packus_epi16(w, w), 0x08);
+		_mm_storeu_si128((__m128i *)d, _mm256_castsi256_si128(b));
+	}
+	lut_16_8_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void iec958_enc_avx2(uint32_t *dst, const int32_t *src,
+			    const uint32_t *pattern, size_t samples,
+			    unsigned int byteswap)
+{
+	const __m256i dm = _mm256_set1_epi32(0x0ffffff0);
+	const __m256i pm = _mm256_set1_epi32(0x80000000);
+	const __m256i sw = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+					    11, 10, 9, 8, 15, 14, 13, 12,
+					    3, 2, 1, 0, 7, 6, 5, 4,
+					    11, 10, 9, 8, 15, 14, 13, 12);
+
+	for (; samples >= 8; samples -= 8, src += 8, pattern += 8, dst += 8) {
+		__m256i t = _mm256_and_si256(_mm256_srli_epi32(_mm256_loadu_si256((const __m256i *)src), 4), dm);
+		__m256i f;
+		t = _mm256_or_si256(t, _mm256_loadu_si256((const __m256i *)pattern));
+		f = _mm256_xor_si256(t, _mm256_slli_epi32(t, 16));
+		f = _mm256_xor_si256(f, _mm256_slli_epi32(f, 8));
+		f = _mm256_xor_si256(f, _mm256_slli_epi32(f, 4));
+		f = _mm256_xor_si256(f, _mm256_slli_epi32(f, 2));
+		f = _mm256_xor_si256(f, _mm256_slli_epi32(f, 1));
+		t = _mm256_or_si256(_mm256_andnot_si256(pm, t), _mm256_and_si256(f, pm));
+		if (byteswap)
+			t = _mm256_shuffle_epi8(t, sw);
+		_mm256_storeu_si256((__m256i *)dst, t);
+	}
+	iec958_enc_c(dst, src, pattern, samples, byteswap);
+}
+
+SIMD_TARGET("avx2")
+static void iec958_dec_avx2(int32_t *dst, const uint32_t *src, size_t samples,
+			    unsigned int byteswap)
+{
+	const __m256i sw = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+					    11, 10, 9, 8, 15, 14, 13, 12,
+					    3, 2, 1, 0, 7, 6, 5, 4,
+					    11, 10, 9, 8, 15, 14, 13, 12);
+
+	for (; samples >= 8; samples -= 8, src += 8, dst += 8) {
+		__m256i t = _mm256_loadu_si256((const __m256i *)src);
+		if (byteswap)
+			t = _mm256_shuffle_epi8(t, sw);
+		_mm256_storeu_si256((__m256i *)dst, _mm256_slli_epi32(_mm256_srli_epi32(t, 4), 8));
+	}
+	iec958_dec_c(dst, src, samples, byteswap);
+}
+
+#ifndef HAVE_SOFT_FLOAT
+
+/*
+ * float conversions, the vector versions must give the same results as
+ * snd_pcm_simd_float_to_int() and snd_pcm_simd_double_to_int()
+ */
+
+SIMD_TARGET("sse2")
+static inline __m128i f2i_trunc_sse2(__m128 f)
+{
+	/* out of range and NaN convert to 0x80000000 */
+	__m128i max = _mm_castps_si128(_mm_cmpge_ps(f, _mm_set1_ps(1.0f)));
+	__m128i i = _mm_cvttps_epi32(_mm_mul_ps(f, _mm_set1_ps(2147483648.0f)));
+	return _mm_or_si128(_mm_andnot_si128(max, i),
+			    _mm_and_si128(max, _mm_set1_epi32(0x7fffffff)));
+}
+
+SIMD_TARGET("sse2")
+static inline __m128i f2i_round_sse2(__m128 v, __m128 lo, __m128 hi, __m128i maxi)
+{
+	__m128i max = _mm_castps_si128(_mm_cmpge_ps(v, hi));
+	/* max_ps returns lo for NaN */
+	__m128i i = _mm_cvtps_epi32(_mm_max_ps(v, lo));
+	return _mm_or_si128(_mm_andnot_si128(max, i), _mm_and_si128(max, maxi));
+}
+
+SIMD_TARGET("sse2")
+static inline __m128 simd_noise_sse2(snd_pcm_simd_conv_t *conv)
+{
+	float n[4];
+	unsigned int k;
+	for (k = 0; k < 4; k++)
+		n[k] = simd_tpdf(&conv->seed);
+	return _mm_loadu_ps(n);
+}
+
+/* convert 4 floats, the result has conv->bits significant bits */
+SIMD_TARGET("sse2")
+static inline __m128i f2i_sse2(__m128 f, snd_pcm_simd_conv_t *conv)
+{
+	float scale = (float)(1U << (conv->bits - 1));
+	__m128 v;
+
+	if (conv->mode == SND_PCM_SIMD_F2I_TRUNC)
+		return _mm_sra_epi32(f2i_trunc_sse2(f),
+				     _mm_cvtsi32_si128(32 - conv->bits));
+	v = _mm_mul_ps(f, _mm_set1_ps(scale));
+	if (conv->mode == SND_PCM_SIMD_F2I_DITHER)
+		v = _mm_add_ps(v, simd_noise_sse2(conv));
+	return f2i_round_sse2(v, _mm_set1_ps(-scale), _mm_set1_ps(scale - 1.0f),
+			      _mm_set1_epi32(simd_max_int(conv->bits)));
+}
+
+/* convert 2 doubles into the low half */
+SIMD_TARGET("sse2")
+static inline __m128i d2i_sse2(__m128d f, snd_pcm_simd_conv_t *conv)
+{
+	double scale = (double)(1U << (conv->bits - 1));
+	__m128d v;
+
+	if (conv->mode == SND_PCM_SIMD_F2I_TRUNC) {
+		v = _mm_mul_pd(f, _mm_set1_pd(2147483648.0));
+		/* min_pd returns its second operand (NaN) for NaN */
+		v = _mm_min_pd(_mm_set1_pd(2147483647.0), v);
+		return _mm_sra_epi32(_mm_cvttpd_epi32(v),
+				     _mm_cvtsi32_si128(32 - conv->bits));
+	}
+	v = _mm_mul_pd(f, _mm_set1_pd(scale));
+	if (conv->mode == SND_PCM_SIMD_F2I_DITHER) {
+		double n0 = simd_tpdf(&conv->seed);
+		double n1 = simd_tpdf(&conv->seed);
+		v = _mm_add_pd(v, _mm_setr_pd(n0, n1));
+	}
+	/* both bounds are exact, max_pd returns the bound for NaN */
+	v = _mm_min_pd(_mm_max_pd(v, _mm_set1_pd(-scale)), _mm_set1_pd(scale - 1.0));
+	return _mm_cvtpd_epi32(v);
+}
+
+SIMD_TARGET("sse2")
+static void conv_s16_float_sse2(SIMD_CONV_ARGS)
+{
+	float *d = dst;
+	const int16_t *s = src;
+	const __m128 scale = _mm_set1_ps((float)SIMD_S32_SCALE);
+	const __m128i z = _mm_setzero_si128();
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8) {
+		__m128i v = _mm_loadu_si128((const __m128i *)s);
+		_mm_storeu_ps(d, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(z, v)), scale));
+		_mm_storeu_ps(d + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(z, v)), scale));
+	}
+	conv_s16_float_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("sse2")
+static void conv_s32_float_sse2(SIMD_CONV_ARGS)
+{
+	float *d = dst;
+	const int32_t *s = src;
+	const __m128 scale = _mm_set1_ps((float)SIMD_S32_SCALE);
+	const __m128i shift = _mm_cvtsi32_si128(32 - conv->bits);
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4) {
+		__m128i v = _mm_sll_epi32(_mm_loadu_si128((const __m128i *)s), shift);
+		_mm_storeu_ps(d, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+	}
+	conv_s32_float_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("sse2")
+static void conv_s16_double_sse2(SIMD_CONV_ARGS)
+{
+	double *d = dst;
+	const int16_t *s = src;
+	const __m128d scale = _mm_set1_pd(SIMD_S32_SCALE);
+	const __m128i z = _mm_setzero_si128();
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4) {
+		__m128i v = _mm_unpacklo_epi16(z, _mm_loadl_epi64((const __m128i *)s));
+		_mm_storeu_pd(d, _mm_mul_pd(_mm_cvtepi32_pd(v), scale));
+		_mm_storeu_pd(d + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(v, 8)), scale));
+	}
+	conv_s16_double_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("sse2")
+static void conv_s32_double_sse2(SIMD_CONV_ARGS)
+{
+	double *d = dst;
+	const int32_t *s = src;
+	const __m128d scale = _mm_set1_pd(SIMD_S32_SCALE);
+	const __m128i shift = _mm_cvtsi32_si128(32 - conv->bits);
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4) {
+		__m128i v = _mm_sll_epi32(_mm_loadu_si128((const __m128i *)s), shift);
+		_mm_storeu_pd(d, _mm_mul_pd(_mm_cvtepi32_pd(v), scale));
+		_mm_storeu_pd(d + 2, _mm_mul_pd(_mm_cvtepi32_pd(_mm_srli_si128(v, 8)), scale));
+	}
+	conv_s32_double_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("sse2")
+static void conv_float_s16_sse2(SIMD_CONV_ARGS)
+{
+	int16_t *d = dst;
+	const float *s = src;
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8) {
+		__m128i a = f2i_sse2(_mm_loadu_ps(s), conv);
+		__m128i b = f2i_sse2(_mm_loadu_ps(s + 4), conv);
+		_mm_storeu_si128((__m128i *)d, _mm_packs_epi32(a, b));
+	}
+	conv_float_s16_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("sse2")
+static void conv_float_s32_sse2(SIMD_CONV_ARGS)
+{
+	int32_t *d = dst;
+	const float *s = src;
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4)
+		_mm_storeu_si128((__m128i *)d, f2i_sse2(_mm_loadu_ps(s), conv));
+	conv_float_s32_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("sse2")
+static void conv_double_s16_sse2(SIMD_CONV_ARGS)
+{
+	int16_t *d = dst;
+	const double *s = src;
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4) {
+		__m128i a = d2i_sse2(_mm_loadu_pd(s), conv);
+		__m128i b = d2i_sse2(_mm_loadu_pd(s + 2), conv);
+		a = _mm_unpacklo_epi64(a, b);
+		_mm_storel_epi64((__m128i *)d, _mm_packs_epi32(a, a));
+	}
+	conv_double_s16_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("sse2")
+static void conv_double_s32_sse2(SIMD_CONV_ARGS)
+{
+	int32_t *d = dst;
+	const double *s = src;
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4) {
+		__m128i a = d2i_sse2(_mm_loadu_pd(s), conv);
+		__m128i b = d2i_sse2(_mm_loadu_pd(s + 2), conv);
+		_mm_storeu_si128((__m128i *)d, _mm_unpacklo_epi64(a, b));
+	}
+	conv_double_s32_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("sse2")
+static void route_mac_sse2(float *acc, const int32_t *src, size_t samples,
+			   float gain)
+{
+	__m128 g = _mm_set1_ps(gain);
+
+	for (; samples >= 4; samples -= 4, src += 4, acc += 4) {
+		__m128 v = _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)src));
+		_mm_storeu_ps(acc, _mm_add_ps(_mm_loadu_ps(acc), _mm_mul_ps(v, g)));
+	}
+	route_mac_c(acc, src, samples, gain);
+}
+
+/* cvtps rounds to nearest even and gives 0x80000000 for out of range
+ * values, only the positive overflow needs a fixup
+ */
+SIMD_TARGET("sse2")
+static void route_norm_sse2(int32_t *dst, const float *acc, size_t samples)
+{
+	const __m128 hi = _mm_set1_ps(2147483648.0f);
+	const __m128i maxi = _mm_set1_epi32(0x7fffffff);
+
+	for (; samples >= 4; samples -= 4, acc += 4, dst += 4) {
+		__m128 v = _mm_loadu_ps(acc);
+		__m128i m = _mm_castps_si128(_mm_cmpgt_ps(v, hi));
+		__m128i r = _mm_cvtps_epi32(v);
+		r = _mm_or_si128(_mm_andnot_si128(m, r), _mm_and_si128(m, maxi));
+		_mm_storeu_si128((__m128i *)dst, r);
+	}
+	route_norm_c(dst, acc, samples);
+}
+
+SIMD_TARGET("sse2")
+static void rate_dot2_sse2(const float *x, const float *h0, const float *h1,
+			   size_t taps, float *res)
+{
+	__m128 a = _mm_setzero_ps(), b = _mm_setzero_ps();
+	float tail[2];
+
+	for (; taps >= 4; taps -= 4, x += 4, h0 += 4, h1 += 4) {
+		__m128 v = _mm_loadu_ps(x);
+		a = _mm_add_ps(a, _mm_mul_ps(v, _mm_loadu_ps(h0)));
+		b = _mm_add_ps(b, _mm_mul_ps(v, _mm_loadu_ps(h1)));
+	}
+	/* horizontal sums of a and b at once */
+	a = _mm_add_ps(_mm_unpacklo_ps(a, b), _mm_unpackhi_ps(a, b));
+	a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+	rate_dot2_c(x, h0, h1, taps, tail);
+	res[0] = _mm_cvtss_f32(a) + tail[0];
+	res[1] = _mm_cvtss_f32(_mm_shuffle_ps(a, a, 1)) + tail[1];
+}
+
+SIMD_TARGET("sse2")
+static inline float simd_hmax_sse2(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+	v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+	return _mm_cvtss_f32(v);
+}
+
+SIMD_TARGET("sse2")
+static void meter_level_sse2(const float *src, size_t samples, float *res)
+{
+	const __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 peak = _mm_setzero_ps(), sum = _mm_setzero_ps();
+
+	for (; samples >= 4; samples -= 4, src += 4) {
+		__m128 v = _mm_loadu_ps(src);
+		peak = _mm_max_ps(_mm_and_ps(v, abs), peak);
+		sum = _mm_add_ps(sum, _mm_mul_ps(v, v));
+	}
+	sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+	sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+	if (simd_hmax_sse2(peak) > res[0])
+		res[0] = simd_hmax_sse2(peak);
+	res[1] += _mm_cvtss_f32(sum);
+	meter_level_c(src, samples, res);
+}
+
+/* four outputs at a time, the taps are broadcast */
+SIMD_TARGET("sse2")
+static float fir_peak_sse2(const float *x, const float *h, size_t taps,
+			   size_t samples)
+{
+	const __m128 abs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 peak = _mm_setzero_ps();
+	float tail;
+	size_t k;
+
+	for (; samples >= 4; samples -= 4, x += 4) {
+		__m128 y = _mm_setzero_ps();
+		for (k = 0; k < taps; k++)
+			y = _mm_add_ps(y, _mm_mul_ps(_mm_loadu_ps(x + k),
+						     _mm_set1_ps(h[k])));
+		peak = _mm_max_ps(_mm_and_ps(y, abs), peak);
+	}
+	tail = fir_peak_c(x, h, taps, samples);
+	return tail > simd_hmax_sse2(peak) ? tail : simd_hmax_sse2(peak);
+}
+
+SIMD_TARGET("sse2")
+static void gain_float_sse2(void *dst, const void *src, size_t samples,
+			    snd_pcm_simd_gain_t *g, unsigned int bits)
+{
+	float *d = dst;
+	const float *s = src;
+	const __m128 k = _mm_set1_ps(1.0f / 65536);
+	size_t head;
+
+	head = gain_head(g, samples, 4);
+	gain_float_c(d, s, head, g, bits);
+	s += head;
+	d += head;
+	for (samples -= head; samples >= 4; samples -= 4, s += 4, d += 4) {
+		const uint32_t *vol = g->vol + g->pos;
+		__m128 f = _mm_mul_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)vol)), k);
+		_mm_storeu_ps(d, _mm_mul_ps(_mm_loadu_ps(s), f));
+		gain_advance(g, 4);
+	}
+	gain_float_c(d, s, samples, g, bits);
+}
+
+#endif /* HAVE_SOFT_FLOAT */
+
+#ifndef HAVE_SOFT_FLOAT
+
+SIMD_TARGET("avx2")
+static inline __m256 simd_noise_avx2(snd_pcm_simd_conv_t *conv)
+{
+	float n[8];
+	unsigned int k;
+	for (k = 0; k < 8; k++)
+		n[k] = simd_tpdf(&conv->seed);
+	return _mm256_loadu_ps(n);
+}
+
+/* convert 8 floats, the result has conv->bits significant bits */
+SIMD_TARGET("avx2")
+static inline __m256i f2i_avx2(__m256 f, snd_pcm_simd_conv_t *conv)
+{
+	float scale = (float)(1U << (conv->bits - 1));
+	__m256 v;
+	__m256i i, max;
+
+	if (conv->mode == SND_PCM_SIMD_F2I_TRUNC) {
+		max = _mm256_castps_si256(_mm256_cmp_ps(f, _mm256_set1_ps(1.0f), _CMP_GE_OQ));
+		i = _mm256_cvttps_epi32(_mm256_mul_ps(f, _mm256_set1_ps(2147483648.0f)));
+		i = _mm256_blendv_epi8(i, _mm256_set1_epi32(0x7fffffff), max);
+		return _mm256_sra_epi32(i, _mm_cvtsi32_si128(32 - conv->bits));
+	}
+	v = _mm256_mul_ps(f, _mm256_set1_ps(scale));
+	if (conv->mode == SND_PCM_SIMD_F2I_DITHER)
+		v = _mm256_add_ps(v, simd_noise_avx2(conv));
+	max = _mm256_castps_si256(_mm256_cmp_ps(v, _mm256_set1_ps(scale - 1.0f), _CMP_GE_OQ));
+	i = _mm256_cvtps_epi32(_mm256_max_ps(v, _mm256_set1_ps(-scale)));
+	return _mm256_blendv_epi8(i, _mm256_set1_epi32(simd_max_int(conv->bits)), max);
+}
+
+/* convert 4 doubles */
+SIMD_TARGET("avx2")
+static inline __m128i d2i_avx2(__m256d f, snd_pcm_simd_conv_t *conv)
+{
+	double scale = (double)(1U << (conv->bits - 1));
+	__m256d v;
+
+	if (conv->mode == SND_PCM_SIMD_F2I_TRUNC) {
+		v = _mm256_mul_pd(f, _mm256_set1_pd(2147483648.0));
+		v = _mm256_min_pd(_mm256_set1_pd(2147483647.0), v);
+		return _mm_sra_epi32(_mm256_cvttpd_epi32(v),
+				     _mm_cvtsi32_si128(32 - conv->bits));
+	}
+	v = _mm256_mul_pd(f, _mm256_set1_pd(scale));
+	if (conv->mode == SND_PCM_SIMD_F2I_DITHER)
+		v = _mm256_add_pd(v, _mm256_cvtps_pd(simd_noise_sse2(conv)));
+	v = _mm256_min_pd(_mm256_max_pd(v, _mm256_set1_pd(-scale)),
+			  _mm256_set1_pd(scale - 1.0));
+	return _mm256_cvtpd_epi32(v);
+}
+
+SIMD_TARGET("avx2")
+static void conv_s16_float_avx2(SIMD_CONV_ARGS)
+{
+	float *d = dst;
+	const int16_t *s = src;
+	const __m256 scale = _mm256_set1_ps((float)SIMD_S32_SCALE);
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8) {
+		__m256i v = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)s));
+		v = _mm256_slli_epi32(v, 16);
+		_mm256_storeu_ps(d, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	conv_s16_float_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void conv_s32_float_avx2(SIMD_CONV_ARGS)
+{
+	float *d = dst;
+	const int32_t *s = src;
+	const __m256 scale = _mm256_set1_ps((float)SIMD_S32_SCALE);
+	const __m128i shift = _mm_cvtsi32_si128(32 - conv->bits);
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8) {
+		__m256i v = _mm256_sll_epi32(_mm256_loadu_si256((const __m256i *)s), shift);
+		_mm256_storeu_ps(d, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+	}
+	conv_s32_float_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void conv_s16_double_avx2(SIMD_CONV_ARGS)
+{
+	double *d = dst;
+	const int16_t *s = src;
+	const __m256d scale = _mm256_set1_pd(SIMD_S32_SCALE);
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4) {
+		__m128i v = _mm_unpacklo_epi16(_mm_setzero_si128(),
+					       _mm_loadl_epi64((const __m128i *)s));
+		_mm256_storeu_pd(d, _mm256_mul_pd(_mm256_cvtepi32_pd(v), scale));
+	}
+	conv_s16_double_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void conv_s32_double_avx2(SIMD_CONV_ARGS)
+{
+	double *d = dst;
+	const int32_t *s = src;
+	const __m256d scale = _mm256_set1_pd(SIMD_S32_SCALE);
+	const __m128i shift = _mm_cvtsi32_si128(32 - conv->bits);
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4) {
+		__m128i v = _mm_sll_epi32(_mm_loadu_si128((const __m128i *)s), shift);
+		_mm256_storeu_pd(d, _mm256_mul_pd(_mm256_cvtepi32_pd(v), scale));
+	}
+	conv_s32_double_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void conv_float_s16_avx2(SIMD_CONV_ARGS)
+{
+	int16_t *d = dst;
+	const float *s = src;
+
+	for (; samples >= 16; samples -= 16, s += 16, d += 16) {
+		__m256i a = f2i_avx2(_mm256_loadu_ps(s), conv);
+		__m256i b = f2i_avx2(_mm256_loadu_ps(s + 8), conv);
+		__m256i v = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b),
+						     _MM_SHUFFLE(3, 1, 2, 0));
+		_mm256_storeu_si256((__m256i *)d, v);
+	}
+	conv_float_s16_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void conv_float_s32_avx2(SIMD_CONV_ARGS)
+{
+	int32_t *d = dst;
+	const float *s = src;
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8)
+		_mm256_storeu_si256((__m256i *)d, f2i_avx2(_mm256_loadu_ps(s), conv));
+	conv_float_s32_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void conv_double_s16_avx2(SIMD_CONV_ARGS)
+{
+	int16_t *d = dst;
+	const double *s = src;
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8) {
+		__m128i a = d2i_avx2(_mm256_loadu_pd(s), conv);
+		__m128i b = d2i_avx2(_mm256_loadu_pd(s + 4), conv);
+		_mm_storeu_si128((__m128i *)d, _mm_packs_epi32(a, b));
+	}
+	conv_double_s16_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void conv_double_s32_avx2(SIMD_CONV_ARGS)
+{
+	int32_t *d = dst;
+	const double *s = src;
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4)
+		_mm_storeu_si128((__m128i *)d, d2i_avx2(_mm256_loadu_pd(s), conv));
+	conv_double_s32_c(d, s, samples, conv);
+}
+
+SIMD_TARGET("avx2")
+static void route_mac_avx2(float *acc, const int32_t *src, size_t samples,
+			   float gain)
+{
+	__m256 g = _mm256_set1_ps(gain);
+
+	for (; samples >= 8; samples -= 8, src += 8, acc += 8) {
+		__m256 v = _mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)src));
+		_mm256_storeu_ps(acc, _mm256_add_ps(_mm256_loadu_ps(acc),
+						    _mm256_mul_ps(v, g)));
+	}
+	route_mac_c(acc, src, samples, gain);
+}
+
+SIMD_TARGET("avx2")
+static void route_norm_avx2(int32_t *dst, const float *acc, size_t samples)
+{
+	const __m256 hi = _mm256_set1_ps(2147483648.0f);
+	const __m256 maxi = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+	for (; samples >= 8; samples -= 8, acc += 8, dst += 8) {
+		__m256 v = _mm256_loadu_ps(acc);
+		__m256 m = _mm256_cmp_ps(v, hi, _CMP_GT_OQ);
+		__m256 r = _mm256_castsi256_ps(_mm256_cvtps_epi32(v));
+		_mm256_storeu_si256((__m256i *)dst,
+				    _mm256_castps_si256(_mm256_blendv_ps(r, maxi, m)));
+	}
+	route_norm_c(dst, acc, samples);
+}
+
+SIMD_TARGET("avx2")
+static void rate_dot2_avx2(const float *x, const float *h0, const float *h1,
+			   size_t taps, float *res)
+{
+	__m256 a = _mm256_setzero_ps(), b = _mm256_setzero_ps();
+	__m128 s;
+	float tail[2];
+
+	for (; taps >= 8; taps -= 8, x += 8, h0 += 8, h1 += 8) {
+		__m256 v = _mm256_loadu_ps(x);
+		a = _mm256_add_ps(a, _mm256_mul_ps(v, _mm256_loadu_ps(h0)));
+		b = _mm256_add_ps(b, _mm256_mul_ps(v, _mm256_loadu_ps(h1)));
+	}
+	/* a0+a1 a2+a3 b0+b1 b2+b3 in each lane */
+	a = _mm256_hadd_ps(a, b);
+	s = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+	s = _mm_hadd_ps(s, s);
+	rate_dot2_c(x, h0, h1, taps, tail);
+	res[0] = _mm_cvtss_f32(s) + tail[0];
+	res[1] = _mm_cvtss_f32(_mm_shuffle_ps(s, s, 1)) + tail[1];
+}
+
+SIMD_TARGET("avx2")
+static inline float simd_hmax_avx2(__m256 v)
+{
+	return simd_hmax_sse2(_mm_max_ps(_mm256_castps256_ps128(v),
+					 _mm256_extractf128_ps(v, 1)));
+}
+
+SIMD_TARGET("avx2")
+static void meter_level_avx2(const float *src, size_t samples, float *res)
+{
+	const __m256 abs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 peak = _mm256_setzero_ps(), sum = _mm256_setzero_ps();
+	__m128 s;
+
+	for (; samples >= 8; samples -= 8, src += 8) {
+		__m256 v = _mm256_loadu_ps(src);
+		peak = _mm256_max_ps(_mm256_and_ps(v, abs), peak);
+		sum = _mm256_add_ps(sum, _mm256_mul_ps(v, v));
+	}
+	s = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	s = _mm_hadd_ps(s, s);
+	s = _mm_hadd_ps(s, s);
+	if (simd_hmax_avx2(peak) > res[0])
+		res[0] = simd_hmax_avx2(peak);
+	res[1] += _mm_cvtss_f32(s);
+	meter_level_c(src, samples, res);
+}
+
+SIMD_TARGET("avx2")
+static float fir_peak_avx2(const float *x, const float *h, size_t taps,
+			   size_t samples)
+{
+	const __m256 abs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 peak = _mm256_setzero_ps();
+	float tail;
+	size_t k;
+
+	for (; samples >= 8; samples -= 8, x += 8) {
+		__m256 y = _mm256_setzero_ps();
+		for (k = 0; k < taps; k++)
+			y = _mm256_add_ps(y, _mm256_mul_ps(_mm256_loadu_ps(x + k),
+							   _mm256_set1_ps(h[k])));
+		peak = _mm256_max_ps(_mm256_and_ps(y, abs), peak);
+	}
+	tail = fir_peak_c(x, h, taps, samples);
+	return tail > simd_hmax_avx2(peak) ? tail : simd_hmax_avx2(peak);
+}
+
+SIMD_TARGET("avx2")
+static void gain_float_avx2(void *dst, const void *src, size_t samples,
+			    snd_pcm_simd_gain_t *g, unsigned int bits)
+{
+	float *d = dst;
+	const float *s = src;
+	const __m256 k = _mm256_set1_ps(1.0f / 65536);
+	size_t head;
+
+	head = gain_head(g, samples, 8);
+	gain_float_c(d, s, head, g, bits);
+	s += head;
+	d += head;
+	for (samples -= head; samples >= 8; samples -= 8, s += 8, d += 8) {
+		const uint32_t *vol = g->vol + g->pos;
+		__m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_loadu_si256((const __m256i *)vol)), k);
+		_mm256_storeu_ps(d, _mm256_mul_ps(_mm256_loadu_ps(s), f));
+		gain_advance(g, 8);
+	}
+	gain_float_c(d, s, samples, g, bits);
+}
+
+#endif /* HAVE_SOFT_FLOAT */
+
+#endif /* HAVE_X86_SIMD */
+
+#ifdef HAVE_NEON_SIMD
+
+/*
+ * NEON versions
+ */
+
+static void conv_16_32_neon(SIMD_CONV_ARGS)
+{
+	uint32_t *d = dst;
+	const uint16_t *s = src;
+	const uint16x8_t f = vdupq_n_u16(conv->flip);
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8) {
+		uint16x8_t v = veorq_u16(vld1q_u16(s), f);
+		vst1q_u32(d, vshll_n_u16(vget_low_u16(v), 16));
+		vst1q_u32(d + 4, vshll_n_u16(vget_high_u16(v), 16));
+	}
+	conv_16_32_c(d, s, samples, conv);
+}
+
+static void conv_32_16_neon(SIMD_CONV_ARGS)
+{
+	uint16_t *d = dst;
+	const uint32_t *s = src;
+	const uint16x8_t f = vdupq_n_u16(conv->flip);
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8) {
+		uint16x8_t v = vcombine_u16(vshrn_n_u32(vld1q_u32(s), 16),
+					    vshrn_n_u32(vld1q_u32(s + 4), 16));
+		vst1q_u16(d, veorq_u16(v, f));
+	}
+	conv_32_16_c(d, s, samples, conv);
+}
+
+static void conv_24_3_32_neon(SIMD_CONV_ARGS)
+{
+	uint32_t *d = dst;
+	const uint8_t *s = src;
+	const uint8x16_t f = vdupq_n_u8(conv->flip >> 24);
+
+	for (; samples >= 16; samples -= 16, s += 48, d += 16) {
+		uint8x16x3_t v = vld3q_u8(s);
+		uint8x16x4_t o;
+		o.val[0] = vdupq_n_u8(0);
+		o.val[1] = v.val[0];
+		o.val[2] = v.val[1];
+		o.val[3] = veorq_u8(v.val[2], f);
+		vst4q_u8((uint8_t *)d, o);
+	}
+	conv_24_3_32_c(d, s, samples, conv);
+}
+
+static void conv_32_24_3_neon(SIMD_CONV_ARGS)
+{
+	uint8_t *d = dst;
+	const uint32_t *s = src;
+	const uint8x16_t f = vdupq_n_u8(conv->flip >> 24);
+
+	for (; samples >= 16; samples -= 16, s += 16, d += 48) {
+		uint8x16x4_t v = vld4q_u8((const uint8_t *)s);
+		uint8x16x3_t o;
+		o.val[0] = v.val[1];
+		o.val[1] = v.val[2];
+		o.val[2] = veorq_u8(v.val[3], f);
+		vst3q_u8(d, o);
+	}
+	conv_32_24_3_c(d, s, samples, conv);
+}
+
+static void gain_s16_neon(void *dst, const void *src, size_t samples,
+			  snd_pcm_simd_gain_t *g, unsigned int bits)
+{
+	int16_t *d = dst;
+	const int16_t *s = src;
+	const uint32x4_t fmask = vdupq_n_u32(0xffff);
+	size_t head;
+
+	head = gain_head(g, samples, 8);
+	gain_s16_c(d, s, head, g, bits);
+	s += head;
+	d += head;
+	for (samples -= head; samples >= 8; samples -= 8, s += 8, d += 8) {
+		const uint32_t *vol = g->vol + g->pos;
+		int16x8_t a = vld1q_s16(s);
+		uint32x4_t v0 = vld1q_u32(vol);
+		uint32x4_t v1 = vld1q_u32(vol + 4);
+		int32x4_t a0 = vmovl_s16(vget_low_s16(a));
+		int32x4_t a1 = vmovl_s16(vget_high_s16(a));
+		int32x4_t r0 = vshrq_n_s32(vmulq_s32(a0, vreinterpretq_s32_u32(vandq_u32(v0, fmask))), 16);
+		int32x4_t r1 = vshrq_n_s32(vmulq_s32(a1, vreinterpretq_s32_u32(vandq_u32(v1, fmask))), 16);
+		r0 = vmlaq_s32(r0, a0, vreinterpretq_s32_u32(vshrq_n_u32(v0, 16)));
+		r1 = vmlaq_s32(r1, a1, vreinterpretq_s32_u32(vshrq_n_u32(v1, 16)));
+		vst1q_s16(d, vcombine_s16(vqmovn_s32(r0), vqmovn_s32(r1)));
+		gain_advance(g, 8);
+	}
+	gain_s16_c(d, s, samples, g, bits);
+}
+
+static void gain_s32_neon(void *dst, const void *src, size_t samples,
+			  snd_pcm_simd_gain_t *g, unsigned int bits)
+{
+	int32_t *d = dst;
+	const int32_t *s = src;
+	const int32x4_t lshift = vdupq_n_s32(32 - bits);
+	const int32x4_t rshift = vdupq_n_s32(bits - 32);
+	const int32x4_t max = vdupq_n_s32((1U << (bits - 1)) - 1);
+	const int32x4_t min = vdupq_n_s32(0U - (1U << (bits - 1)));
+	size_t head;
+
+	head = gain_head(g, samples, 4);
+	gain_s32_c(d, s, head, g, bits);
+	s += head;
+	d += head;
+	for (samples -= head; samples >= 4; samples -= 4, s += 4, d += 4) {
+		const uint32_t *vol = g->vol + g->pos;
+		int32x4_t a = vshlq_s32(vshlq_s32(vld1q_s32(s), lshift), rshift);
+		int32x4_t v = vreinterpretq_s32_u32(vld1q_u32(vol));
+		int64x2_t p0 = vshrq_n_s64(vmull_s32(vget_low_s32(a), vget_low_s32(v)), 16);
+		int64x2_t p1 = vshrq_n_s64(vmull_s32(vget_high_s32(a), vget_high_s32(v)), 16);
+		int32x4_t r = vcombine_s32(vqmovn_s64(p0), vqmovn_s64(p1));
+		vst1q_s32(d, vminq_s32(vmaxq_s32(r, min), max));
+		gain_advance(g, 4);
+	}
+	gain_s32_c(d, s, samples, g, bits);
+}
+
+static inline void mix_s16_run_neon(int16_t *d, const int16_t *s, int32_t *sum,
+				    size_t samples, int remix)
+{
+	const int16x8_t zero = vdupq_n_s16(0);
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8, sum += 8) {
+		int16x8_t a = vld1q_s16(s);
+		uint16x8_t z = vceqq_s16(vld1q_s16(d), zero);
+		int16x8_t zs = vreinterpretq_s16_u16(z);
+		int32x4_t s0 = vbicq_s32(vld1q_s32(sum), vmovl_s16(vget_low_s16(zs)));
+		int32x4_t s1 = vbicq_s32(vld1q_s32(sum + 4), vmovl_s16(vget_high_s16(zs)));
+		int16x8_t r;
+		if (remix) {
+			s0 = vsubq_s32(s0, vmovl_s16(vget_low_s16(a)));
+			s1 = vsubq_s32(s1, vmovl_s16(vget_high_s16(a)));
+		} else {
+			s0 = vaddq_s32(s0, vmovl_s16(vget_low_s16(a)));
+			s1 = vaddq_s32(s1, vmovl_s16(vget_high_s16(a)));
+		}
+		vst1q_s32(sum, s0);
+		vst1q_s32(sum + 4, s1);
+		r = vcombine_s16(vqmovn_s32(s0), vqmovn_s32(s1));
+		if (remix)
+			r = vbslq_s16(z, vnegq_s16(a), r);
+		vst1q_s16(d, r);
+	}
+	mix_s16_run_c(d, s, sum, samples, remix);
+}
+
+static inline void mix_s32_run_neon(int32_t *d, const int32_t *s, int32_t *sum,
+				    size_t samples, int remix)
+{
+	const int32x4_t zero = vdupq_n_s32(0);
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4, sum += 4) {
+		int32x4_t a = vld1q_s32(s);
+		uint32x4_t z = vceqq_s32(vld1q_s32(d), zero);
+		int32x4_t v = vbicq_s32(vld1q_s32(sum), vreinterpretq_s32_u32(z));
+		if (remix) {
+			v = vsubq_s32(v, vshrq_n_s32(a, 8));
+			a = vnegq_s32(a);
+		} else {
+			v = vaddq_s32(v, vshrq_n_s32(a, 8));
+		}
+		vst1q_s32(sum, v);
+		/* the saturating shift clips exactly as the C code */
+		vst1q_s32(d, vbslq_s32(z, a, vqshlq_n_s32(v, 8)));
+	}
+	mix_s32_run_c(d, s, sum, samples, remix);
+}
+
+static void mix_s16_neon(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s16_run_neon(dst, src, sum, samples, 0);
+}
+
+static void remix_s16_neon(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s16_run_neon(dst, src, sum, samples, 1);
+}
+
+static void mix_s32_neon(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s32_run_neon(dst, src, sum, samples, 0);
+}
+
+static void remix_s32_neon(void *dst, const void *src, int32_t *sum, size_t samples)
+{
+	mix_s32_run_neon(dst, src, sum, samples, 1);
+}
+
+#if defined(__aarch64__) && !defined(HAVE_SOFT_FLOAT)
+
+/* convert 4 floats, the result has conv->bits significant bits */
+static inline int32x4_t f2i_neon(float32x4_t f, snd_pcm_simd_conv_t *conv)
+{
+	float scale = (float)(1U << (conv->bits - 1));
+	float32x4_t v;
+	int32x4_t i;
+
+	if (conv->mode == SND_PCM_SIMD_F2I_TRUNC) {
+		/* the conversion saturates like the clipping of the tables */
+		i = vcvtq_s32_f32(vmulq_f32(f, vdupq_n_f32(2147483648.0f)));
+		return vshlq_s32(i, vdupq_n_s32(-(int)(32 - conv->bits)));
+	}
+	v = vmulq_f32(f, vdupq_n_f32(scale));
+	if (conv->mode == SND_PCM_SIMD_F2I_DITHER) {
+		float n[4];
+		unsigned int k;
+		for (k = 0; k < 4; k++)
+			n[k] = simd_tpdf(&conv->seed);
+		v = vaddq_f32(v, vld1q_f32(n));
+	}
+	i = vcvtnq_s32_f32(v);
+	i = vbslq_s32(vcgeq_f32(v, vdupq_n_f32(scale - 1.0f)),
+		      vdupq_n_s32(simd_max_int(conv->bits)), i);
+	/* NaN compares false and goes to the minimum */
+	return vbslq_s32(vcgtq_f32(v, vdupq_n_f32(-scale)), i,
+			 vdupq_n_s32(simd_min_int(conv->bits)));
+}
+
+static void conv_s16_float_neon(SIMD_CONV_ARGS)
+{
+	float *d = dst;
+	const int16_t *s = src;
+	const float32x4_t scale = vdupq_n_f32((float)SIMD_S32_SCALE);
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8) {
+		int16x8_t v = vld1q_s16(s);
+		vst1q_f32(d, vmulq_f32(vcvtq_f32_s32(vshll_n_s16(vget_low_s16(v), 16)), scale));
+		vst1q_f32(d + 4, vmulq_f32(vcvtq_f32_s32(vshll_n_s16(vget_high_s16(v), 16)), scale));
+	}
+	conv_s16_float_c(d, s, samples, conv);
+}
+
+static void conv_s32_float_neon(SIMD_CONV_ARGS)
+{
+	float *d = dst;
+	const int32_t *s = src;
+	const float32x4_t scale = vdupq_n_f32((float)SIMD_S32_SCALE);
+	const int32x4_t shift = vdupq_n_s32(32 - conv->bits);
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4) {
+		int32x4_t v = vshlq_s32(vld1q_s32(s), shift);
+		vst1q_f32(d, vmulq_f32(vcvtq_f32_s32(v), scale));
+	}
+	conv_s32_float_c(d, s, samples, conv);
+}
+
+static void conv_float_s16_neon(SIMD_CONV_ARGS)
+{
+	int16_t *d = dst;
+	const float *s = src;
+
+	for (; samples >= 8; samples -= 8, s += 8, d += 8) {
+		int32x4_t a = f2i_neon(vld1q_f32(s), conv);
+		int32x4_t b = f2i_neon(vld1q_f32(s + 4), conv);
+		vst1q_s16(d, vcombine_s16(vmovn_s32(a), vmovn_s32(b)));
+	}
+	conv_float_s16_c(d, s, samples, conv);
+}
+
+static void conv_float_s32_neon(SIMD_CONV_ARGS)
+{
+	int32_t *d = dst;
+	const float *s = src;
+
+	for (; samples >= 4; samples -= 4, s += 4, d += 4)
+		vst1q_s32(d, f2i_neon(vld1q_f32(s), conv));
+	conv_float_s32_c(d, s, samples, conv);
+}
+
+static void route_mac_neon(float *acc, const int32_t *src, size_t samples,
+			   float gain)
+{
+	for (; samples >= 4; samples -= 4, src += 4, acc += 4) {
+		float32x4_t v = vcvtq_f32_s32(vld1q_s32(src));
+		vst1q_f32(acc, vaddq_f32(vld1q_f32(acc), vmulq_n_f32(v, gain)));
+	}
+	route_mac_c(acc, src, samples, gain);
+}
+
+/* the conversion saturates just like the scalar code on aarch64 */
+static void route_norm_neon(int32_t *dst, const float *acc, size_t samples)
+{
+	for (; samples >= 4; samples -= 4, acc += 4, dst += 4)
+		vst1q_s32(dst, vcvtnq_s32_f32(vld1q_f32(acc)));
+	route_norm_c(dst, acc, samples);
+}
+
+static void rate_dot2_neon(const float *x, const float *h0, const float *h1,
+			   size_t taps, float *res)
+{
+	float32x4_t a = vdupq_n_f32(0), b = vdupq_n_f32(0);
+	float tail[2];
+
+	for (; taps >= 4; taps -= 4, x += 4, h0 += 4, h1 += 4) {
+		float32x4_t v = vld1q_f32(x);
+		a = vfmaq_f32(a, v, vld1q_f32(h0));
+		b = vfmaq_f32(b, v, vld1q_f32(h1));
+	}
+	rate_dot2_c(x, h0, h1, taps, tail);
+	res[0] = vaddvq_f32(a) + tail[0];
+	res[1] = vaddvq_f32(b) + tail[1];
+}
+
+static void meter_level_neon(const float *src, size_t samples, float *res)
+{
+	float32x4_t peak = vdupq_n_f32(0), sum = vdupq_n_f32(0);
+
+	for (; samples >= 4; samples -= 4, src += 4) {
+		float32x4_t v = vld1q_f32(src);
+		peak = vmaxnmq_f32(vabsq_f32(v), peak);
+		sum = vfmaq_f32(sum, v, v);
+	}
+	if (vmaxvq_f32(peak) > res[0])
+		res[0] = vmaxvq_f32(peak);
+	res[1] += vaddvq_f32(sum);
+	meter_level_c(src, samples, res);
+}
+
+static float fir_peak_neon(const float *x, const float *h, size_t taps,
+			   size_t samples)
+{
+	float32x4_t peak = vdupq_n_f32(0);
+	float tail;
+	size_t k;
+
+	for (; samples >= 4; samples -= 4, x += 4) {
+		float32x4_t y = vdupq_n_f32(0);
+		for (k = 0; k < taps; k++)
+			y = vfmaq_n_f32(y, vld1q_f32(x + k), h[k]);
+		peak = vmaxnmq_f32(vabsq_f32(y), peak);
+	}
+	tail = fir_peak_c(x, h, taps, samples);
+	return tail > vmaxvq_f32(peak) ? tail : vmaxvq_f32(peak);
+}
+
+static void gain_float_neon(void *dst, const void *src, size_t samples,
+			    snd_pcm_simd_gain_t *g, unsigned int bits)
+{
+	float *d = dst;
+	const float *s = src;
+	size_t head;
+
+	head = gain_head(g, samples, 4);
+	gain_float_c(d, s, head, g, bits);
+	s += head;
+	d += head;
+	for (samples -= head; samples >= 4; samples -= 4, s += 4, d += 4) {
+		const uint32_t *vol = g->vol + g->pos;
+		float32x4_t f = vmulq_n_f32(vcvtq_f32_s32(vreinterpretq_s32_u32(vld1q_u32(vol))),
+					    1.0f / 65536);
+		vst1q_f32(d, vmulq_f32(vld1q_f32(s), f));
+		gain_advance(g, 4);
+	}
+	gain_float_c(d, s, samples, g, bits);
+}
+
+#endif /* __aarch64__ && !HAVE_SOFT_FLOAT */
+
+#endif /* HAVE_NEON_SIMD */
+
+static unsigned int simd_detect(void)
+{
+	unsigned int flags = 0;
+	const char *env = getenv("LIBASOUND_SIMD");
+
+	if (env && *env == '0')
+		return 0;
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		flags |= SND_PCM_SIMD_SSE2;
+	if (__builtin_cpu_supports("avx2"))
+		flags |= SND_PCM_SIMD_AVX2;
+#endif
+#ifdef HAVE_NEON_SIMD
+	flags |= SND_PCM_SIMD_NEON;
+#endif
+	return flags;
+}
+
+#ifdef HAVE_X86_SIMD
+
+/* MXCSR flush to zero and denormals are zero */
+#define SIMD_MXCSR_FTZ	0x8000
+#define SIMD_MXCSR_DAZ	0x0040
+
+/* FTZ and DAZ if supported, set by simd_ops_init() */
+static unsigned int simd_mxcsr_mask;
+
+/* the earliest SSE parts have no DAZ, MXCSR_MASK tells */
+SIMD_TARGET("fxsr")
+static unsigned int simd_mxcsr_detect(void)
+{
+	unsigned char area[512] __attribute__((aligned(16)));
+	uint32_t mask;
+
+	__builtin_cpu_init();
+	if (!__builtin_cpu_supports("sse"))
+		return 0;
+	memset(area, 0, sizeof(area));
+	_fxsave(area);
+	memcpy(&mask, area + 28, sizeof(mask));
+	if (mask == 0)
+		mask = 0xffbf;
+	return mask & (SIMD_MXCSR_FTZ | SIMD_MXCSR_DAZ);
+}
+
+#endif
+
+static snd_pcm_simd_ops_t simd_ops;
+#ifdef HAVE_LIBPTHREAD
+static pthread_once_t simd_ops_once = PTHREAD_ONCE_INIT;
+#else
+static int simd_ops_ready;
+#endif
+
+static void simd_ops_init(void)
+{
+	snd_pcm_simd_ops_t ops;
+
+	ops.flags = simd_detect();
+	ops.conv_16_32 = conv_16_32_c;
+	ops.conv_32_16 = conv_32_16_c;
+	ops.conv_24_3_32 = conv_24_3_32_c;
+	ops.conv_32_24_3 = conv_32_24_3_c;
+	ops.gain_s16 = gain_s16_c;
+	ops.gain_s32 = gain_s32_c;
+	ops.mix_s16 = mix_s16_c;
+	ops.remix_s16 = remix_s16_c;
+	ops.mix_s32 = mix_s32_c;
+	ops.remix_s32 = remix_s32_c;
+	ops.lut_8_16 = lut_8_16_c;
+	ops.lut_16_8 = lut_16_8_c;
+	ops.iec958_enc = iec958_enc_c;
+	ops.iec958_dec = iec958_dec_c;
+	ops.copy_stream = copy_stream_c;
+	ops.fill_stream = fill_stream_c;
+#ifndef HAVE_SOFT_FLOAT
+	ops.conv_s16_float = conv_s16_float_c;
+	ops.conv_s32_float = conv_s32_float_c;
+	ops.conv_s16_double = conv_s16_double_c;
+	ops.conv_s32_double = conv_s32_double_c;
+	ops.conv_float_s16 = conv_float_s16_c;
+	ops.conv_float_s32 = conv_float_s32_c;
+	ops.conv_double_s16 = conv_double_s16_c;
+	ops.conv_double_s32 = conv_double_s32_c;
+	ops.route_mac = route_mac_c;
+	ops.route_norm = route_norm_c;
+	ops.rate_dot2 = rate_dot2_c;
+	ops.meter_level = meter_level_c;
+	ops.fir_peak = fir_peak_c;
+	ops.gain_float = gain_float_c;
+#else
+	ops.conv_s16_float = NULL;
+	ops.conv_s32_float = NULL;
+	ops.conv_s16_double = NULL;
+	ops.conv_s32_double = NULL;
+	ops.conv_float_s16 = NULL;
+	ops.conv_float_s32 = NULL;
+	ops.conv_double_s16 = NULL;
+	ops.conv_double_s32 = NULL;
+	ops.route_mac = NULL;
+	ops.route_norm = NULL;
+	ops.rate_dot2 = NULL;
+	ops.meter_level = NULL;
+	ops.fir_peak = NULL;
+	ops.gain_float = NULL;
+#endif
+#ifdef HAVE_X86_SIMD
+	if (ops.flags & SND_PCM_SIMD_SSE2) {
+		ops.conv_16_32 = conv_16_32_sse2;
+		ops.conv_32_16 = conv_32_16_sse2;
+		ops.gain_s16 = gain_s16_sse2;
+		ops.mix_s16 = mix_s16_sse2;
+		ops.remix_s16 = remix_s16_sse2;
+		ops.mix_s32 = mix_s32_sse2;
+		ops.remix_s32 = remix_s32_sse2;
+		ops.iec958_enc = iec958_enc_sse2;
+		ops.iec958_dec = iec958_dec_sse2;
+		ops.copy_stream = copy_stream_sse2;
+		ops.fill_stream = fill_stream_sse2;
+#ifndef HAVE_SOFT_FLOAT
+		ops.conv_s16_float = conv_s16_float_sse2;
+		ops.conv_s32_float = conv_s32_float_sse2;
+		ops.conv_s16_double = conv_s16_double_sse2;
+		ops.conv_s32_double = conv_s32_double_sse2;
+		ops.conv_float_s16 = conv_float_s16_sse2;
+		ops.conv_float_s32 = conv_float_s32_sse2;
+		ops.conv_double_s16 = conv_double_s16_sse2;
+		ops.conv_double_s32 = conv_double_s32_sse2;
+		ops.route_mac = route_mac_sse2;
+		ops.route_norm = route_norm_sse2;
+		ops.rate_dot2 = rate_dot2_sse2;
+		ops.meter_level = meter_level_sse2;
+		ops.fir_peak = fir_peak_sse2;
+		ops.gain_float = gain_float_sse2;
+#endif
+	}
+	if (ops.flags & SND_PCM_SIMD_AVX2) {
+		ops.conv_16_32 = conv_16_32_avx2;
+		ops.conv_32_16 = conv_32_16_avx2;
+		ops.conv_24_3_32 = conv_24_3_32_avx2;
+		ops.conv_32_24_3 = conv_32_24_3_avx2;
+		ops.gain_s16 = gain_s16_avx2;
+		ops.gain_s32 = gain_s32_avx2;
+		ops.mix_s16 = mix_s16_avx2;
+		ops.remix_s16 = remix_s16_avx2;
+		ops.mix_s32 = mix_s32_avx2;
+		ops.remix_s32 = remix_s32_avx2;
+		ops.lut_8_16 = lut_8_16_avx2;
+		ops.lut_16_8 = lut_16_8_avx2;
+		ops.iec958_enc = iec958_enc_avx2;
+		ops.iec958_dec = iec958_dec_avx2;
+#ifndef HAVE_SOFT_FLOAT
+		ops.conv_s16_float = conv_s16_float_avx2;
+		ops.conv_s32_float = conv_s32_float_avx2;
+		ops.conv_s16_double = conv_s16_double_avx2;
+		ops.conv_s32_double = conv_s32_double_avx2;
+		ops.conv_float_s16 = conv_float_s16_avx2;
+		ops.conv_float_s32 = conv_float_s32_avx2;
+		ops.conv_double_s16 = conv_double_s16_avx2;
+		ops.conv_double_s32 = conv_double_s32_avx2;
+		ops.route_mac = route_mac_avx2;
+		ops.route_norm = route_norm_avx2;
+		ops.rate_dot2 = rate_dot2_avx2;
+		ops.meter_level = meter_level_avx2;
+		ops.fir_peak = fir_peak_avx2;
+		ops.gain_float = gain_float_avx2;
+#endif
+	}
+#endif
+#ifdef HAVE_NEON_SIMD
+	if (ops.flags & SND_PCM_SIMD_NEON) {
+		ops.conv_16_32 = conv_16_32_neon;
+		ops.conv_32_16 = conv_32_16_neon;
+		ops.conv_24_3_32 = conv_24_3_32_neon;
+		ops.conv_32_24_3 = conv_32_24_3_neon;
+		ops.gain_s16 = gain_s16_neon;
+		ops.gain_s32 = gain_s32_neon;
+		ops.mix_s16 = mix_s16_neon;
+		ops.remix_s16 = remix_s16_neon;
+		ops.mix_s32 = mix_s32_neon;
+		ops.remix_s32 = remix_s32_neon;
+#if defined(__aarch64__) && !defined(HAVE_SOFT_FLOAT)
+		ops.conv_s16_float = conv_s16_float_neon;
+		ops.conv_s32_float = conv_s32_float_neon;
+		ops.conv_float_s16 = conv_float_s16_neon;
+		ops.conv_float_s32 = conv_float_s32_neon;
+		ops.route_mac = route_mac_neon;
+		ops.route_norm = route_norm_neon;
+		ops.rate_dot2 = rate_dot2_neon;
+		ops.meter_level = meter_level_neon;
+		ops.fir_peak = fir_peak_neon;
+		ops.gain_float = gain_float_neon;
+#endif
+	}
+#endif
+	simd_ops = ops;
+#ifdef HAVE_X86_SIMD
+	simd_mxcsr_mask = simd_mxcsr_detect();
+#endif
+}
+
+/**
+ * \brief Return the sample kernels for the running CPU
+ * \return kernel table (never NULL)
+ *
+ * The selection is done once, by the first caller; the other callers
+ * wait for it to complete.
+ */
+const snd_pcm_simd_ops_t *snd_pcm_simd_ops(void)
+{
+#ifdef HAVE_LIBPTHREAD
+	pthread_once(&simd_ops_once, simd_ops_init);
+#else
+	if (!simd_ops_ready) {
+		simd_ops_init();
+		simd_ops_ready = 1;
+	}
+#endif
+	return &simd_ops;
+}
+
+#ifdef HAVE_X86_SIMD
+
+SIMD_TARGET("sse")
+unsigned int snd_pcm_simd_denormals_enter(void)
+{
+	unsigned int mask, csr;
+
+	/* the mask is detected along with the kernel table */
+	snd_pcm_simd_ops();
+	mask = simd_mxcsr_mask;
+	if (!mask)
+		return 0;
+	csr = _mm_getcsr();
+	if ((csr & mask) != mask)
+		_mm_setcsr(csr | mask);
+	return csr & mask;
+}
+
+SIMD_TARGET("sse")
+void snd_pcm_simd_denormals_leave(unsigned int state)
+{
+	unsigned int mask = simd_mxcsr_mask, csr;
+
+	if (!mask || state == mask)
+		return;
+	/* keep the exception flags raised meanwhile */
+	csr = _mm_getcsr();
+	_mm_setcsr((csr & ~mask) | state);
+}
+
+#elif defined(__aarch64__) && !defined(HAVE_SOFT_FLOAT)
+
+/* FPCR.FZ flushes both the inputs and the results */
+#define SIMD_FPCR_FZ	(1ULL << 24)
+
+unsigned int snd_pcm_simd_denormals_enter(void)
+{
+	uint64_t fpcr;
+
+	__asm__ __volatile__("mrs %0, fpcr" : "=r" (fpcr));
+	if (!(fpcr & SIMD_FPCR_FZ))
+		__asm__ __volatile__("msr fpcr, %0" : : "r" (fpcr | SIMD_FPCR_FZ));
+	return !!(fpcr & SIMD_FPCR_FZ);
+}
+
+void snd_pcm_simd_denormals_leave(unsigned int state)
+{
+	uint64_t fpcr;
+
+	if (state)
+		return;
+	__asm__ __volatile__("mrs %0, fpcr" : "=r" (fpcr));
+	__asm__ __volatile__("msr fpcr, %0" : : "r" (fpcr & ~SIMD_FPCR_FZ));
+}
+
+#else
+
+unsigned int snd_pcm_simd_denormals_enter(void)
+{
+	return 0;
+}
+
+void snd_pcm_simd_denormals_leave(ATTRIBUTE_UNUSED unsigned int state)
+{
+}
+
+#endif
+
+/*
+ * Return the count of channels starting at areas which form one run of
+ * contiguous samples (1 for a planar channel), zero when the layout
+ * cannot be handled by the kernels.
+ */
+static unsigned int simd_areas_run(const snd_pcm_channel_area_t *areas,
+				   unsigned int channels, unsigned int width)
+{
+	unsigned int chns = 1;
+
+	if (areas->first % 8 || areas->step % 8)
+		return 0;
+	if (areas->step == width)
+		return 1;
+	while (chns < channels &&
+	       areas[chns].addr == areas->addr &&
+	       areas[chns].step == areas->step &&
+	       areas[chns].first == areas[chns - 1].first + width)
+		chns++;
+	if (chns * width != areas->step)
+		return 0;
+	return chns;
+}
+
+static int simd_areas_walk(const snd_pcm_channel_area_t *dst_areas,
+			   snd_pcm_uframes_t dst_offset,
+			   const snd_pcm_channel_area_t *src_areas,
+			   snd_pcm_uframes_t src_offset,
+			   unsigned int channels, snd_pcm_uframes_t frames,
+			   unsigned int dst_width, unsigned int src_width,
+			   snd_pcm_simd_conv_func_t func,
+			   snd_pcm_simd_conv_t *conv)
+{
+	while (channels > 0) {
+		unsigned int chns = simd_areas_run(src_areas, channels, src_width);
+		if (!chns || simd_areas_run(dst_areas, channels, dst_width) != chns)
+			return -EINVAL;
+		if (func)
+			func(snd_pcm_channel_area_addr(dst_areas, dst_offset),
+			     snd_pcm_channel_area_addr(src_areas, src_offset),
+			     (size_t)frames * chns, conv);
+		src_areas += chns;
+		dst_areas += chns;
+		channels -= chns;
+	}
+	return 0;
+}
+
+/**
+ * \brief Convert areas with a whole-buffer kernel
+ * \param dst_areas destination areas
+ * \param dst_offset offset in frames inside destination areas
+ * \param src_areas source areas
+ * \param src_offset offset in frames inside source areas
+ * \param channels channels count
+ * \param frames frames to convert
+ * \param dst_width destination physical sample width in bits
+ * \param src_width source physical sample width in bits
+ * \param func kernel
+ * \param conv kernel parameters
+ * \return 0 on success, -EINVAL when the layout is not supported
+ *
+ * Planar channels are converted one by one, interleaved channels sharing
+ * one buffer are collapsed into a single run. Nothing is touched when
+ * -EINVAL is returned, so the caller can fall back to the generic code.
+ */
+int snd_pcm_simd_convert_areas(const snd_pcm_channel_area_t *dst_areas,
+			       snd_pcm_uframes_t dst_offset,
+			       const snd_pcm_channel_area_t *src_areas,
+			       snd_pcm_uframes_t src_offset,
+			       unsigned int channels, snd_pcm_uframes_t frames,
+			       unsigned int dst_width, unsigned int src_width,
+			       snd_pcm_simd_conv_func_t func,
+			       snd_pcm_simd_conv_t *conv)
+{
+	int err;
+
+	err = simd_areas_walk(dst_areas, dst_offset, src_areas, src_offset,
+			      channels, frames, dst_width, src_width, NULL, NULL);
+	if (err < 0)
+		return err;
+	return simd_areas_walk(dst_areas, dst_offset, src_areas, src_offset,
+			       channels, frames, dst_width, src_width, func, conv);
+}
+
+#endif /* DOC_HIDDEN */
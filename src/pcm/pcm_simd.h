@@ -0,0 +1,195 @@
+/*
+ *  PCM - SIMD sample kernels
+ *
+ *
+ *   This library is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU Lesser General Public License as
+ *   published by the Free Software Foundation; either version 2.1 of
+ *   the License, or (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU Lesser General Public License for more details.
+ *
+ *   You should have received a copy of the GNU Lesser General Public
+ *   License along with this library; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/*
+ * The kernels work on runs of contiguous samples in host byte order and
+ * must produce exactly the same output as the plugin_ops.h tables
+ * (float to integer kernels in the rounding modes other than TRUNC must
+ * match snd_pcm_simd_float_to_int() instead).
+ * The best variant for the running CPU is selected once at first use;
+ * the LIBASOUND_SIMD=0 environment variable forces the C variants.
+ */
+
+#define SND_PCM_SIMD_SSE2	(1U << 0)
+#define SND_PCM_SIMD_AVX2	(1U << 1)
+#define SND_PCM_SIMD_NEON	(1U << 2)
+
+/* float to integer rounding modes */
+#define SND_PCM_SIMD_F2I_TRUNC	0	/* as the plugin_ops.h tables */
+#define SND_PCM_SIMD_F2I_ROUND	1	/* round to nearest, saturate */
+#define SND_PCM_SIMD_F2I_DITHER	2	/* TPDF dither, round, saturate */
+
+typedef struct {
+	uint32_t flip;		/* sign bit mask to toggle (0 for none) */
+	unsigned int bits;	/* significant bits in a 32-bit container */
+	unsigned int mode;	/* float to integer rounding mode */
+	uint32_t seed;		/* dither generator state */
+	const void *table;	/* lookup table of the lut kernels */
+} snd_pcm_simd_conv_t;
+
+/* bytes readable past the last entry of a lookup table (gathers) */
+#define SND_PCM_SIMD_LUT_PAD	4
+
+/*
+ * softvol gain row: the factors of len consecutive samples, repeated over
+ * the whole run; step (NULL for constant factors) is added to a factor
+ * after each use, so the kernels ramp the volume by themselves
+ */
+typedef struct {
+	uint32_t *vol;		/* 16.16 factors */
+	const uint32_t *step;	/* per use increments or NULL */
+	unsigned int len;	/* multiple of SND_PCM_SIMD_GAIN_ALIGN */
+	unsigned int pos;	/* factor of the next sample */
+} snd_pcm_simd_gain_t;
+
+#define SND_PCM_SIMD_GAIN_ALIGN	16
+
+typedef void (*snd_pcm_simd_conv_func_t)(void *dst, const void *src,
+					 size_t samples,
+					 snd_pcm_simd_conv_t *conv);
+
+typedef void (*snd_pcm_simd_mac_func_t)(float *acc, const int32_t *src,
+					size_t samples, float gain);
+typedef void (*snd_pcm_simd_norm_func_t)(int32_t *dst, const float *acc,
+					 size_t samples);
+typedef void (*snd_pcm_simd_gain_func_t)(void *dst, const void *src,
+					 size_t samples,
+					 snd_pcm_simd_gain_t *gain,
+					 unsigned int bits);
+typedef void (*snd_pcm_simd_mix_func_t)(void *dst, const void *src,
+					int32_t *sum, size_t samples);
+typedef void (*snd_pcm_simd_copy_func_t)(void *dst, const void *src,
+					 size_t bytes);
+typedef void (*snd_pcm_simd_fill_func_t)(void *dst, uint64_t pattern,
+					 size_t bytes);
+typedef void (*snd_pcm_simd_iec958_enc_func_t)(uint32_t *dst, const int32_t *src,
+					       const uint32_t *pattern,
+					       size_t samples,
+					       unsigned int byteswap);
+typedef void (*snd_pcm_simd_iec958_dec_func_t)(int32_t *dst, const uint32_t *src,
+					       size_t samples,
+					       unsigned int byteswap);
+typedef void (*snd_pcm_simd_dot2_func_t)(const float *x, const float *h0,
+					 const float *h1, size_t taps,
+					 float *res);
+typedef void (*snd_pcm_simd_level_func_t)(const float *src, size_t samples,
+					  float *res);
+typedef float (*snd_pcm_simd_fir_peak_func_t)(const float *x, const float *h,
+					      size_t taps, size_t samples);
+
+typedef struct {
+	unsigned int flags;
+	/* 16-bit <-> 32-bit (conv_xx12_1200 / conv_1234_xx12) */
+	snd_pcm_simd_conv_func_t conv_16_32;
+	snd_pcm_simd_conv_func_t conv_32_16;
+	/* 24-bit in 3 bytes <-> 32-bit (get32_123_1230 / put32_1234_123) */
+	snd_pcm_simd_conv_func_t conv_24_3_32;
+	snd_pcm_simd_conv_func_t conv_32_24_3;
+	/* signed integer -> float/float64 (get32 + put32float) */
+	snd_pcm_simd_conv_func_t conv_s16_float;
+	snd_pcm_simd_conv_func_t conv_s32_float;
+	snd_pcm_simd_conv_func_t conv_s16_double;
+	snd_pcm_simd_conv_func_t conv_s32_double;
+	/* float/float64 -> signed integer (get32float + put32) */
+	snd_pcm_simd_conv_func_t conv_float_s16;
+	snd_pcm_simd_conv_func_t conv_float_s32;
+	snd_pcm_simd_conv_func_t conv_double_s16;
+	snd_pcm_simd_conv_func_t conv_double_s32;
+	/* G.711 codecs: 8-bit code -> 16-bit sample through a 256 entry
+	 * uint16_t table, 16-bit sample -> 8-bit code through a 65536 entry
+	 * uint8_t table indexed by the sample bits (flip applies to the
+	 * 16-bit side), both tables padded by SND_PCM_SIMD_LUT_PAD bytes
+	 */
+	snd_pcm_simd_conv_func_t lut_8_16;
+	snd_pcm_simd_conv_func_t lut_16_8;
+	/* route plugin: acc += src * gain, then round and clip to int32 */
+	snd_pcm_simd_mac_func_t route_mac;
+	snd_pcm_simd_norm_func_t route_norm;
+	/* rate converter: res[0] = x . h0, res[1] = x . h1 */
+	snd_pcm_simd_dot2_func_t rate_dot2;
+	/* meter: res[0] = max(res[0], |src|), res[1] += sum of src^2;
+	 * fir_peak returns the largest |x[n] .. x[n + taps - 1] . h| for
+	 * n < samples, x holds samples + taps - 1 values
+	 */
+	snd_pcm_simd_level_func_t meter_level;
+	snd_pcm_simd_fir_peak_func_t fir_peak;
+	/* softvol: dst = src * vol / 0x10000 per sample with vol taken from
+	 * the gain row, rounded down and saturated to bits (gain_s32 only,
+	 * the input is sign extended too)
+	 */
+	snd_pcm_simd_gain_func_t gain_s16;
+	snd_pcm_simd_gain_func_t gain_s32;
+	snd_pcm_simd_gain_func_t gain_float;
+	/* dmix: mix into / remix out of the sum buffer, contiguous runs */
+	snd_pcm_simd_mix_func_t mix_s16;
+	snd_pcm_simd_mix_func_t remix_s16;
+	snd_pcm_simd_mix_func_t mix_s32;
+	snd_pcm_simd_mix_func_t remix_s32;
+	/* IEC958 subframes <-> S32: the encoder ORs the data bits with
+	 * pattern[i] (preamble in bits 0-3, channel status in bit 30 and
+	 * the parity of the preamble bits in bit 31) and sets bit 31 to
+	 * the parity of bits 4-30
+	 */
+	snd_pcm_simd_iec958_enc_func_t iec958_enc;
+	snd_pcm_simd_iec958_dec_func_t iec958_dec;
+	/* large runs written around the cache (non-temporal stores);
+	 * fill_stream needs dst aligned to and bytes a multiple of 8
+	 */
+	snd_pcm_simd_copy_func_t copy_stream;
+	snd_pcm_simd_fill_func_t fill_stream;
+} snd_pcm_simd_ops_t;
+
+/* make local functions really local */
+#define snd_pcm_simd_ops \
+	snd1_pcm_simd_ops
+#define snd_pcm_simd_convert_areas \
+	snd1_pcm_simd_convert_areas
+#define snd_pcm_simd_float_to_int \
+	snd1_pcm_simd_float_to_int
+#define snd_pcm_simd_double_to_int \
+	snd1_pcm_simd_double_to_int
+#define snd_pcm_simd_denormals_enter \
+	snd1_pcm_simd_denormals_enter
+#define snd_pcm_simd_denormals_leave \
+	snd1_pcm_simd_denormals_leave
+
+const snd_pcm_simd_ops_t *snd_pcm_simd_ops(void);
+
+int snd_pcm_simd_convert_areas(const snd_pcm_channel_area_t *dst_areas,
+			       snd_pcm_uframes_t dst_offset,
+			       const snd_pcm_channel_area_t *src_areas,
+			       snd_pcm_uframes_t src_offset,
+			       unsigned int channels, snd_pcm_uframes_t frames,
+			       unsigned int dst_width, unsigned int src_width,
+			       snd_pcm_simd_conv_func_t func,
+			       snd_pcm_simd_conv_t *conv);
+
+/* reference scalar float -> integer conversion, the result has conv->bits
+ * significant bits (sign extended)
+ */
+int32_t snd_pcm_simd_float_to_int(float val, snd_pcm_simd_conv_t *conv);
+int32_t snd_pcm_simd_double_to_int(double val, snd_pcm_simd_conv_t *conv);
+
+/* flush denormal floats to zero on the calling thread (FTZ/DAZ on x86,
+ * FPCR.FZ on aarch64, nothing elsewhere); pass the returned state to
+ * snd_pcm_simd_denormals_leave() to restore the previous mode
+ */
+unsigned int snd_pcm_simd_denormals_enter(void);
+void snd_pcm_simd_denormals_leave(unsigned int state);
@@ -29,6 +29,7 @@
 #include "pcm_local.h"
 #include "pcm_plugin.h"
 #include "bswap.h"
+#include "pcm_simd.h"
 #include <math.h>
 #include <sound/tlv.h>
 
@@ -39,6 +40,15 @@ const char *_snd_module_pcm_softvol = "";
 
 #ifndef DOC_HIDDEN
 
+/* the maximal count of control values */
+#define SOFTVOL_MAX_CHANNELS	128
+
+typedef struct {
+	int64_t gain;		/* current factor << 16 */
+	int64_t step;		/* increment per frame while ramping */
+	uint32_t target;	/* factor for the current control value */
+} snd_pcm_softvol_gain_t;
+
 typedef struct {
 	/* This field need to be the first */
 	snd_pcm_plugin_t plug;
@@ -46,12 +56,22 @@ typedef struct {
 	unsigned int cchannels;
 	snd_ctl_t *ctl;
 	snd_ctl_elem_value_t elem;
-	unsigned int cur_vol[2];
+	unsigned int cur_vol[SOFTVOL_MAX_CHANNELS];
 	unsigned int max_val;     /* max index */
 	unsigned int zero_dB_val; /* index at 0 dB */
 	double min_dB;
 	double max_dB;
 	unsigned int *dB_value;
+	int ramp;		  /* ramp the volume changes */
+	unsigned int channels;	  /* PCM channels */
+	snd_pcm_softvol_gain_t *gains;	/* per PCM channel */
+	int gains_valid;
+	snd_pcm_uframes_t ramp_left;	/* frames until the targets */
+	snd_pcm_simd_gain_t row;  /* gain row of the interleaved kernels */
+	uint32_t *row_buf;	  /* factors and steps of the row */
+	int row_valid;
+	snd_pcm_simd_gain_func_t gain_func;
+	unsigned int gain_bits;
 } snd_pcm_softvol_t;
 
 #define VOL_SCALE_SHIFT		16
@@ -149,10 +169,10 @@ static inline int MULTI_DIV_24(int a, unsigned int b)
 	fraction = MULTI_DIV_32x16(a, b & VOL_SCALE_MASK);
 	if (gain) {
 		long long amp = (long long)a * gain + fraction;
-		if (amp > (int)0x7fffff)
-			amp = (int)0x7fffff;
-		else if (amp < (int)0x800000)
-			amp = (int)0x800000;
+		if (amp > 0x7fffff)
+			amp = 0x7fffff;
+		else if (amp < -0x800000)
+			amp = -0x800000;
 		return (int)amp;
 	}
 	return fraction;
@@ -176,252 +196,332 @@ static inline short MULTI_DIV_short(short a, unsigned int b, int swap)
 #endif /* DOC_HIDDEN */
 
 /*
- * apply volumue attenuation
+ * apply volume attenuation
  *
- * TODO: use SIMD operations
+ * The factor of every PCM channel is kept in 16.16 fixed point (0x10000
+ * is 0 dB). When the control changes, the factors move linearly to the
+ * new values over one period when ramping is enabled. The SIMD kernels
+ * take the factors from a gain row that covers a whole number of frames
+ * and ramp them by themselves; the row is built only when the factors
+ * change, or per block while ramping.
  */
 
 #ifndef DOC_HIDDEN
-#define CONVERT_AREA(TYPE, swap) do {	\
-	unsigned int ch, fr; \
-	TYPE *src, *dst; \
-	for (ch = 0; ch < channels; ch++) { \
-		src_area = &src_areas[ch]; \
-		dst_area = &dst_areas[ch]; \
-		src = snd_pcm_channel_area_addr(src_area, src_offset); \
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset); \
-		src_step = snd_pcm_channel_area_step(src_area) / sizeof(TYPE); \
-		dst_step = snd_pcm_channel_area_step(dst_area) / sizeof(TYPE); \
-		GET_VOL_SCALE; \
-		fr = frames; \
-		if (! vol_scale) { \
-			while (fr--) { \
-				*dst = 0; \
-				dst += dst_step; \
-			} \
-		} else if (vol_scale == 0xffff) { \
-			while (fr--) { \
-				*dst = *src; \
-				src += src_step; \
-				dst += dst_step; \
-			} \
-		} else { \
-			while (fr--) { \
-				*dst = (TYPE) MULTI_DIV_##TYPE(*src, vol_scale, swap); \
-				src += src_step; \
-				dst += dst_step; \
-			} \
-		} \
-	} \
-} while (0)
-
-#define CONVERT_AREA_S24_3LE() do {					\
-	unsigned int ch, fr;						\
-	unsigned char *src, *dst;					\
-	int tmp;							\
-	for (ch = 0; ch < channels; ch++) {				\
-		src_area = &src_areas[ch];				\
-		dst_area = &dst_areas[ch];				\
-		src = snd_pcm_channel_area_addr(src_area, src_offset);	\
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);	\
-		src_step = snd_pcm_channel_area_step(src_area);		\
-		dst_step = snd_pcm_channel_area_step(dst_area);		\
-		GET_VOL_SCALE;						\
-		fr = frames;						\
-		if (! vol_scale) {					\
-			while (fr--) {					\
-				dst[0] = dst[1] = dst[2] = 0;		\
-				dst += dst_step;			\
-			}						\
-		} else if (vol_scale == 0xffff) {			\
-			while (fr--) {					\
-				dst[0] = src[0];			\
-				dst[1] = src[1];			\
-				dst[2] = src[2];			\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		} else {						\
-			while (fr--) {					\
-				tmp = src[0] |				\
-				      (src[1] << 8) |			\
-				      (((signed char *) src)[2] << 16);	\
-				tmp = MULTI_DIV_24(tmp, vol_scale);	\
-				dst[0] = tmp;				\
-				dst[1] = tmp >> 8;			\
-				dst[2] = tmp >> 16;			\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		}							\
-	}								\
-} while (0)
-
-#define CONVERT_AREA_S24_LE() do {					\
-	unsigned int ch, fr;						\
-	int *src, *dst;							\
-	int tmp;							\
-	for (ch = 0; ch < channels; ch++) {				\
-		src_area = &src_areas[ch];				\
-		dst_area = &dst_areas[ch];				\
-		src = snd_pcm_channel_area_addr(src_area, src_offset);	\
-		dst = snd_pcm_channel_area_addr(dst_area, dst_offset);	\
-		src_step = snd_pcm_channel_area_step(src_area)		\
-				/ sizeof(int);				\
-		dst_step = snd_pcm_channel_area_step(dst_area)		\
-				/ sizeof(int);				\
-		GET_VOL_SCALE;						\
-		fr = frames;						\
-		if (! vol_scale) {					\
-			while (fr--) {					\
-				*dst = 0;				\
-				dst += dst_step;			\
-			}						\
-		} else if (vol_scale == 0xffff) {			\
-			while (fr--) {					\
-				*dst = *src;				\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		} else {						\
-			while (fr--) {					\
-				tmp = *src << 8;			\
-				tmp = (signed int) tmp >> 8;		\
-				*dst = MULTI_DIV_24(tmp, vol_scale);	\
-				src += dst_step;			\
-				dst += src_step;			\
-			}						\
-		}							\
-	}								\
-} while (0)
-		
-#define GET_VOL_SCALE \
-	switch (ch) { \
-	case 0: \
-	case 2: \
-		vol_scale = (channels == ch + 1) ? vol_c : vol[0]; \
-		break; \
-	case 4: \
-	case 5: \
-		vol_scale = vol_c; \
-		break; \
-	default: \
-		vol_scale = vol[ch & 1]; \
-		break; \
-	}
 
-#endif /* DOC_HIDDEN */
+/* samples per ramp block, the rows restart from the exact factors */
+#define SOFTVOL_BLOCK		1024
+
+/* the factor for a control value, 0xffff in the tables stands for 0 dB */
+static uint32_t softvol_factor(snd_pcm_softvol_t *svol, unsigned int val)
+{
+	uint32_t vol;
+
+	if (svol->max_val == 1)
+		return val ? 0x10000 : 0;
+	vol = svol->dB_value[val];
+	return vol == 0xffff ? 0x10000 : vol;
+}
 
-/* 2-channel stereo control */
-static void softvol_convert_stereo_vol(snd_pcm_softvol_t *svol,
-				       const snd_pcm_channel_area_t *dst_areas,
-				       snd_pcm_uframes_t dst_offset,
-				       const snd_pcm_channel_area_t *src_areas,
-				       snd_pcm_uframes_t src_offset,
-				       unsigned int channels,
-				       snd_pcm_uframes_t frames)
+/*
+ * A stereo control is mapped to mono, 2.0, 2.1, 4.0, 4.1, 5.1 or 7.1
+ * channels, the center and LFE channels get the average value.
+ * A control with more values maps value (ch % count) to channel ch.
+ */
+static uint32_t softvol_channel_factor(snd_pcm_softvol_t *svol,
+				       unsigned int ch, unsigned int channels)
 {
-	const snd_pcm_channel_area_t *dst_area, *src_area;
-	unsigned int src_step, dst_step;
-	unsigned int vol_scale, vol[2], vol_c;
+	unsigned int center;
 
-	if (svol->cur_vol[0] == 0 && svol->cur_vol[1] == 0) {
-		snd_pcm_areas_silence(dst_areas, dst_offset, channels, frames,
-				      svol->sformat);
+	if (svol->cchannels == 1)
+		return softvol_factor(svol, svol->cur_vol[0]);
+	if (svol->cchannels > 2)
+		return softvol_factor(svol, svol->cur_vol[ch % svol->cchannels]);
+	if (svol->max_val == 1)
+		center = svol->cur_vol[0] | svol->cur_vol[1];
+	else
+		center = (svol->cur_vol[0] + svol->cur_vol[1]) / 2;
+	switch (ch) {
+	case 0:
+	case 2:
+		if (channels == ch + 1)
+			return softvol_factor(svol, center);
+		return softvol_factor(svol, svol->cur_vol[0]);
+	case 4:
+	case 5:
+		return softvol_factor(svol, center);
+	default:
+		return softvol_factor(svol, svol->cur_vol[ch & 1]);
+	}
+}
+
+/* set the new targets, start a ramp if they changed */
+static void softvol_update_gains(snd_pcm_t *pcm, snd_pcm_softvol_t *svol)
+{
+	unsigned int ch, muted = 1, changed = 0;
+
+	for (ch = 0; ch < svol->cchannels; ch++) {
+		if (svol->cur_vol[ch]) {
+			muted = 0;
+			break;
+		}
+	}
+	for (ch = 0; ch < svol->channels; ch++) {
+		snd_pcm_softvol_gain_t *g = &svol->gains[ch];
+		/* all values at zero always mute the stream */
+		uint32_t target = muted ? 0 :
+			softvol_channel_factor(svol, ch, svol->channels);
+		if (g->target != target) {
+			g->target = target;
+			changed = 1;
+		}
+	}
+	if (!changed && svol->gains_valid)
 		return;
-	} else if (svol->zero_dB_val && svol->cur_vol[0] == svol->zero_dB_val &&
-		   svol->cur_vol[1] == svol->zero_dB_val) {
-		snd_pcm_areas_copy(dst_areas, dst_offset, src_areas, src_offset,
-				   channels, frames, svol->sformat);
+	svol->row_valid = 0;
+	if (!svol->ramp || !svol->gains_valid || !pcm->period_size) {
+		for (ch = 0; ch < svol->channels; ch++) {
+			svol->gains[ch].gain = (int64_t)svol->gains[ch].target << 16;
+			svol->gains[ch].step = 0;
+		}
+		svol->ramp_left = 0;
+		svol->gains_valid = 1;
 		return;
 	}
+	svol->ramp_left = pcm->period_size;
+	for (ch = 0; ch < svol->channels; ch++) {
+		snd_pcm_softvol_gain_t *g = &svol->gains[ch];
+		g->step = (((int64_t)g->target << 16) - g->gain) /
+			(int64_t)svol->ramp_left;
+	}
+}
 
-	if (svol->max_val == 1) {
-		vol[0] = svol->cur_vol[0] ? 0xffff : 0;
-		vol[1] = svol->cur_vol[1] ? 0xffff : 0;
-		vol_c = vol[0] | vol[1];
-	} else {
-		vol[0] = svol->dB_value[svol->cur_vol[0]];
-		vol[1] = svol->dB_value[svol->cur_vol[1]];
-		vol_c = svol->dB_value[(svol->cur_vol[0] + svol->cur_vol[1]) / 2];
+/* advance the factors by frames (at most ramp_left) */
+static void softvol_ramp(snd_pcm_softvol_t *svol, snd_pcm_uframes_t frames)
+{
+	unsigned int ch;
+
+	if (!svol->ramp_left)
+		return;
+	svol->ramp_left -= frames;
+	for (ch = 0; ch < svol->channels; ch++) {
+		snd_pcm_softvol_gain_t *g = &svol->gains[ch];
+		if (svol->ramp_left) {
+			g->gain += g->step * (int64_t)frames;
+		} else {
+			g->gain = (int64_t)g->target << 16;
+			g->step = 0;
+		}
 	}
+	svol->row_valid = 0;
+}
+
+/*
+ * lay the factors of the next frames out as a gain row, lane i belongs to
+ * channel i % channels of frame i / channels; buf holds the factors and
+ * the steps, row->len values each
+ */
+static void softvol_fill_row(snd_pcm_simd_gain_t *row, uint32_t *buf,
+			     const snd_pcm_softvol_gain_t *gains,
+			     unsigned int channels, int ramp)
+{
+	unsigned int frames = row->len / channels;
+	unsigned int i;
+
+	for (i = 0; i < row->len; i++) {
+		const snd_pcm_softvol_gain_t *g = &gains[i % channels];
+		buf[i] = (g->gain + g->step * (i / channels + 1)) >> 16;
+		buf[row->len + i] = (g->step * frames) >> 16;
+	}
+	row->vol = buf;
+	row->step = ramp ? buf + row->len : NULL;
+	row->pos = 0;
+}
+
+/* all channels interleaved in one buffer */
+static int softvol_interleaved(const snd_pcm_channel_area_t *areas,
+			       unsigned int channels, unsigned int width)
+{
+	unsigned int ch;
+
+	if (areas->first % 8 || areas->step != channels * width)
+		return 0;
+	for (ch = 1; ch < channels; ch++) {
+		if (areas[ch].addr != areas->addr ||
+		    areas[ch].step != areas->step ||
+		    areas[ch].first != areas->first + ch * width)
+			return 0;
+	}
+	return 1;
+}
+
+static inline int softvol_contiguous(const snd_pcm_channel_area_t *area,
+				     unsigned int width)
+{
+	return area->first % 8 == 0 && area->step == width;
+}
+
+/* generic per-sample version for any layout and byte order */
+static void softvol_convert_channel(snd_pcm_softvol_t *svol,
+				    const snd_pcm_channel_area_t *dst_area,
+				    snd_pcm_uframes_t dst_offset,
+				    const snd_pcm_channel_area_t *src_area,
+				    snd_pcm_uframes_t src_offset,
+				    const snd_pcm_softvol_gain_t *g,
+				    snd_pcm_uframes_t frames)
+{
+	char *src = snd_pcm_channel_area_addr(src_area, src_offset);
+	char *dst = snd_pcm_channel_area_addr(dst_area, dst_offset);
+	int src_step = snd_pcm_channel_area_step(src_area);
+	int dst_step = snd_pcm_channel_area_step(dst_area);
+	int swap = !snd_pcm_format_cpu_endian(svol->sformat);
+	int64_t gain = g->gain, step = g->step;
+	int tmp;
+
 	switch (svol->sformat) {
 	case SND_PCM_FORMAT_S16_LE:
 	case SND_PCM_FORMAT_S16_BE:
-		/* 16bit samples */
-		CONVERT_AREA(short, 
-			     !snd_pcm_format_cpu_endian(svol->sformat));
+		while (frames--) {
+			*(short *)dst = MULTI_DIV_short(*(short *)src,
+							(gain += step) >> 16,
+							swap);
+			src += src_step;
+			dst += dst_step;
+		}
 		break;
 	case SND_PCM_FORMAT_S32_LE:
 	case SND_PCM_FORMAT_S32_BE:
-		/* 32bit samples */
-		CONVERT_AREA(int,
-			     !snd_pcm_format_cpu_endian(svol->sformat));
+		while (frames--) {
+			*(int *)dst = MULTI_DIV_int(*(int *)src,
+						    (gain += step) >> 16, swap);
+			src += src_step;
+			dst += dst_step;
+		}
 		break;
 	case SND_PCM_FORMAT_S24_LE:
-		/* 24bit samples */
-		CONVERT_AREA_S24_LE();
+		while (frames--) {
+			tmp = *(int *)src << 8;
+			tmp = (signed int) tmp >> 8;
+			*(int *)dst = MULTI_DIV_24(tmp, (gain += step) >> 16);
+			src += src_step;
+			dst += dst_step;
+		}
 		break;
 	case SND_PCM_FORMAT_S24_3LE:
-		CONVERT_AREA_S24_3LE();
+		while (frames--) {
+			unsigned char *s = (unsigned char *)src;
+			unsigned char *d = (unsigned char *)dst;
+			tmp = s[0] | (s[1] << 8) | (((signed char *) s)[2] << 16);
+			tmp = MULTI_DIV_24(tmp, (gain += step) >> 16);
+			d[0] = tmp;
+			d[1] = tmp >> 8;
+			d[2] = tmp >> 16;
+			src += src_step;
+			dst += dst_step;
+		}
 		break;
+#ifndef HAVE_SOFT_FLOAT
+	case SND_PCM_FORMAT_FLOAT:
+		while (frames--) {
+			*(float *)dst = *(float *)src *
+				((int32_t)((gain += step) >> 16) *
+				 (1.0f / 65536));
+			src += src_step;
+			dst += dst_step;
+		}
+		break;
+#endif
 	default:
 		break;
 	}
 }
 
-#undef GET_VOL_SCALE
-#define GET_VOL_SCALE
-
-/* mono control */
-static void softvol_convert_mono_vol(snd_pcm_softvol_t *svol,
-				     const snd_pcm_channel_area_t *dst_areas,
-				     snd_pcm_uframes_t dst_offset,
-				     const snd_pcm_channel_area_t *src_areas,
-				     snd_pcm_uframes_t src_offset,
-				     unsigned int channels,
-				     snd_pcm_uframes_t frames)
+#endif /* DOC_HIDDEN */
+
+static void softvol_convert(snd_pcm_t *pcm, snd_pcm_softvol_t *svol,
+			    const snd_pcm_channel_area_t *dst_areas,
+			    snd_pcm_uframes_t dst_offset,
+			    const snd_pcm_channel_area_t *src_areas,
+			    snd_pcm_uframes_t src_offset,
+			    unsigned int channels,
+			    snd_pcm_uframes_t frames)
 {
-	const snd_pcm_channel_area_t *dst_area, *src_area;
-	unsigned int src_step, dst_step;
-	unsigned int vol_scale;
+	unsigned int width = snd_pcm_format_physical_width(svol->sformat);
+	snd_pcm_uframes_t size;
+	unsigned int ch, block;
+	int interleaved;
 
-	if (svol->cur_vol[0] == 0) {
-		snd_pcm_areas_silence(dst_areas, dst_offset, channels, frames,
-				      svol->sformat);
-		return;
-	} else if (svol->zero_dB_val && svol->cur_vol[0] == svol->zero_dB_val) {
-		snd_pcm_areas_copy(dst_areas, dst_offset, src_areas, src_offset,
-				   channels, frames, svol->sformat);
+	if (CHECK_SANITY(channels != svol->channels))
 		return;
+	softvol_update_gains(pcm, svol);
+	if (!svol->ramp_left) {
+		int silence = 1, copy = 1;
+		for (ch = 0; ch < channels; ch++) {
+			if (svol->gains[ch].target)
+				silence = 0;
+			if (svol->gains[ch].target != 0x10000)
+				copy = 0;
+		}
+		if (silence) {
+			snd_pcm_areas_silence(dst_areas, dst_offset, channels,
+					      frames, svol->sformat);
+			return;
+		} else if (copy) {
+			snd_pcm_areas_copy(dst_areas, dst_offset,
+					   src_areas, src_offset,
+					   channels, frames, svol->sformat);
+			return;
+		}
 	}
 
-	if (svol->max_val == 1)
-		vol_scale = svol->cur_vol[0] ? 0xffff : 0;
-	else
-		vol_scale = svol->dB_value[svol->cur_vol[0]];
-	switch (svol->sformat) {
-	case SND_PCM_FORMAT_S16_LE:
-	case SND_PCM_FORMAT_S16_BE:
-		/* 16bit samples */
-		CONVERT_AREA(short, 
-			     !snd_pcm_format_cpu_endian(svol->sformat));
-		break;
-	case SND_PCM_FORMAT_S32_LE:
-	case SND_PCM_FORMAT_S32_BE:
-		/* 32bit samples */
-		CONVERT_AREA(int,
-			     !snd_pcm_format_cpu_endian(svol->sformat));
-		break;
-	case SND_PCM_FORMAT_S24_LE:
-		/* 24bit samples */
-		CONVERT_AREA_S24_LE();
-		break;
-	case SND_PCM_FORMAT_S24_3LE:
-		CONVERT_AREA_S24_3LE();
-		break;
-	default:
-		break;
+	interleaved = svol->gain_func &&
+		      softvol_interleaved(src_areas, channels, width) &&
+		      softvol_interleaved(dst_areas, channels, width);
+	block = SOFTVOL_BLOCK / channels;
+	if (!block)
+		block = 1;
+	while (frames > 0) {
+		size = frames;
+		if (svol->ramp_left) {
+			if (size > block)
+				size = block;
+			if (size > svol->ramp_left)
+				size = svol->ramp_left;
+		}
+		if (interleaved) {
+			if (!svol->row_valid) {
+				softvol_fill_row(&svol->row, svol->row_buf,
+						 svol->gains, channels,
+						 svol->ramp_left != 0);
+				svol->row_valid = 1;
+			}
+			svol->gain_func(snd_pcm_channel_area_addr(dst_areas, dst_offset),
+					snd_pcm_channel_area_addr(src_areas, src_offset),
+					(size_t)size * channels, &svol->row,
+					svol->gain_bits);
+		} else {
+			for (ch = 0; ch < channels; ch++) {
+				if (svol->gain_func &&
+				    softvol_contiguous(&src_areas[ch], width) &&
+				    softvol_contiguous(&dst_areas[ch], width)) {
+					uint32_t buf[2 * SND_PCM_SIMD_GAIN_ALIGN];
+					snd_pcm_simd_gain_t row = {
+						.len = SND_PCM_SIMD_GAIN_ALIGN
+					};
+					softvol_fill_row(&row, buf, &svol->gains[ch], 1,
+							 svol->ramp_left != 0);
+					svol->gain_func(snd_pcm_channel_area_addr(&dst_areas[ch], dst_offset),
+							snd_pcm_channel_area_addr(&src_areas[ch], src_offset),
+							size, &row, svol->gain_bits);
+				} else
+					softvol_convert_channel(svol, &dst_areas[ch], dst_offset,
+								&src_areas[ch], src_offset,
+								&svol->gains[ch], size);
+			}
+		}
+		softvol_ramp(svol, size);
+		src_offset += size;
+		dst_offset += size;
+		frames -= size;
 	}
 }
 
@@ -445,8 +545,18 @@ static void get_current_volume(snd_pcm_softvol_t *svol)
 	}
 }
 
+static void softvol_free_gains(snd_pcm_softvol_t *svol)
+{
+	free(svol->gains);
+	svol->gains = NULL;
+	free(svol->row_buf);
+	svol->row_buf = NULL;
+	svol->channels = 0;
+}
+
 static void softvol_free(snd_pcm_softvol_t *svol)
 {
+	softvol_free_gains(svol);
 	if (svol->plug.gen.close_slave)
 		snd_pcm_close(svol->plug.gen.slave);
 	if (svol->ctl)
@@ -463,6 +573,49 @@ static int snd_pcm_softvol_close(snd_pcm_t *pcm)
 	return 0;
 }
 
+static int softvol_format_supported(snd_pcm_format_t format)
+{
+	switch (format) {
+	case SND_PCM_FORMAT_S16_LE:
+	case SND_PCM_FORMAT_S16_BE:
+	case SND_PCM_FORMAT_S24_LE:
+	case SND_PCM_FORMAT_S24_3LE:
+	case SND_PCM_FORMAT_S32_LE:
+	case SND_PCM_FORMAT_S32_BE:
+#ifndef HAVE_SOFT_FLOAT
+	case SND_PCM_FORMAT_FLOAT:
+#endif
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* the SIMD kernels handle the samples in the host byte order */
+static void softvol_select_gain_func(snd_pcm_softvol_t *svol)
+{
+	const snd_pcm_simd_ops_t *ops = snd_pcm_simd_ops();
+
+	svol->gain_func = NULL;
+	svol->gain_bits = snd_pcm_format_width(svol->sformat);
+	switch (svol->sformat) {
+	case SND_PCM_FORMAT_S16:
+		svol->gain_func = ops->gain_s16;
+		break;
+	case SND_PCM_FORMAT_S24:
+	case SND_PCM_FORMAT_S32:
+		svol->gain_func = ops->gain_s32;
+		break;
+#ifndef HAVE_SOFT_FLOAT
+	case SND_PCM_FORMAT_FLOAT:
+		svol->gain_func = ops->gain_float;
+		break;
+#endif
+	default:
+		break;
+	}
+}
+
 static int snd_pcm_softvol_hw_refine_cprepare(snd_pcm_t *pcm,
 					      snd_pcm_hw_params_t *params)
 {
@@ -479,6 +632,9 @@ static int snd_pcm_softvol_hw_refine_cprepare(snd_pcm_t *pcm,
 			(1ULL << (SND_PCM_FORMAT_S24_3LE - 32))
 		}
 	};
+#ifndef HAVE_SOFT_FLOAT
+	snd_pcm_format_mask_set(&format_mask, SND_PCM_FORMAT_FLOAT);
+#endif
 	if (svol->sformat != SND_PCM_FORMAT_UNKNOWN) {
 		snd_pcm_format_mask_none(&format_mask);
 		snd_pcm_format_mask_set(&format_mask, svol->sformat);
@@ -626,20 +782,40 @@ static int snd_pcm_softvol_hw_params(snd_pcm_t *pcm, snd_pcm_hw_params_t * param
 					  snd_pcm_generic_hw_params);
 	if (err < 0)
 		return err;
-	if (slave->format != SND_PCM_FORMAT_S16_LE &&
-	    slave->format != SND_PCM_FORMAT_S16_BE &&
-	    slave->format != SND_PCM_FORMAT_S24_3LE && 
-	    slave->format != SND_PCM_FORMAT_S24_LE &&
-	    slave->format != SND_PCM_FORMAT_S32_LE &&
-	    slave->format != SND_PCM_FORMAT_S32_BE) {
+	if (!softvol_format_supported(slave->format)) {
 		SNDERR("softvol supports only S16_LE, S16_BE, S24_LE, S24_3LE, "
-		       "S32_LE or S32_BE");
+		       "S32_LE, S32_BE or FLOAT");
 		return -EINVAL;
 	}
 	svol->sformat = slave->format;
+
+	softvol_free_gains(svol);
+	svol->gains = calloc(slave->channels, sizeof(*svol->gains));
+	/* the row covers whole frames and whole vectors */
+	svol->row.len = slave->channels;
+	while (svol->row.len % SND_PCM_SIMD_GAIN_ALIGN)
+		svol->row.len += slave->channels;
+	svol->row_buf = malloc(sizeof(*svol->row_buf) * 2 * svol->row.len);
+	if (!svol->gains || !svol->row_buf) {
+		softvol_free_gains(svol);
+		snd_pcm_hw_free(slave);
+		return -ENOMEM;
+	}
+	svol->channels = slave->channels;
+	svol->gains_valid = 0;
+	svol->row_valid = 0;
+	softvol_select_gain_func(svol);
 	return 0;
 }
 
+static int snd_pcm_softvol_hw_free(snd_pcm_t *pcm)
+{
+	snd_pcm_softvol_t *svol = pcm->private_data;
+
+	softvol_free_gains(svol);
+	return snd_pcm_generic_hw_free(pcm);
+}
+
 static snd_pcm_uframes_t
 snd_pcm_softvol_write_areas(snd_pcm_t *pcm,
 			    const snd_pcm_channel_area_t *areas,
@@ -653,12 +829,8 @@ snd_pcm_softvol_write_areas(snd_pcm_t *pcm,
 	if (size > *slave_sizep)
 		size = *slave_sizep;
 	get_current_volume(svol);
-	if (svol->cchannels == 1)
-		softvol_convert_mono_vol(svol, slave_areas, slave_offset,
-					 areas, offset, pcm->channels, size);
-	else
-		softvol_convert_stereo_vol(svol, slave_areas, slave_offset,
-					   areas, offset, pcm->channels, size);
+	softvol_convert(pcm, svol, slave_areas, slave_offset,
+			areas, offset, pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -676,12 +848,8 @@ snd_pcm_softvol_read_areas(snd_pcm_t *pcm,
 	if (size > *slave_sizep)
 		size = *slave_sizep;
 	get_current_volume(svol);
-	if (svol->cchannels == 1)
-		softvol_convert_mono_vol(svol, areas, offset, slave_areas,
-					 slave_offset, pcm->channels, size);
-	else
-		softvol_convert_stereo_vol(svol, areas, offset, slave_areas,
-					   slave_offset, pcm->channels, size);
+	softvol_convert(pcm, svol, areas, offset, slave_areas, slave_offset,
+			pcm->channels, size);
 	*slave_sizep = size;
 	return size;
 }
@@ -698,6 +866,8 @@ static void snd_pcm_softvol_dump(snd_pcm_t *pcm, snd_output_t *out)
 		snd_output_printf(out, "max_dB: %g\n", svol->max_dB);
 		snd_output_printf(out, "resolution: %d\n", svol->max_val + 1);
 	}
+	snd_output_printf(out, "count: %u\n", svol->cchannels);
+	snd_output_printf(out, "ramp: %s\n", svol->ramp ? "yes" : "no");
 	if (pcm->setup) {
 		snd_output_printf(out, "Its setup is:\n");
 		snd_pcm_dump_setup(pcm, out);
@@ -880,7 +1050,7 @@ static const snd_pcm_ops_t snd_pcm_softvol_ops = {
 	.info = snd_pcm_generic_info,
 	.hw_refine = snd_pcm_softvol_hw_refine,
 	.hw_params = snd_pcm_softvol_hw_params,
-	.hw_free = snd_pcm_generic_hw_free,
+	.hw_free = snd_pcm_softvol_hw_free,
 	.sw_params = snd_pcm_generic_sw_params,
 	.channel_info = snd_pcm_generic_channel_info,
 	.dump = snd_pcm_softvol_dump,
@@ -904,6 +1074,7 @@ static const snd_pcm_ops_t snd_pcm_softvol_ops = {
  * \param min_dB minimal dB value
  * \param max_dB maximal dB value
  * \param resolution resolution of control
+ * \param ramp When set, the volume changes are ramped over one period
  * \param slave Slave PCM handle
  * \param close_slave When set, the slave PCM handle is closed with copy PCM
  * \retval zero on success otherwise a negative error code
@@ -916,19 +1087,16 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 			 int ctl_card, snd_ctl_elem_id_t *ctl_id,
 			 int cchannels,
 			 double min_dB, double max_dB, int resolution,
-			 snd_pcm_t *slave, int close_slave)
+			 int ramp, snd_pcm_t *slave, int close_slave)
 {
 	snd_pcm_t *pcm;
 	snd_pcm_softvol_t *svol;
 	int err;
 	assert(pcmp && slave);
 	if (sformat != SND_PCM_FORMAT_UNKNOWN &&
-	    sformat != SND_PCM_FORMAT_S16_LE &&
-	    sformat != SND_PCM_FORMAT_S16_BE &&
-	    sformat != SND_PCM_FORMAT_S24_3LE && 
-	    sformat != SND_PCM_FORMAT_S24_LE &&
-	    sformat != SND_PCM_FORMAT_S32_LE &&
-	    sformat != SND_PCM_FORMAT_S32_BE)
+	    !softvol_format_supported(sformat))
+		return -EINVAL;
+	if (cchannels < 1 || cchannels > SOFTVOL_MAX_CHANNELS)
 		return -EINVAL;
 	svol = calloc(1, sizeof(*svol));
 	if (! svol)
@@ -951,6 +1119,7 @@ int snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	snd_pcm_plugin_init(&svol->plug);
 	svol->sformat = sformat;
 	svol->cchannels = cchannels;
+	svol->ramp = ramp;
 	svol->plug.read = snd_pcm_softvol_read_areas;
 	svol->plug.write = snd_pcm_softvol_write_areas;
 	svol->plug.undo_read = snd_pcm_plugin_undo_read_generic;
@@ -1052,7 +1221,7 @@ static int _snd_pcm_parse_control_id(snd_config_t *conf, snd_ctl_elem_id_t *ctl_
 				SNDERR("field %s is not an integer", id);
 				goto _err;
 			}
-			if (v < 1 || v > 2) {
+			if (v < 1 || v > SOFTVOL_MAX_CHANNELS) {
 				SNDERR("Invalid count %ld", v);
 				goto _err;
 			}
@@ -1092,7 +1261,12 @@ This plugin applies the software volume attenuation.
 The format, rate and channels must match for both of source and destination.
 
 When the control is stereo (count=2), the channels are assumed to be either
-mono, 2.0, 2.1, 4.0, 4.1, 5.1 or 7.1.
+mono, 2.0, 2.1, 4.0, 4.1, 5.1 or 7.1. A control with more values sets the
+volume of each channel independently, the channel N uses the value
+N modulo count.
+
+Volume changes are applied at once, or ramped linearly over one period
+when ramp is enabled.
 
 If the control already exists and it's a system control (i.e. no
 user-defined control), the plugin simply passes its slave without
@@ -1116,12 +1290,13 @@ pcm.name {
 		[index INT]     # index of the element
 		[device INT]    # device number of the element
 		[subdevice INT] # subdevice number of the element
-		[count INT]     # control channels 1 or 2 (default: 2)
+		[count INT]     # control channels 1 to 128 (default: 2)
 	}
 	[min_dB REAL]           # minimal dB value (default: -51.0)
 	[max_dB REAL]           # maximal dB value (default:   0.0)
 	[resolution INT]        # resolution (default: 256)
 				# resolution = 2 means a mute switch
+	[ramp BOOL]             # ramp volume changes (default: no)
 }
 \endcode
 
@@ -1162,6 +1337,7 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 	double min_dB = PRESET_MIN_DB;
 	double max_dB = ZERO_DB;
 	int card = -1, cchannels = 2;
+	int ramp = 0;
 
 	snd_config_for_each(i, next, conf) {
 		snd_config_t *n = snd_config_iterator_entry(i);
@@ -1204,6 +1380,15 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 			}
 			continue;
 		}
+		if (strcmp(id, "ramp") == 0) {
+			err = snd_config_get_bool(n);
+			if (err < 0) {
+				SNDERR("Invalid ramp value");
+				return err;
+			}
+			ramp = err;
+			continue;
+		}
 		SNDERR("Unknown field %s", id);
 		return -EINVAL;
 	}
@@ -1241,13 +1426,8 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 		if (err < 0)
 			return err;
 		if (sformat != SND_PCM_FORMAT_UNKNOWN &&
-		    sformat != SND_PCM_FORMAT_S16_LE &&
-		    sformat != SND_PCM_FORMAT_S16_BE &&
-		    sformat != SND_PCM_FORMAT_S24_3LE && 
-		    sformat != SND_PCM_FORMAT_S24_LE &&
-		    sformat != SND_PCM_FORMAT_S32_LE &&
-		    sformat != SND_PCM_FORMAT_S32_BE) {
-			SNDERR("only S16_LE, S16_BE, S24_LE, S24_3LE, S32_LE or S32_BE format is supported");
+		    !softvol_format_supported(sformat)) {
+			SNDERR("only S16_LE, S16_BE, S24_LE, S24_3LE, S32_LE, S32_BE or FLOAT format is supported");
 			snd_config_delete(sconf);
 			return -EINVAL;
 		}
@@ -1262,7 +1442,7 @@ int _snd_pcm_softvol_open(snd_pcm_t **pcmp, const char *name,
 		}
 		err = snd_pcm_softvol_open(pcmp, name, sformat, card, &ctl_id,
 					   cchannels, min_dB, max_dB,
-					   resolution, spcm, 1);
+					   resolution, ramp, spcm, 1);
 		if (err < 0)
 			snd_pcm_close(spcm);
 	}